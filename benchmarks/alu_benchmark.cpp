@@ -0,0 +1,112 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Measures throughput of ALU instructions for every encoding form. Every guest
+// loop runs all eight group 1 operations in the given form, so each kernel is
+// part of the measurement.
+//
+// Usage: msemu_alu_benchmark [instructions per form]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "8086_cpu.hpp"
+#include "bus.hpp"
+#include "device.hpp"
+#include "memory.hpp"
+
+namespace
+{
+
+using RamType = msemu::Device<msemu::Memory<1024 * 1024>, 0x00000000>;
+using BusType = msemu::Bus<RamType>;
+
+constexpr uint32_t code_address = 0xf0100;
+
+struct Form
+{
+    const char* name;
+    // encodes form for operation 0-7
+    std::vector<uint8_t> (*encode)(uint8_t op);
+};
+
+// clang-format off
+const Form forms[] = {
+    {"r/m16, reg16", [](uint8_t op) { return std::vector<uint8_t>{static_cast<uint8_t>(op * 8 + 1), 0xd8}; }},
+    {"reg16, [bx]",  [](uint8_t op) { return std::vector<uint8_t>{static_cast<uint8_t>(op * 8 + 3), 0x07}; }},
+    {"[bx], reg16",  [](uint8_t op) { return std::vector<uint8_t>{static_cast<uint8_t>(op * 8 + 1), 0x07}; }},
+    {"al, imm8",     [](uint8_t op) { return std::vector<uint8_t>{static_cast<uint8_t>(op * 8 + 4), 0x5a}; }},
+    {"ax, imm16",    [](uint8_t op) { return std::vector<uint8_t>{static_cast<uint8_t>(op * 8 + 5), 0x5a, 0xa5}; }},
+    {"r/m8, imm8",   [](uint8_t op) { return std::vector<uint8_t>{0x80, static_cast<uint8_t>(0xc3 | op << 3), 0x5a}; }},
+    {"r/m16, imm16", [](uint8_t op) { return std::vector<uint8_t>{0x81, static_cast<uint8_t>(0xc3 | op << 3), 0x5a, 0xa5}; }},
+    {"r/m16, simm8", [](uint8_t op) { return std::vector<uint8_t>{0x83, static_cast<uint8_t>(0xc3 | op << 3), 0xa5}; }},
+    {"[bx], imm16",  [](uint8_t op) { return std::vector<uint8_t>{0x81, static_cast<uint8_t>(0x07 | op << 3), 0x5a, 0xa5}; }},
+};
+// clang-format on
+
+std::vector<uint8_t> guest_loop(const Form& form)
+{
+    // mov ax, 0; mov ds, ax; mov bx, 0x1000
+    std::vector<uint8_t> code = {0xb8, 0x00, 0x00, 0x8e, 0xd8, 0xbb, 0x00, 0x10};
+    const std::size_t loop    = code.size();
+    for (uint8_t op = 0; op < 8; ++op)
+    {
+        const auto instruction = form.encode(op);
+        code.insert(code.end(), instruction.begin(), instruction.end());
+    }
+    // jmp loop
+    const auto offset = static_cast<int>(loop) - static_cast<int>(code.size() + 2);
+    code.push_back(0xeb);
+    code.push_back(static_cast<uint8_t>(offset));
+    return code;
+}
+
+} // namespace
+
+int main(int argc, const char* argv[])
+{
+    const std::size_t instructions = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000000;
+
+    auto bus = std::make_unique<BusType>(RamType("ram"));
+    msemu::cpu8086::Cpu cpu(*bus);
+
+    printf("%-14s %12s %12s\n", "form", "MIPS", "ns/inst");
+    for (const auto& form : forms)
+    {
+        bus->write(code_address, guest_loop(form));
+        cpu.jump_to_bios();
+
+        const auto begin = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < instructions; ++i)
+        {
+            cpu.step();
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+        if (cpu.error()[0] != '\0')
+        {
+            printf("ERR: %s failed: %s\n", form.name, cpu.error());
+            return 1;
+        }
+        const double mips = static_cast<double>(instructions) / elapsed.count() / 1e6;
+        printf("%-14s %12.1f %12.2f\n", form.name, mips, 1e3 / mips);
+    }
+    return 0;
+}
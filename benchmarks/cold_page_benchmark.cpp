@@ -0,0 +1,135 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Measures resident memory of idle guests before and after their cold pages
+// are compressed, and latency of the first access to a compressed page.
+//
+// Usage: msemu_cold_page_benchmark [instances] [RAM KiB]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <unistd.h>
+
+#include "dynamic_bus.hpp"
+
+namespace
+{
+
+std::size_t resident_bytes()
+{
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (file == nullptr)
+    {
+        return 0;
+    }
+    unsigned long size     = 0;
+    unsigned long resident = 0;
+    const int fields       = fscanf(file, "%lu %lu", &size, &resident);
+    fclose(file);
+    return fields == 2 ? resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE)) : 0;
+}
+
+// Every fourth page stays zero like unused RAM, the rest holds 64 byte
+// records with an id, a name and zero padding, like typical guest tables.
+void fill(msemu::DynamicBus& bus, const uint32_t size)
+{
+    std::vector<uint8_t> page(msemu::DynamicBus::cold_page_size);
+    for (uint32_t address = 0; address < size; address += msemu::DynamicBus::cold_page_size)
+    {
+        if ((address / msemu::DynamicBus::cold_page_size) % 4 == 0)
+        {
+            continue;
+        }
+        for (uint32_t offset = 0; offset < page.size(); offset += 64)
+        {
+            const uint32_t id = (address + offset) / 64;
+            page[offset]      = static_cast<uint8_t>(id);
+            page[offset + 1]  = static_cast<uint8_t>(id >> 8);
+            for (uint32_t i = 0; i < 8; ++i)
+            {
+                page[offset + 2 + i] = static_cast<uint8_t>("ENTRY_0"[i]);
+            }
+            page[offset + 8] = static_cast<uint8_t>('0' + id % 10);
+        }
+        bus.write(address, page);
+    }
+}
+
+} // namespace
+
+int main(int argc, const char* argv[])
+{
+    const std::size_t instances = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 32;
+    const auto ram_size = static_cast<uint32_t>((argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 640) * 1024);
+
+    const std::size_t baseline = resident_bytes();
+    std::vector<std::unique_ptr<msemu::DynamicBus>> buses;
+    for (std::size_t i = 0; i < instances; ++i)
+    {
+        buses.push_back(std::make_unique<msemu::DynamicBus>());
+        if (!buses.back()->map_ram("ram", 0, ram_size, true))
+        {
+            return 1;
+        }
+        fill(*buses.back(), ram_size);
+    }
+    const std::size_t active = resident_bytes() - baseline;
+
+    // the first period clears accessed bits of filled pages, the second finds them cold
+    const auto begin = std::chrono::steady_clock::now();
+    for (auto& bus : buses)
+    {
+        bus->age(1);
+        bus->age(1);
+    }
+    const std::chrono::duration<double> aging = std::chrono::steady_clock::now() - begin;
+    const std::size_t idle                    = resident_bytes() - baseline;
+
+    std::size_t pool = 0;
+    for (auto& bus : buses)
+    {
+        pool += bus->cold_stats().pool_bytes;
+        for (uint32_t address = 0; address < ram_size; address += msemu::DynamicBus::cold_page_size)
+        {
+            static_cast<void>(bus->read<uint8_t>(address));
+        }
+    }
+
+    uint64_t touches = 0;
+    std::chrono::nanoseconds total{};
+    std::chrono::nanoseconds max{};
+    for (auto& bus : buses)
+    {
+        const auto stats = bus->cold_stats();
+        touches += stats.decompressions;
+        total += stats.touch_total;
+        max = std::max(max, stats.touch_max);
+    }
+
+    printf("instances: %zu, RAM: %u KiB\n", instances, ram_size / 1024);
+    printf("resident active: %zu KiB, idle: %zu KiB (%.1fx), pool: %zu KiB\n", active / 1024, idle / 1024,
+           idle != 0 ? static_cast<double>(active) / static_cast<double>(idle) : 0.0, pool / 1024);
+    printf("aging: %.1f ms, first touch: %lu pages, avg: %lu ns, max: %lu ns\n", aging.count() * 1e3,
+           static_cast<unsigned long>(touches),
+           static_cast<unsigned long>(touches != 0 ? total.count() / static_cast<int64_t>(touches) : 0),
+           static_cast<unsigned long>(max.count()));
+    return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Measures guest speed with a heavy device model, a video output converting
+// a full EGA frame every 80000 instructions, running on the CPU thread and
+// on a worker thread.
+//
+// Usage: msemu_device_benchmark [instructions] [quantum]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "8086_cpu.hpp"
+#include "bus.hpp"
+#include "device.hpp"
+#include "device_scheduler.hpp"
+#include "memory.hpp"
+#include "video.hpp"
+
+namespace
+{
+
+using RamType = msemu::Device<msemu::Memory<1024 * 1024>, 0x00000000>;
+using BusType = msemu::Bus<RamType>;
+
+constexpr uint64_t frame_period = 80000;
+
+// clang-format off
+const std::vector<uint8_t> guest_loop = {
+    0xb8, 0x00, 0x00, // mov ax, 0
+    0x8e, 0xd8,       // mov ds, ax
+    0x8e, 0xd0,       // mov ss, ax
+    0xbc, 0x00, 0x80, // mov sp, 0x8000
+    0xa1, 0x00, 0x01, // loop: mov ax, [0x100]
+    0x8b, 0xd8,       // mov bx, ax
+    0xa3, 0x02, 0x01, // mov [0x102], ax
+    0x50,             // push ax
+    0x5b,             // pop bx
+    0xeb, 0xf4        // jmp loop
+};
+// clang-format on
+
+const char* mode_name(const msemu::DeviceScheduler::Mode mode)
+{
+    return mode == msemu::DeviceScheduler::Mode::parallel ? "parallel" : "sequential";
+}
+
+} // namespace
+
+int main(int argc, const char* argv[])
+{
+    const uint64_t instructions = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 50000000;
+    const uint64_t quantum      = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10000;
+
+    auto bus = std::make_unique<BusType>(RamType("ram"));
+    bus->write(0xf0100, guest_loop);
+    msemu::cpu8086::Cpu cpu(*bus);
+
+    printf("%-10s %8s %10s %8s %10s\n", "mode", "quantum", "MIPS", "frames", "wait ms");
+    for (const auto mode : {msemu::DeviceScheduler::Mode::sequential, msemu::DeviceScheduler::Mode::parallel})
+    {
+        cpu.reset();
+        cpu.jump_to_bios();
+
+        auto video    = std::make_unique<msemu::VideoMemory>();
+        auto output   = std::make_unique<msemu::VideoOutput>();
+        uint64_t next = frame_period;
+        video->mode(msemu::VideoMode::ega_640x350x16);
+
+        msemu::DeviceScheduler scheduler(quantum, quantum / 10, mode);
+        scheduler.add_device("video",
+                             [&](msemu::DeviceScheduler::Context& context)
+                             {
+                                 for (; next < context.until(); next += frame_period)
+                                 {
+                                     video->invalidate();
+                                     output->update(*video);
+                                     context.emit(msemu::DeviceEvent{next, 0, 0, false, 0});
+                                 }
+                             });
+
+        uint64_t frames  = 0;
+        const auto begin = std::chrono::steady_clock::now();
+        scheduler.run(
+            instructions, [&cpu](const uint64_t count) { return cpu.run(count); },
+            [&frames](const msemu::DeviceEvent&) { ++frames; });
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+        printf("%-10s %8llu %10.1f %8llu %10.1f\n", mode_name(mode), static_cast<unsigned long long>(quantum),
+               static_cast<double>(instructions) / elapsed.count() / 1e6,
+               static_cast<unsigned long long>(frames),
+               static_cast<double>(scheduler.stats().wait.count()) / 1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Measures how fleet throughput scales with number of instances for every
+// placement policy.
+//
+// Usage: msemu_fleet_benchmark [max instances] [instructions per instance]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "8086_cpu.hpp"
+#include "bus.hpp"
+#include "device.hpp"
+#include "fleet.hpp"
+#include "memory.hpp"
+
+namespace
+{
+
+using RamType = msemu::Device<msemu::Memory<1024 * 1024>, 0x00000000>;
+using BusType = msemu::Bus<RamType>;
+
+// clang-format off
+const std::vector<uint8_t> guest_loop = {
+    0xb8, 0x00, 0x00, // mov ax, 0
+    0x8e, 0xd8,       // mov ds, ax
+    0x8e, 0xd0,       // mov ss, ax
+    0xbc, 0x00, 0x80, // mov sp, 0x8000
+    0xa1, 0x00, 0x01, // loop: mov ax, [0x100]
+    0x8b, 0xd8,       // mov bx, ax
+    0xa3, 0x02, 0x01, // mov [0x102], ax
+    0x50,             // push ax
+    0x5b,             // pop bx
+    0xeb, 0xf4        // jmp loop
+};
+// clang-format on
+
+const char* placement_name(const msemu::Fleet::Placement placement)
+{
+    switch (placement)
+    {
+        case msemu::Fleet::Placement::none:
+            return "none";
+        case msemu::Fleet::Placement::node:
+            return "node";
+        case msemu::Fleet::Placement::cpu:
+            return "cpu";
+    }
+    return "";
+}
+
+} // namespace
+
+int main(int argc, const char* argv[])
+{
+    const std::size_t max_instances =
+        argc > 1 ? std::strtoul(argv[1], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+    const std::size_t instructions = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 20000000;
+
+    auto bus = std::make_unique<BusType>(RamType("ram"));
+    bus->write(0xf0100, guest_loop);
+    msemu::cpu8086::Cpu cpu(*bus);
+    cpu.jump_to_bios();
+
+    printf("%-9s %9s %12s %12s\n", "placement", "instances", "total MIPS", "MIPS/inst");
+    for (const auto placement :
+         {msemu::Fleet::Placement::none, msemu::Fleet::Placement::node, msemu::Fleet::Placement::cpu})
+    {
+        for (std::size_t instances = 1; instances <= max_instances; instances *= 2)
+        {
+            msemu::Fleet fleet(instances, placement);
+            fleet.share(*bus);
+
+            const auto begin = std::chrono::steady_clock::now();
+            const bool ok    = fleet.run(
+                [&cpu, instructions](std::size_t)
+                {
+                    cpu.run(instructions);
+                    return cpu.error()[0] == '\0' ? 0 : 1;
+                });
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+            if (!ok)
+            {
+                printf("ERR: instance failed: %s\n", cpu.error());
+                return 1;
+            }
+            const double total = static_cast<double>(instructions * instances) / elapsed.count() / 1e6;
+            printf("%-9s %9zu %12.1f %12.1f\n", placement_name(placement), instances, total,
+                   total / static_cast<double>(instances));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+; Adds 8 digit unpacked BCD numbers with aaa and splits binary counter into
+; decimal digits with aam.
+
+%include "common.inc"
+
+ACCUMULATOR equ 0x0000
+ADDEND      equ 0x0010
+DIGITS      equ 0x0020
+DIGIT_COUNT equ 8
+
+start:
+    setup_segments
+
+    ; addend = 00012347, accumulator = 0
+    mov bx, 0
+.clear:
+    mov byte [ACCUMULATOR + bx], 0
+    mov byte [ADDEND + bx], 0
+    add bx, 1
+    cmp bx, DIGIT_COUNT
+    jb .clear
+    mov byte [ADDEND + 3], 1
+    mov byte [ADDEND + 4], 2
+    mov byte [ADDEND + 5], 3
+    mov byte [ADDEND + 6], 4
+    mov byte [ADDEND + 7], 7
+
+    mov cl, 0
+accumulate:
+    ; accumulator += addend, most significant digit first in memory
+    mov si, DIGIT_COUNT - 1
+    mov dl, 0
+.digit:
+    mov ah, 0
+    mov al, [ACCUMULATOR + si]
+    add al, dl
+    aaa
+    add al, [ADDEND + si]
+    aaa
+    mov [ACCUMULATOR + si], al
+    mov dl, ah
+    sub si, 1
+    jnc .digit
+
+    ; digits of counter modulo 64
+    add cl, 1
+    mov al, cl
+    and al, 0x3f
+    aam
+    mov [DIGITS], ah
+    mov [DIGITS + 1], al
+    jmp accumulate
@@ -0,0 +1,183 @@
+; Integer kernel shaped after Dhrystone 2.1 main loop: record copy through
+; pointers, procedure calls, string compare, one and two dimensional array
+; stores and branches on integer, char and enumeration values. Without mul
+; the array row offset is built from shifts done with add.
+
+%include "common.inc"
+
+RECORD_GLOB equ 0x0000 ; 16 byte records
+RECORD_NEXT equ 0x0010
+RECORD_SIZE equ 16
+ARRAY_1     equ 0x0100 ; 50 words
+ARRAY_2     equ 0x0200 ; 50 x 50 words, rows of 100 bytes
+STRING_1    equ 0x1600 ; 30 bytes
+STRING_2    equ 0x1620
+STRING_SIZE equ 30
+INT_GLOB    equ 0x1700
+BOOL_GLOB   equ 0x1702
+CHAR_1      equ 0x1704
+CHAR_2      equ 0x1705
+INT_1       equ 0x1706
+INT_2       equ 0x1708
+INT_3       equ 0x170a
+ENUM_LOC    equ 0x170c
+RUNS        equ 0x170e
+
+start:
+    setup_segments
+
+    mov bx, 0
+.strings:
+    mov byte [STRING_1 + bx], 'D'
+    mov byte [STRING_2 + bx], 'D'
+    add bx, 1
+    cmp bx, STRING_SIZE
+    jb .strings
+    mov word [RUNS], 0
+
+run:
+    call proc_5
+    call proc_4
+    mov word [INT_1], 2
+    mov word [INT_2], 3
+    mov byte [STRING_2 + STRING_SIZE - 1], '2'
+    mov word [ENUM_LOC], 1
+    call func_2
+    mov [BOOL_GLOB], al
+
+.while:
+    mov ax, [INT_1]
+    cmp ax, [INT_2]
+    jge .done
+    ; int_3 = 5 * int_1 - int_2
+    mov dx, ax
+    add dx, dx
+    add dx, dx
+    add dx, ax
+    sub dx, [INT_2]
+    mov [INT_3], dx
+    call proc_7
+    add word [INT_1], 1
+    jmp .while
+
+.done:
+    call proc_8
+    call proc_1
+
+    ; for char_index = 'A' .. char_2
+    mov cl, 'A'
+.chars:
+    cmp cl, [CHAR_2]
+    ja .chars_done
+    cmp word [ENUM_LOC], 2
+    jne .next_char
+    mov word [INT_2], 3
+.next_char:
+    add cl, 1
+    jmp .chars
+.chars_done:
+
+    ; int_2 = int_2 * int_1, int_1 = int_2 / int_3 replaced by add and sub
+    mov ax, [INT_2]
+    add ax, [INT_1]
+    mov [INT_2], ax
+    sub ax, [INT_3]
+    mov [INT_1], ax
+    add word [RUNS], 1
+    jmp run
+
+; record copy and field updates through pointers
+proc_1:
+    mov si, RECORD_GLOB
+    mov di, RECORD_NEXT
+    mov cx, RECORD_SIZE / 2
+.copy:
+    mov ax, [si]
+    mov [di], ax
+    add si, 2
+    add di, 2
+    loop .copy
+    mov word [RECORD_GLOB + 2], 5
+    mov ax, [RECORD_GLOB + 2]
+    mov [RECORD_NEXT + 2], ax
+    cmp word [RECORD_NEXT + 4], 0
+    jne .other
+    mov word [RECORD_NEXT + 2], 6
+    call proc_7
+    ret
+.other:
+    mov word [RECORD_NEXT + 4], 0
+    ret
+
+; bool_glob = char_1 == 'A' or bool_glob, char_2 = 'B'
+proc_4:
+    mov al, 0
+    cmp byte [CHAR_1], 'A'
+    jne .store
+    mov al, 1
+.store:
+    or [BOOL_GLOB], al
+    mov byte [CHAR_2], 'B'
+    ret
+
+proc_5:
+    mov byte [CHAR_1], 'A'
+    mov byte [BOOL_GLOB], 0
+    ret
+
+; int_3 = int_1 + 2 + int_2
+proc_7:
+    mov ax, [INT_1]
+    add ax, 2
+    add ax, [INT_2]
+    mov [INT_3], ax
+    ret
+
+; array stores at index int_1 + 5
+proc_8:
+    mov si, [INT_1]
+    add si, 5
+    mov bx, si
+    add bx, bx
+    mov ax, [INT_3]
+    mov [ARRAY_1 + bx], ax
+    mov [ARRAY_1 + bx + 2], ax
+    mov [ARRAY_1 + bx + 60], si
+    ; di = row offset of index, 100 * index = 64 + 32 + 4 times index
+    mov di, si
+    add di, di
+    add di, di
+    mov dx, di
+    add di, di
+    add di, di
+    add di, di
+    mov cx, di
+    add di, di
+    add di, cx
+    add di, dx
+    add di, bx
+    mov [ARRAY_2 + di], si
+    mov [ARRAY_2 + di + 2], si
+    add word [ARRAY_2 + di - 2], 1
+    mov [ARRAY_2 + di + 2000], ax
+    mov word [INT_GLOB], 5
+    ret
+
+; compares strings, al = 1 when string_1 is greater
+func_2:
+    mov bx, 0
+.compare:
+    mov al, [STRING_1 + bx]
+    cmp al, [STRING_2 + bx]
+    jne .differ
+    add bx, 1
+    cmp bx, STRING_SIZE
+    jb .compare
+    mov al, 0
+    ret
+.differ:
+    mov al, 0
+    jbe .done
+    mov al, 1
+.done:
+    ret
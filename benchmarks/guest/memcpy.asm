@@ -0,0 +1,32 @@
+; Copies 4 KiB buffer with word moves, then 1 KiB with byte moves.
+
+%include "common.inc"
+
+SOURCE      equ 0x0000
+DESTINATION equ 0x4000
+SIZE        equ 4096
+
+start:
+    setup_segments
+
+copy:
+    mov si, SOURCE
+    mov di, DESTINATION
+    mov cx, SIZE / 2
+.words:
+    mov ax, [si]
+    mov [di], ax
+    add si, 2
+    add di, 2
+    loop .words
+
+    mov si, SOURCE + 1
+    mov di, DESTINATION + 1
+    mov cx, SIZE / 4
+.bytes:
+    mov al, [si]
+    mov [di], al
+    add si, 1
+    add di, 1
+    loop .bytes
+    jmp copy
@@ -0,0 +1,29 @@
+; Fills 4 KiB buffer with unrolled word stores, then 1 KiB with byte stores.
+
+%include "common.inc"
+
+DESTINATION equ 0x4000
+SIZE        equ 4096
+
+start:
+    setup_segments
+    mov ax, 0x5a5a
+
+fill:
+    mov di, DESTINATION
+    mov cx, SIZE / 8
+.words:
+    mov [di], ax
+    mov [di + 2], ax
+    mov [di + 4], ax
+    mov [di + 6], ax
+    add di, 8
+    loop .words
+
+    mov di, DESTINATION + 1
+    mov cx, SIZE / 4
+.bytes:
+    mov [di], al
+    add di, 1
+    loop .bytes
+    jmp fill
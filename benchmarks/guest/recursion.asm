@@ -0,0 +1,32 @@
+; Naive recursive Fibonacci, exercises near call, ret, push and pop.
+; fib(18) = 2584 is stored at RESULT.
+
+%include "common.inc"
+
+RESULT equ 0x0000
+
+start:
+    setup_segments
+
+again:
+    mov ax, 18
+    call fib
+    mov [RESULT], ax
+    jmp again
+
+; ax = fib(ax), clobbers bx
+fib:
+    cmp ax, 2
+    jb .leaf
+    push ax
+    sub ax, 1
+    call fib
+    pop bx
+    push ax
+    mov ax, bx
+    sub ax, 2
+    call fib
+    pop bx
+    add ax, bx
+.leaf:
+    ret
@@ -0,0 +1,46 @@
+; Sieve of Eratosthenes over odd numbers, the classic BYTE benchmark with
+; 8190 flags. Number of found primes (1899) is stored at COUNT.
+
+%include "common.inc"
+
+FLAGS equ 0x0000
+SIZE  equ 8190
+COUNT equ 0x2000
+
+start:
+    setup_segments
+
+sieve:
+    mov bx, 0
+.fill:
+    mov byte [FLAGS + bx], 1
+    add bx, 1
+    cmp bx, SIZE
+    jb .fill
+
+    mov dx, 0
+    mov si, 0
+.scan:
+    cmp byte [FLAGS + si], 0
+    je .next
+    ; prime = 2 * i + 3, strike its odd multiples starting at i + prime
+    mov ax, si
+    add ax, ax
+    add ax, 3
+    mov bx, si
+    add bx, ax
+.strike:
+    cmp bx, SIZE
+    jae .counted
+    mov byte [FLAGS + bx], 0
+    add bx, ax
+    jmp .strike
+.counted:
+    add dx, 1
+.next:
+    add si, 1
+    cmp si, SIZE
+    jb .scan
+
+    mov [COUNT], dx
+    jmp sieve
@@ -0,0 +1,56 @@
+; Naive search of 8 byte needle in 2 KiB pseudo random text. The needle is
+; taken from the end of the text, position of the first match is stored at
+; FOUND.
+
+%include "common.inc"
+
+TEXT        equ 0x0000
+TEXT_SIZE   equ 2048
+NEEDLE      equ 0x1000
+NEEDLE_SIZE equ 8
+FOUND       equ 0x1010
+
+start:
+    setup_segments
+
+    ; letters 'a'..'p' from bits 8-11 of 16 bit LCG, period 4096
+    mov ax, 1
+    mov bx, 0
+.generate:
+    mov cx, ax
+    add ax, ax
+    add ax, ax
+    add ax, cx
+    add ax, 0x3619
+    mov dl, ah
+    and dl, 0x0f
+    add dl, 'a'
+    mov [TEXT + bx], dl
+    add bx, 1
+    cmp bx, TEXT_SIZE
+    jb .generate
+
+    mov bx, 0
+.needle:
+    mov dl, [TEXT + TEXT_SIZE - NEEDLE_SIZE + bx]
+    mov [NEEDLE + bx], dl
+    add bx, 1
+    cmp bx, NEEDLE_SIZE
+    jb .needle
+
+search:
+    mov si, TEXT
+.position:
+    mov bx, 0
+.compare:
+    mov al, [si + bx]
+    cmp al, [NEEDLE + bx]
+    jne .mismatch
+    add bx, 1
+    cmp bx, NEEDLE_SIZE
+    jb .compare
+    mov [FOUND], si
+    jmp search
+.mismatch:
+    add si, 1
+    jmp .position
@@ -0,0 +1,143 @@
+#!/bin/sh
+# Lists code size of Cpu handlers from GNU ld map file and sums them by
+# placement: .text.hot, plain .text and .text.unlikely (cold). Only handlers
+# instantiated in object files matching the pattern are listed, so every
+# handler appears once.
+#
+# Exits with 1 when hot handlers of any Cpu instantiation do not fit in L1i.
+#
+# Usage: handler_size_report.sh <map file> [object pattern] [L1i size in bytes]
+
+map=$1
+object=${2:-main.cpp}
+l1i=${3:-32768}
+
+if [ ! -f "$map" ]; then
+    echo "ERR: map file not found: $map"
+    exit 1
+fi
+
+awk -v object="$object" -v l1i="$l1i" '
+# strips "msemu::cpu8086::Cpu<...>::" from demangled name, sets type to the
+# Cpu instantiation
+function handler(name,    begin, depth, i, c)
+{
+    begin = index(name, "msemu::cpu8086::Cpu<")
+    if (begin == 0)
+    {
+        return ""
+    }
+    depth = 0
+    for (i = begin + length("msemu::cpu8086::Cpu"); i <= length(name); ++i)
+    {
+        c = substr(name, i, 1)
+        if (c == "<")
+        {
+            ++depth
+        }
+        else if (c == ">" && --depth == 0)
+        {
+            type = substr(name, begin, i - begin + 1)
+            return strip(substr(name, i + 3))
+        }
+    }
+    return ""
+}
+
+# drops "void msemu::cpu8086::Cpu<...>::" from template arguments of hot copies
+function strip(name,    begin, depth, i, c)
+{
+    while ((begin = index(name, "void msemu::cpu8086::Cpu<")) > 0)
+    {
+        depth = 0
+        for (i = begin + length("void msemu::cpu8086::Cpu"); i <= length(name); ++i)
+        {
+            c = substr(name, i, 1)
+            if (c == "<")
+            {
+                ++depth
+            }
+            else if (c == ">" && --depth == 0)
+            {
+                break
+            }
+        }
+        name = substr(name, 1, begin - 1) substr(name, i + 3)
+    }
+    return name
+}
+
+function hex(text,    value, i)
+{
+    value = 0
+    for (i = 3; i <= length(text); ++i)
+    {
+        value = value * 16 + index("0123456789abcdef", tolower(substr(text, i, 1))) - 1
+    }
+    return value
+}
+
+function placement(section)
+{
+    if (section ~ /^\.text\.hot/)
+    {
+        return "hot"
+    }
+    if (section ~ /^\.text\.unlikely/)
+    {
+        return "cold"
+    }
+    return "text"
+}
+
+# input section, address and size follow on the same or the next line
+/^ \.text/ {
+    section = $1
+    size    = NF >= 4 ? hex($3) : -1
+    source  = NF >= 4 ? $4 : ""
+    pending = 1
+    next
+}
+
+pending && size < 0 && NF >= 3 && $1 ~ /^0x/ {
+    size   = hex($2)
+    source = $3
+    next
+}
+
+# first symbol of the section names the function
+pending && NF >= 2 && $1 ~ /^0x/ {
+    pending = 0
+    $1      = ""
+    name    = handler(substr($0, 2))
+    if (name != "" && size > 0 && index(source, object) > 0)
+    {
+        if (!(type in instances))
+        {
+            instances[type] = ++count
+            types[count]    = type
+        }
+        instance = instances[type]
+        kind     = placement(section)
+        printf "%d %-6s %6d %s\n", instance, kind, size, name | "sort -k1,1n -k2,2 -k3,3nr"
+        total[instance, kind] += size
+    }
+    next
+}
+END {
+    close("sort -k1,1n -k2,2 -k3,3nr")
+    for (i = 1; i <= count; ++i)
+    {
+        printf "\n%d: %s\n", i, types[i]
+        printf "   hot: %d bytes, text: %d bytes, cold: %d bytes\n", total[i, "hot"], total[i, "text"],
+               total[i, "cold"]
+        printf "   hot path footprint: %.1f%% of %d bytes L1i\n", 100.0 * total[i, "hot"] / l1i, l1i
+        if (total[i, "hot"] > l1i)
+        {
+            printf "ERR: hot handlers of instance %d do not fit in L1i\n", i
+            status = 1
+        }
+    }
+    exit status
+}
+' "$map"
@@ -0,0 +1,102 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Measures full frame conversion time of every video mode and kernel.
+//
+// Usage: msemu_video_benchmark [frames]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+
+#include "video.hpp"
+
+namespace
+{
+
+const char* mode_name(const msemu::VideoMode mode)
+{
+    switch (mode)
+    {
+        case msemu::VideoMode::cga_320x200x4:
+            return "cga_320x200x4";
+        case msemu::VideoMode::cga_640x200x2:
+            return "cga_640x200x2";
+        case msemu::VideoMode::ega_320x200x16:
+            return "ega_320x200x16";
+        case msemu::VideoMode::ega_640x350x16:
+            return "ega_640x350x16";
+    }
+    return "";
+}
+
+const char* kernel_name(const msemu::VideoOutput::Kernel kernel)
+{
+    switch (kernel)
+    {
+        case msemu::VideoOutput::Kernel::scalar:
+            return "scalar";
+        case msemu::VideoOutput::Kernel::sse2:
+            return "sse2";
+        case msemu::VideoOutput::Kernel::avx2:
+            return "avx2";
+    }
+    return "";
+}
+
+} // namespace
+
+int main(int argc, const char* argv[])
+{
+    const std::size_t frames = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+
+    auto memory = std::make_unique<msemu::VideoMemory>();
+    std::mt19937 random(0);
+    for (auto& byte : memory->span())
+    {
+        byte = static_cast<uint8_t>(random());
+    }
+
+    using Kernel = msemu::VideoOutput::Kernel;
+    printf("%-15s %-7s %12s\n", "mode", "kernel", "us/frame");
+    for (const auto mode : {msemu::VideoMode::cga_320x200x4, msemu::VideoMode::cga_640x200x2,
+                            msemu::VideoMode::ega_320x200x16, msemu::VideoMode::ega_640x350x16})
+    {
+        memory->mode(mode);
+        for (const auto kernel : {Kernel::scalar, Kernel::sse2, Kernel::avx2})
+        {
+            if (kernel > msemu::VideoOutput::best_kernel())
+            {
+                continue;
+            }
+            msemu::VideoOutput output(kernel);
+            const auto begin = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < frames; ++i)
+            {
+                memory->invalidate();
+                output.update(*memory);
+            }
+            const std::chrono::duration<double, std::micro> elapsed =
+                std::chrono::steady_clock::now() - begin;
+            printf("%-15s %-7s %12.1f\n", mode_name(mode), kernel_name(kernel),
+                   elapsed.count() / static_cast<double>(frames));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace msemu::cpu8086
+{
+
+template <typename T>
+struct ArithmeticType
+{
+};
+
+template <>
+struct ArithmeticType<uint8_t>
+{
+    using type = uint16_t;
+};
+
+template <>
+struct ArithmeticType<uint16_t>
+{
+    using type = uint32_t;
+};
+
+// Order matches reg field of group 1 opcodes and opcode rows 0x00-0x3f.
+enum class AluOp : uint8_t
+{
+    add_op,
+    or_op,
+    adc_op,
+    sbb_op,
+    and_op,
+    sub_op,
+    xor_op,
+    cmp_op,
+    test_op
+};
+
+// Positions of arithmetic flags in FLAGS register.
+namespace alu_flags
+{
+constexpr uint16_t carry    = 0x0001;
+constexpr uint16_t parity   = 0x0004;
+constexpr uint16_t adjust   = 0x0010;
+constexpr uint16_t zero     = 0x0040;
+constexpr uint16_t sign     = 0x0080;
+constexpr uint16_t overflow = 0x0800;
+constexpr uint16_t mask     = carry | parity | adjust | zero | sign | overflow;
+} // namespace alu_flags
+
+// Parity flag value for every low byte of result.
+constexpr std::array<uint16_t, 256> parity_table = []
+{
+    std::array<uint16_t, 256> table{};
+    for (uint32_t i = 0; i < table.size(); ++i)
+    {
+        uint32_t bits = i;
+        bits ^= bits >> 4;
+        bits ^= bits >> 2;
+        bits ^= bits >> 1;
+        table[i] = (bits & 1) == 0 ? alu_flags::parity : 0;
+    }
+    return table;
+}();
+
+constexpr bool alu_writes_result(const AluOp op)
+{
+    return op != AluOp::cmp_op && op != AluOp::test_op;
+}
+
+template <typename T>
+struct AluResult
+{
+    T value;
+    uint16_t flags;
+};
+
+// Computes result and all arithmetic flags of operation without branches.
+// Operands are widened, so carry and borrow end up in the bit above the
+// operand, overflow is a sign change which none of the operands explains.
+template <AluOp op, typename T>
+constexpr AluResult<T> alu(const T l, const T r, const bool carry_in)
+{
+    using Type                  = typename ArithmeticType<T>::type;
+    constexpr uint32_t bits     = sizeof(T) * 8;
+    constexpr uint32_t sign_bit = bits - 1;
+
+    const Type wl = l;
+    const Type wr = r;
+    Type result   = 0;
+    Type overflow = 0;
+    if constexpr (op == AluOp::add_op || op == AluOp::adc_op)
+    {
+        result   = static_cast<Type>(wl + wr + (op == AluOp::adc_op ? carry_in : 0));
+        overflow = static_cast<Type>((wl ^ result) & (wr ^ result));
+    }
+    else if constexpr (op == AluOp::sub_op || op == AluOp::sbb_op || op == AluOp::cmp_op)
+    {
+        result   = static_cast<Type>(wl - wr - (op == AluOp::sbb_op ? carry_in : 0));
+        overflow = static_cast<Type>((wl ^ wr) & (wl ^ result));
+    }
+    else if constexpr (op == AluOp::or_op)
+    {
+        result = wl | wr;
+    }
+    else if constexpr (op == AluOp::and_op || op == AluOp::test_op)
+    {
+        result = wl & wr;
+    }
+    else if constexpr (op == AluOp::xor_op)
+    {
+        result = wl ^ wr;
+    }
+
+    const T value = static_cast<T>(result);
+    uint16_t flags =
+        static_cast<uint16_t>(parity_table[value & 0xff] | ((value >> (sign_bit - 7)) & alu_flags::sign) |
+                              (value == 0 ? alu_flags::zero : 0));
+    if constexpr (op != AluOp::or_op && op != AluOp::and_op && op != AluOp::xor_op && op != AluOp::test_op)
+    {
+        flags |= static_cast<uint16_t>(((result >> bits) & alu_flags::carry) |
+                                       ((wl ^ wr ^ result) & alu_flags::adjust) |
+                                       (((overflow >> sign_bit) & 1) * alu_flags::overflow));
+    }
+    return AluResult<T>{value, flags};
+}
+
+} // namespace msemu::cpu8086
@@ -0,0 +1,119 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <utility>
+
+namespace msemu::cpu8086
+{
+
+// Marks 64 byte blocks of physical memory from which instructions were fetched.
+// One 64 bit word covers exactly one 4 KiB page, so writes into pages without
+// code cost a single load and compare. Writes into marked blocks are counted as
+// self modifying code and unmark only the blocks they touched.
+class CodeMap
+{
+public:
+    constexpr static uint32_t block_shift = 6;
+    constexpr static uint32_t page_shift  = 12;
+
+    struct Stats
+    {
+        uint64_t events;
+        uint64_t invalidated_blocks;
+    };
+
+    CodeMap()
+        : pages_{}
+        , stats_{}
+    {
+    }
+
+    // Marks all blocks touched by range, returns first and size of them.
+    std::pair<uint32_t, uint32_t> mark(const uint32_t address, const uint32_t size)
+    {
+        const uint32_t first = address >> block_shift;
+        const uint32_t last  = (address + size - 1) >> block_shift;
+        for (uint32_t block = first; block <= last; ++block)
+        {
+            pages_[page_index(block)] |= block_bit(block);
+        }
+        return {first << block_shift, (last - first + 1) << block_shift};
+    }
+
+    // Returns true when write touched code, touched blocks are unmarked.
+    inline bool write(const uint32_t address, const uint32_t size)
+    {
+        // word write crossing into next page is checked on the slow path
+        if (pages_[page_index(address >> block_shift)] == 0 && (address & page_mask) < page_mask) [[likely]]
+        {
+            return false;
+        }
+        return invalidate(address, size);
+    }
+
+    void clear()
+    {
+        pages_ = {};
+    }
+
+    const Stats& stats() const
+    {
+        return stats_;
+    }
+
+private:
+    // 2 MiB covers segment:offset addresses above 1 MiB as well
+    constexpr static uint32_t pages                 = 512;
+    constexpr static uint32_t blocks_per_page_shift = page_shift - block_shift;
+    constexpr static uint32_t page_mask             = (1u << page_shift) - 1;
+
+    static inline uint32_t page_index(const uint32_t block)
+    {
+        return (block >> blocks_per_page_shift) & (pages - 1);
+    }
+
+    static inline uint64_t block_bit(const uint32_t block)
+    {
+        return uint64_t{1} << (block & ((1u << blocks_per_page_shift) - 1));
+    }
+
+    [[gnu::noinline]] bool invalidate(const uint32_t address, const uint32_t size)
+    {
+        bool hit = false;
+        for (uint32_t block = address >> block_shift; block <= (address + size - 1) >> block_shift; ++block)
+        {
+            uint64_t& page = pages_[page_index(block)];
+            if ((page & block_bit(block)) != 0)
+            {
+                page &= ~block_bit(block);
+                ++stats_.invalidated_blocks;
+                hit = true;
+            }
+        }
+        stats_.events += hit ? 1 : 0;
+        return hit;
+    }
+
+    std::array<uint64_t, pages> pages_;
+    Stats stats_;
+};
+
+} // namespace msemu::cpu8086
@@ -0,0 +1,91 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace msemu::cpu8086
+{
+
+// Packs carry, parity, zero, sign and overflow of FLAGS into 5 bit index.
+constexpr uint32_t condition_index(const uint16_t flags)
+{
+    return static_cast<uint32_t>((flags & 0x0001) | ((flags >> 1) & 0x0002) | ((flags >> 4) & 0x000c) |
+                                 ((flags >> 7) & 0x0010));
+}
+
+// Conditions of Jcc indexed by low nibble of opcode. Bit i of an entry tells
+// whether the condition holds for flags packed by condition_index() to i, so
+// evaluation is a shift and a mask for every condition.
+constexpr std::array<uint32_t, 16> condition_table = []
+{
+    std::array<uint32_t, 16> table{};
+    for (uint32_t i = 0; i < 32; ++i)
+    {
+        const bool c = i & 0x01;
+        const bool p = i & 0x02;
+        const bool z = i & 0x04;
+        const bool s = i & 0x08;
+        const bool o = i & 0x10;
+
+        const std::array<bool, 8> holds = {
+            o,            // jo
+            c,            // jb
+            z,            // jz
+            c || z,       // jbe
+            s,            // js
+            p,            // jp
+            s != o,       // jl
+            z || s != o,  // jle
+        };
+        for (uint32_t condition = 0; condition < table.size(); ++condition)
+        {
+            // odd conditions negate the preceding one
+            const bool result = holds[condition >> 1] != ((condition & 1) != 0);
+            table[condition] |= static_cast<uint32_t>(result) << i;
+        }
+    }
+    return table;
+}();
+
+constexpr bool condition_holds(const uint8_t condition, const uint16_t flags)
+{
+    return (condition_table[condition] >> condition_index(flags)) & 1;
+}
+
+enum class Branch : uint8_t
+{
+    jcc,
+    jcxz,
+    loop,
+    loopz,
+    loopnz,
+    count
+};
+
+// Cycles of not taken and taken branch.
+constexpr std::array<std::array<uint8_t, 2>, static_cast<std::size_t>(Branch::count)> branch_costs = {{
+    {4, 16},
+    {6, 18},
+    {5, 17},
+    {6, 18},
+    {5, 19},
+}};
+
+} // namespace msemu::cpu8086
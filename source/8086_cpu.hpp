@@ -17,47 +17,47 @@
 
 #pragma once
 
-#include <bitset>
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <utility>
 
 #include "16_bit_modrm.hpp"
+#include "8086_alu.hpp"
+#include "8086_code_map.hpp"
+#include "8086_conditions.hpp"
 #include "8086_modrm.hpp"
+#include "8086_opcodes.hpp"
 #include "8086_registers.hpp"
+#include "8086_return_stack.hpp"
+#include "8086_tlb.hpp"
 #include "core_dump.hpp"
 #include "memory.hpp"
 
-#include <iostream>
-
 namespace msemu
 {
 namespace cpu8086
 {
 
-template <typename T>
-struct ArithmeticType
-{
-};
-
-template <>
-struct ArithmeticType<uint8_t>
-{
-    using type = uint16_t;
-};
-
-template <>
-struct ArithmeticType<uint16_t>
-{
-    using type = uint32_t;
-};
-
-
 template <typename BusType>
 class Cpu
 {
 public:
     Cpu(BusType &bus)
         : last_instruction_cost_{0}
+        , budget_{0}
+        , left_{0}
+        , skipped_{0}
+        , stopped_{false}
         , error_msg_{}
+        , fetch_window_{nullptr}
+        , fetch_ip_{0}
+        , fetch_buffer_{}
+        , tlb_{}
+        , code_map_{}
+        , code_range_{}
+        , return_stack_{}
+        , bus_generation_{0}
         , bus_{bus}
     {
 
@@ -90,14 +90,28 @@ public:
         set_opcode(0xd5, &Cpu::_aad);
         set_opcode(0xd4, &Cpu::_aam);
 
-        // adc
-        set_opcode(0x12, &Cpu::_adc_from_modrm<uint8_t>);
-        set_opcode(0x13, &Cpu::_adc_from_modrm<uint16_t>);
-        set_opcode(0x14, &Cpu::_adc_to_register<uint8_t, Register::al_id>);
-        set_opcode(0x15, &Cpu::_adc_to_register<uint16_t, Register::ax_id>);
-        set_grp1_0_opcode(0x02, &Cpu::_adc_modrm_imm<uint8_t, uint8_t>);
-        set_grp1_1_opcode(0x02, &Cpu::_adc_modrm_imm<uint16_t, uint16_t>);
-        set_grp1_3_opcode(0x02, &Cpu::_adc_modrm_imm<uint16_t, uint8_t>);
+        // arithmetic and logic, rows 0x00-0x3f share one layout
+        set_alu_opcodes<AluOp::add_op>();
+        set_alu_opcodes<AluOp::or_op>();
+        set_alu_opcodes<AluOp::adc_op>();
+        set_alu_opcodes<AluOp::sbb_op>();
+        set_alu_opcodes<AluOp::and_op>();
+        set_alu_opcodes<AluOp::sub_op>();
+        set_alu_opcodes<AluOp::xor_op>();
+        set_alu_opcodes<AluOp::cmp_op>();
+
+        // test
+        set_opcode(0x84, &Cpu::_alu_modrm_reg<AluOp::test_op, uint8_t>);
+        set_opcode(0x85, &Cpu::_alu_modrm_reg<AluOp::test_op, uint16_t>);
+        set_opcode(0xa8, &Cpu::_alu_acc_imm<AluOp::test_op, uint8_t>);
+        set_opcode(0xa9, &Cpu::_alu_acc_imm<AluOp::test_op, uint16_t>);
+        set_opcode(0xf6, &Cpu::_grp3a_process);
+        set_opcode(0xf7, &Cpu::_grp3b_process);
+        // reg 1 is undocumented alias of test
+        set_grp3a_opcode(0x00, &Cpu::_alu_modrm_imm<AluOp::test_op, uint8_t, uint8_t>);
+        set_grp3a_opcode(0x01, &Cpu::_alu_modrm_imm<AluOp::test_op, uint8_t, uint8_t>);
+        set_grp3b_opcode(0x00, &Cpu::_alu_modrm_imm<AluOp::test_op, uint16_t, uint16_t>);
+        set_grp3b_opcode(0x01, &Cpu::_alu_modrm_imm<AluOp::test_op, uint16_t, uint16_t>);
 
         // modifiers
         set_opcode(0x26, &Cpu::_set_section_offset<Register::es_id>);
@@ -105,11 +119,6 @@ public:
         set_opcode(0x2e, &Cpu::_set_section_offset<Register::cs_id>);
         set_opcode(0x3e, &Cpu::_set_section_offset<Register::ds_id>);
 
-        // add group
-        // set_opcode(0x14, &Cpu::_adc_imm_to_acc<uint8_t>);
-
-        set_opcode(0x31, &Cpu::_xor_modrm_from_reg);
-
         // mov group
         set_opcode(0xa0, &Cpu::_mov_mem_to_reg<Register::al_id, uint8_t>);
         set_opcode(0xa1, &Cpu::_mov_mem_to_reg<Register::ax_id, uint16_t>);
@@ -150,6 +159,49 @@ public:
         set_opcode(0xe9, &Cpu::_jump_short<int16_t>);
         set_opcode(0xea, &Cpu::_jump_far);
 
+        // jumps - conditional
+        set_jump_conditional_opcode<0x0>(); // jo
+        set_jump_conditional_opcode<0x1>(); // jno
+        set_jump_conditional_opcode<0x2>(); // jb
+        set_jump_conditional_opcode<0x3>(); // jnb
+        set_jump_conditional_opcode<0x4>(); // jz
+        set_jump_conditional_opcode<0x5>(); // jnz
+        set_jump_conditional_opcode<0x6>(); // jbe
+        set_jump_conditional_opcode<0x7>(); // ja
+        set_jump_conditional_opcode<0x8>(); // js
+        set_jump_conditional_opcode<0x9>(); // jns
+        set_jump_conditional_opcode<0xa>(); // jp
+        set_jump_conditional_opcode<0xb>(); // jnp
+        set_jump_conditional_opcode<0xc>(); // jl
+        set_jump_conditional_opcode<0xd>(); // jge
+        set_jump_conditional_opcode<0xe>(); // jle
+        set_jump_conditional_opcode<0xf>(); // jg
+
+        set_opcode(0xe0, &Cpu::_loop<Branch::loopnz>);
+        set_opcode(0xe1, &Cpu::_loop<Branch::loopz>);
+        set_opcode(0xe2, &Cpu::_loop<Branch::loop>);
+        set_opcode(0xe3, &Cpu::_jump_cx_zero);
+
+        // calls and returns
+        set_opcode(0xe8, &Cpu::_call_near);
+        set_opcode(0x9a, &Cpu::_call_far);
+        set_grp5_opcode(0x02, &Cpu::_call_near_modrm);
+        set_grp5_opcode(0x03, &Cpu::_call_far_modrm);
+        set_opcode(0xc2, &Cpu::_ret<false, true>);
+        set_opcode(0xc3, &Cpu::_ret<false, false>);
+        set_opcode(0xca, &Cpu::_ret<true, true>);
+        set_opcode(0xcb, &Cpu::_ret<true, false>);
+
+        // interrupts
+        set_opcode(0xcc, &Cpu::_int3);
+        set_opcode(0xcd, &Cpu::_int);
+        set_opcode(0xce, &Cpu::_into);
+        set_opcode(0xcf, &Cpu::_iret);
+
+        // flags
+        set_opcode(0x9c, &Cpu::_pushf);
+        set_opcode(0x9d, &Cpu::_popf);
+
         set_grp5_opcode(0x04, &Cpu::_jump_short_modrm);
         set_grp5_opcode(0x05, &Cpu::_jump_far_modrm);
 
@@ -186,8 +238,6 @@ public:
 
         set_opcode(0xfc, &Cpu::_cld);
 
-        set_opcode(0xc3, &Cpu::_unimpl);
-
         reset();
 #ifdef DUMP_CORE_STATE
         dump(error_msg_, bus_);
@@ -206,40 +256,330 @@ public:
 
     inline uint32_t calculate_code_address() const
     {
-        return static_cast<uint32_t>(Register::cs() << 4 | Register::ip());
+        return physical_address(Register::cs(), Register::ip());
     }
 
     inline uint32_t calculate_data_address(const uint32_t address) const
     {
-        return static_cast<uint32_t>(Register::ds() << 4 | address);
+        return physical_address(Register::ds(), address);
     }
 
     inline uint32_t calculate_stack_address(const uint32_t address) const
     {
-        return static_cast<uint32_t>(Register::ss() << 4 | address);
+        return physical_address(Register::ss(), address);
     }
 
-    void step()
+    // Executes one instruction and ignores trap flag, run(1) takes INT 1 after it.
+    [[gnu::hot]] void step()
     {
-        const auto *op = &opcodes_[bus_.template read<uint8_t>(calculate_code_address())];
-        (this->*op->impl)();
+        fetch();
+        dispatch();
 #ifdef DUMP_CORE_STATE
         dump(error_msg_, bus_);
 #endif
     }
 
+    // Executes instructions until count is reached or unimplemented opcode
+    // stops the cpu, returns number of executed instructions. Trap flag is
+    // honoured only by the trace loop, which is entered when the flag is set
+    // by popf or iret and left when it clears, so the fast loop does not test it.
+    uint64_t run(const uint64_t count)
+    {
+        if constexpr (Remappable<BusType>)
+        {
+            // start of run is the quiescent state of runtime device map
+            if (bus_.quiescent(bus_generation_))
+            {
+                invalidate_tlb();
+            }
+        }
+
+        left_         = count;
+        skipped_      = 0;
+        stopped_      = false;
+        error_msg_[0] = '\0';
+        while (left_ != 0)
+        {
+            budget_ = std::exchange(left_, 0);
+            if (Register::flags().t())
+            {
+                run_trace();
+            }
+            else
+            {
+                run_fast();
+            }
+        }
+        return count - skipped_;
+    }
+
     void reset()
     {
         Register::reset();
     }
 
+    const char *error() const
+    {
+        return error_msg_;
+    }
+
+    struct Stats
+    {
+        SoftwareTlb::Stats tlb;
+        CodeMap::Stats smc;
+        ReturnStack::Stats returns;
+    };
+
+    Stats stats() const
+    {
+        return Stats{.tlb = tlb_.stats(), .smc = code_map_.stats(), .returns = return_stack_.stats()};
+    }
+
+    // Must be called when devices are mapped or unmapped on the bus.
+    void invalidate_tlb()
+    {
+        tlb_.invalidate();
+        code_range_ = {};
+    }
+
 protected:
+    constexpr static uint32_t fetch_window_size = max_instruction_length;
+
+    // Bus decoding is unrolled at compile time, for one or two devices it is
+    // cheaper than TLB lookup, for more devices TLB wins.
+    constexpr static bool use_tlb = BusType::device_count > 2;
+
+    // Points fetch window at the instruction under cs:ip. When the window is
+    // inside single memory device, operands are decoded directly from host
+    // memory, otherwise bytes are copied with ip wrapping inside the segment.
+    // Code range covers host memory of already marked code blocks, so the common
+    // case is one range check for both translation and code marking.
+    inline void fetch()
+    {
+        fetch_ip_              = Register::ip();
+        const uint32_t address = calculate_code_address();
+        if (fetch_ip_ <= 0x10000 - fetch_window_size) [[likely]]
+        {
+            fetch_window_ = SoftwareTlb::translate(code_range_, address, fetch_window_size);
+            if (fetch_window_ != nullptr) [[likely]]
+            {
+                return;
+            }
+        }
+        refill_code_range(address);
+    }
+
+    [[gnu::noinline]] void refill_code_range(const uint32_t address)
+    {
+        const auto [start, size] = code_map_.mark(address, fetch_window_size);
+        HostRange host{};
+        if constexpr (use_tlb)
+        {
+            host = tlb_.range(bus_, SoftwareTlb::code, address);
+        }
+        else
+        {
+            host = bus_.host_range(address);
+        }
+
+        // part of marked blocks backed by the device
+        const uint64_t begin = std::max<uint64_t>(start, host.start);
+        const uint64_t end =
+            std::min<uint64_t>(static_cast<uint64_t>(start) + size, static_cast<uint64_t>(host.start) + host.size);
+        code_range_ = {};
+        if (end > begin)
+        {
+            code_range_ = HostRange{.start    = static_cast<uint32_t>(begin),
+                                    .size     = static_cast<uint32_t>(end - begin),
+                                    .data     = host.data + (begin - host.start),
+                                    .writable = false};
+        }
+
+        fetch_window_ = nullptr;
+        if (fetch_ip_ <= 0x10000 - fetch_window_size)
+        {
+            fetch_window_ = SoftwareTlb::translate(code_range_, address, fetch_window_size);
+        }
+        if (fetch_window_ == nullptr)
+        {
+            fetch_slow();
+        }
+    }
+
+    [[gnu::cold]] void fetch_slow()
+    {
+        for (uint32_t i = 0; i < fetch_window_size; ++i)
+        {
+            fetch_buffer_[i] = bus_.template read<uint8_t>(
+                physical_address(Register::cs(), static_cast<uint16_t>(fetch_ip_ + i)));
+        }
+        fetch_window_ = fetch_buffer_.data();
+    }
+
+    // Cost of register form comes from the opcode table, handlers replace it
+    // for memory operands and taken branches.
+    inline void dispatch()
+    {
+        const uint8_t opcode   = fetch_window_[0];
+        last_instruction_cost_ = base_costs[opcode];
+        (this->*opcodes_[opcode].impl)();
+    }
+
+    // Reads next instruction bytes from fetch window and advances ip.
+    template <typename T>
+    inline T read_code() const
+    {
+        const uint16_t offset = static_cast<uint16_t>(Register::ip() - fetch_ip_);
+        Register::increment_ip(sizeof(T));
+        if constexpr (sizeof(T) == 1)
+        {
+            return static_cast<T>(fetch_window_[offset]);
+        }
+        else
+        {
+            return static_cast<T>(fetch_window_[offset] | fetch_window_[offset + 1] << 8);
+        }
+    }
+
+    template <typename T>
+    inline T read_memory(const SoftwareTlb::Entry entry, const uint32_t address)
+    {
+        if constexpr (!use_tlb)
+        {
+            return bus_.template read<T>(address);
+        }
+        else if (const uint8_t *data = tlb_.read(bus_, entry, address, sizeof(T)); data != nullptr)
+        {
+            if constexpr (sizeof(T) == 1)
+            {
+                return static_cast<T>(data[0]);
+            }
+            else
+            {
+                return static_cast<T>(data[0] | data[1] << 8);
+            }
+        }
+        if constexpr (sizeof(T) == 2)
+        {
+            // word may straddle two devices
+            return static_cast<T>(bus_.template read<uint8_t>(address) |
+                                  bus_.template read<uint8_t>(address + 1) << 8);
+        }
+        return bus_.template read<T>(address);
+    }
+
+    template <typename T>
+    inline void write_memory(const SoftwareTlb::Entry entry, const uint32_t address, const T value)
+    {
+        if (code_map_.write(address, sizeof(T))) [[unlikely]]
+        {
+            // written blocks have to be marked again on next fetch
+            code_range_ = {};
+        }
+        if constexpr (!use_tlb)
+        {
+            bus_.write(address, value);
+            return;
+        }
+        else if (uint8_t *data = tlb_.write(bus_, entry, address, sizeof(T)); data != nullptr)
+        {
+            data[0] = static_cast<uint8_t>(value);
+            if constexpr (sizeof(T) == 2)
+            {
+                data[1] = static_cast<uint8_t>(value >> 8);
+            }
+            return;
+        }
+        if constexpr (sizeof(T) == 2)
+        {
+            bus_.write(address, static_cast<uint8_t>(value));
+            bus_.write(address + 1, static_cast<uint8_t>(value >> 8));
+            return;
+        }
+        bus_.write(address, value);
+    }
+
+    // bp based addressing defaults to the stack segment
+    static inline SoftwareTlb::Entry tlb_entry(const ModRM mod)
+    {
+        return mod.rm == 2 || mod.rm == 3 || (mod.rm == 6 && mod.mod != 0) ? SoftwareTlb::stack
+                                                                             : SoftwareTlb::data;
+    }
+
     // configuration
     void set_opcode(uint8_t id, void (Cpu::*fun)(void))
     {
         opcodes_[id].impl = fun;
     }
 
+    // ALU ops which the benchmarks execute often. ALU handlers are instantiated
+    // for every op and width, only these go to .text.hot, so the hot set fits
+    // in L1i. adc, sbb, xor and test stay in .text.
+    constexpr static bool alu_hot(const AluOp op)
+    {
+        return op == AluOp::add_op || op == AluOp::or_op || op == AluOp::and_op || op == AluOp::sub_op ||
+               op == AluOp::cmp_op;
+    }
+
+    // Hot copy of handler which is inlined into it.
+    template <void (Cpu::*handler)()>
+    [[gnu::hot]] void hot()
+    {
+        (this->*handler)();
+    }
+
+    template <void (Cpu::*handler)(const ModRM)>
+    [[gnu::hot]] void hot_extra(const ModRM mod)
+    {
+        (this->*handler)(mod);
+    }
+
+    template <AluOp op, void (Cpu::*handler)()>
+    constexpr static auto alu_handler()
+    {
+        if constexpr (alu_hot(op))
+        {
+            return &Cpu::hot<handler>;
+        }
+        return handler;
+    }
+
+    template <AluOp op, void (Cpu::*handler)(const ModRM)>
+    constexpr static auto alu_extra_handler()
+    {
+        if constexpr (alu_hot(op))
+        {
+            return &Cpu::hot_extra<handler>;
+        }
+        return handler;
+    }
+
+    // op r/m,reg; op reg,r/m; op acc,imm for both widths and group 1 immediates
+    template <AluOp op>
+    void set_alu_opcodes()
+    {
+        constexpr uint8_t row = static_cast<uint8_t>(static_cast<uint8_t>(op) * 8);
+        set_opcode(row + 0, alu_handler<op, &Cpu::_alu_modrm_reg<op, uint8_t>>());
+        set_opcode(row + 1, alu_handler<op, &Cpu::_alu_modrm_reg<op, uint16_t>>());
+        set_opcode(row + 2, alu_handler<op, &Cpu::_alu_reg_modrm<op, uint8_t>>());
+        set_opcode(row + 3, alu_handler<op, &Cpu::_alu_reg_modrm<op, uint16_t>>());
+        set_opcode(row + 4, alu_handler<op, &Cpu::_alu_acc_imm<op, uint8_t>>());
+        set_opcode(row + 5, alu_handler<op, &Cpu::_alu_acc_imm<op, uint16_t>>());
+        constexpr uint8_t reg = static_cast<uint8_t>(op);
+        set_grp1_0_opcode(reg, alu_extra_handler<op, &Cpu::_alu_modrm_imm<op, uint8_t, uint8_t>>());
+        set_grp1_1_opcode(reg, alu_extra_handler<op, &Cpu::_alu_modrm_imm<op, uint16_t, uint16_t>>());
+        // 0x83 sign extends byte immediate
+        set_grp1_3_opcode(reg, alu_extra_handler<op, &Cpu::_alu_modrm_imm<op, uint16_t, int8_t>>());
+    }
+
+    // 0x60-0x6f are undocumented aliases of 0x70-0x7f on 8086
+    template <uint8_t condition>
+    void set_jump_conditional_opcode()
+    {
+        set_opcode(0x60 | condition, &Cpu::_jump_conditional<condition>);
+        set_opcode(0x70 | condition, &Cpu::_jump_conditional<condition>);
+    }
+
     void set_grp1_0_opcode(const uint8_t id, void (Cpu::*fun)(const ModRM))
     {
         grp1_0_opcodes_[id].impl = fun;
@@ -283,81 +623,341 @@ protected:
 
 
     // core emulation
+    //
+    // Handlers of common instructions are marked hot and error and trace
+    // paths cold, the linker groups them into .text.hot and .text.unlikely,
+    // so hot dispatch stays dense in instruction cache. Sizes are listed by
+    // handler_size_report target.
 
-    void _unimpl()
+    [[gnu::cold]] void _unimpl()
     {
-        snprintf(error_msg_, sizeof(error_msg_), "Opcode: 0x%x is unimplemented!\n",
-                 bus_.template read<uint8_t>(calculate_code_address()));
-        last_instruction_cost_ = 0;
+        unimplemented(bus_.template read<uint8_t>(calculate_code_address()), -1);
     }
 
-    void _unimpl_extra(const ModRM mod)
+    [[gnu::cold]] void _unimpl_extra(const ModRM mod)
     {
         Register::decrement_ip(2);
-        snprintf(error_msg_, sizeof(error_msg_), "Opcode: 0x%x is unimplemented!, modrm: 0x%02x\n",
-                 bus_.template read<uint8_t>(calculate_code_address()), static_cast<uint8_t>(mod));
+        unimplemented(bus_.template read<uint8_t>(calculate_code_address()), static_cast<uint8_t>(mod));
+    }
+
+    // Error formatting is kept out of line, away from handlers.
+    [[gnu::cold, gnu::noinline]] void unimplemented(const uint8_t opcode, const int modrm)
+    {
+        if (modrm < 0)
+        {
+            snprintf(error_msg_, sizeof(error_msg_), "Opcode: 0x%x is unimplemented!\n", opcode);
+        }
+        else
+        {
+            snprintf(error_msg_, sizeof(error_msg_), "Opcode: 0x%x is unimplemented!, modrm: 0x%02x\n",
+                     opcode, modrm);
+        }
         last_instruction_cost_ = 0;
+        stop();
+    }
+
+    // run loops
+    [[gnu::hot]] inline void run_fast()
+    {
+        while (budget_ != 0)
+        {
+            --budget_;
+            step();
+        }
+    }
+
+    // INT 1 follows every instruction which started with trap flag set,
+    // prefixes are executed in one step with their instruction.
+    [[gnu::cold]] void run_trace()
+    {
+        while (budget_ != 0)
+        {
+            --budget_;
+            const bool trap = Register::flags().t();
+            step();
+            // unimplemented opcode did not execute, there is nothing to trap after
+            if (trap && !stopped_)
+            {
+                interrupt(1);
+            }
+            if (!Register::flags().t())
+            {
+                leave_loop();
+            }
+        }
+    }
+
+    // Makes run() pick the loop again for instructions left in the budget.
+    inline void leave_loop()
+    {
+        left_ += budget_;
+        budget_ = 0;
+    }
+
+    // Loops take the instruction from the budget before it runs, the one which
+    // stopped the cpu is not executed either.
+    inline void stop()
+    {
+        skipped_ = left_ + budget_ + 1;
+        stopped_ = true;
+        left_    = 0;
+        budget_  = 0;
     }
 
 
     void _grp5_process()
     {
         Register::increment_ip(1);
-        const ModRM mod = bus_.template read<uint8_t>(calculate_code_address());
-        Register::increment_ip(1);
+        const ModRM mod = read_code<uint8_t>();
         const auto *op = &grp5_opcodes_[mod.reg];
         (this->*op->impl)(mod);
     }
 
-    void _grp1_0_process()
+    [[gnu::hot]] void _grp1_0_process()
     {
         Register::increment_ip(1);
-        const ModRM mod = bus_.template read<uint8_t>(calculate_code_address());
-        Register::increment_ip(1);
+        const ModRM mod = read_code<uint8_t>();
         const auto *op = &grp1_0_opcodes_[mod.reg];
         (this->*op->impl)(mod);
     }
-    void _grp1_1_process()
+    [[gnu::hot]] void _grp1_1_process()
     {
         Register::increment_ip(1);
-        const ModRM mod = bus_.template read<uint8_t>(calculate_code_address());
-        Register::increment_ip(1);
+        const ModRM mod = read_code<uint8_t>();
         const auto *op = &grp1_1_opcodes_[mod.reg];
         (this->*op->impl)(mod);
     }
 
-    void _grp1_3_process()
+    [[gnu::hot]] void _grp1_3_process()
     {
         Register::increment_ip(1);
-        const ModRM mod = bus_.template read<uint8_t>(calculate_code_address());
-        Register::increment_ip(1);
+        const ModRM mod = read_code<uint8_t>();
         const auto *op = &grp1_3_opcodes_[mod.reg];
         (this->*op->impl)(mod);
     }
 
 
+    void _grp3a_process()
+    {
+        Register::increment_ip(1);
+        const ModRM mod = read_code<uint8_t>();
+        const auto *op  = &grp3a_opcodes_[mod.reg];
+        (this->*op->impl)(mod);
+    }
+
+    void _grp3b_process()
+    {
+        Register::increment_ip(1);
+        const ModRM mod = read_code<uint8_t>();
+        const auto *op  = &grp3b_opcodes_[mod.reg];
+        (this->*op->impl)(mod);
+    }
+
     template <typename T>
-    void _jump_short()
+    [[gnu::hot]] void _jump_short()
     {
         Register::increment_ip(1);
-        const T offset = bus_.template read<T>(calculate_code_address());
-        Register::increment_ip(sizeof(T));
+        const T offset = read_code<T>();
         const uint16_t address = static_cast<uint16_t>(static_cast<int>(Register::ip()) + offset);
         Register::ip(address);
-        last_instruction_cost_ = 15;
+    }
+
+    // Adds displacement to ip only when taken, without a branch on host.
+    template <Branch type>
+    inline void branch(const bool taken, const int8_t displacement)
+    {
+        const auto mask = static_cast<uint16_t>(0u - static_cast<unsigned>(taken));
+        const auto jump = static_cast<uint16_t>(static_cast<int16_t>(displacement));
+        Register::ip(static_cast<uint16_t>(Register::ip() + (jump & mask)));
+        last_instruction_cost_ = branch_costs[static_cast<std::size_t>(type)][taken];
+    }
+
+    template <uint8_t condition>
+    [[gnu::hot]] void _jump_conditional()
+    {
+        Register::increment_ip(1);
+        const int8_t displacement = read_code<int8_t>();
+        branch<Branch::jcc>(condition_holds(condition, Register::flags().value()), displacement);
+    }
+
+    [[gnu::hot]] void _jump_cx_zero()
+    {
+        Register::increment_ip(1);
+        const int8_t displacement = read_code<int8_t>();
+        branch<Branch::jcxz>(Register::cx() == 0, displacement);
+    }
+
+    template <Branch type>
+    [[gnu::hot]] void _loop()
+    {
+        Register::increment_ip(1);
+        const int8_t displacement = read_code<int8_t>();
+        const uint16_t cx         = static_cast<uint16_t>(Register::cx() - 1);
+        Register::cx(cx);
+
+        bool taken = cx != 0;
+        if constexpr (type == Branch::loopz)
+        {
+            taken &= Register::flags().z();
+        }
+        else if constexpr (type == Branch::loopnz)
+        {
+            taken &= !Register::flags().z();
+        }
+        branch<type>(taken, displacement);
+    }
+
+    inline void push(const uint16_t value)
+    {
+        Register::decrement_sp(2);
+        write_memory(SoftwareTlb::stack, calculate_stack_address(Register::sp()), value);
+    }
+
+    inline uint16_t pop()
+    {
+        const uint16_t value = read_memory<uint16_t>(SoftwareTlb::stack, calculate_stack_address(Register::sp()));
+        Register::increment_sp(2);
+        return value;
+    }
+
+    // Pushes return address of far transfer, ip ends up on top of stack.
+    inline void push_far_return()
+    {
+        push(Register::cs());
+        push(Register::ip());
+        return_stack_.push(calculate_stack_address(Register::sp()), Register::cs(), Register::ip());
+    }
+
+    inline void call_near(const uint16_t target)
+    {
+        push(Register::ip());
+        return_stack_.push(calculate_stack_address(Register::sp()), Register::cs(), Register::ip());
+        Register::ip(target);
+    }
+
+    [[gnu::hot]] void _call_near()
+    {
+        Register::increment_ip(1);
+        const uint16_t displacement = read_code<uint16_t>();
+        call_near(static_cast<uint16_t>(Register::ip() + displacement));
+    }
+
+    void _call_far()
+    {
+        Register::increment_ip(1);
+        const uint16_t ip = read_code<uint16_t>();
+        const uint16_t cs = read_code<uint16_t>();
+        push_far_return();
+        Register::ip(ip);
+        Register::cs(cs);
+    }
+
+    void _call_near_modrm(const ModRM mod)
+    {
+        const uint16_t disp   = process_modrm(mod);
+        const uint16_t target = read_modmr<uint16_t, 21, 16>(mod, disp);
+        call_near(target);
+    }
+
+    void _call_far_modrm(const ModRM mod)
+    {
+        const uint16_t disp     = process_modrm(mod);
+        const auto from_address = calculate_memory_address(mod, disp);
+        const uint16_t ip       = read_memory<uint16_t>(tlb_entry(mod), from_address);
+        const uint16_t cs       = read_memory<uint16_t>(tlb_entry(mod), from_address + 2);
+        push_far_return();
+        Register::ip(ip);
+        Register::cs(cs);
+        last_instruction_cost_ = static_cast<uint8_t>(37 + modes.costs[mod.mod][mod.rm]);
+    }
+
+    template <bool far, bool release>
+    [[gnu::hot]] void _ret()
+    {
+        Register::increment_ip(1);
+        const uint16_t release_bytes = release ? read_code<uint16_t>() : 0;
+        const uint32_t slot          = calculate_stack_address(Register::sp());
+        const uint16_t ip            = pop();
+        const uint16_t cs            = far ? pop() : Register::cs();
+        return_stack_.pop(slot, cs, ip);
+        Register::increment_sp(release_bytes);
+        Register::ip(ip);
+        Register::cs(cs);
+    }
+
+    void interrupt(const uint8_t vector)
+    {
+        push(static_cast<uint16_t>(Register::flags().value() | 0xf002));
+        Register::flags().i(false);
+        Register::flags().t(false);
+        push_far_return();
+        const uint32_t address = static_cast<uint32_t>(vector) * 4;
+        Register::ip(read_memory<uint16_t>(SoftwareTlb::data, address));
+        Register::cs(read_memory<uint16_t>(SoftwareTlb::data, address + 2));
+    }
+
+    [[gnu::cold]] void _int()
+    {
+        Register::increment_ip(1);
+        interrupt(read_code<uint8_t>());
+    }
+
+    [[gnu::cold]] void _int3()
+    {
+        Register::increment_ip(1);
+        interrupt(3);
+    }
+
+    [[gnu::cold]] void _into()
+    {
+        Register::increment_ip(1);
+        if (Register::flags().o())
+        {
+            interrupt(4);
+            last_instruction_cost_ = 53;
+        }
+    }
+
+    [[gnu::cold]] void _iret()
+    {
+        Register::increment_ip(1);
+        const uint32_t slot = calculate_stack_address(Register::sp());
+        const uint16_t ip   = pop();
+        const uint16_t cs   = pop();
+        Register::flags().value(pop());
+        return_stack_.pop(slot, cs, ip);
+        Register::ip(ip);
+        Register::cs(cs);
+        if (Register::flags().t())
+        {
+            leave_loop();
+        }
+    }
+
+    void _pushf()
+    {
+        Register::increment_ip(1);
+        push(static_cast<uint16_t>(Register::flags().value() | 0xf002));
+    }
+
+    void _popf()
+    {
+        Register::increment_ip(1);
+        Register::flags().value(pop());
+        if (Register::flags().t())
+        {
+            leave_loop();
+        }
     }
 
     void _jump_far()
     {
         Register::increment_ip(1);
-        const uint16_t ip_address = bus_.template read<uint16_t>(calculate_code_address());
-        Register::increment_ip(2);
-        const uint16_t cs_address = bus_.template read<uint16_t>(calculate_code_address());
-        Register::increment_ip(2);
+        const uint16_t ip_address = read_code<uint16_t>();
+        const uint16_t cs_address = read_code<uint16_t>();
 
         Register::ip(ip_address);
         Register::cs(cs_address);
-        last_instruction_cost_ = 15;
     }
 
     void _jump_short_modrm(const ModRM mod)
@@ -371,9 +971,8 @@ protected:
     {
         const uint16_t disp     = process_modrm(mod);
         const auto from_address = calculate_memory_address(mod, disp);
-        last_instruction_cost_  = static_cast<uint8_t>(12 + modes.costs[mod.mod][mod.rm]);
-        const uint16_t ip       = bus_.template read<uint16_t>(from_address);
-        const uint16_t cs       = bus_.template read<uint16_t>(from_address + 2);
+        const uint16_t ip       = read_memory<uint16_t>(tlb_entry(mod), from_address);
+        const uint16_t cs       = read_memory<uint16_t>(tlb_entry(mod), from_address + 2);
         Register::ip(ip);
         Register::cs(cs);
         last_instruction_cost_ = static_cast<uint8_t>(24 + modes.costs[mod.mod][mod.rm]);
@@ -392,7 +991,7 @@ protected:
             const auto from_address = calculate_memory_address(mod, offset);
 
             last_instruction_cost_ = 12 + modes.costs[mod.mod][mod.rm];
-            return bus_.template read<uint16_t>(from_address);
+            return read_memory<uint16_t>(tlb_entry(mod), from_address);
         }
 
         last_instruction_cost_ = 2;
@@ -405,7 +1004,7 @@ protected:
         if (mod.mod < 3)
         {
             const auto to_address = calculate_memory_address(mod, offset);
-            bus_.write(to_address, value);
+            write_memory(tlb_entry(mod), to_address, value);
             last_instruction_cost_ = mem_cost + modes.costs[mod.mod][mod.rm];
             return;
         }
@@ -420,7 +1019,7 @@ protected:
         if (mod.mod < 3)
         {
             const auto to_address = calculate_memory_address(mod, offset);
-            bus_.write(to_address, value);
+            write_memory(tlb_entry(mod), to_address, value);
             last_instruction_cost_ = 14 + modes.costs[mod.mod][mod.rm];
             return;
         }
@@ -435,7 +1034,7 @@ protected:
         {
             const auto from_address = calculate_memory_address(mod, offset);
             last_instruction_cost_  = static_cast<uint8_t>(mem_cost + modes.costs[mod.mod][mod.rm]);
-            return bus_.template read<T>(from_address);
+            return read_memory<T>(tlb_entry(mod), from_address);
         }
 
         last_instruction_cost_ = reg_cost;
@@ -443,49 +1042,37 @@ protected:
     }
 
     template <uint32_t reg, typename T>
-    void _mov_imm_to_reg()
+    [[gnu::hot]] void _mov_imm_to_reg()
     {
         Register::increment_ip(1);
-        const T data = bus_.template read<T>(calculate_code_address());
-        Register::increment_ip(sizeof(T));
+        const T data = read_code<T>();
         set_register_by_id<T, reg>(data);
-        last_instruction_cost_ = 4;
     }
 
     template <uint32_t reg, typename T>
-    void _mov_mem_to_reg()
+    [[gnu::hot]] void _mov_mem_to_reg()
     {
         Register::increment_ip(1);
-        const uint16_t address = bus_.template read<uint16_t>(calculate_code_address());
-        Register::increment_ip(2);
+        const uint16_t address = read_code<uint16_t>();
 
-        const T value = bus_.template read<T>(calculate_data_address(address));
+        const T value = read_memory<T>(SoftwareTlb::data, get_data_address(address, section_offset_));
 
         set_register_by_id<T, reg>(value);
-        if constexpr (reg == Register::ax_id || reg == Register::al_id || reg == Register::ah_id)
-        {
-            last_instruction_cost_ = 14;
-        }
-        else
+        if constexpr (reg != Register::ax_id && reg != Register::al_id && reg != Register::ah_id)
         {
             last_instruction_cost_ = 12 + get_cost(AccessCost::Direct);
         }
     }
 
     template <uint32_t reg, typename T>
-    void _mov_reg_to_mem()
+    [[gnu::hot]] void _mov_reg_to_mem()
     {
         Register::increment_ip(1);
-        const uint16_t address = bus_.template read<uint16_t>(calculate_code_address());
-        Register::increment_ip(2);
+        const uint16_t address = read_code<uint16_t>();
         const T value = get_register_by_id<T, reg>();
-        bus_.write(calculate_data_address(address), value);
+        write_memory(SoftwareTlb::data, get_data_address(address, section_offset_), value);
 
-        if constexpr (reg == Register::al_id || reg == Register::ah_id || reg == Register::ax_id)
-        {
-            last_instruction_cost_ = 14;
-        }
-        else
+        if constexpr (reg != Register::al_id && reg != Register::ah_id && reg != Register::ax_id)
         {
             last_instruction_cost_ = 13 + get_cost(AccessCost::Direct);
         }
@@ -493,29 +1080,24 @@ protected:
 
     inline std::pair<uint16_t, ModRM> process_modrm() const
     {
-        const ModRM mod = bus_.template read<uint8_t>(calculate_code_address());
-        Register::increment_ip(1);
+        const ModRM mod = read_code<uint8_t>();
         return std::pair<uint16_t, ModRM>(process_modrm(mod), mod);
     }
 
     inline uint16_t process_modrm(const ModRM mod) const
     {
-        uint16_t offset = 0;
-        if ((mod.mod == 0 && mod.rm == 0x06) || mod.mod == 2)
-        {
-            offset = bus_.template read<uint16_t>(calculate_code_address());
-            Register::increment_ip(2);
-        }
-        else if (mod.mod == 1)
+        switch (displacement_size(static_cast<uint8_t>(mod)))
         {
-            offset = bus_.template read<uint8_t>(calculate_code_address());
-            Register::increment_ip(1);
+            case 2:
+                return read_code<uint16_t>();
+            case 1:
+                return read_code<uint8_t>();
         }
-        return offset;
+        return 0;
     }
 
     template <typename T>
-    void _mov_byte_reg_to_modmr()
+    [[gnu::hot]] void _mov_byte_reg_to_modmr()
     {
         Register::increment_ip(1);
 
@@ -527,7 +1109,7 @@ protected:
 
 
     template <typename T>
-    void _mov_byte_modmr_to_reg()
+    [[gnu::hot]] void _mov_byte_modmr_to_reg()
     {
         Register::increment_ip(1);
         const auto [offset, mod] = process_modrm();
@@ -536,13 +1118,12 @@ protected:
     }
 
     template <typename T>
-    void _mov_byte_imm_to_modmr()
+    [[gnu::hot]] void _mov_byte_imm_to_modmr()
     {
         Register::increment_ip(1);
         const auto [offset, mod] = process_modrm();
 
-        const T value = bus_.template read<T>(calculate_code_address());
-        Register::increment_ip(sizeof(T));
+        const T value = read_code<T>();
 
         write_modmr_imm<T>(mod, offset, value);
     }
@@ -564,25 +1145,23 @@ protected:
     }
 
     template <uint32_t reg>
-    void _push_register_16()
+    [[gnu::hot]] void _push_register_16()
     {
         Register::increment_ip(1);
         const uint16_t value = get_register_16_by_id<reg>();
         Register::decrement_sp(2);
         const uint16_t sp = Register::sp();
-        bus_.write(calculate_stack_address(sp), value);
-        last_instruction_cost_ = 15;
+        write_memory(SoftwareTlb::stack, calculate_stack_address(sp), value);
     }
 
     template <uint32_t reg>
-    void _pop_register_16()
+    [[gnu::hot]] void _pop_register_16()
     {
         Register::increment_ip(1);
         const uint16_t sp    = Register::sp();
-        const uint16_t value = bus_.template read<uint16_t>(calculate_stack_address(sp));
+        const uint16_t value = read_memory<uint16_t>(SoftwareTlb::stack, calculate_stack_address(sp));
         set_register_16_by_id<reg>(value);
         Register::increment_sp(2);
-        last_instruction_cost_ = 12;
     }
 
 
@@ -592,10 +1171,8 @@ protected:
         Register::increment_ip(1);
         const uint16_t value = get_segment_register_by_id<reg>();
         Register::decrement_sp(2);
-        const uint16_t sp      = Register::sp();
-        last_instruction_cost_ = 14;
-
-        bus_.write(calculate_stack_address(sp), value);
+        const uint16_t sp = Register::sp();
+        write_memory(SoftwareTlb::stack, calculate_stack_address(sp), value);
     }
 
     void _push_modrm(const ModRM mod)
@@ -604,7 +1181,7 @@ protected:
         const uint16_t value = read_modmr<uint16_t, 24, 15>(mod, disp);
         Register::decrement_sp(2);
         const uint16_t sp = Register::sp();
-        bus_.write(calculate_stack_address(sp), value);
+        write_memory(SoftwareTlb::stack, calculate_stack_address(sp), value);
     }
 
     void _pop_modrm()
@@ -612,7 +1189,7 @@ protected:
         Register::increment_ip(1);
         const auto [disp, mod] = process_modrm();
         const uint16_t sp      = Register::sp();
-        const uint16_t value   = bus_.template read<uint16_t>(calculate_stack_address(sp));
+        const uint16_t value   = read_memory<uint16_t>(SoftwareTlb::stack, calculate_stack_address(sp));
         write_modmr<uint16_t, 25, 12>(mod, disp, value);
         Register::increment_sp(2);
     }
@@ -623,11 +1200,9 @@ protected:
     {
         Register::increment_ip(1);
         const uint16_t sp    = Register::sp();
-        const uint16_t value = bus_.template read<uint16_t>(calculate_stack_address(sp));
+        const uint16_t value = read_memory<uint16_t>(SoftwareTlb::stack, calculate_stack_address(sp));
         set_segment_register_by_id<reg>(value);
         Register::increment_sp(2);
-
-        last_instruction_cost_ = 12;
     }
 
     void _cld()
@@ -636,25 +1211,19 @@ protected:
         Register::flags().d(false);
     }
 
-    void _xor_modrm_from_reg()
-    {
-        Register::increment_ip(1);
-        const auto [offset, mod] = process_modrm();
-        const uint16_t v1        = get_register_16_by_id(mod.reg);
-        const uint16_t v2        = read_modmr<uint8_t>(mod, offset);
-        set_register_16_by_id(mod.reg, v1 ^ v2);
-    }
-
     template <uint32_t reg_id>
-    void _set_section_offset()
+    [[gnu::hot]] void _set_section_offset()
     {
         Register::increment_ip(1);
         section_offset_ = reg_id;
-        const auto *op  = &opcodes_[bus_.template read<uint8_t>(calculate_code_address())];
-        (this->*op->impl)();
+        // prefixed instruction can be one byte longer than the window
+        fetch();
+        dispatch();
+        section_offset_.reset();
     }
 
-    void _aaa()
+    // aaa and aam are hot, the bcd guest benchmark loops over them
+    [[gnu::hot]] void _aaa()
     {
         Register::increment_ip(1);
         uint8_t al = get_register_8_by_id<Register::al_id>();
@@ -665,26 +1234,24 @@ protected:
             set_register_8_by_id<Register::ah_id>(ah + 1);
             Register::flags().ax(1);
             Register::flags().cy(1);
-            set_register_8_by_id<Register::al_id>(al & 0x0f);
         }
         else
         {
             Register::flags().ax(0);
             Register::flags().cy(0);
         }
-        last_instruction_cost_ = 8;
+        set_register_8_by_id<Register::al_id>(al & 0x0f);
     }
 
-    void _aas()
+    [[gnu::cold]] void _aas()
     {
         Register::increment_ip(1);
         uint8_t al = get_register_8_by_id<Register::al_id>();
         if ((al & 0x0f) > 9 || Register::flags().ax())
         {
-            al               = (al - 6) & 0x0f;
+            al -= 6;
             const uint8_t ah = get_register_8_by_id<Register::ah_id>();
             set_register_8_by_id<Register::ah_id>(ah - 1);
-            set_register_8_by_id<Register::al_id>(al);
             Register::flags().cy(1);
             Register::flags().ax(1);
         }
@@ -693,7 +1260,7 @@ protected:
             Register::flags().cy(0);
             Register::flags().ax(0);
         }
-        last_instruction_cost_ = 8;
+        set_register_8_by_id<Register::al_id>(al & 0x0f);
     }
 
     template <typename T>
@@ -711,17 +1278,10 @@ protected:
     template <typename T>
     inline void set_parity_flag(T v)
     {
-        std::bitset<8> b(v & 0xff);
-        Register::flags().p(b.count() % 2 == 0);
+        Register::flags().p(parity_table[v & 0xff] != 0);
     }
 
-    template <typename T>
-    inline void set_auxiliary_flag(T src, T dest, T result)
-    {
-        Register::flags().ax((src ^= dest ^ result) & 0x10);
-    }
-
-    void _aad()
+    [[gnu::cold]] void _aad()
     {
         Register::increment_ip(2);
         uint8_t al       = get_register_8_by_id<Register::al_id>();
@@ -733,11 +1293,9 @@ protected:
         set_sign_flag(al);
         set_zero_flag(al);
         set_parity_flag(al);
-
-        last_instruction_cost_ = 60;
     }
 
-    void _aam()
+    [[gnu::hot]] void _aam()
     {
         Register::increment_ip(2);
         uint8_t al       = get_register_8_by_id<Register::al_id>();
@@ -749,88 +1307,86 @@ protected:
         set_sign_flag(al);
         set_zero_flag(al);
         set_parity_flag(al);
-
-        last_instruction_cost_ = 83;
     }
 
-    template <typename T>
-    inline void set_carry_flag(T result)
+    template <AluOp op, typename T>
+    inline T alu_execute(const T l, const T r)
     {
-        static_assert(std::is_same_v<T, uint16_t> || std::is_same_v<T, uint32_t>,
-                      "Overflow must be checked with higher type than original");
-
-        if constexpr (std::is_same_v<T, uint16_t>)
-        {
-            Register::flags().cy(result & 0xff00);
-        }
-        else if constexpr (std::is_same_v<T, uint32_t>)
-        {
-            Register::flags().cy(result & 0xffff0000);
-        }
+        const AluResult<T> result = alu<op, T>(l, r, Register::flags().cy());
+        Register::flags().arithmetic(result.flags);
+        return result.value;
     }
 
-    template <typename T>
-    inline void set_overflow_flag(T result, T original)
+    // r/m is the destination operand, cmp and test only read it
+    template <AluOp op, typename T, uint8_t mem_cost, uint8_t mem_read_cost, uint8_t reg_cost>
+    inline void alu_to_modrm(const ModRM mod, const uint16_t offset, const T r)
     {
-        if constexpr (std::is_same_v<T, uint8_t>)
+        if (mod.mod < 3)
         {
-            Register::flags().o((result ^ original) & 0x80);
+            const auto address = calculate_memory_address(mod, offset);
+            const T result     = alu_execute<op>(read_memory<T>(tlb_entry(mod), address), r);
+            if constexpr (alu_writes_result(op))
+            {
+                write_memory(tlb_entry(mod), address, result);
+                last_instruction_cost_ = static_cast<uint8_t>(mem_cost + modes.costs[mod.mod][mod.rm]);
+            }
+            else
+            {
+                last_instruction_cost_ = static_cast<uint8_t>(mem_read_cost + modes.costs[mod.mod][mod.rm]);
+            }
+            return;
         }
-        else if constexpr (std::is_same_v<T, uint16_t>)
+
+        const T result = alu_execute<op>(get_register_by_id<T>(mod.rm), r);
+        if constexpr (alu_writes_result(op))
         {
-            Register::flags().o((result ^ original) & 0x8000);
+            set_register_by_id<T>(mod.rm, result);
         }
+        last_instruction_cost_ = reg_cost;
     }
 
-    template <typename T>
-    inline T adc(const T l, const T r)
+    template <AluOp op, typename T>
+    [[gnu::always_inline]] inline void _alu_modrm_reg()
     {
-        using Type  = typename ArithmeticType<T>::type;
-        Type result = r + l;
-        std::cerr << "L: " << std::hex << static_cast<uint16_t>(l) << ", r: " << static_cast<uint16_t>(r)
-                  << ", result: " << static_cast<uint16_t>(result) << std::endl;
-        result += static_cast<Type>(Register::flags().cy());
-        set_auxiliary_flag(l, r, static_cast<T>(result));
-        set_carry_flag(result);
-        set_overflow_flag(static_cast<T>(result), l);
-        set_sign_flag(static_cast<T>(result));
-        set_parity_flag(static_cast<T>(result));
-        set_zero_flag(static_cast<T>(result));
-        return static_cast<T>(result);
+        Register::increment_ip(1);
+        const auto [offset, mod] = process_modrm();
+        alu_to_modrm<op, T, 16, 9, 3>(mod, offset, get_register_by_id<T>(mod.reg));
     }
 
-    template <typename T, uint32_t reg>
-    void _adc_to_register()
+    template <AluOp op, typename T>
+    [[gnu::always_inline]] inline void _alu_reg_modrm()
     {
         Register::increment_ip(1);
-        const T r = bus_.template read<T>(calculate_code_address());
-        Register::increment_ip(sizeof(T));
-        const T l = get_register_by_id<T, reg>();
-
-        set_register_by_id<T, reg>(adc(l, r));
-        last_instruction_cost_ = 4;
+        const auto [offset, mod] = process_modrm();
+        const T r                = read_modmr<T, 9, 3>(mod, offset);
+        const T result           = alu_execute<op>(get_register_by_id<T>(mod.reg), r);
+        if constexpr (alu_writes_result(op))
+        {
+            set_register_by_id<T>(mod.reg, result);
+        }
     }
 
-    template <typename T>
-    void _adc_from_modrm()
+    template <AluOp op, typename T>
+    [[gnu::always_inline]] inline void _alu_acc_imm()
     {
+        constexpr uint32_t reg = sizeof(T) == 1 ? Register::al_id : Register::ax_id;
         Register::increment_ip(1);
-        const auto [offset, mod] = process_modrm();
-        const T l                = get_register_by_id<T>(mod.reg);
-        const T r                = read_modmr<T>(mod, offset);
-
-        set_register_by_id(mod.reg, adc(l, r));
+        const T r      = read_code<T>();
+        const T result = alu_execute<op>(get_register_by_id<T, reg>(), r);
+        if constexpr (alu_writes_result(op))
+        {
+            set_register_by_id<T, reg>(result);
+        }
     }
 
-    template <typename T, typename ImmType>
-    void _adc_modrm_imm(const ModRM mod)
+    template <AluOp op, typename T, typename ImmType>
+    [[gnu::always_inline]] inline void _alu_modrm_imm(const ModRM mod)
     {
+        constexpr bool test = op == AluOp::test_op;
         const uint16_t offset = process_modrm(mod);
-        const T l             = read_modmr<T>(mod, offset);
-        const T r             = bus_.template read<ImmType>(calculate_code_address());
-        Register::increment_ip(sizeof(ImmType));
-
-        write_modmr<T>(mod, offset, adc(l, r));
+        // conversion of signed immediate sign extends it
+        const T r = static_cast<T>(read_code<ImmType>());
+        alu_to_modrm<op, T, 17, test ? 11 : 10, test ? 5 : 4>(mod, offset, r);
     }
 
     struct MoveOperand
@@ -851,10 +1407,32 @@ protected:
         fun impl;
     };
 
+    constexpr static std::array<uint8_t, 256> base_costs = [] {
+        std::array<uint8_t, 256> costs{};
+        for (std::size_t opcode = 0; opcode < costs.size(); ++opcode)
+        {
+            costs[opcode] = opcode_table[opcode].cost;
+        }
+        return costs;
+    }();
+
     Instruction *op_;
     uint8_t last_instruction_cost_;
+    // instructions left for the running loop and for the loops after it
+    uint64_t budget_;
+    uint64_t left_;
+    // not executed because of stop()
+    uint64_t skipped_;
+    bool stopped_;
     std::optional<uint8_t> section_offset_;
     char error_msg_[100];
+    const uint8_t *fetch_window_;
+    uint16_t fetch_ip_;
+    std::array<uint8_t, fetch_window_size> fetch_buffer_;
+    SoftwareTlb tlb_;
+    CodeMap code_map_;
+    HostRange code_range_;
+    ReturnStack return_stack_;
     static inline Instruction opcodes_[256];
     static inline ExtraInstruction grp1_0_opcodes_[8];
     static inline ExtraInstruction grp1_1_opcodes_[8];
@@ -864,6 +1442,7 @@ protected:
     static inline ExtraInstruction grp3b_opcodes_[8];
     static inline ExtraInstruction grp4_opcodes_[8];
     static inline ExtraInstruction grp5_opcodes_[8];
+    uint64_t bus_generation_;
     BusType &bus_;
 };
 
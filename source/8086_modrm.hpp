@@ -19,6 +19,7 @@
 
 #include <array>
 #include <cstdint>
+#include <optional>
 
 #include "8086_registers.hpp"
 
@@ -73,31 +74,28 @@ static inline uint32_t get_code_address(const uint32_t address, std::optional<ui
 {
     if (segment_register)
     {
-        const uint32_t section_modifier = get_segment_register_by_id(*segment_register);
-        return (section_modifier << 4) + address;
+        return physical_address(get_segment_register_by_id(*segment_register), address);
     }
-    return (static_cast<uint32_t>(Register::cs()) << 4) + address;
+    return physical_address(Register::cs(), address);
 }
 
 static inline uint32_t get_data_address(const uint32_t address, std::optional<uint8_t>& segment_register)
 {
     if (segment_register)
     {
-        const uint32_t section_modifier = get_segment_register_by_id(*segment_register);
-        return (section_modifier << 4) + address;
+        return physical_address(get_segment_register_by_id(*segment_register), address);
     }
-    return (static_cast<uint32_t>(Register::ds()) << 4) + address;
+    return physical_address(Register::ds(), address);
 }
 
 static inline uint32_t get_stack_address(const uint32_t address, std::optional<uint8_t>& segment_register)
 {
     if (segment_register)
     {
-        const uint32_t section_modifier = get_segment_register_by_id(*segment_register);
-        return (section_modifier << 4) + address;
+        return physical_address(get_segment_register_by_id(*segment_register), address);
     }
     
-    return (static_cast<uint32_t>(Register::ss()) << 4) + address;
+    return physical_address(Register::ss(), address);
 }
 
 constexpr static inline Modes modes{
@@ -133,7 +131,7 @@ constexpr static inline Modes modes{
                 [](uint16_t, std::optional<uint8_t>& segment_register) -> uint32_t
                 { return get_data_address(Register::di(), segment_register); },
                 [](uint16_t address, std::optional<uint8_t>& segment_register) -> uint32_t
-                { return get_stack_address(address, segment_register); },
+                { return get_data_address(address, segment_register); },
                 [](uint16_t, std::optional<uint8_t>& segment_register) -> uint32_t
                 { return get_data_address(Register::bx(), segment_register); },
             },
@@ -0,0 +1,365 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "8086_registers.hpp"
+
+namespace msemu::cpu8086
+{
+
+namespace flag
+{
+constexpr uint16_t c      = 0x0001;
+constexpr uint16_t p      = 0x0004;
+constexpr uint16_t a      = 0x0010;
+constexpr uint16_t z      = 0x0040;
+constexpr uint16_t s      = 0x0080;
+constexpr uint16_t t      = 0x0100;
+constexpr uint16_t i      = 0x0200;
+constexpr uint16_t d      = 0x0400;
+constexpr uint16_t o      = 0x0800;
+constexpr uint16_t status = c | p | a | z | s | o;
+constexpr uint16_t all    = status | t | i | d;
+} // namespace flag
+
+enum class Prefix : uint8_t
+{
+    none,
+    segment,
+    lock,
+    rep
+};
+
+constexpr uint8_t no_segment = 0xff;
+
+struct OpcodeInfo
+{
+    const char* mnemonic;
+    Prefix prefix;
+    bool modrm;
+    // bytes of immediate, address or displacement after opcode and ModRM
+    uint8_t immediate;
+    // operand width in bytes, 0 without data operand
+    uint8_t width;
+    uint16_t flags_read;
+    uint16_t flags_written;
+    // segment of memory operand without override prefix
+    uint8_t segment;
+    // cycles of register form, effective address calculation and taken
+    // branches are added by the interpreter
+    uint8_t cost;
+};
+
+// opcode, ModRM, 16 bit displacement and 16 bit immediate
+constexpr std::size_t max_instruction_length = 6;
+
+namespace detail
+{
+
+constexpr OpcodeInfo make(const char* mnemonic, const uint8_t width, const uint8_t cost,
+                          const uint8_t immediate = 0)
+{
+    return OpcodeInfo{.mnemonic      = mnemonic,
+                      .prefix        = Prefix::none,
+                      .modrm         = false,
+                      .immediate     = immediate,
+                      .width         = width,
+                      .flags_read    = 0,
+                      .flags_written = 0,
+                      .segment       = no_segment,
+                      .cost          = cost};
+}
+
+constexpr OpcodeInfo make_modrm(const char* mnemonic, const uint8_t width, const uint8_t cost,
+                                const uint8_t immediate = 0)
+{
+    OpcodeInfo info = make(mnemonic, width, cost, immediate);
+    info.modrm      = true;
+    info.segment    = Register::ds_id;
+    return info;
+}
+
+constexpr OpcodeInfo with_flags(OpcodeInfo info, const uint16_t read, const uint16_t written)
+{
+    info.flags_read    = read;
+    info.flags_written = written;
+    return info;
+}
+
+constexpr OpcodeInfo with_segment(OpcodeInfo info, const uint8_t segment)
+{
+    info.segment = segment;
+    return info;
+}
+
+constexpr OpcodeInfo make_prefix(const char* mnemonic, const Prefix prefix)
+{
+    OpcodeInfo info = make(mnemonic, 0, 2);
+    info.prefix     = prefix;
+    return info;
+}
+
+constexpr std::array<OpcodeInfo, 256> make_opcode_table()
+{
+    std::array<OpcodeInfo, 256> table{};
+    table.fill(make("(bad)", 0, 2));
+
+    // add, or, adc, sbb, and, sub, xor, cmp in rows of 8 opcodes
+    constexpr const char* alu[]       = {"add", "or", "adc", "sbb", "and", "sub", "xor", "cmp"};
+    constexpr const char* segment[]   = {"es", "cs", "ss", "ds"};
+    constexpr const char* adjust[]    = {"daa", "das", "aaa", "aas"};
+    constexpr uint8_t adjust_cost[]   = {4, 4, 8, 8};
+    constexpr uint16_t adjust_reads[] = {flag::a | flag::c, flag::a | flag::c, flag::a, flag::a};
+    for (uint8_t row = 0; row < 8; ++row)
+    {
+        const uint8_t base   = static_cast<uint8_t>(row * 8);
+        const uint16_t reads = row == 2 || row == 3 ? flag::c : 0;
+        table[base + 0]      = with_flags(make_modrm(alu[row], 1, 3), reads, flag::status);
+        table[base + 1]      = with_flags(make_modrm(alu[row], 2, 3), reads, flag::status);
+        table[base + 2]      = with_flags(make_modrm(alu[row], 1, 3), reads, flag::status);
+        table[base + 3]      = with_flags(make_modrm(alu[row], 2, 3), reads, flag::status);
+        table[base + 4]      = with_flags(make(alu[row], 1, 4, 1), reads, flag::status);
+        table[base + 5]      = with_flags(make(alu[row], 2, 4, 2), reads, flag::status);
+        if (row < 4)
+        {
+            // push and pop of segment register, pop cs exists only on 8086
+            table[base + 6] = with_segment(make("push", 2, 14), Register::ss_id);
+            table[base + 7] = with_segment(make("pop", 2, 12), Register::ss_id);
+        }
+        else
+        {
+            const uint8_t id = static_cast<uint8_t>(row - 4);
+            table[base + 6]  = make_prefix(segment[id], Prefix::segment);
+            table[base + 7]  = with_flags(make(adjust[id], 1, adjust_cost[id]), adjust_reads[id], flag::status);
+        }
+    }
+
+    for (uint8_t reg = 0; reg < 8; ++reg)
+    {
+        table[0x40 + reg] = with_flags(make("inc", 2, 2), 0, flag::status & ~flag::c);
+        table[0x48 + reg] = with_flags(make("dec", 2, 2), 0, flag::status & ~flag::c);
+        table[0x50 + reg] = with_segment(make("push", 2, 15), Register::ss_id);
+        table[0x58 + reg] = with_segment(make("pop", 2, 12), Register::ss_id);
+        table[0x90 + reg] = make(reg == 0 ? "nop" : "xchg", 2, 3);
+        table[0xb0 + reg] = make("mov", 1, 4, 1);
+        table[0xb8 + reg] = make("mov", 2, 4, 2);
+    }
+
+    // 0x60-0x6f are aliases of conditional jumps on 8086
+    constexpr const char* jcc[]  = {"jo", "jno", "jb", "jae", "je", "jne", "jbe", "ja",
+                                    "js", "jns", "jp", "jnp", "jl", "jge", "jle", "jg"};
+    constexpr uint16_t tested[8] = {flag::o,           flag::c, flag::z, flag::c | flag::z, flag::s, flag::p,
+                                    flag::s | flag::o, flag::z | flag::s | flag::o};
+    for (uint8_t condition = 0; condition < 16; ++condition)
+    {
+        table[0x60 + condition] = with_flags(make(jcc[condition], 0, 4, 1), tested[condition / 2], 0);
+        table[0x70 + condition] = table[0x60 + condition];
+    }
+
+    // group 1, operation selected by reg field of ModRM
+    table[0x80] = with_flags(make_modrm("grp1", 1, 4, 1), flag::c, flag::status);
+    table[0x81] = with_flags(make_modrm("grp1", 2, 4, 2), flag::c, flag::status);
+    table[0x82] = with_flags(make_modrm("grp1", 1, 4, 1), flag::c, flag::status);
+    table[0x83] = with_flags(make_modrm("grp1", 2, 4, 1), flag::c, flag::status);
+    table[0x84] = with_flags(make_modrm("test", 1, 3), 0, flag::status);
+    table[0x85] = with_flags(make_modrm("test", 2, 3), 0, flag::status);
+    table[0x86] = make_modrm("xchg", 1, 4);
+    table[0x87] = make_modrm("xchg", 2, 4);
+    table[0x88] = make_modrm("mov", 1, 2);
+    table[0x89] = make_modrm("mov", 2, 2);
+    table[0x8a] = make_modrm("mov", 1, 2);
+    table[0x8b] = make_modrm("mov", 2, 2);
+    table[0x8c] = make_modrm("mov", 2, 2);
+    table[0x8d] = with_segment(make_modrm("lea", 2, 2), no_segment);
+    table[0x8e] = make_modrm("mov", 2, 2);
+    table[0x8f] = make_modrm("pop", 2, 12);
+
+    table[0x98] = make("cbw", 2, 2);
+    table[0x99] = make("cwd", 2, 5);
+    table[0x9a] = with_segment(make("call", 0, 28, 4), Register::ss_id);
+    table[0x9b] = make("wait", 0, 4);
+    table[0x9c] = with_segment(with_flags(make("pushf", 2, 10), flag::all, 0), Register::ss_id);
+    table[0x9d] = with_segment(with_flags(make("popf", 2, 8), 0, flag::all), Register::ss_id);
+    table[0x9e] = with_flags(make("sahf", 1, 4), 0, flag::status & ~flag::o);
+    table[0x9f] = with_flags(make("lahf", 1, 4), flag::status & ~flag::o, 0);
+
+    table[0xa0] = with_segment(make("mov", 1, 14, 2), Register::ds_id);
+    table[0xa1] = with_segment(make("mov", 2, 14, 2), Register::ds_id);
+    table[0xa2] = with_segment(make("mov", 1, 14, 2), Register::ds_id);
+    table[0xa3] = with_segment(make("mov", 2, 14, 2), Register::ds_id);
+    table[0xa4] = with_segment(with_flags(make("movsb", 1, 18), flag::d, 0), Register::ds_id);
+    table[0xa5] = with_segment(with_flags(make("movsw", 2, 18), flag::d, 0), Register::ds_id);
+    table[0xa6] = with_segment(with_flags(make("cmpsb", 1, 22), flag::d, flag::status), Register::ds_id);
+    table[0xa7] = with_segment(with_flags(make("cmpsw", 2, 22), flag::d, flag::status), Register::ds_id);
+    table[0xa8] = with_flags(make("test", 1, 4, 1), 0, flag::status);
+    table[0xa9] = with_flags(make("test", 2, 4, 2), 0, flag::status);
+    table[0xaa] = with_segment(with_flags(make("stosb", 1, 11), flag::d, 0), Register::es_id);
+    table[0xab] = with_segment(with_flags(make("stosw", 2, 11), flag::d, 0), Register::es_id);
+    table[0xac] = with_segment(with_flags(make("lodsb", 1, 12), flag::d, 0), Register::ds_id);
+    table[0xad] = with_segment(with_flags(make("lodsw", 2, 12), flag::d, 0), Register::ds_id);
+    table[0xae] = with_segment(with_flags(make("scasb", 1, 15), flag::d, flag::status), Register::es_id);
+    table[0xaf] = with_segment(with_flags(make("scasw", 2, 15), flag::d, flag::status), Register::es_id);
+
+    // 0xc0, 0xc1, 0xc8 and 0xc9 are aliases of returns on 8086
+    for (const std::size_t base : {0xc0u, 0xc8u})
+    {
+        const bool far      = base == 0xc8;
+        const char* name    = far ? "retf" : "ret";
+        table[base + 0]     = with_segment(make(name, 0, far ? 17 : 12, 2), Register::ss_id);
+        table[base + 1]     = with_segment(make(name, 0, far ? 18 : 8), Register::ss_id);
+        table[base + 2]     = table[base + 0];
+        table[base + 3]     = table[base + 1];
+    }
+    table[0xc4] = make_modrm("les", 2, 16);
+    table[0xc5] = make_modrm("lds", 2, 16);
+    table[0xc6] = make_modrm("mov", 1, 4, 1);
+    table[0xc7] = make_modrm("mov", 2, 4, 2);
+    // interrupts push flags and clear trap and interrupt flag
+    constexpr uint16_t cleared = flag::t | flag::i;
+    table[0xcc] = with_segment(with_flags(make("int3", 0, 52), flag::all, cleared), Register::ss_id);
+    table[0xcd] = with_segment(with_flags(make("int", 0, 51, 1), flag::all, cleared), Register::ss_id);
+    table[0xce] = with_segment(with_flags(make("into", 0, 4), flag::all, 0), Register::ss_id);
+    table[0xcf] = with_segment(with_flags(make("iret", 0, 24), 0, flag::all), Register::ss_id);
+
+    // group 2, rotates write only carry and overflow, rcl and rcr read carry
+    table[0xd0] = with_flags(make_modrm("grp2", 1, 2), flag::c, flag::c | flag::o);
+    table[0xd1] = with_flags(make_modrm("grp2", 2, 2), flag::c, flag::c | flag::o);
+    // count in cl may be 0, which leaves all flags as they were
+    table[0xd2] = with_flags(make_modrm("grp2", 1, 8), flag::c, 0);
+    table[0xd3] = with_flags(make_modrm("grp2", 2, 8), flag::c, 0);
+    table[0xd4] = with_flags(make("aam", 1, 83, 1), 0, flag::status);
+    table[0xd5] = with_flags(make("aad", 1, 60, 1), 0, flag::status);
+    table[0xd6] = with_flags(make("salc", 1, 4), flag::c, 0);
+    table[0xd7] = with_segment(make("xlat", 1, 11), Register::ds_id);
+    for (uint8_t escape = 0xd8; escape <= 0xdf; ++escape)
+    {
+        table[escape] = make_modrm("esc", 0, 2);
+    }
+
+    table[0xe0] = with_flags(make("loopnz", 0, 5, 1), flag::z, 0);
+    table[0xe1] = with_flags(make("loopz", 0, 6, 1), flag::z, 0);
+    table[0xe2] = make("loop", 0, 5, 1);
+    table[0xe3] = make("jcxz", 0, 6, 1);
+    table[0xe4] = make("in", 1, 10, 1);
+    table[0xe5] = make("in", 2, 10, 1);
+    table[0xe6] = make("out", 1, 10, 1);
+    table[0xe7] = make("out", 2, 10, 1);
+    table[0xe8] = with_segment(make("call", 0, 19, 2), Register::ss_id);
+    table[0xe9] = make("jmp", 0, 15, 2);
+    table[0xea] = make("jmp", 0, 15, 4);
+    table[0xeb] = make("jmp", 0, 15, 1);
+    table[0xec] = make("in", 1, 8);
+    table[0xed] = make("in", 2, 8);
+    table[0xee] = make("out", 1, 8);
+    table[0xef] = make("out", 2, 8);
+
+    // 0xf1 is alias of lock on 8086
+    table[0xf0] = make_prefix("lock", Prefix::lock);
+    table[0xf1] = make_prefix("lock", Prefix::lock);
+    table[0xf2] = make_prefix("repnz", Prefix::rep);
+    table[0xf3] = make_prefix("rep", Prefix::rep);
+    table[0xf4] = make("hlt", 0, 2);
+    table[0xf5] = with_flags(make("cmc", 0, 2), flag::c, flag::c);
+    // group 3, test has immediate of operand width, see instruction_length()
+    table[0xf6] = make_modrm("grp3", 1, 3);
+    table[0xf7] = make_modrm("grp3", 2, 3);
+    table[0xf8] = with_flags(make("clc", 0, 2), 0, flag::c);
+    table[0xf9] = with_flags(make("stc", 0, 2), 0, flag::c);
+    table[0xfa] = with_flags(make("cli", 0, 2), 0, flag::i);
+    table[0xfb] = with_flags(make("sti", 0, 2), 0, flag::i);
+    table[0xfc] = with_flags(make("cld", 0, 2), 0, flag::d);
+    table[0xfd] = with_flags(make("std", 0, 2), 0, flag::d);
+    // group 4 is inc and dec, group 5 also calls, jumps and pushes
+    table[0xfe] = with_flags(make_modrm("grp4", 1, 3), 0, flag::status & ~flag::c);
+    table[0xff] = make_modrm("grp5", 2, 3);
+    return table;
+}
+
+} // namespace detail
+
+// Static description of every 8086 opcode. Encoding is known only here, the
+// disassembler, lockstep reports and length decoding derive from it, the
+// interpreter takes displacement sizes and costs of register forms from it.
+//
+// Group opcodes (0x80-0x83, 0xd0-0xd3, 0xf6, 0xf7, 0xfe, 0xff) select the
+// operation with reg field of ModRM. Their flags_read is union and
+// flags_written intersection of what the members do. flags_written holds only
+// flags written by every execution, so analyses based on the table stay
+// conservative.
+constexpr std::array<OpcodeInfo, 256> opcode_table = detail::make_opcode_table();
+
+// Bytes of displacement which follow ModRM byte.
+constexpr std::size_t displacement_size(const uint8_t modrm)
+{
+    const uint8_t mod = modrm >> 6;
+    const uint8_t rm  = modrm & 0x07;
+    if (mod == 0)
+    {
+        return rm == 6 ? 2 : 0;
+    }
+    return mod == 3 ? 0 : mod;
+}
+
+// Bytes of ModRM, displacement and immediate which follow opcode, modrm is
+// not looked at unless the opcode has ModRM byte.
+constexpr std::size_t operands_length(const uint8_t opcode, const uint8_t modrm)
+{
+    const auto& info   = opcode_table[opcode];
+    std::size_t length = info.immediate;
+    if (info.modrm)
+    {
+        length += 1 + displacement_size(modrm);
+        // test, reg 1 is undocumented alias of reg 0
+        if ((opcode == 0xf6 || opcode == 0xf7) && ((modrm >> 3) & 0x07) < 2)
+        {
+            length += info.width;
+        }
+    }
+    return length;
+}
+
+// Length of instruction at the beginning of bytes including its prefixes,
+// 0 when bytes end before the instruction does.
+constexpr std::size_t instruction_length(const std::span<const uint8_t> bytes)
+{
+    std::size_t length = 0;
+    while (length < bytes.size() && opcode_table[bytes[length]].prefix != Prefix::none)
+    {
+        ++length;
+    }
+    if (length == bytes.size())
+    {
+        return 0;
+    }
+
+    const uint8_t opcode = bytes[length];
+    if (opcode_table[opcode].modrm && length + 1 == bytes.size())
+    {
+        return 0;
+    }
+    const uint8_t modrm = length + 1 < bytes.size() ? bytes[length + 1] : 0;
+    length += 1 + operands_length(opcode, modrm);
+    return length <= bytes.size() ? length : 0;
+}
+
+} // namespace msemu::cpu8086
@@ -0,0 +1,1447 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "8086_registers.hpp"
+#include "8086_state.hpp"
+
+namespace msemu::cpu8086
+{
+
+// Golden model of the 8086 used to check the fast Cpu.
+// It is deliberately naive: one switch, own register file, every memory
+// access is done byte by byte through the bus and nothing is cached, so it
+// shares no code with the paths it is supposed to verify. Do not optimise it.
+//
+// Where the core tests pin a behaviour that differs between CPU generations
+// (PUSH SP / POP SP) the model follows the core.
+template <typename BusType>
+class ReferenceCpu
+{
+public:
+    enum class Status
+    {
+        ok,
+        halted,
+        unsupported
+    };
+
+    constexpr static uint16_t cf  = 0x0001;
+    constexpr static uint16_t pf  = 0x0004;
+    constexpr static uint16_t af  = 0x0010;
+    constexpr static uint16_t zf  = 0x0040;
+    constexpr static uint16_t sf  = 0x0080;
+    constexpr static uint16_t tf  = 0x0100;
+    constexpr static uint16_t if_ = 0x0200;
+    constexpr static uint16_t df  = 0x0400;
+    constexpr static uint16_t of  = 0x0800;
+
+    constexpr static uint16_t arithmetic_flags = cf | pf | af | zf | sf | of;
+
+    ReferenceCpu(BusType& bus)
+        : bus_(bus)
+        , state_{}
+        , status_{Status::ok}
+        , undefined_flags_{0}
+        , segment_{}
+        , rep_{Rep::none}
+    {
+    }
+
+    void reset(const CpuState& state)
+    {
+        state_       = state;
+        state_.flags = state.flags & Flags::defined_mask;
+        status_      = Status::ok;
+    }
+
+    CpuState& state()
+    {
+        return state_;
+    }
+
+    const CpuState& state() const
+    {
+        return state_;
+    }
+
+    Status status() const
+    {
+        return status_;
+    }
+
+    // flags which the last instruction left architecturally undefined
+    uint16_t undefined_flags() const
+    {
+        return undefined_flags_;
+    }
+
+    Status step()
+    {
+        if (status_ == Status::halted)
+        {
+            return status_;
+        }
+
+        const CpuState before = state_;
+        undefined_flags_      = 0;
+        segment_.reset();
+        rep_ = Rep::none;
+
+        uint8_t opcode = fetch8();
+        while (is_prefix(opcode))
+        {
+            opcode = fetch8();
+        }
+
+        status_ = execute(opcode);
+        if (status_ == Status::unsupported)
+        {
+            state_ = before;
+        }
+        return status_;
+    }
+
+private:
+    enum class Rep
+    {
+        none,
+        rep,
+        repnz
+    };
+
+    struct Operand
+    {
+        bool is_register;
+        uint8_t id;
+        uint16_t segment;
+        uint16_t offset;
+    };
+
+    struct ModRMOperands
+    {
+        uint8_t reg;
+        Operand rm;
+    };
+
+    template <typename T>
+    constexpr static uint32_t sign_bit = sizeof(T) == 1 ? 0x80 : 0x8000;
+
+    template <typename T>
+    constexpr static uint32_t mask = sizeof(T) == 1 ? 0xff : 0xffff;
+
+    bool is_prefix(const uint8_t opcode)
+    {
+        switch (opcode)
+        {
+            case 0x26:
+            case 0x2e:
+            case 0x36:
+            case 0x3e:
+                segment_ = static_cast<uint8_t>((opcode >> 3) & 0x03);
+                return true;
+            case 0xf0:
+                return true;
+            case 0xf2:
+                rep_ = Rep::repnz;
+                return true;
+            case 0xf3:
+                rep_ = Rep::rep;
+                return true;
+        }
+        return false;
+    }
+
+    // registers
+
+    uint16_t& reg16(const uint8_t id)
+    {
+        return state_.regs[id];
+    }
+
+    uint16_t& sreg(const uint8_t id)
+    {
+        return state_.sregs[id];
+    }
+
+    template <typename T>
+    T get_reg(const uint8_t id) const
+    {
+        if constexpr (sizeof(T) == 1)
+        {
+            const uint16_t value = state_.regs[id & 0x03];
+            return static_cast<T>(id < 4 ? value & 0xff : value >> 8);
+        }
+        else
+        {
+            return state_.regs[id];
+        }
+    }
+
+    template <typename T>
+    void set_reg(const uint8_t id, const T value)
+    {
+        if constexpr (sizeof(T) == 1)
+        {
+            uint16_t& r = state_.regs[id & 0x03];
+            if (id < 4)
+            {
+                r = static_cast<uint16_t>((r & 0xff00) | value);
+            }
+            else
+            {
+                r = static_cast<uint16_t>((r & 0x00ff) | (value << 8));
+            }
+        }
+        else
+        {
+            state_.regs[id] = value;
+        }
+    }
+
+    bool flag(const uint16_t f) const
+    {
+        return state_.flags & f;
+    }
+
+    void set_flag(const uint16_t f, const bool value)
+    {
+        if (value)
+        {
+            state_.flags = static_cast<uint16_t>(state_.flags | f);
+        }
+        else
+        {
+            state_.flags = static_cast<uint16_t>(state_.flags & ~f);
+        }
+    }
+
+    // memory
+
+    static uint32_t physical(const uint16_t segment, const uint16_t offset)
+    {
+        return physical_address(segment, offset) & 0xfffff;
+    }
+
+    uint8_t read8(const uint16_t segment, const uint16_t offset)
+    {
+        return bus_.template read<uint8_t>(physical(segment, offset));
+    }
+
+    uint16_t read16(const uint16_t segment, const uint16_t offset)
+    {
+        const uint8_t low  = read8(segment, offset);
+        const uint8_t high = read8(segment, static_cast<uint16_t>(offset + 1));
+        return static_cast<uint16_t>(high << 8 | low);
+    }
+
+    void write8(const uint16_t segment, const uint16_t offset, const uint8_t value)
+    {
+        bus_.write(physical(segment, offset), value);
+    }
+
+    void write16(const uint16_t segment, const uint16_t offset, const uint16_t value)
+    {
+        write8(segment, offset, static_cast<uint8_t>(value & 0xff));
+        write8(segment, static_cast<uint16_t>(offset + 1), static_cast<uint8_t>(value >> 8));
+    }
+
+    template <typename T>
+    T read(const uint16_t segment, const uint16_t offset)
+    {
+        if constexpr (sizeof(T) == 1)
+        {
+            return read8(segment, offset);
+        }
+        else
+        {
+            return read16(segment, offset);
+        }
+    }
+
+    template <typename T>
+    void write(const uint16_t segment, const uint16_t offset, const T value)
+    {
+        if constexpr (sizeof(T) == 1)
+        {
+            write8(segment, offset, value);
+        }
+        else
+        {
+            write16(segment, offset, value);
+        }
+    }
+
+    uint8_t fetch8()
+    {
+        const uint8_t value = read8(sreg(Register::cs_id), state_.ip);
+        state_.ip           = static_cast<uint16_t>(state_.ip + 1);
+        return value;
+    }
+
+    uint16_t fetch16()
+    {
+        const uint8_t low  = fetch8();
+        const uint8_t high = fetch8();
+        return static_cast<uint16_t>(high << 8 | low);
+    }
+
+    template <typename T>
+    T fetch()
+    {
+        if constexpr (sizeof(T) == 1)
+        {
+            return fetch8();
+        }
+        else
+        {
+            return fetch16();
+        }
+    }
+
+    uint16_t data_segment()
+    {
+        return sreg(segment_ ? *segment_ : static_cast<uint8_t>(Register::ds_id));
+    }
+
+    void push(const uint16_t value)
+    {
+        reg16(Register::sp_id) = static_cast<uint16_t>(reg16(Register::sp_id) - 2);
+        write16(sreg(Register::ss_id), reg16(Register::sp_id), value);
+    }
+
+    uint16_t pop()
+    {
+        const uint16_t value   = read16(sreg(Register::ss_id), reg16(Register::sp_id));
+        reg16(Register::sp_id) = static_cast<uint16_t>(reg16(Register::sp_id) + 2);
+        return value;
+    }
+
+    uint16_t flags_image() const
+    {
+        return static_cast<uint16_t>((state_.flags & Flags::defined_mask) | 0xf002);
+    }
+
+    // operands
+
+    ModRMOperands decode_modrm()
+    {
+        const uint8_t modrm = fetch8();
+        const uint8_t mod   = static_cast<uint8_t>(modrm >> 6);
+        const uint8_t reg   = static_cast<uint8_t>((modrm >> 3) & 0x07);
+        const uint8_t rm    = static_cast<uint8_t>(modrm & 0x07);
+
+        if (mod == 3)
+        {
+            return ModRMOperands{reg, Operand{true, rm, 0, 0}};
+        }
+
+        uint8_t segment = Register::ds_id;
+        uint16_t offset = 0;
+        switch (rm)
+        {
+            case 0:
+                offset = static_cast<uint16_t>(reg16(Register::bx_id) + reg16(Register::si_id));
+                break;
+            case 1:
+                offset = static_cast<uint16_t>(reg16(Register::bx_id) + reg16(Register::di_id));
+                break;
+            case 2:
+                offset  = static_cast<uint16_t>(reg16(Register::bp_id) + reg16(Register::si_id));
+                segment = Register::ss_id;
+                break;
+            case 3:
+                offset  = static_cast<uint16_t>(reg16(Register::bp_id) + reg16(Register::di_id));
+                segment = Register::ss_id;
+                break;
+            case 4:
+                offset = reg16(Register::si_id);
+                break;
+            case 5:
+                offset = reg16(Register::di_id);
+                break;
+            case 6:
+                if (mod == 0)
+                {
+                    offset = fetch16();
+                }
+                else
+                {
+                    offset  = reg16(Register::bp_id);
+                    segment = Register::ss_id;
+                }
+                break;
+            case 7:
+                offset = reg16(Register::bx_id);
+                break;
+        }
+
+        if (mod == 1)
+        {
+            const int8_t displacement = static_cast<int8_t>(fetch8());
+            offset                    = static_cast<uint16_t>(offset + displacement);
+        }
+        else if (mod == 2)
+        {
+            offset = static_cast<uint16_t>(offset + fetch16());
+        }
+
+        if (segment_)
+        {
+            segment = *segment_;
+        }
+        return ModRMOperands{reg, Operand{false, 0, sreg(segment), offset}};
+    }
+
+    template <typename T>
+    T read_operand(const Operand& op)
+    {
+        if (op.is_register)
+        {
+            return get_reg<T>(op.id);
+        }
+        return read<T>(op.segment, op.offset);
+    }
+
+    template <typename T>
+    void write_operand(const Operand& op, const T value)
+    {
+        if (op.is_register)
+        {
+            set_reg<T>(op.id, value);
+            return;
+        }
+        write<T>(op.segment, op.offset, value);
+    }
+
+    // flags helpers
+
+    static bool parity(uint8_t value)
+    {
+        value ^= static_cast<uint8_t>(value >> 4);
+        value ^= static_cast<uint8_t>(value >> 2);
+        value ^= static_cast<uint8_t>(value >> 1);
+        return !(value & 1);
+    }
+
+    template <typename T>
+    void set_szp(const uint32_t result)
+    {
+        const T value = static_cast<T>(result);
+        set_flag(zf, value == 0);
+        set_flag(sf, value & sign_bit<T>);
+        set_flag(pf, parity(static_cast<uint8_t>(value & 0xff)));
+    }
+
+    template <typename T>
+    T add(const T l, const T r, const bool carry)
+    {
+        const uint32_t result = static_cast<uint32_t>(l) + r + carry;
+        set_flag(cf, result > mask<T>);
+        set_flag(af, (l ^ r ^ result) & 0x10);
+        set_flag(of, (l ^ result) & (r ^ result) & sign_bit<T>);
+        set_szp<T>(result);
+        return static_cast<T>(result);
+    }
+
+    template <typename T>
+    T sub(const T l, const T r, const bool borrow)
+    {
+        const uint32_t result = static_cast<uint32_t>(l) - r - borrow;
+        set_flag(cf, static_cast<uint32_t>(l) < static_cast<uint32_t>(r) + borrow);
+        set_flag(af, (l ^ r ^ result) & 0x10);
+        set_flag(of, (l ^ r) & (l ^ result) & sign_bit<T>);
+        set_szp<T>(result);
+        return static_cast<T>(result);
+    }
+
+    template <typename T>
+    T logic(const T result)
+    {
+        set_flag(cf, false);
+        set_flag(of, false);
+        set_flag(af, false);
+        undefined_flags_ |= af;
+        set_szp<T>(result);
+        return result;
+    }
+
+    template <typename T>
+    T alu(const uint8_t op, const T l, const T r)
+    {
+        switch (op)
+        {
+            case 0:
+                return add<T>(l, r, false);
+            case 1:
+                return logic<T>(static_cast<T>(l | r));
+            case 2:
+                return add<T>(l, r, flag(cf));
+            case 3:
+                return sub<T>(l, r, flag(cf));
+            case 4:
+                return logic<T>(static_cast<T>(l & r));
+            case 5:
+            case 7:
+                return sub<T>(l, r, false);
+            case 6:
+                return logic<T>(static_cast<T>(l ^ r));
+        }
+        return l;
+    }
+
+    template <typename T>
+    void alu_modrm(const uint8_t op, const bool to_register)
+    {
+        const auto [reg, rm] = decode_modrm();
+        if (to_register)
+        {
+            const T result = alu<T>(op, get_reg<T>(reg), read_operand<T>(rm));
+            if (op != 7)
+            {
+                set_reg<T>(reg, result);
+            }
+            return;
+        }
+        const T result = alu<T>(op, read_operand<T>(rm), get_reg<T>(reg));
+        if (op != 7)
+        {
+            write_operand<T>(rm, result);
+        }
+    }
+
+    template <typename T>
+    void alu_accumulator(const uint8_t op)
+    {
+        const T imm    = fetch<T>();
+        const T result = alu<T>(op, get_reg<T>(0), imm);
+        if (op != 7)
+        {
+            set_reg<T>(0, result);
+        }
+    }
+
+    template <typename T, typename ImmType>
+    void alu_group()
+    {
+        const auto [op, rm] = decode_modrm();
+        const T l           = read_operand<T>(rm);
+        const T r           = static_cast<T>(static_cast<std::make_signed_t<ImmType>>(fetch<ImmType>()));
+        const T result      = alu<T>(op, l, r);
+        if (op != 7)
+        {
+            write_operand<T>(rm, result);
+        }
+    }
+
+    template <typename T>
+    T inc_dec(const T value, const bool decrement)
+    {
+        const bool carry = flag(cf);
+        const T result   = decrement ? sub<T>(value, 1, false) : add<T>(value, 1, false);
+        set_flag(cf, carry);
+        return result;
+    }
+
+    template <typename T>
+    T shift(const uint8_t op, const T value, const uint8_t count)
+    {
+        if (count == 0)
+        {
+            return value;
+        }
+
+        uint32_t v = value;
+        bool carry = flag(cf);
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            bool next = carry;
+            switch (op)
+            {
+                case 0:
+                    carry = v & sign_bit<T>;
+                    v     = ((v << 1) | carry) & mask<T>;
+                    break;
+                case 1:
+                    carry = v & 1;
+                    v     = (v >> 1) | (carry ? sign_bit<T> : 0);
+                    break;
+                case 2:
+                    next  = v & sign_bit<T>;
+                    v     = ((v << 1) | carry) & mask<T>;
+                    carry = next;
+                    break;
+                case 3:
+                    next  = v & 1;
+                    v     = (v >> 1) | (carry ? sign_bit<T> : 0);
+                    carry = next;
+                    break;
+                case 4:
+                    carry = v & sign_bit<T>;
+                    v     = (v << 1) & mask<T>;
+                    break;
+                case 5:
+                    carry = v & 1;
+                    v     = v >> 1;
+                    break;
+                case 7:
+                    carry = v & 1;
+                    v     = (v >> 1) | (v & sign_bit<T>);
+                    break;
+            }
+        }
+
+        set_flag(cf, carry);
+        const bool msb = v & sign_bit<T>;
+        switch (op)
+        {
+            case 0:
+            case 2:
+            case 4:
+                set_flag(of, msb != carry);
+                break;
+            case 1:
+            case 3:
+                set_flag(of, msb != static_cast<bool>(v & (sign_bit<T> >> 1)));
+                break;
+            case 5:
+                set_flag(of, value & sign_bit<T>);
+                break;
+            case 7:
+                set_flag(of, false);
+                break;
+        }
+        if (count != 1)
+        {
+            undefined_flags_ |= of;
+        }
+        if (op >= 4)
+        {
+            set_szp<T>(v);
+            undefined_flags_ |= af;
+        }
+        return static_cast<T>(v);
+    }
+
+    template <typename T>
+    Status group2(const bool by_cl)
+    {
+        const auto [op, rm] = decode_modrm();
+        if (op == 6)
+        {
+            return Status::unsupported;
+        }
+        const uint8_t count = by_cl ? get_reg<uint8_t>(Register::cl_id) : 1;
+        write_operand<T>(rm, shift<T>(op, read_operand<T>(rm), count));
+        return Status::ok;
+    }
+
+    template <typename T>
+    Status group3()
+    {
+        using Wide         = std::conditional_t<sizeof(T) == 1, uint16_t, uint32_t>;
+        using Signed       = std::make_signed_t<T>;
+        using SignedWide   = std::make_signed_t<Wide>;
+        constexpr int bits = sizeof(T) * 8;
+
+        const auto [op, rm] = decode_modrm();
+        const T value       = read_operand<T>(rm);
+        const Wide acc      = sizeof(T) == 1
+                                  ? get_reg<uint16_t>(Register::ax_id)
+                                  : static_cast<Wide>(static_cast<uint32_t>(get_reg<uint16_t>(Register::dx_id))
+                                                           << 16 |
+                                                      get_reg<uint16_t>(Register::ax_id));
+
+        const auto store_wide = [this](const Wide result) {
+            if constexpr (sizeof(T) == 1)
+            {
+                set_reg<uint16_t>(Register::ax_id, result);
+            }
+            else
+            {
+                set_reg<uint16_t>(Register::ax_id, static_cast<uint16_t>(result & 0xffff));
+                set_reg<uint16_t>(Register::dx_id, static_cast<uint16_t>(result >> 16));
+            }
+        };
+        const auto store_pair = [this](const T quotient, const T remainder) {
+            if constexpr (sizeof(T) == 1)
+            {
+                set_reg<uint8_t>(Register::al_id, quotient);
+                set_reg<uint8_t>(Register::ah_id, remainder);
+            }
+            else
+            {
+                set_reg<uint16_t>(Register::ax_id, quotient);
+                set_reg<uint16_t>(Register::dx_id, remainder);
+            }
+        };
+
+        switch (op)
+        {
+            case 0:
+                logic<T>(static_cast<T>(value & fetch<T>()));
+                return Status::ok;
+            case 2:
+                write_operand<T>(rm, static_cast<T>(~value));
+                return Status::ok;
+            case 3:
+                write_operand<T>(rm, sub<T>(0, value, false));
+                return Status::ok;
+            case 4:
+            {
+                const Wide result = static_cast<Wide>(static_cast<Wide>(get_reg<T>(0)) * value);
+                store_wide(result);
+                set_flag(cf, result >> bits);
+                set_flag(of, result >> bits);
+                undefined_flags_ |= sf | zf | af | pf;
+                return Status::ok;
+            }
+            case 5:
+            {
+                const SignedWide result = static_cast<SignedWide>(static_cast<Signed>(get_reg<T>(0)) *
+                                                                  static_cast<Signed>(value));
+                store_wide(static_cast<Wide>(result));
+                const bool fits = result == static_cast<Signed>(result);
+                set_flag(cf, !fits);
+                set_flag(of, !fits);
+                undefined_flags_ |= sf | zf | af | pf;
+                return Status::ok;
+            }
+            case 6:
+            {
+                undefined_flags_ |= arithmetic_flags;
+                if (value == 0 || acc / value > mask<T>)
+                {
+                    interrupt(0);
+                    return Status::ok;
+                }
+                store_pair(static_cast<T>(acc / value), static_cast<T>(acc % value));
+                return Status::ok;
+            }
+            case 7:
+            {
+                undefined_flags_ |= arithmetic_flags;
+                const SignedWide dividend = static_cast<SignedWide>(acc);
+                const Signed divisor      = static_cast<Signed>(value);
+                if (divisor == 0)
+                {
+                    interrupt(0);
+                    return Status::ok;
+                }
+                const int64_t quotient = static_cast<int64_t>(dividend) / divisor;
+                if (quotient != static_cast<Signed>(quotient))
+                {
+                    interrupt(0);
+                    return Status::ok;
+                }
+                store_pair(static_cast<T>(quotient), static_cast<T>(static_cast<int64_t>(dividend) % divisor));
+                return Status::ok;
+            }
+        }
+        return Status::unsupported;
+    }
+
+    // control flow
+
+    void interrupt(const uint8_t vector)
+    {
+        push(flags_image());
+        set_flag(if_, false);
+        set_flag(tf, false);
+        push(sreg(Register::cs_id));
+        push(state_.ip);
+        const uint16_t offset = static_cast<uint16_t>(vector * 4);
+        state_.ip             = read16(0, offset);
+        sreg(Register::cs_id) = read16(0, static_cast<uint16_t>(offset + 2));
+    }
+
+    void jump_relative(const int16_t displacement)
+    {
+        state_.ip = static_cast<uint16_t>(state_.ip + displacement);
+    }
+
+    bool condition(const uint8_t cc) const
+    {
+        bool result = false;
+        switch (cc >> 1)
+        {
+            case 0:
+                result = flag(of);
+                break;
+            case 1:
+                result = flag(cf);
+                break;
+            case 2:
+                result = flag(zf);
+                break;
+            case 3:
+                result = flag(cf) || flag(zf);
+                break;
+            case 4:
+                result = flag(sf);
+                break;
+            case 5:
+                result = flag(pf);
+                break;
+            case 6:
+                result = flag(sf) != flag(of);
+                break;
+            case 7:
+                result = flag(zf) || (flag(sf) != flag(of));
+                break;
+        }
+        return (cc & 1) ? !result : result;
+    }
+
+    // strings
+
+    template <typename T>
+    void string_iteration(const uint8_t opcode)
+    {
+        const uint16_t delta = static_cast<uint16_t>(flag(df) ? -sizeof(T) : sizeof(T));
+        uint16_t& si         = reg16(Register::si_id);
+        uint16_t& di         = reg16(Register::di_id);
+        const uint16_t es    = sreg(Register::es_id);
+
+        switch (opcode & 0xfe)
+        {
+            case 0xa4:
+                write<T>(es, di, read<T>(data_segment(), si));
+                si = static_cast<uint16_t>(si + delta);
+                di = static_cast<uint16_t>(di + delta);
+                break;
+            case 0xa6:
+                sub<T>(read<T>(data_segment(), si), read<T>(es, di), false);
+                si = static_cast<uint16_t>(si + delta);
+                di = static_cast<uint16_t>(di + delta);
+                break;
+            case 0xaa:
+                write<T>(es, di, get_reg<T>(0));
+                di = static_cast<uint16_t>(di + delta);
+                break;
+            case 0xac:
+                set_reg<T>(0, read<T>(data_segment(), si));
+                si = static_cast<uint16_t>(si + delta);
+                break;
+            case 0xae:
+                sub<T>(get_reg<T>(0), read<T>(es, di), false);
+                di = static_cast<uint16_t>(di + delta);
+                break;
+        }
+    }
+
+    template <typename T>
+    void string_op(const uint8_t opcode)
+    {
+        if (rep_ == Rep::none)
+        {
+            string_iteration<T>(opcode);
+            return;
+        }
+
+        const bool compares = (opcode & 0xfe) == 0xa6 || (opcode & 0xfe) == 0xae;
+        uint16_t& cx        = reg16(Register::cx_id);
+        while (cx != 0)
+        {
+            string_iteration<T>(opcode);
+            cx = static_cast<uint16_t>(cx - 1);
+            if (compares && (rep_ == Rep::rep) != flag(zf))
+            {
+                break;
+            }
+        }
+    }
+
+    // decimal adjust
+
+    void daa(const bool subtract)
+    {
+        const uint8_t old_al = get_reg<uint8_t>(Register::al_id);
+        const bool old_cf    = flag(cf);
+        uint8_t al           = old_al;
+        set_flag(cf, false);
+        if ((al & 0x0f) > 9 || flag(af))
+        {
+            const bool carry = subtract ? al < 6 : al > 0xf9;
+            al               = static_cast<uint8_t>(subtract ? al - 6 : al + 6);
+            set_flag(cf, old_cf || carry);
+            set_flag(af, true);
+        }
+        else
+        {
+            set_flag(af, false);
+        }
+
+        if (old_al > 0x99 || old_cf)
+        {
+            al = static_cast<uint8_t>(subtract ? al - 0x60 : al + 0x60);
+            set_flag(cf, true);
+        }
+        else if (!subtract)
+        {
+            set_flag(cf, false);
+        }
+        set_reg<uint8_t>(Register::al_id, al);
+        set_szp<uint8_t>(al);
+        undefined_flags_ |= of;
+    }
+
+    void aaa(const bool subtract)
+    {
+        uint8_t al = get_reg<uint8_t>(Register::al_id);
+        uint8_t ah = get_reg<uint8_t>(Register::ah_id);
+        if ((al & 0x0f) > 9 || flag(af))
+        {
+            al = static_cast<uint8_t>(subtract ? al - 6 : al + 6);
+            ah = static_cast<uint8_t>(subtract ? ah - 1 : ah + 1);
+            set_flag(af, true);
+            set_flag(cf, true);
+        }
+        else
+        {
+            set_flag(af, false);
+            set_flag(cf, false);
+        }
+        set_reg<uint8_t>(Register::al_id, al & 0x0f);
+        set_reg<uint8_t>(Register::ah_id, ah);
+        undefined_flags_ |= of | sf | zf | pf;
+    }
+
+    Status execute(const uint8_t opcode)
+    {
+        if (opcode < 0x40 && (opcode & 0x07) < 6)
+        {
+            const uint8_t op = static_cast<uint8_t>(opcode >> 3);
+            switch (opcode & 0x07)
+            {
+                case 0:
+                    alu_modrm<uint8_t>(op, false);
+                    break;
+                case 1:
+                    alu_modrm<uint16_t>(op, false);
+                    break;
+                case 2:
+                    alu_modrm<uint8_t>(op, true);
+                    break;
+                case 3:
+                    alu_modrm<uint16_t>(op, true);
+                    break;
+                case 4:
+                    alu_accumulator<uint8_t>(op);
+                    break;
+                case 5:
+                    alu_accumulator<uint16_t>(op);
+                    break;
+            }
+            return Status::ok;
+        }
+
+        if (opcode >= 0x40 && opcode <= 0x4f)
+        {
+            uint16_t& r = reg16(opcode & 0x07);
+            r           = inc_dec<uint16_t>(r, opcode & 0x08);
+            return Status::ok;
+        }
+
+        if (opcode >= 0x50 && opcode <= 0x57)
+        {
+            push(reg16(opcode & 0x07));
+            return Status::ok;
+        }
+
+        if (opcode >= 0x58 && opcode <= 0x5f)
+        {
+            const uint16_t value = pop();
+            if ((opcode & 0x07) == Register::sp_id)
+            {
+                reg16(Register::sp_id) = static_cast<uint16_t>(value + 2);
+                return Status::ok;
+            }
+            reg16(opcode & 0x07) = value;
+            return Status::ok;
+        }
+
+        if (opcode >= 0x70 && opcode <= 0x7f)
+        {
+            const int8_t displacement = static_cast<int8_t>(fetch8());
+            if (condition(opcode & 0x0f))
+            {
+                jump_relative(displacement);
+            }
+            return Status::ok;
+        }
+
+        if (opcode >= 0x91 && opcode <= 0x97)
+        {
+            std::swap(reg16(Register::ax_id), reg16(opcode & 0x07));
+            return Status::ok;
+        }
+
+        if (opcode >= 0xb0 && opcode <= 0xb7)
+        {
+            set_reg<uint8_t>(opcode & 0x07, fetch8());
+            return Status::ok;
+        }
+
+        if (opcode >= 0xb8 && opcode <= 0xbf)
+        {
+            reg16(opcode & 0x07) = fetch16();
+            return Status::ok;
+        }
+
+        if (opcode >= 0xd8 && opcode <= 0xdf)
+        {
+            decode_modrm();
+            return Status::ok;
+        }
+
+        switch (opcode)
+        {
+            case 0x06:
+            case 0x0e:
+            case 0x16:
+            case 0x1e:
+                push(sreg(opcode >> 3));
+                return Status::ok;
+            case 0x07:
+            case 0x17:
+            case 0x1f:
+                sreg(opcode >> 3) = pop();
+                return Status::ok;
+            case 0x27:
+                daa(false);
+                return Status::ok;
+            case 0x2f:
+                daa(true);
+                return Status::ok;
+            case 0x37:
+                aaa(false);
+                return Status::ok;
+            case 0x3f:
+                aaa(true);
+                return Status::ok;
+
+            case 0x80:
+            case 0x82:
+                alu_group<uint8_t, uint8_t>();
+                return Status::ok;
+            case 0x81:
+                alu_group<uint16_t, uint16_t>();
+                return Status::ok;
+            case 0x83:
+                alu_group<uint16_t, uint8_t>();
+                return Status::ok;
+            case 0x84:
+            {
+                const auto [reg, rm] = decode_modrm();
+                logic<uint8_t>(static_cast<uint8_t>(read_operand<uint8_t>(rm) & get_reg<uint8_t>(reg)));
+                return Status::ok;
+            }
+            case 0x85:
+            {
+                const auto [reg, rm] = decode_modrm();
+                logic<uint16_t>(static_cast<uint16_t>(read_operand<uint16_t>(rm) & get_reg<uint16_t>(reg)));
+                return Status::ok;
+            }
+            case 0x86:
+            {
+                const auto [reg, rm] = decode_modrm();
+                const uint8_t value  = read_operand<uint8_t>(rm);
+                write_operand<uint8_t>(rm, get_reg<uint8_t>(reg));
+                set_reg<uint8_t>(reg, value);
+                return Status::ok;
+            }
+            case 0x87:
+            {
+                const auto [reg, rm] = decode_modrm();
+                const uint16_t value = read_operand<uint16_t>(rm);
+                write_operand<uint16_t>(rm, get_reg<uint16_t>(reg));
+                set_reg<uint16_t>(reg, value);
+                return Status::ok;
+            }
+            case 0x88:
+            {
+                const auto [reg, rm] = decode_modrm();
+                write_operand<uint8_t>(rm, get_reg<uint8_t>(reg));
+                return Status::ok;
+            }
+            case 0x89:
+            {
+                const auto [reg, rm] = decode_modrm();
+                write_operand<uint16_t>(rm, get_reg<uint16_t>(reg));
+                return Status::ok;
+            }
+            case 0x8a:
+            {
+                const auto [reg, rm] = decode_modrm();
+                set_reg<uint8_t>(reg, read_operand<uint8_t>(rm));
+                return Status::ok;
+            }
+            case 0x8b:
+            {
+                const auto [reg, rm] = decode_modrm();
+                set_reg<uint16_t>(reg, read_operand<uint16_t>(rm));
+                return Status::ok;
+            }
+            case 0x8c:
+            {
+                const auto [reg, rm] = decode_modrm();
+                write_operand<uint16_t>(rm, sreg(reg & 0x03));
+                return Status::ok;
+            }
+            case 0x8d:
+            {
+                const auto [reg, rm] = decode_modrm();
+                if (rm.is_register)
+                {
+                    return Status::unsupported;
+                }
+                set_reg<uint16_t>(reg, rm.offset);
+                return Status::ok;
+            }
+            case 0x8e:
+            {
+                const auto [reg, rm] = decode_modrm();
+                sreg(reg & 0x03)     = read_operand<uint16_t>(rm);
+                return Status::ok;
+            }
+            case 0x8f:
+            {
+                const auto [reg, rm] = decode_modrm();
+                write_operand<uint16_t>(rm, pop());
+                return Status::ok;
+            }
+            case 0x90:
+            case 0x9b:
+                return Status::ok;
+            case 0x98:
+                reg16(Register::ax_id) =
+                    static_cast<uint16_t>(static_cast<int8_t>(get_reg<uint8_t>(Register::al_id)));
+                return Status::ok;
+            case 0x99:
+                reg16(Register::dx_id) = (reg16(Register::ax_id) & 0x8000) ? 0xffff : 0x0000;
+                return Status::ok;
+            case 0x9a:
+            {
+                const uint16_t ip = fetch16();
+                const uint16_t cs = fetch16();
+                push(sreg(Register::cs_id));
+                push(state_.ip);
+                sreg(Register::cs_id) = cs;
+                state_.ip             = ip;
+                return Status::ok;
+            }
+            case 0x9c:
+                push(flags_image());
+                return Status::ok;
+            case 0x9d:
+                state_.flags = pop() & Flags::defined_mask;
+                return Status::ok;
+            case 0x9e:
+                state_.flags = static_cast<uint16_t>((state_.flags & 0xff00) |
+                                                     (get_reg<uint8_t>(Register::ah_id) & 0xd5));
+                return Status::ok;
+            case 0x9f:
+                set_reg<uint8_t>(Register::ah_id, static_cast<uint8_t>((state_.flags & 0xd5) | 0x02));
+                return Status::ok;
+            case 0xa0:
+                set_reg<uint8_t>(Register::al_id, read8(data_segment(), fetch16()));
+                return Status::ok;
+            case 0xa1:
+                reg16(Register::ax_id) = read16(data_segment(), fetch16());
+                return Status::ok;
+            case 0xa2:
+                write8(data_segment(), fetch16(), get_reg<uint8_t>(Register::al_id));
+                return Status::ok;
+            case 0xa3:
+                write16(data_segment(), fetch16(), reg16(Register::ax_id));
+                return Status::ok;
+            case 0xa4:
+            case 0xa6:
+            case 0xaa:
+            case 0xac:
+            case 0xae:
+                string_op<uint8_t>(opcode);
+                return Status::ok;
+            case 0xa5:
+            case 0xa7:
+            case 0xab:
+            case 0xad:
+            case 0xaf:
+                string_op<uint16_t>(opcode);
+                return Status::ok;
+            case 0xa8:
+                logic<uint8_t>(static_cast<uint8_t>(get_reg<uint8_t>(Register::al_id) & fetch8()));
+                return Status::ok;
+            case 0xa9:
+                logic<uint16_t>(static_cast<uint16_t>(reg16(Register::ax_id) & fetch16()));
+                return Status::ok;
+            case 0xc2:
+            {
+                const uint16_t bytes   = fetch16();
+                state_.ip              = pop();
+                reg16(Register::sp_id) = static_cast<uint16_t>(reg16(Register::sp_id) + bytes);
+                return Status::ok;
+            }
+            case 0xc3:
+                state_.ip = pop();
+                return Status::ok;
+            case 0xc4:
+            case 0xc5:
+            {
+                const auto [reg, rm] = decode_modrm();
+                if (rm.is_register)
+                {
+                    return Status::unsupported;
+                }
+                set_reg<uint16_t>(reg, read16(rm.segment, rm.offset));
+                sreg(opcode == 0xc4 ? Register::es_id : Register::ds_id) =
+                    read16(rm.segment, static_cast<uint16_t>(rm.offset + 2));
+                return Status::ok;
+            }
+            case 0xc6:
+            {
+                const auto [reg, rm] = decode_modrm();
+                write_operand<uint8_t>(rm, fetch8());
+                return Status::ok;
+            }
+            case 0xc7:
+            {
+                const auto [reg, rm] = decode_modrm();
+                write_operand<uint16_t>(rm, fetch16());
+                return Status::ok;
+            }
+            case 0xca:
+            {
+                const uint16_t bytes   = fetch16();
+                state_.ip              = pop();
+                sreg(Register::cs_id)  = pop();
+                reg16(Register::sp_id) = static_cast<uint16_t>(reg16(Register::sp_id) + bytes);
+                return Status::ok;
+            }
+            case 0xcb:
+                state_.ip             = pop();
+                sreg(Register::cs_id) = pop();
+                return Status::ok;
+            case 0xcc:
+                interrupt(3);
+                return Status::ok;
+            case 0xcd:
+                interrupt(fetch8());
+                return Status::ok;
+            case 0xce:
+                if (flag(of))
+                {
+                    interrupt(4);
+                }
+                return Status::ok;
+            case 0xcf:
+                state_.ip             = pop();
+                sreg(Register::cs_id) = pop();
+                state_.flags          = pop() & Flags::defined_mask;
+                return Status::ok;
+            case 0xd0:
+                return group2<uint8_t>(false);
+            case 0xd1:
+                return group2<uint16_t>(false);
+            case 0xd2:
+                return group2<uint8_t>(true);
+            case 0xd3:
+                return group2<uint16_t>(true);
+            case 0xd4:
+            {
+                const uint8_t base = fetch8();
+                undefined_flags_ |= of | af | cf;
+                if (base == 0)
+                {
+                    interrupt(0);
+                    return Status::ok;
+                }
+                const uint8_t al = get_reg<uint8_t>(Register::al_id);
+                set_reg<uint8_t>(Register::ah_id, static_cast<uint8_t>(al / base));
+                set_reg<uint8_t>(Register::al_id, static_cast<uint8_t>(al % base));
+                set_szp<uint8_t>(static_cast<uint8_t>(al % base));
+                return Status::ok;
+            }
+            case 0xd5:
+            {
+                const uint8_t base = fetch8();
+                const uint8_t al   = static_cast<uint8_t>(get_reg<uint8_t>(Register::ah_id) * base +
+                                                        get_reg<uint8_t>(Register::al_id));
+                set_reg<uint16_t>(Register::ax_id, al);
+                set_szp<uint8_t>(al);
+                undefined_flags_ |= of | af | cf;
+                return Status::ok;
+            }
+            case 0xd7:
+            {
+                const uint16_t offset =
+                    static_cast<uint16_t>(reg16(Register::bx_id) + get_reg<uint8_t>(Register::al_id));
+                set_reg<uint8_t>(Register::al_id, read8(data_segment(), offset));
+                return Status::ok;
+            }
+            case 0xe0:
+            case 0xe1:
+            case 0xe2:
+            {
+                const int8_t displacement = static_cast<int8_t>(fetch8());
+                uint16_t& cx              = reg16(Register::cx_id);
+                cx                        = static_cast<uint16_t>(cx - 1);
+                bool taken                = cx != 0;
+                if (opcode == 0xe0)
+                {
+                    taken = taken && !flag(zf);
+                }
+                else if (opcode == 0xe1)
+                {
+                    taken = taken && flag(zf);
+                }
+                if (taken)
+                {
+                    jump_relative(displacement);
+                }
+                return Status::ok;
+            }
+            case 0xe3:
+            {
+                const int8_t displacement = static_cast<int8_t>(fetch8());
+                if (reg16(Register::cx_id) == 0)
+                {
+                    jump_relative(displacement);
+                }
+                return Status::ok;
+            }
+            case 0xe8:
+            {
+                const int16_t displacement = static_cast<int16_t>(fetch16());
+                push(state_.ip);
+                jump_relative(displacement);
+                return Status::ok;
+            }
+            case 0xe9:
+                jump_relative(static_cast<int16_t>(fetch16()));
+                return Status::ok;
+            case 0xea:
+            {
+                const uint16_t ip     = fetch16();
+                sreg(Register::cs_id) = fetch16();
+                state_.ip             = ip;
+                return Status::ok;
+            }
+            case 0xeb:
+                jump_relative(static_cast<int8_t>(fetch8()));
+                return Status::ok;
+            case 0xf4:
+                return Status::halted;
+            case 0xf5:
+                set_flag(cf, !flag(cf));
+                return Status::ok;
+            case 0xf6:
+                return group3<uint8_t>();
+            case 0xf7:
+                return group3<uint16_t>();
+            case 0xf8:
+            case 0xf9:
+                set_flag(cf, opcode & 0x01);
+                return Status::ok;
+            case 0xfa:
+            case 0xfb:
+                set_flag(if_, opcode & 0x01);
+                return Status::ok;
+            case 0xfc:
+            case 0xfd:
+                set_flag(df, opcode & 0x01);
+                return Status::ok;
+            case 0xfe:
+            {
+                const auto [op, rm] = decode_modrm();
+                if (op > 1)
+                {
+                    return Status::unsupported;
+                }
+                write_operand<uint8_t>(rm, inc_dec<uint8_t>(read_operand<uint8_t>(rm), op == 1));
+                return Status::ok;
+            }
+            case 0xff:
+                return group5();
+        }
+        return Status::unsupported;
+    }
+
+    Status group5()
+    {
+        const auto [op, rm] = decode_modrm();
+        if ((op == 3 || op == 5) && rm.is_register)
+        {
+            return Status::unsupported;
+        }
+
+        switch (op)
+        {
+            case 0:
+            case 1:
+                write_operand<uint16_t>(rm, inc_dec<uint16_t>(read_operand<uint16_t>(rm), op == 1));
+                return Status::ok;
+            case 2:
+            {
+                const uint16_t target = read_operand<uint16_t>(rm);
+                push(state_.ip);
+                state_.ip = target;
+                return Status::ok;
+            }
+            case 3:
+            {
+                const uint16_t ip = read16(rm.segment, rm.offset);
+                const uint16_t cs = read16(rm.segment, static_cast<uint16_t>(rm.offset + 2));
+                push(sreg(Register::cs_id));
+                push(state_.ip);
+                sreg(Register::cs_id) = cs;
+                state_.ip             = ip;
+                return Status::ok;
+            }
+            case 4:
+                state_.ip = read_operand<uint16_t>(rm);
+                return Status::ok;
+            case 5:
+            {
+                const uint16_t ip     = read16(rm.segment, rm.offset);
+                sreg(Register::cs_id) = read16(rm.segment, static_cast<uint16_t>(rm.offset + 2));
+                state_.ip             = ip;
+                return Status::ok;
+            }
+            case 6:
+                push(read_operand<uint16_t>(rm));
+                return Status::ok;
+        }
+        return Status::unsupported;
+    }
+
+    BusType& bus_;
+    CpuState state_;
+    Status status_;
+    uint16_t undefined_flags_;
+    std::optional<uint8_t> segment_;
+    Rep rep_;
+};
+
+} // namespace msemu::cpu8086
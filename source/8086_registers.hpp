@@ -43,6 +43,13 @@ namespace msemu::cpu8086
 
 #define get_reg16(reg, mask, offset) (static_cast<uint16_t>((reg >> offset) & 0xffff))
 
+// Physical address of segment:offset. It is not wrapped at 1 MiB, ffff:ffff
+// ends up at 0x10ffef.
+constexpr uint32_t physical_address(const uint16_t segment, const uint32_t offset)
+{
+    return (static_cast<uint32_t>(segment) << 4) + offset;
+}
+
 struct Flags
 {
 private:
@@ -86,6 +93,27 @@ private:
     }
 
 public:
+    constexpr static uint16_t defined_mask = cy_mask | p_mask | ax_mask | z_mask | s_mask | t_mask | i_mask |
+                                             d_mask | o_mask;
+
+    inline static uint16_t value()
+    {
+        return static_cast<uint16_t>(r4 & defined_mask);
+    }
+
+    inline static void value(const uint16_t v)
+    {
+        r4 = v & defined_mask;
+    }
+
+    constexpr static uint16_t arithmetic_mask = cy_mask | p_mask | ax_mask | z_mask | s_mask | o_mask;
+
+    // Replaces all arithmetic flags at once, v uses FLAGS register layout.
+    inline static void arithmetic(const uint16_t v)
+    {
+        r4 = (r4 & ~static_cast<uint32_t>(arithmetic_mask)) | (v & arithmetic_mask);
+    }
+
     inline static bool cy()
     {
         return get_flag<cy_mask>();
@@ -0,0 +1,112 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace msemu::cpu8086
+{
+
+// Shadow stack of return addresses pushed by CALL and INT. Entries are keyed
+// by physical address of the stack slot which holds the return ip, so RET
+// predicts its target before reading guest stack. Prediction is only a hint,
+// the caller still pops the real target and reports whether they matched.
+// Stack switches or return addresses modified by the guest end up as misses.
+class ReturnStack
+{
+public:
+    constexpr static std::size_t depth = 16;
+
+    struct Target
+    {
+        uint32_t slot;
+        uint16_t cs;
+        uint16_t ip;
+    };
+
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+    };
+
+    ReturnStack()
+        : entries_{}
+        , top_(0)
+        , size_(0)
+        , stats_{}
+    {
+    }
+
+    void push(const uint32_t slot, const uint16_t cs, const uint16_t ip)
+    {
+        top_           = (top_ + 1) % depth;
+        entries_[top_] = Target{slot, cs, ip};
+        size_          = size_ < depth ? size_ + 1 : depth;
+    }
+
+    // Predicted target of return which pops from slot, nullptr when unknown.
+    const Target* predict(const uint32_t slot) const
+    {
+        return size_ != 0 && entries_[top_].slot == slot ? &entries_[top_] : nullptr;
+    }
+
+    // Records whether the real target was predicted. Entries of frames below
+    // slot were abandoned (stack grows down) and are dropped, the top entry is
+    // dropped only when it belongs to slot. A return which was not pushed by
+    // call, i.e. push and ret used as a jump, keeps the caller prediction.
+    void pop(const uint32_t slot, const uint16_t cs, const uint16_t ip)
+    {
+        while (size_ != 0 && entries_[top_].slot < slot)
+        {
+            drop();
+        }
+        const Target* predicted = predict(slot);
+        const bool hit          = predicted != nullptr && predicted->cs == cs && predicted->ip == ip;
+        ++(hit ? stats_.hits : stats_.misses);
+        if (predicted != nullptr)
+        {
+            drop();
+        }
+    }
+
+    void clear()
+    {
+        size_ = 0;
+    }
+
+    const Stats& stats() const
+    {
+        return stats_;
+    }
+
+private:
+    void drop()
+    {
+        top_ = (top_ + depth - 1) % depth;
+        --size_;
+    }
+
+    std::array<Target, depth> entries_;
+    std::size_t top_;
+    std::size_t size_;
+    Stats stats_;
+};
+
+} // namespace msemu::cpu8086
@@ -0,0 +1,53 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "8086_state.hpp"
+
+namespace msemu::cpu8086
+{
+
+CpuState capture_state()
+{
+    CpuState state{};
+    for (uint8_t i = 0; i < state.regs.size(); ++i)
+    {
+        state.regs[i] = get_register_16_by_id(i);
+    }
+    for (uint8_t i = 0; i < state.sregs.size(); ++i)
+    {
+        state.sregs[i] = get_segment_register_by_id(i);
+    }
+    state.ip    = Register::ip();
+    state.flags = Register::flags().value();
+    return state;
+}
+
+void restore_state(const CpuState& state)
+{
+    for (uint8_t i = 0; i < state.regs.size(); ++i)
+    {
+        set_register_16_by_id(i, state.regs[i]);
+    }
+    for (uint8_t i = 0; i < state.sregs.size(); ++i)
+    {
+        set_segment_register_by_id(i, state.sregs[i]);
+    }
+    Register::ip(state.ip);
+    Register::flags().value(state.flags);
+}
+
+} // namespace msemu::cpu8086
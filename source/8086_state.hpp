@@ -0,0 +1,43 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "8086_registers.hpp"
+
+namespace msemu::cpu8086
+{
+
+// Plain copy of the architectural state. Registers are indexed with the same
+// ids as the ModRM encoding (Register::ax_id..di_id, Register::es_id..ds_id).
+struct CpuState
+{
+    std::array<uint16_t, 8> regs;
+    std::array<uint16_t, 4> sregs;
+    uint16_t ip;
+    uint16_t flags;
+
+    bool operator==(const CpuState&) const = default;
+};
+
+CpuState capture_state();
+void restore_state(const CpuState& state);
+
+} // namespace msemu::cpu8086
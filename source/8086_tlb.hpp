@@ -0,0 +1,123 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "memory.hpp"
+
+namespace msemu::cpu8086
+{
+
+// Last host memory range resolved through the bus for code fetch, stack and
+// data accesses. Entries are checked against physical address, so segment
+// register writes do not need to flush them, bus remaps do.
+class SoftwareTlb
+{
+public:
+    enum Entry : uint8_t
+    {
+        code,
+        stack,
+        data,
+        entries
+    };
+
+    struct Stats
+    {
+        std::array<uint64_t, entries> hits;
+        std::array<uint64_t, entries> misses;
+    };
+
+    SoftwareTlb()
+        : ranges_{}
+        , stats_{}
+    {
+    }
+
+    template <typename BusType>
+    inline const uint8_t* read(BusType& bus, const Entry entry, const uint32_t address, const uint32_t size)
+    {
+        return lookup(bus, entry, address, size);
+    }
+
+    template <typename BusType>
+    inline uint8_t* write(BusType& bus, const Entry entry, const uint32_t address, const uint32_t size)
+    {
+        uint8_t* data = lookup(bus, entry, address, size);
+        return ranges_[entry].writable ? data : nullptr;
+    }
+
+    // Whole host range containing address.
+    template <typename BusType>
+    inline const HostRange& range(BusType& bus, const Entry entry, const uint32_t address)
+    {
+        lookup(bus, entry, address, 1);
+        return ranges_[entry];
+    }
+
+    void invalidate()
+    {
+        ranges_ = {};
+    }
+
+    const Stats& stats() const
+    {
+        return stats_;
+    }
+
+    static inline uint8_t* translate(const HostRange& range, const uint32_t address, const uint32_t size)
+    {
+        // 64 bit sum, so addresses below range start never wrap into it,
+        // unmapped ranges have size 0 and never match
+        const uint32_t offset = address - range.start;
+        if (static_cast<uint64_t>(offset) + size <= range.size)
+        {
+            return range.data + offset;
+        }
+        return nullptr;
+    }
+
+private:
+    template <typename BusType>
+    inline uint8_t* lookup(BusType& bus, const Entry entry, const uint32_t address, const uint32_t size)
+    {
+        const HostRange& range = ranges_[entry];
+        const uint32_t offset  = address - range.start;
+        if (static_cast<uint64_t>(offset) + size <= range.size) [[likely]]
+        {
+            ++stats_.hits[entry];
+            return range.data + offset;
+        }
+        return refill(bus, entry, address, size);
+    }
+
+    template <typename BusType>
+    [[gnu::noinline]] uint8_t* refill(BusType& bus, const Entry entry, const uint32_t address, const uint32_t size)
+    {
+        ++stats_.misses[entry];
+        ranges_[entry] = bus.host_range(address);
+        return translate(ranges_[entry], address, size);
+    }
+
+    std::array<HostRange, entries> ranges_;
+    Stats stats_;
+};
+
+} // namespace msemu::cpu8086
@@ -0,0 +1,165 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "8237_dma.hpp"
+
+namespace msemu
+{
+
+namespace
+{
+
+// page registers of channels 0 - 3 on IBM PC
+constexpr std::array<uint16_t, Dma8237::channels> page_ports = {0x87, 0x83, 0x81, 0x82};
+
+} // namespace
+
+Dma8237::Dma8237()
+    : channels_{}
+    , flip_flop_(false)
+    , status_(0)
+    , command_(0)
+    , completion_{}
+    , stats_{}
+{
+    write_port(0x0d, 0);
+}
+
+void Dma8237::write_port(const uint16_t port, const uint8_t value)
+{
+    for (uint8_t channel = 0; channel < channels; ++channel)
+    {
+        if (port == page_ports[channel])
+        {
+            channels_[channel].page = value;
+            return;
+        }
+    }
+
+    if (port < 0x08)
+    {
+        Channel& channel = channels_[port >> 1];
+        uint16_t& base   = port & 1 ? channel.base_count : channel.base_address;
+        base = flip_flop_ ? static_cast<uint16_t>((base & 0x00ff) | value << 8)
+                          : static_cast<uint16_t>((base & 0xff00) | value);
+        (port & 1 ? channel.count : channel.address) = base;
+        flip_flop_                                   = !flip_flop_;
+        return;
+    }
+
+    switch (port)
+    {
+        case 0x08:
+            command_ = value;
+            return;
+        case 0x0a:
+            channels_[value & 3].masked = value & 0x04;
+            return;
+        case 0x0b:
+            channels_[value & 3].mode = value;
+            return;
+        case 0x0c:
+            flip_flop_ = false;
+            return;
+        case 0x0d:
+            for (auto& channel : channels_)
+            {
+                channel.masked = true;
+            }
+            flip_flop_ = false;
+            status_    = 0;
+            command_   = 0;
+            return;
+        case 0x0e:
+            for (auto& channel : channels_)
+            {
+                channel.masked = false;
+            }
+            return;
+        case 0x0f:
+            for (uint8_t channel = 0; channel < channels; ++channel)
+            {
+                channels_[channel].masked = (value >> channel) & 1;
+            }
+            return;
+        default:
+            // software requests are not needed, devices call transfer() directly
+            return;
+    }
+}
+
+uint8_t Dma8237::read_port(const uint16_t port)
+{
+    for (uint8_t channel = 0; channel < channels; ++channel)
+    {
+        if (port == page_ports[channel])
+        {
+            return channels_[channel].page;
+        }
+    }
+
+    if (port < 0x08)
+    {
+        const Channel& channel = channels_[port >> 1];
+        const uint16_t current = port & 1 ? channel.count : channel.address;
+        const auto value       = static_cast<uint8_t>(flip_flop_ ? current >> 8 : current);
+        flip_flop_             = !flip_flop_;
+        return value;
+    }
+
+    if (port == 0x08)
+    {
+        // terminal count bits are cleared by read
+        const uint8_t status = status_;
+        status_ &= 0xf0;
+        return status;
+    }
+    return 0xff;
+}
+
+void Dma8237::poll(const uint64_t now)
+{
+    for (uint8_t channel = 0; channel < channels; ++channel)
+    {
+        Channel& state = channels_[channel];
+        if (state.done_at == 0 || state.done_at > now)
+        {
+            continue;
+        }
+        state.done_at = 0;
+        status_       = static_cast<uint8_t>(status_ | 1 << channel);
+        if (completion_)
+        {
+            completion_(channel);
+        }
+    }
+}
+
+uint64_t Dma8237::next_event() const
+{
+    uint64_t next = 0;
+    for (const auto& channel : channels_)
+    {
+        if (channel.done_at != 0 && (next == 0 || channel.done_at < next))
+        {
+            next = channel.done_at;
+        }
+    }
+    return next;
+}
+
+} // namespace msemu
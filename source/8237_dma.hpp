@@ -0,0 +1,218 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <span>
+
+#include "memory.hpp"
+
+namespace msemu
+{
+
+// Intel 8237 DMA controller with page registers of IBM PC.
+//
+// Devices do not request bytes one by one, they hand whole buffer to
+// transfer(), which moves it with span reads and writes on the bus. Buffer
+// is split only where 16 bit address counter wraps within 64 KiB page (like
+// on real hardware, page register is not incremented) and at device ends.
+// Terminal count becomes visible when transfer would finish on real
+// hardware, poll() with current cycle raises it and calls completion.
+class Dma8237
+{
+public:
+    static constexpr uint8_t channels = 4;
+    // memory cycle of PC DMA, S1 - S4 states
+    static constexpr uint64_t cycles_per_byte = 4;
+
+    enum class Transfer : uint8_t
+    {
+        verify      = 0,
+        to_memory   = 1,
+        from_memory = 2
+    };
+
+    enum class Mode : uint8_t
+    {
+        demand  = 0,
+        single  = 1,
+        block   = 2,
+        cascade = 3
+    };
+
+    struct Channel
+    {
+        uint16_t base_address;
+        uint16_t base_count;
+        uint16_t address;
+        uint16_t count;
+        uint8_t page;
+        uint8_t mode;
+        bool masked;
+        // cycle when running transfer reaches terminal count, 0 when none
+        uint64_t done_at;
+    };
+
+    struct Stats
+    {
+        std::size_t transfers;
+        std::size_t bytes;
+        std::size_t chunks;
+    };
+
+    using Completion = std::function<void(uint8_t channel)>;
+
+    Dma8237();
+
+    void write_port(uint16_t port, uint8_t value);
+    uint8_t read_port(uint16_t port);
+
+    void on_complete(Completion completion)
+    {
+        completion_ = std::move(completion);
+    }
+
+    // Moves up to remaining count of channel between buffer and guest memory,
+    // returns number of transferred bytes.
+    template <typename BusType>
+    uint32_t transfer(BusType& bus, const uint8_t channel, std::span<uint8_t> buffer, const uint64_t now)
+    {
+        Channel& state = channels_[channel & 3];
+        if (state.masked || mode(state) == Mode::cascade)
+        {
+            return 0;
+        }
+
+        const uint32_t remaining = uint32_t{state.count} + 1;
+        const auto size          = static_cast<uint32_t>(std::min<std::size_t>(buffer.size(), remaining));
+        const bool decrement     = state.mode & 0x20;
+        uint32_t done            = 0;
+        while (done < size)
+        {
+            const uint32_t address = uint32_t{state.page} << 16 | state.address;
+            // bytes until address counter wraps
+            const uint32_t wrap  = decrement ? uint32_t{state.address} + 1 : 0x10000 - state.address;
+            const uint32_t chunk = copy(bus, transfer_type(state), address,
+                                        buffer.subspan(done, std::min(wrap, size - done)), decrement);
+            done += chunk;
+            state.address = static_cast<uint16_t>(decrement ? state.address - chunk : state.address + chunk);
+            ++stats_.chunks;
+        }
+
+        state.count = static_cast<uint16_t>(state.count - size);
+        if (size == remaining)
+        {
+            state.done_at = std::max<uint64_t>(now + uint64_t{size} * cycles_per_byte, 1);
+            if (state.mode & 0x10)
+            {
+                state.address = state.base_address;
+                state.count   = state.base_count;
+            }
+            else
+            {
+                state.masked = true;
+            }
+        }
+        ++stats_.transfers;
+        stats_.bytes += size;
+        return size;
+    }
+
+    // Raises terminal count of transfers finished before now.
+    void poll(uint64_t now);
+
+    // Cycle of next terminal count, 0 when nothing is running.
+    uint64_t next_event() const;
+
+    const Channel& channel(const uint8_t channel) const
+    {
+        return channels_[channel & 3];
+    }
+
+    const Stats& stats() const
+    {
+        return stats_;
+    }
+
+private:
+    static Mode mode(const Channel& channel)
+    {
+        return static_cast<Mode>(channel.mode >> 6);
+    }
+
+    static Transfer transfer_type(const Channel& channel)
+    {
+        return static_cast<Transfer>((channel.mode >> 2) & 3);
+    }
+
+    // Copies part of buffer within single device, address belongs to the
+    // first byte of buffer. Returns copied size.
+    template <typename BusType>
+    static uint32_t copy(BusType& bus, const Transfer type, uint32_t address, std::span<uint8_t> buffer,
+                         const bool decrement)
+    {
+        const HostRange range = bus.host_range(address);
+        if (range.size == 0)
+        {
+            // nothing responds, bytes are lost
+            return static_cast<uint32_t>(buffer.size());
+        }
+        const uint32_t available = decrement ? address - range.start + 1 : range.start + range.size - address;
+        const uint32_t size      = std::min(static_cast<uint32_t>(buffer.size()), available);
+        buffer                   = buffer.first(size);
+        if (type == Transfer::verify)
+        {
+            return size;
+        }
+        if (decrement)
+        {
+            address = address - size + 1;
+        }
+
+        // descending addresses take bytes of buffer in reverse order
+        if (decrement)
+        {
+            std::reverse(buffer.begin(), buffer.end());
+        }
+        if (type == Transfer::to_memory)
+        {
+            bus.write(address, std::span<const uint8_t>(buffer));
+        }
+        else
+        {
+            bus.read(address, buffer);
+        }
+        if (decrement)
+        {
+            std::reverse(buffer.begin(), buffer.end());
+        }
+        return size;
+    }
+
+    std::array<Channel, channels> channels_;
+    bool flip_flop_;
+    uint8_t status_;
+    uint8_t command_;
+    Completion completion_;
+    Stats stats_;
+};
+
+} // namespace msemu
@@ -0,0 +1,94 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bisect.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace msemu::cpu8086
+{
+
+namespace
+{
+
+uint64_t fnv1a(uint64_t hash, std::span<const uint8_t> data)
+{
+    for (const uint8_t byte : data)
+    {
+        hash = (hash ^ byte) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+uint64_t fnv1a(const uint64_t hash, const uint64_t value)
+{
+    uint8_t bytes[sizeof(value)];
+    std::memcpy(bytes, &value, sizeof(value));
+    return fnv1a(hash, bytes);
+}
+
+constexpr uint64_t fnv1a_offset = 0xcbf29ce484222325ull;
+
+} // namespace
+
+uint64_t hash_state(const CpuState& state, const uint16_t flags_mask)
+{
+    CpuState masked = state;
+    masked.flags &= flags_mask;
+
+    uint64_t hash = fnv1a_offset;
+    for (const uint16_t value : masked.regs)
+    {
+        hash = fnv1a(hash, value);
+    }
+    for (const uint16_t value : masked.sregs)
+    {
+        hash = fnv1a(hash, value);
+    }
+    hash = fnv1a(hash, masked.ip);
+    return fnv1a(hash, masked.flags);
+}
+
+uint64_t hash_dirty_pages(std::span<const DeviceMemory> memory, std::span<const DeviceMemory> baseline,
+                          const DirtyPages& dirty)
+{
+    uint64_t hash = fnv1a_offset;
+    for (std::size_t device = 0; device < std::min(memory.size(), baseline.size()); ++device)
+    {
+        const auto current    = memory[device].data;
+        const auto original   = baseline[device].data;
+        const uint32_t start  = memory[device].start;
+        const std::size_t end = std::min(current.size(), original.size());
+        for (std::size_t offset = 0; offset < end; offset += bisect_page_size)
+        {
+            const std::size_t size = std::min<std::size_t>(bisect_page_size, end - offset);
+            if (!dirty.any(static_cast<uint32_t>(start + offset), static_cast<uint32_t>(size)))
+            {
+                continue;
+            }
+            if (std::memcmp(current.data() + offset, original.data() + offset, size) != 0)
+            {
+                hash = fnv1a(hash, (static_cast<uint64_t>(device) << 32) | offset);
+                hash = fnv1a(hash, current.subspan(offset, size));
+            }
+        }
+    }
+    return hash;
+}
+
+} // namespace msemu::cpu8086
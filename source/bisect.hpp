@@ -0,0 +1,597 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "8086_cpu.hpp"
+#include "8086_reference_cpu.hpp"
+#include "8086_state.hpp"
+#include "core_dump.hpp"
+
+namespace msemu::cpu8086
+{
+
+constexpr uint32_t bisect_page_size = 4096;
+// Segment:offset addresses reach ffff:ffff, above 1 MiB.
+constexpr uint32_t bisect_address_space = 0x110000;
+
+// Pages of the address space written since clear().
+class DirtyPages
+{
+public:
+    constexpr static uint32_t page_count = bisect_address_space / bisect_page_size;
+
+    void mark(const uint32_t address, const uint32_t size)
+    {
+        const uint32_t end = std::min(address + size, bisect_address_space);
+        for (uint32_t page = address / bisect_page_size; page * bisect_page_size < end; ++page)
+        {
+            pages_.set(page);
+        }
+    }
+
+    // Any page which overlaps the range was written.
+    bool any(const uint32_t address, const uint32_t size) const
+    {
+        const uint32_t end = std::min(address + size, bisect_address_space);
+        for (uint32_t page = address / bisect_page_size; page * bisect_page_size < end; ++page)
+        {
+            if (pages_.test(page))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::size_t count() const
+    {
+        return pages_.count();
+    }
+
+    void clear()
+    {
+        pages_.reset();
+    }
+
+private:
+    std::bitset<page_count> pages_;
+};
+
+// Forwards every access to the wrapped bus and marks pages it writes. Host
+// ranges are read only, so the CPU sends every write through write().
+template <typename BusType>
+class DirtyTrackingBus
+{
+public:
+    constexpr static std::size_t device_count = BusType::device_count;
+
+    DirtyTrackingBus(BusType& bus)
+        : bus_(bus)
+        , dirty_{}
+    {
+    }
+
+    template <typename DataType>
+    DataType read(const uint32_t address)
+    {
+        return bus_.template read<DataType>(address);
+    }
+
+    void read(const uint32_t address, std::span<uint8_t> data)
+    {
+        bus_.read(address, data);
+    }
+
+    HostRange host_range(const uint32_t address)
+    {
+        HostRange range = bus_.host_range(address);
+        range.writable  = false;
+        return range;
+    }
+
+    void write(const uint32_t address, const std::span<const uint8_t> data)
+    {
+        dirty_.mark(address, static_cast<uint32_t>(data.size()));
+        bus_.write(address, data);
+    }
+
+    void write(const uint32_t address, const auto data)
+    {
+        dirty_.mark(address, sizeof(data));
+        bus_.write(address, data);
+    }
+
+    DirtyPages& dirty()
+    {
+        return dirty_;
+    }
+
+    BusType& bus()
+    {
+        return bus_;
+    }
+
+private:
+    BusType& bus_;
+    DirtyPages dirty_;
+};
+
+struct DeviceMemory
+{
+    uint32_t start;
+    std::span<const uint8_t> data;
+};
+
+uint64_t hash_state(const CpuState& state, uint16_t flags_mask);
+
+// Rolling hash of pages which differ from baseline, both lists hold memory of
+// bus devices in the same order. Only pages marked in dirty are compared,
+// pages which were not written since the baseline was taken can't differ.
+uint64_t hash_dirty_pages(std::span<const DeviceMemory> memory, std::span<const DeviceMemory> baseline,
+                          const DirtyPages& dirty);
+
+template <typename BusType>
+std::vector<DeviceMemory> device_memory(const BusType& bus)
+{
+    std::vector<DeviceMemory> memory;
+    bus.for_each_device([&memory](const auto& device)
+                        { memory.push_back(DeviceMemory{device.start_address, device.span()}); });
+    return memory;
+}
+
+// Copies pages marked in dirty between buses with the same devices.
+template <typename BusType>
+void copy_dirty_pages(const BusType& from, BusType& to, const DirtyPages& dirty)
+{
+    const std::vector<DeviceMemory> source = device_memory(from);
+    std::size_t device                     = 0;
+    to.for_each_device(
+        [&source, &device, &dirty](auto& target)
+        {
+            const std::span<uint8_t> data = target.span();
+            const DeviceMemory& memory    = source[device++];
+            for (std::size_t offset = 0; offset < data.size(); offset += bisect_page_size)
+            {
+                const std::size_t size = std::min<std::size_t>(bisect_page_size, data.size() - offset);
+                if (dirty.any(static_cast<uint32_t>(memory.start + offset), static_cast<uint32_t>(size)))
+                {
+                    std::copy_n(memory.data.begin() + static_cast<std::ptrdiff_t>(offset), size,
+                                data.begin() + static_cast<std::ptrdiff_t>(offset));
+                }
+            }
+        });
+}
+
+// Registers, flags and memory in pages dirtied since baseline.
+template <typename BusType>
+uint64_t hash_machine(const CpuState& state, const uint16_t flags_mask, const BusType& bus,
+                      const BusType& baseline, const DirtyPages& dirty)
+{
+    return hash_state(state, flags_mask) ^
+           hash_dirty_pages(device_memory(bus), device_memory(baseline), dirty);
+}
+
+// Same for memory written without tracking, every page is compared.
+template <typename BusType>
+uint64_t hash_machine(const CpuState& state, const uint16_t flags_mask, const BusType& bus,
+                      const BusType& baseline)
+{
+    DirtyPages all;
+    all.mark(0, bisect_address_space);
+    return hash_machine(state, flags_mask, bus, baseline, all);
+}
+
+// Fast core on its own copy of memory. Cpu registers are process wide, so
+// they are swapped in only for the duration of run(). Pages written since
+// the last checkpoint are tracked, so restoring it copies only those.
+template <typename BusType>
+class FastSide
+{
+public:
+    using Memory = BusType;
+
+    FastSide(const BusType& bus, const char* name = "fast")
+        : name_(name)
+        , memory_(std::make_unique<BusType>(bus))
+        , tracked_(*memory_)
+        , cpu_(tracked_)
+        , state_{}
+    {
+    }
+
+    uint64_t run(const uint64_t count)
+    {
+        restore_state(state_);
+        const uint64_t executed = cpu_.run(count);
+        state_                  = capture_state();
+        return executed;
+    }
+
+    void restore(const CpuState& state)
+    {
+        state_ = state;
+    }
+
+    // Memory is the last checkpoint, only pages written since are copied back.
+    void restore(const CpuState& state, const BusType& memory)
+    {
+        state_ = state;
+        copy_dirty_pages(memory, *memory_, tracked_.dirty());
+        tracked_.dirty().clear();
+    }
+
+    const CpuState& state() const
+    {
+        return state_;
+    }
+
+    BusType& bus()
+    {
+        return *memory_;
+    }
+
+    // Pages written since the last restore or checkpoint.
+    DirtyPages& dirty()
+    {
+        return tracked_.dirty();
+    }
+
+    const char* name() const
+    {
+        return name_;
+    }
+
+private:
+    const char* name_;
+    std::unique_ptr<BusType> memory_;
+    DirtyTrackingBus<BusType> tracked_;
+    Cpu<DirtyTrackingBus<BusType>> cpu_;
+    CpuState state_;
+};
+
+template <typename BusType>
+class ReferenceSide
+{
+public:
+    using Memory = BusType;
+
+    ReferenceSide(const BusType& bus, const char* name = "reference")
+        : name_(name)
+        , memory_(std::make_unique<BusType>(bus))
+        , tracked_(*memory_)
+        , cpu_(tracked_)
+    {
+    }
+
+    uint64_t run(const uint64_t count)
+    {
+        uint64_t executed = 0;
+        while (executed < count && cpu_.step() == ReferenceCpu<DirtyTrackingBus<BusType>>::Status::ok)
+        {
+            ++executed;
+        }
+        return executed;
+    }
+
+    void restore(const CpuState& state)
+    {
+        cpu_.reset(state);
+    }
+
+    // Memory is the last checkpoint, only pages written since are copied back.
+    void restore(const CpuState& state, const BusType& memory)
+    {
+        cpu_.reset(state);
+        copy_dirty_pages(memory, *memory_, tracked_.dirty());
+        tracked_.dirty().clear();
+    }
+
+    const CpuState& state() const
+    {
+        return cpu_.state();
+    }
+
+    BusType& bus()
+    {
+        return *memory_;
+    }
+
+    // Pages written since the last restore or checkpoint.
+    DirtyPages& dirty()
+    {
+        return tracked_.dirty();
+    }
+
+    const char* name() const
+    {
+        return name_;
+    }
+
+private:
+    const char* name_;
+    std::unique_ptr<BusType> memory_;
+    DirtyTrackingBus<BusType> tracked_;
+    ReferenceCpu<DirtyTrackingBus<BusType>> cpu_;
+};
+
+// Finds the first instruction after which two configurations of the same
+// machine disagree, i.e. the fast core against the reference or two runs
+// started from different images.
+//
+// Both sides run at full speed for an interval and compare hashes of
+// registers, flags and pages dirtied since the last checkpoint. End of a
+// matching interval becomes the new checkpoint. When hashes differ, the
+// interval is bisected: both sides are restored from the checkpoint and run
+// half way, so no step executes again from boot. A side which stops earlier
+// than the other diverges as well.
+template <typename SideA, typename SideB>
+class Bisector
+{
+public:
+    enum class Result
+    {
+        matched,
+        diverged
+    };
+
+    // Sides start with the given memory. Flags which both sides compute
+    // differently on purpose, i.e. architecturally undefined ones, can be
+    // excluded with flags_mask.
+    Bisector(const typename SideA::Memory& a, const typename SideB::Memory& b,
+             const uint16_t flags_mask = Flags::defined_mask)
+        : a_(a)
+        , b_(b)
+        , flags_mask_(flags_mask)
+        , checkpoint_{0, {}, {}, std::make_unique<typename SideA::Memory>(a),
+                      std::make_unique<typename SideB::Memory>(b)}
+        , restores_{0}
+        , report_{}
+    {
+    }
+
+    // Starts both sides from state and their current memory.
+    void reset(const CpuState& state)
+    {
+        a_.restore(state);
+        b_.restore(state);
+        checkpoint(0);
+        restores_ = 0;
+        report_.clear();
+    }
+
+    Result run(const uint64_t instructions, const uint64_t interval)
+    {
+        while (checkpoint_.position < instructions)
+        {
+            const uint64_t count = std::min(interval, instructions - checkpoint_.position);
+            uint64_t executed    = 0;
+            if (!advance(count, executed))
+            {
+                bisect(count);
+                return Result::diverged;
+            }
+            checkpoint(checkpoint_.position + executed);
+            if (executed < count)
+            {
+                break;
+            }
+        }
+        return Result::matched;
+    }
+
+    // Instructions executed by both sides before the divergence or the end of run.
+    uint64_t position() const
+    {
+        return checkpoint_.position;
+    }
+
+    std::size_t restores() const
+    {
+        return restores_;
+    }
+
+    const std::string& report() const
+    {
+        return report_;
+    }
+
+    SideA& a()
+    {
+        return a_;
+    }
+
+    SideB& b()
+    {
+        return b_;
+    }
+
+private:
+    struct Checkpoint
+    {
+        uint64_t position;
+        CpuState a;
+        CpuState b;
+        std::unique_ptr<typename SideA::Memory> a_memory;
+        std::unique_ptr<typename SideB::Memory> b_memory;
+    };
+
+    // Checkpoint memory gets only pages written since the previous one.
+    void checkpoint(const uint64_t position)
+    {
+        checkpoint_.position = position;
+        checkpoint_.a        = a_.state();
+        checkpoint_.b        = b_.state();
+        copy_dirty_pages(a_.bus(), *checkpoint_.a_memory, a_.dirty());
+        copy_dirty_pages(b_.bus(), *checkpoint_.b_memory, b_.dirty());
+        a_.dirty().clear();
+        b_.dirty().clear();
+    }
+
+    void restore()
+    {
+        a_.restore(checkpoint_.a, *checkpoint_.a_memory);
+        b_.restore(checkpoint_.b, *checkpoint_.b_memory);
+        ++restores_;
+    }
+
+    bool advance(const uint64_t count, uint64_t& executed)
+    {
+        executed                  = a_.run(count);
+        const uint64_t executed_b = b_.run(count);
+        return executed == executed_b &&
+               hash_machine(a_.state(), flags_mask_, a_.bus(), *checkpoint_.a_memory, a_.dirty()) ==
+                   hash_machine(b_.state(), flags_mask_, b_.bus(), *checkpoint_.b_memory, b_.dirty());
+    }
+
+    // Sides disagree after count instructions from the checkpoint.
+    void bisect(uint64_t count)
+    {
+        while (count > 1)
+        {
+            restore();
+            const uint64_t half = count / 2;
+            uint64_t executed   = 0;
+            if (advance(half, executed))
+            {
+                checkpoint(checkpoint_.position + executed);
+                count -= half;
+            }
+            else
+            {
+                count = half;
+            }
+        }
+
+        restore();
+        std::vector<std::string> a = describe(a_);
+        std::vector<std::string> b = describe(b_);
+        if (a_.run(1) == 0)
+        {
+            a.push_back("stopped");
+        }
+        if (b_.run(1) == 0)
+        {
+            b.push_back("stopped");
+        }
+        append_state(a, a_, *checkpoint_.a_memory);
+        append_state(b, b_, *checkpoint_.b_memory);
+        append_writes(a, b);
+
+        char line[160];
+        snprintf(line, sizeof(line), "divergence after %llu instructions, %zu restores\n",
+                 static_cast<unsigned long long>(checkpoint_.position), restores_);
+        report_ = line;
+        for (std::size_t i = 0; i < std::max(a.size(), b.size()); ++i)
+        {
+            snprintf(line, sizeof(line), "%-56s| %s\n", i < a.size() ? a[i].c_str() : "",
+                     i < b.size() ? b[i].c_str() : "");
+            report_ += line;
+        }
+    }
+
+    template <typename Side>
+    static std::vector<std::string> describe(Side& side)
+    {
+        const CpuState& state = side.state();
+        const uint32_t address = physical_address(state.sregs[Register::cs_id], state.ip);
+        char instruction[80];
+        disassemble(instruction, sizeof(instruction), address, side.bus());
+
+        char line[96];
+        snprintf(line, sizeof(line), "%04x:%04x %s", state.sregs[Register::cs_id], state.ip, instruction);
+        return {side.name(), line};
+    }
+
+    template <typename Side>
+    void append_state(std::vector<std::string>& lines, Side& side, const typename Side::Memory& baseline)
+    {
+        const CpuState& s = side.state();
+        char line[96];
+        snprintf(line, sizeof(line), "ax: %04x cx: %04x dx: %04x bx: %04x", s.regs[0], s.regs[1], s.regs[2],
+                 s.regs[3]);
+        lines.push_back(line);
+        snprintf(line, sizeof(line), "sp: %04x bp: %04x si: %04x di: %04x", s.regs[4], s.regs[5], s.regs[6],
+                 s.regs[7]);
+        lines.push_back(line);
+        snprintf(line, sizeof(line), "es: %04x cs: %04x ss: %04x ds: %04x", s.sregs[0], s.sregs[1],
+                 s.sregs[2], s.sregs[3]);
+        lines.push_back(line);
+        const uint64_t hash = hash_machine(s, flags_mask_, side.bus(), baseline, side.dirty());
+        snprintf(line, sizeof(line), "ip: %04x flags: %04x hash: %016llx", s.ip,
+                 static_cast<unsigned>(s.flags & flags_mask_), static_cast<unsigned long long>(hash));
+        lines.push_back(line);
+    }
+
+    // Bytes which differ between the sides and were written by the last instruction.
+    void append_writes(std::vector<std::string>& a, std::vector<std::string>& b)
+    {
+        const auto a_memory = device_memory(a_.bus());
+        const auto b_memory = device_memory(b_.bus());
+        const auto a_before = device_memory(*checkpoint_.a_memory);
+        const auto b_before = device_memory(*checkpoint_.b_memory);
+
+        constexpr std::size_t max_writes = 8;
+        std::size_t writes               = 0;
+        for (std::size_t device = 0; device < std::min(a_memory.size(), b_memory.size()); ++device)
+        {
+            const auto current_a   = a_memory[device].data;
+            const auto current_b   = b_memory[device].data;
+            const uint32_t start   = a_memory[device].start;
+            const std::size_t size = std::min(current_a.size(), current_b.size());
+            for (std::size_t i = 0; i < size && writes < max_writes; ++i)
+            {
+                const uint32_t address = static_cast<uint32_t>(start + i);
+                if (!a_.dirty().any(address, 1) && !b_.dirty().any(address, 1))
+                {
+                    // clean page on both sides, continue from the next one
+                    i = (address | (bisect_page_size - 1)) - start;
+                    continue;
+                }
+                const bool written = current_a[i] != a_before[device].data[i] ||
+                                     current_b[i] != b_before[device].data[i];
+                if (written && current_a[i] != current_b[i])
+                {
+                    char line[64];
+                    snprintf(line, sizeof(line), "device %zu [%05zx]=%02x", device, i, current_a[i]);
+                    a.push_back(line);
+                    snprintf(line, sizeof(line), "device %zu [%05zx]=%02x", device, i, current_b[i]);
+                    b.push_back(line);
+                    ++writes;
+                }
+            }
+        }
+    }
+
+    SideA a_;
+    SideB b_;
+    uint16_t flags_mask_;
+    Checkpoint checkpoint_;
+    std::size_t restores_;
+    std::string report_;
+};
+
+} // namespace msemu::cpu8086
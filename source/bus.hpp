@@ -23,16 +23,27 @@
 #include <span>
 #include <string_view>
 #include <tuple>
+#include <type_traits>
 
 #include "memory.hpp"
 
 namespace msemu
 {
 
+// Devices which memory has to see every write, i.e. video memory tracking
+// dirty scanlines. Host ranges of such devices are not writable, so the
+// software TLB sends writes through the bus.
+template <typename DeviceType>
+concept WriteTracking = requires(DeviceType& device, uint32_t offset, uint32_t size) {
+    device.memory().written(offset, size);
+};
+
 template <typename... T>
 class Bus
 {
 public:
+    constexpr static std::size_t device_count = sizeof...(T);
+
     Bus(T... t)
         : devices_(std::forward<T>(t)...)
     {
@@ -58,9 +69,22 @@ public:
         clear_impl();
     }
 
+    template <typename Visitor>
+    void for_each_device(Visitor&& visitor)
+    {
+        for_each_device_impl(visitor);
+    }
+
+    template <typename Visitor>
+    void for_each_device(Visitor&& visitor) const
+    {
+        for_each_device_impl(visitor);
+    }
+
     void write(const uint32_t address, const std::span<const uint8_t> data)
     {
         get_by_address_impl(address).write(address, data);
+        written_impl(address, static_cast<uint32_t>(data.size()));
     }
 
     template <typename DataType>
@@ -77,6 +101,20 @@ public:
     void write(const uint32_t address, const auto data)
     {
         get_by_address_impl(address).write(address, data);
+        if constexpr (std::is_integral_v<decltype(data)>)
+        {
+            written_impl(address, sizeof(data));
+        }
+        else
+        {
+            written_impl(address, static_cast<uint32_t>(std::size(data)));
+        }
+    }
+
+    // Host memory of device which contains address, empty when unmapped.
+    HostRange host_range(const uint32_t address)
+    {
+        return host_range_impl(address);
     }
 
 private:
@@ -167,6 +205,42 @@ private:
         }
     }
 
+    template <std::size_t I = 0>
+    inline HostRange host_range_impl(const uint32_t address)
+    {
+        if constexpr (I == sizeof...(T))
+        {
+            return HostRange{};
+        }
+        else
+        {
+            auto& device = std::get<I>(devices_);
+            if (address >= device.start_address && address < device.end_address)
+            {
+                return HostRange{device.start_address, device.end_address - device.start_address,
+                                 device.span().data(), !WriteTracking<std::tuple_element_t<I, Devices>>};
+            }
+            return host_range_impl<I + 1>(address);
+        }
+    }
+
+    template <std::size_t I = 0>
+    inline void written_impl(const uint32_t address, const uint32_t size)
+    {
+        if constexpr (I < sizeof...(T))
+        {
+            if constexpr (WriteTracking<std::tuple_element_t<I, Devices>>)
+            {
+                auto& device = std::get<I>(devices_);
+                if (address >= device.start_address && address < device.end_address)
+                {
+                    device.memory().written(address - device.start_address, size);
+                }
+            }
+            written_impl<I + 1>(address, size);
+        }
+    }
+
     template <std::size_t I = 0>
     inline void clear_impl()
     {
@@ -181,6 +255,26 @@ private:
         }
     }
 
+    template <std::size_t I = 0, typename Visitor>
+    inline void for_each_device_impl(Visitor& visitor)
+    {
+        if constexpr (I < sizeof...(T))
+        {
+            visitor(std::get<I>(devices_));
+            for_each_device_impl<I + 1>(visitor);
+        }
+    }
+
+    template <std::size_t I = 0, typename Visitor>
+    inline void for_each_device_impl(Visitor& visitor) const
+    {
+        if constexpr (I < sizeof...(T))
+        {
+            visitor(std::get<I>(devices_));
+            for_each_device_impl<I + 1>(visitor);
+        }
+    }
+
     std::tuple<T...> devices_;
 };
 
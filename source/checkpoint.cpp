@@ -0,0 +1,122 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "checkpoint.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace msemu
+{
+
+Checkpointer::Checkpointer(std::string path, const uint64_t interval)
+    : path_(std::move(path))
+    , temporary_path_(path_ + ".tmp")
+    , interval_(interval)
+    , ticks_(0)
+    , reaper_{}
+    , busy_(false)
+    , last_failed_(false)
+    , completed_(0)
+    , failed_(0)
+    , stats_{}
+{
+}
+
+Checkpointer::~Checkpointer()
+{
+    wait();
+}
+
+bool Checkpointer::ready()
+{
+    // the child of the previous checkpoint still writes the temporary file
+    if (busy())
+    {
+        ++stats_.skipped;
+        return false;
+    }
+    if (reaper_.joinable())
+    {
+        reaper_.join();
+    }
+    return true;
+}
+
+bool Checkpointer::start(const std::function<bool()>& write)
+{
+    const auto begin = std::chrono::steady_clock::now();
+    const pid_t pid  = fork();
+    if (pid == 0)
+    {
+        // only write() and rename(), _exit so stdio buffers inherited from the parent are not flushed
+        const bool ok = write() && rename(temporary_path_.c_str(), path_.c_str()) == 0;
+        _exit(ok ? 0 : 1);
+    }
+    const auto pause = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin);
+
+    if (pid < 0)
+    {
+        printf("ERR: Checkpoint fork failed\n");
+        ++stats_.skipped;
+        return false;
+    }
+
+    ++stats_.started;
+    stats_.last_pause = pause;
+    stats_.max_pause  = std::max(stats_.max_pause, pause);
+    busy_.store(true, std::memory_order_release);
+    reaper_ = std::thread(&Checkpointer::reap, this, pid);
+    return true;
+}
+
+void Checkpointer::reap(const int pid)
+{
+    int status = 0;
+    int result = 0;
+    while ((result = waitpid(pid, &status, 0)) < 0 && errno == EINTR)
+    {
+    }
+    const bool ok = result == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    ++(ok ? completed_ : failed_);
+    last_failed_.store(!ok, std::memory_order_relaxed);
+    busy_.store(false, std::memory_order_release);
+}
+
+bool Checkpointer::wait()
+{
+    if (reaper_.joinable())
+    {
+        reaper_.join();
+    }
+    return !last_failed_.load(std::memory_order_relaxed);
+}
+
+Checkpointer::Stats Checkpointer::stats() const
+{
+    Stats stats     = stats_;
+    stats.completed = completed_.load(std::memory_order_relaxed);
+    stats.failed    = failed_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace msemu
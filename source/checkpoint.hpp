@@ -0,0 +1,124 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "save_state.hpp"
+
+namespace msemu
+{
+
+// Periodic checkpoints which do not stop the guest for serialization.
+//
+// checkpoint() forks the emulator, the child process sees copy-on-write
+// snapshot of registers and every device memory at the moment of fork and
+// writes it to a temporary file, which is renamed over the checkpoint path
+// when complete. Background thread in the parent reaps the child, so the CPU
+// thread is paused only for the fork itself.
+//
+// Other threads (video capture, device workers) may hold malloc or stdio locks
+// at the moment of fork, so the child must not take them. The file and all
+// writer buffers are set up by the parent, the child only calls write().
+class Checkpointer
+{
+public:
+    struct Stats
+    {
+        std::size_t started;
+        std::size_t completed;
+        std::size_t failed;
+        std::size_t skipped;
+        std::chrono::nanoseconds last_pause;
+        std::chrono::nanoseconds max_pause;
+    };
+
+    Checkpointer(std::string path, uint64_t interval);
+    ~Checkpointer();
+
+    Checkpointer(const Checkpointer&) = delete;
+    Checkpointer& operator=(const Checkpointer&) = delete;
+
+    // Counts executed instructions, starts checkpoint every interval.
+    template <typename BusType>
+    void tick(const BusType& bus)
+    {
+        if (++ticks_ < interval_)
+        {
+            return;
+        }
+        ticks_ = 0;
+        checkpoint(bus);
+    }
+
+    // Returns false when previous checkpoint is still being written.
+    template <typename BusType>
+    bool checkpoint(const BusType& bus)
+    {
+        if (!ready())
+        {
+            return false;
+        }
+        SaveStateWriter writer;
+        if (!writer.open(temporary_path_.c_str()))
+        {
+            ++stats_.skipped;
+            return false;
+        }
+        writer.reserve(state_pages(bus));
+        return start(
+            [&writer, &bus]
+            {
+                write_state(writer, bus);
+                return writer.finish();
+            });
+    }
+
+    bool busy() const
+    {
+        return busy_.load(std::memory_order_acquire);
+    }
+
+    // Waits for checkpoint in progress, returns false if it failed.
+    bool wait();
+
+    Stats stats() const;
+
+private:
+    bool ready();
+    bool start(const std::function<bool()>& write);
+    void reap(int pid);
+
+    std::string path_;
+    std::string temporary_path_;
+    uint64_t interval_;
+    uint64_t ticks_;
+    std::thread reaper_;
+    std::atomic<bool> busy_;
+    std::atomic<bool> last_failed_;
+    std::atomic<std::size_t> completed_;
+    std::atomic<std::size_t> failed_;
+    Stats stats_;
+};
+
+} // namespace msemu
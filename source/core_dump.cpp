@@ -86,22 +86,6 @@ void print_table_bottom(std::size_t columns, std::size_t size)
     puts_many(right_bottom, 1);
 }
 
-uint8_t getmodrm_command_size(const ModRM mod)
-{
-    switch (mod.mod)
-    {
-        case 0:
-            return 0;
-        case 1:
-            return 1;
-        case 2:
-            return 2;
-        case 3:
-            return 0;
-    }
-    return 0;
-}
-
 namespace
 {
 char mod0_mapping[8][9]  = {"bx+si", "bx+di", "bp+si", "bp+di", "si", "di", "", "bx"};
@@ -222,84 +206,65 @@ void get_address_string(char* str, const std::size_t size, const char* mod_name,
     }
 }
 
-uint8_t get_modrm_size(const ModRM modrm)
-{
-    if (modrm.mod == 0 && modrm.rm == 6)
-    {
-        return 2;
-    }
-    return modrm.mod < 3 ? modrm.mod + 1 : 1;
-}
-
-uint8_t print_modrm8_from_reg(char* line, std::size_t max_size, std::string_view command, uint8_t data[6],
-                              const char* mod_name)
+void print_modrm8_from_reg(char* line, std::size_t max_size, std::string_view command, uint8_t data[6],
+                           const char* mod_name)
 {
-    const ModRM modrm  = data[0];
-    const auto names   = get_modrm_8_mapping(modrm);
-    const uint8_t size = get_modrm_size(modrm);
+    const ModRM modrm = data[0];
+    const auto names  = get_modrm_8_mapping(modrm);
 
     char address_name[100];
     const char* reg_name = reg8_mapping[modrm.reg];
     get_address_string(address_name, sizeof(address_name), mod_name, data, modrm, names.first);
     snprintf(line, max_size, "%s %s,%s", command.data(), address_name, reg_name);
-    return size;
 }
 
-uint8_t print_modrm16_from_reg(char* line, std::size_t max_size, std::string_view command, uint8_t data[6],
-                               const char* mod_name)
+void print_modrm16_from_reg(char* line, std::size_t max_size, std::string_view command, uint8_t data[6],
+                            const char* mod_name)
 {
     const ModRM modrm = data[0];
     const auto names  = get_modrm_16_mapping(modrm);
-    uint8_t size      = get_modrm_size(modrm);
 
     char address_name[100];
     const char* reg_name = reg16_mapping[modrm.reg];
     get_address_string(address_name, sizeof(address_name), mod_name, data, modrm, names.first);
     snprintf(line, max_size, "%s %s,%s", command.data(), address_name, reg_name);
-    return size;
 }
 
-uint8_t print_reg_from_modrm8(char* line, std::size_t max_size, std::string_view command, uint8_t data[6],
-                              const char* mod_name)
+void print_reg_from_modrm8(char* line, std::size_t max_size, std::string_view command, uint8_t data[6],
+                           const char* mod_name)
 {
-    const ModRM modrm  = data[0];
-    const auto names   = get_modrm_8_mapping(modrm);
-    const uint8_t size = get_modrm_size(modrm);
+    const ModRM modrm = data[0];
+    const auto names  = get_modrm_8_mapping(modrm);
 
     char address_name[100];
     const char* reg_name = reg8_mapping[modrm.reg];
     get_address_string(address_name, sizeof(address_name), mod_name, data, modrm, names.second);
     snprintf(line, max_size, "%s %s,%s", command.data(), reg_name, address_name);
-    return size;
 }
 
-uint8_t print_reg_from_modrm16(char* line, std::size_t max_size, std::string_view command, uint8_t data[6],
-                               const char* mod_name)
+void print_reg_from_modrm16(char* line, std::size_t max_size, std::string_view command, uint8_t data[6],
+                            const char* mod_name)
 {
     const ModRM modrm = data[0];
     const auto names  = get_modrm_16_mapping(modrm);
-    uint8_t size      = get_modrm_size(modrm);
 
     char address_name[100];
     const char* reg_name = reg16_mapping[modrm.reg];
     get_address_string(address_name, sizeof(address_name), mod_name, data, modrm, names.second);
     snprintf(line, max_size, "%s %s,%s", command.data(), reg_name, address_name);
-    return size;
 }
 
 
-uint8_t print_imm8(char* line, std::size_t max_size, std::string_view command, std::string_view dest,
-                   uint8_t data[6])
+void print_imm8(char* line, std::size_t max_size, std::string_view command, std::string_view dest,
+                uint8_t data[6])
 {
     snprintf(line, max_size, "%s %s,0x%02x", command.data(), dest.data(), data[0]);
-    return 2;
 }
 
-uint8_t print_imm16(char* line, std::size_t max_size, std::string_view command, std::string_view dest,
-                    uint8_t data[6])
+void print_imm16(char* line, std::size_t max_size, std::string_view command, std::string_view dest,
+                 uint8_t data[6])
 {
     snprintf(line, max_size, "%s %s,0x%02x%02x", command.data(), dest.data(), data[1], data[0]);
-    return 2;
 }
 
 
@@ -321,77 +286,81 @@ uint8_t opcode_to_command(char* line, std::size_t max_size, std::size_t opcode,
         case 0x37:
         {
             snprintf(line, max_size, "aaa");
-            return 1;
+            break;
         }
         case 0xd5:
         {
             snprintf(line, max_size, "aad");
-            return 2;
+            break;
         }
         case 0xd4:
         {
             snprintf(line, max_size, "aam");
-            return 2;
+            break;
         }
         case 0x3f:
         {
             snprintf(line, max_size, "aas");
-            return 1;
+            break;
         }
         case 0x14:
         {
-            return print_imm8(line, max_size, "adc", "al", data);
+            print_imm8(line, max_size, "adc", "al", data);
+            break;
         }
         case 0x15:
         {
-            return print_imm16(line, max_size, "adc", "ax", data);
+            print_imm16(line, max_size, "adc", "ax", data);
+            break;
         }
         case 0x12:
         {
-            return print_reg_from_modrm8(line, max_size, "adc", data, mod_name);
+            print_reg_from_modrm8(line, max_size, "adc", data, mod_name);
+            break;
         }
         case 0x13:
         {
-            return print_reg_from_modrm16(line, max_size, "adc", data, mod_name);
+            print_reg_from_modrm16(line, max_size, "adc", data, mod_name);
+            break;
         }
 
         case 0x00:
         {
-            return print_modrm8_from_reg(line, max_size, "add", data, mod_name);
+            print_modrm8_from_reg(line, max_size, "add", data, mod_name);
+            break;
         }
         case 0x26:
         {
             mod = SectionMod::ES;
-            return 0;
+            break;
         }
         case 0x36:
         {
             mod = SectionMod::SS;
-            return 0;
+            break;
         }
         case 0x2e:
         {
             mod = SectionMod::CS;
-            return 0;
+            break;
         }
         case 0x3e:
         {
             mod = SectionMod::DS;
-            return 0;
+            break;
         }
         case 0x31:
         {
             auto names = get_modrm_8_mapping(data[0]);
             snprintf(line, max_size, "xor %s,%s", names.first, names.second);
-            return 2 + getmodrm_command_size(data[0]);
+            break;
         }
         case 0xeb:
         {
             const uint8_t address = static_cast<uint8_t>(ip + 2u + data[0]);
             snprintf(line, max_size, "jmp 0x%02x", address);
-            return 2;
+            break;
         }
-        break;
         case 0x48:
         case 0x49:
         case 0x4a:
@@ -414,7 +383,7 @@ uint8_t opcode_to_command(char* line, std::size_t max_size, std::size_t opcode,
         case 0x57:
         {
             snprintf(line, max_size, "push %s", reg16_mapping[(opcode & 0x7)]);
-            return 1;
+            break;
         }
         case 0x58:
         case 0x59:
@@ -426,68 +395,68 @@ uint8_t opcode_to_command(char* line, std::size_t max_size, std::size_t opcode,
         case 0x5f:
         {
             snprintf(line, max_size, "pop %s", reg16_mapping[(opcode & 0x07)]);
-            return 1;
+            break;
         }
         case 0x07:
         {
             snprintf(line, max_size, "pop es");
-            return 1;
+            break;
         }
         case 0x17:
         {
             snprintf(line, max_size, "pop ss");
-            return 1;
+            break;
         }
         case 0x1f:
         {
             snprintf(line, max_size, "pop ds");
-            return 1;
+            break;
         }
         case 0x06:
         {
             snprintf(line, max_size, "push es");
-            return 1;
+            break;
         }
         case 0x0e:
         {
             snprintf(line, max_size, "push cs");
-            return 1;
+            break;
         }
         case 0x16:
         {
             snprintf(line, max_size, "push ss");
-            return 1;
+            break;
         }
         case 0x1e:
         {
             snprintf(line, max_size, "push ds");
-            return 1;
+            break;
         }
         case 0x88:
         {
-            return print_modrm8_from_reg(line, max_size, "mov", data, mod_name) + 2;
+            print_modrm8_from_reg(line, max_size, "mov", data, mod_name);
+            break;
         }
         case 0x89:
         {
-            return print_modrm16_from_reg(line, max_size, "mov", data, mod_name) + 2;
+            print_modrm16_from_reg(line, max_size, "mov", data, mod_name);
+            break;
         }
-        break;
         case 0x8e:
         {
             snprintf(line, max_size, "mov %s,%s", sreg_mapping[get_reg_op(data[0]) & 0x3],
                      reg16_mapping[get_rm(data[0])]);
-            return 2;
+            break;
         }
-        break;
         case 0xaa:
         {
             snprintf(line, max_size, "stosb");
-            return 1;
+            break;
         }
         case 0xab:
         {
             snprintf(line, max_size, "stosw");
-            return 1;
+            break;
         }
         case 0xb0:
         case 0xb1:
@@ -512,9 +481,8 @@ uint8_t opcode_to_command(char* line, std::size_t max_size, std::size_t opcode,
         {
             snprintf(line, max_size, "mov %s,0x%02x%02x", reg16_mapping[(opcode & 0xf) - 8], data[1],
                      data[0]);
-            return 3;
+            break;
         }
-        break;
         case 0xc3:
         {
             snprintf(line, max_size, "ret");
@@ -524,19 +492,19 @@ uint8_t opcode_to_command(char* line, std::size_t max_size, std::size_t opcode,
         case 0xcd:
         {
             snprintf(line, max_size, "int %02x", data[0]);
-            return 1;
+            break;
         }
         case 0xfc:
         {
             snprintf(line, max_size, "cld");
-            return 1;
-        };
+            break;
+        }
         default:
         {
-            snprintf(line, max_size, "- - -");
+            snprintf(line, max_size, "%s", opcode_table[opcode].mnemonic);
         }
     }
-    return 1;
-} // namespace
+    return static_cast<uint8_t>(1 + operands_length(static_cast<uint8_t>(opcode), data[0]));
+}
 
 } // namespace msemu::cpu8086
\ No newline at end of file
@@ -17,10 +17,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
 
+#include "8086_opcodes.hpp"
 #include "8086_registers.hpp"
 
 
@@ -63,93 +65,47 @@ void print_table_row(std::size_t columns, size_t size, const T& data, bool newli
 uint8_t opcode_to_command(char* line, std::size_t max_size, std::size_t opcode, uint8_t data[2],
                           std::size_t ip);
 
-void get_disassembly_line(char* line, std::size_t max_size, uint32_t& program_counter, auto& bus)
+// Writes encoding and command of instruction at physical address to line,
+// returns length of the instruction.
+std::size_t disassemble(char* line, std::size_t max_size, const uint32_t address, auto& bus)
 {
-    static bool continued_instruction = false;
-    const uint32_t address            = Register::cs() << 4 | program_counter;
-    uint8_t pc                        = bus.template read<uint8_t>(address);
-
-    uint8_t data[6] = {};
-
-    for (uint8_t i = 1; i < sizeof(data); ++i)
+    uint8_t bytes[16] = {};
+    for (uint8_t i = 0; i < sizeof(bytes); ++i)
     {
-        data[i - 1] = bus.template read<uint8_t>(address + i);
+        bytes[i] = bus.template read<uint8_t>(address + i);
     }
+    const std::size_t length = std::max<std::size_t>(instruction_length(bytes), 1);
 
+    // prefixes select segment printed with the command which follows them
     char command[30];
-    uint8_t size = opcode_to_command(command, sizeof(command), pc, data, address);
-
-    std::memset(line, 0, max_size);
-    if (continued_instruction)
+    std::size_t opcode = 0;
+    while (opcode + 1 < length && opcode_table[bytes[opcode]].prefix != Prefix::none)
     {
-        continued_instruction = false;
-        uint8_t mod_byte      = bus.template read<uint8_t>(Register::cs() << 4 | (program_counter - 1));
-
-        char cursor = ' ';
-        if (program_counter - 1 == Register::ip())
-        {
-            cursor = '>';
-        }
-        if (size == 1)
-        {
-            snprintf(line, max_size, " %c %8x: %02x %02x                 | %s", cursor, address - 1, mod_byte,
-                     pc, command);
-        }
-        if (size == 2)
-        {
-            snprintf(line, max_size, " %c %8x: %02x %02x %02x             | %s", cursor, address - 1,
-                     mod_byte, pc, data[0], command);
-        }
-        if (size == 3)
-        {
-            snprintf(line, max_size, " %c %8x: %02x %02x %02x %02x         | %s", cursor, address - 1,
-                     mod_byte, pc, data[0], data[1], command);
-        }
-        if (size == 4)
-        {
-            snprintf(line, max_size, " %c %8x: %02x %02x %02x %02x %02x     | %s", cursor, address - 1,
-                     mod_byte, pc, data[0], data[1], data[2], command);
-        }
-        if (size == 5)
-        {
-            snprintf(line, max_size, " %c %8x: %02x %02x %02x %02x %02x %02x | %s", cursor, address - 1,
-                     mod_byte, pc, data[0], data[1], data[2], data[3], command);
-        }
-        program_counter += size;
+        opcode_to_command(command, sizeof(command), bytes[opcode], &bytes[opcode + 1], address + opcode);
+        ++opcode;
     }
-    else if (size != 0)
-    {
-        char cursor;
-        if (program_counter == Register::ip())
-        {
-            cursor = '>';
-        }
-        else
-        {
-            cursor = ' ';
-        }
-        if (size == 1)
-        {
-            snprintf(line, max_size, " %c %8x: %02x                 | %s", cursor, address, pc, command);
-        }
-        if (size == 2)
-        {
-            snprintf(line, max_size, " %c %8x: %02x %02x              | %s", cursor, address, pc, data[0],
-                     command);
-        }
-        if (size == 3)
-        {
-            snprintf(line, max_size, " %c %8x: %02x %02x %02x           | %s", cursor, address, pc, data[0],
-                     data[1], command);
-        }
-        program_counter += size;
-    }
-    else
+    opcode_to_command(command, sizeof(command), bytes[opcode], &bytes[opcode + 1], address + opcode);
+
+    char encoding[3 * sizeof(bytes) + 1] = {};
+    for (std::size_t i = 0; i < length; ++i)
     {
-        program_counter += 1;
-        continued_instruction = true;
-        get_disassembly_line(line, max_size, program_counter, bus);
+        snprintf(&encoding[3 * i], sizeof(encoding) - 3 * i, "%02x ", bytes[i]);
     }
+
+    snprintf(line, max_size, "%-19s| %s", encoding, command);
+    return length;
+}
+
+void get_disassembly_line(char* line, std::size_t max_size, uint32_t& program_counter, auto& bus)
+{
+    const uint32_t address = physical_address(Register::cs(), program_counter);
+
+    char instruction[80];
+    const std::size_t length = disassemble(instruction, sizeof(instruction), address, bus);
+
+    const char cursor = program_counter == Register::ip() ? '>' : ' ';
+    snprintf(line, max_size, " %c %8x: %s", cursor, address, instruction);
+    program_counter += static_cast<uint32_t>(length);
 }
 
 void dump(const char* error_msg, auto& bus)
@@ -0,0 +1,286 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "device_scheduler.hpp"
+
+#include <algorithm>
+
+namespace msemu
+{
+
+namespace
+{
+
+// quanta without urgent events before the quantum is doubled again
+constexpr uint64_t quiet_quanta = 8;
+
+} // namespace
+
+DeviceScheduler::Context::Context(Mailbox<mailbox_size>& inbox, Mailbox<mailbox_size>& outbox,
+                                  const uint32_t device)
+    : inbox_(inbox)
+    , outbox_(outbox)
+    , device_(device)
+    , from_(0)
+    , until_(0)
+{
+}
+
+bool DeviceScheduler::Context::next(DeviceEvent& event)
+{
+    const DeviceEvent* front = inbox_.front();
+    if (front == nullptr || front->stamp >= until_)
+    {
+        return false;
+    }
+    event = *front;
+    inbox_.pop();
+    return true;
+}
+
+bool DeviceScheduler::Context::emit(DeviceEvent event)
+{
+    event.stamp  = std::clamp(event.stamp, from_, until_ - 1);
+    event.device = device_;
+    return outbox_.push(event);
+}
+
+DeviceScheduler::Device::Device(std::string device_name, Model device_model, const uint32_t index)
+    : name(std::move(device_name))
+    , model(std::move(device_model))
+    , inbox{}
+    , outbox{}
+    , context(inbox, outbox, index)
+    , last_post(0)
+    , job(0)
+    , done(0)
+    , thread{}
+{
+}
+
+DeviceScheduler::DeviceScheduler(const uint64_t quantum, const uint64_t min_quantum, const Mode mode)
+    : quantum_(std::max<uint64_t>(quantum, 1))
+    , max_quantum_(quantum_)
+    , min_quantum_(std::clamp<uint64_t>(min_quantum, 1, quantum_))
+    , mode_(mode)
+    , time_(0)
+    , device_time_(0)
+    , sequence_(0)
+    , quiet_(0)
+    , stop_(false)
+    , devices_{}
+    , events_{}
+    , stats_{}
+{
+}
+
+DeviceScheduler::~DeviceScheduler()
+{
+    stop_.store(true, std::memory_order_relaxed);
+    for (auto& device : devices_)
+    {
+        if (device->thread.joinable())
+        {
+            device->job.fetch_add(1, std::memory_order_release);
+            device->job.notify_one();
+            device->thread.join();
+        }
+    }
+}
+
+uint32_t DeviceScheduler::add_device(std::string name, Model model)
+{
+    const auto index = static_cast<uint32_t>(devices_.size());
+    devices_.push_back(std::make_unique<Device>(std::move(name), std::move(model), index));
+    if (mode_ == Mode::parallel)
+    {
+        Device& device = *devices_.back();
+        device.thread  = std::thread(&DeviceScheduler::work, this, std::ref(device));
+    }
+    return index;
+}
+
+bool DeviceScheduler::post(const uint32_t device, DeviceEvent event)
+{
+    Device& target = *devices_[device];
+    event.stamp    = std::max({event.stamp, time_, target.last_post});
+    event.device   = device;
+    if (!target.inbox.push(event))
+    {
+        // the worker may still be consuming the previous quantum, once it is done the inbox holds
+        // what the sequential mode would see, so whether the event is dropped does not depend on timing
+        wait_device(target);
+        if (!target.inbox.push(event))
+        {
+            ++stats_.dropped;
+            return false;
+        }
+    }
+    target.last_post = event.stamp;
+    ++stats_.to_devices;
+    return true;
+}
+
+uint64_t DeviceScheduler::run(const uint64_t instructions, const RunCpu& run_cpu, const Deliver& deliver)
+{
+    uint64_t executed = 0;
+    while (executed < instructions)
+    {
+        const uint64_t count = std::min(quantum_, instructions - executed);
+        // devices simulate the quantum which the CPU has just finished
+        const bool devices = device_time_ < time_;
+        if (devices)
+        {
+            start_devices(device_time_, time_);
+        }
+        const uint64_t done = run_cpu(count);
+        if (devices)
+        {
+            finish_devices();
+            device_time_ = time_;
+        }
+
+        time_ += done;
+        executed += done;
+        ++stats_.quanta;
+        deliver_events(deliver);
+        if (done < count)
+        {
+            break;
+        }
+    }
+    return executed;
+}
+
+void DeviceScheduler::sync(const Deliver& deliver)
+{
+    if (device_time_ < time_)
+    {
+        start_devices(device_time_, time_);
+        finish_devices();
+        device_time_ = time_;
+    }
+    deliver_events(deliver);
+}
+
+void DeviceScheduler::work(Device& device)
+{
+    uint64_t job = 0;
+    while (true)
+    {
+        device.job.wait(job, std::memory_order_acquire);
+        job = device.job.load(std::memory_order_acquire);
+        if (stop_.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        device.model(device.context);
+        device.done.store(job, std::memory_order_release);
+        device.done.notify_one();
+    }
+}
+
+void DeviceScheduler::start_devices(const uint64_t from, const uint64_t until)
+{
+    ++sequence_;
+    for (auto& device : devices_)
+    {
+        // published to the worker by the release store of job
+        device->context.from_  = from;
+        device->context.until_ = until;
+        if (mode_ == Mode::parallel)
+        {
+            device->job.store(sequence_, std::memory_order_release);
+            device->job.notify_one();
+        }
+        else
+        {
+            device->model(device->context);
+        }
+    }
+}
+
+void DeviceScheduler::finish_devices()
+{
+    if (mode_ != Mode::parallel)
+    {
+        return;
+    }
+
+    for (auto& device : devices_)
+    {
+        wait_device(*device);
+    }
+}
+
+void DeviceScheduler::wait_device(Device& device)
+{
+    if (mode_ != Mode::parallel)
+    {
+        return;
+    }
+
+    uint64_t done = device.done.load(std::memory_order_acquire);
+    if (done == sequence_)
+    {
+        return;
+    }
+    const auto begin = std::chrono::steady_clock::now();
+    while (done != sequence_)
+    {
+        device.done.wait(done, std::memory_order_acquire);
+        done = device.done.load(std::memory_order_acquire);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    stats_.wait += std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
+}
+
+void DeviceScheduler::deliver_events(const Deliver& deliver)
+{
+    events_.clear();
+    for (auto& device : devices_)
+    {
+        while (const DeviceEvent* event = device->outbox.front())
+        {
+            events_.push_back(*event);
+            device->outbox.pop();
+        }
+    }
+    std::stable_sort(events_.begin(), events_.end(), [](const DeviceEvent& a, const DeviceEvent& b)
+                     { return a.stamp != b.stamp ? a.stamp < b.stamp : a.device < b.device; });
+
+    bool urgent = false;
+    for (const auto& event : events_)
+    {
+        urgent = urgent || event.urgent;
+        deliver(event);
+    }
+    stats_.to_cpu += events_.size();
+
+    if (urgent)
+    {
+        quantum_ = std::max(min_quantum_, quantum_ / 2);
+        quiet_   = 0;
+    }
+    else if (quantum_ < max_quantum_ && ++quiet_ >= quiet_quanta)
+    {
+        quantum_ = std::min(max_quantum_, quantum_ * 2);
+        quiet_   = 0;
+    }
+}
+
+} // namespace msemu
@@ -0,0 +1,247 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace msemu
+{
+
+// Message between the CPU and a device model, stamped with emulated time in
+// instructions (Cpu has no cycle counter).
+struct DeviceEvent
+{
+    uint64_t stamp;
+    // index of the device, filled in by DeviceScheduler
+    uint32_t device;
+    // meaning of kind and value is defined by the device model
+    uint16_t kind;
+    // interrupt requests and other events which need low latency
+    bool urgent;
+    uint32_t value;
+
+    bool operator==(const DeviceEvent&) const = default;
+};
+
+// Lock-free single producer, single consumer ring of events.
+template <std::size_t Capacity>
+class Mailbox
+{
+public:
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be power of 2");
+
+    Mailbox()
+        : events_{}
+        , head_{0}
+        , tail_{0}
+    {
+    }
+
+    // Producer side, false when the ring is full.
+    bool push(const DeviceEvent& event)
+    {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == Capacity)
+        {
+            return false;
+        }
+        events_[tail & (Capacity - 1)] = event;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, nullptr when the ring is empty.
+    const DeviceEvent* front() const
+    {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        return &events_[head & (Capacity - 1)];
+    }
+
+    void pop()
+    {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    std::array<DeviceEvent, Capacity> events_;
+    alignas(64) std::atomic<std::size_t> head_;
+    alignas(64) std::atomic<std::size_t> tail_;
+};
+
+// Runs device models on worker threads next to the CPU thread.
+//
+// Emulated time advances in quanta. While the CPU executes quantum k, every
+// device simulates quantum k - 1 on its own thread, so device models always
+// run one quantum behind the CPU and see every event the CPU posted to them
+// for that time range. At the quantum boundary the CPU waits for all
+// devices, then gets their events sorted by stamp and device index.
+// Devices exchange data with the CPU only through mailboxes and handoff
+// happens only at boundaries, so results do not depend on thread timing and
+// match the sequential mode, which runs the same protocol on the CPU thread.
+//
+// Events reach the CPU up to two quanta after their stamp. Urgent events
+// (interrupt requests) halve the quantum down to min_quantum, it grows back
+// after quiet quanta. Adaptation depends only on events, so it is
+// deterministic as well.
+class DeviceScheduler
+{
+public:
+    static constexpr std::size_t mailbox_size = 4096;
+
+    // Access to mailboxes of the device for the quantum it simulates.
+    class Context
+    {
+    public:
+        uint64_t from() const
+        {
+            return from_;
+        }
+
+        uint64_t until() const
+        {
+            return until_;
+        }
+
+        // Next event from the CPU stamped before until(), in posting order.
+        bool next(DeviceEvent& event);
+
+        // Stamp is clamped to the simulated quantum. False when the mailbox is full.
+        bool emit(DeviceEvent event);
+
+    private:
+        friend class DeviceScheduler;
+
+        Context(Mailbox<mailbox_size>& inbox, Mailbox<mailbox_size>& outbox, uint32_t device);
+
+        Mailbox<mailbox_size>& inbox_;
+        Mailbox<mailbox_size>& outbox_;
+        uint32_t device_;
+        uint64_t from_;
+        uint64_t until_;
+    };
+
+    using Model   = std::function<void(Context& context)>;
+    using RunCpu  = std::function<uint64_t(uint64_t instructions)>;
+    using Deliver = std::function<void(const DeviceEvent& event)>;
+
+    enum class Mode
+    {
+        parallel,
+        sequential
+    };
+
+    struct Stats
+    {
+        uint64_t quanta;
+        uint64_t to_devices;
+        uint64_t to_cpu;
+        uint64_t dropped;
+        // time the CPU thread spent waiting for devices at boundaries
+        std::chrono::nanoseconds wait;
+    };
+
+    DeviceScheduler(uint64_t quantum = 10000, uint64_t min_quantum = 500, Mode mode = Mode::parallel);
+    ~DeviceScheduler();
+
+    DeviceScheduler(const DeviceScheduler&) = delete;
+    DeviceScheduler& operator=(const DeviceScheduler&) = delete;
+
+    // Returns index of the device, used by post() and DeviceEvent::device.
+    uint32_t add_device(std::string name, Model model);
+
+    // CPU thread posts an event for the device, stamps earlier than the
+    // current quantum or than the previous event are moved forward. When the
+    // inbox is full the CPU waits for the device to finish its quantum, the
+    // event is dropped only if it does not fit then, as in sequential mode.
+    bool post(uint32_t device, DeviceEvent event);
+
+    // Runs the CPU and devices for given number of instructions, run_cpu
+    // executes one quantum and returns executed instructions, deliver gets
+    // device events at boundaries. Returns executed instructions.
+    uint64_t run(uint64_t instructions, const RunCpu& run_cpu, const Deliver& deliver);
+
+    // Lets devices catch up with the CPU and delivers their events.
+    void sync(const Deliver& deliver);
+
+    // Start of the quantum which the CPU is executing.
+    uint64_t now() const
+    {
+        return time_;
+    }
+
+    uint64_t quantum() const
+    {
+        return quantum_;
+    }
+
+    const Stats& stats() const
+    {
+        return stats_;
+    }
+
+private:
+    struct Device
+    {
+        std::string name;
+        Model model;
+        Mailbox<mailbox_size> inbox;
+        Mailbox<mailbox_size> outbox;
+        Context context;
+        uint64_t last_post;
+        // sequence number of requested and finished quantum
+        std::atomic<uint64_t> job;
+        std::atomic<uint64_t> done;
+        std::thread thread;
+
+        Device(std::string name, Model model, uint32_t index);
+    };
+
+    void work(Device& device);
+    void start_devices(uint64_t from, uint64_t until);
+    void finish_devices();
+    // CPU thread waits until the device finished the quantum it was started for.
+    void wait_device(Device& device);
+    void deliver_events(const Deliver& deliver);
+
+    uint64_t quantum_;
+    uint64_t max_quantum_;
+    uint64_t min_quantum_;
+    Mode mode_;
+    uint64_t time_;
+    uint64_t device_time_;
+    uint64_t sequence_;
+    uint64_t quiet_;
+    std::atomic<bool> stop_;
+    std::vector<std::unique_ptr<Device>> devices_;
+    std::vector<DeviceEvent> events_;
+    Stats stats_;
+};
+
+} // namespace msemu
@@ -0,0 +1,299 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "dynamic_bus.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+
+#include "lz.hpp"
+
+namespace msemu
+{
+
+DynamicBus::DynamicBus()
+    : table_(new Table{})
+    , reader_generation_(0)
+    , writer_{}
+    , regions_{}
+    , retired_{}
+    , cold_stats_{}
+{
+}
+
+DynamicBus::~DynamicBus()
+{
+    delete table_.load(std::memory_order_relaxed);
+}
+
+bool DynamicBus::map_ram(std::string_view name, const uint32_t start, const uint32_t size,
+                         const bool compressible)
+{
+    if (compressible && size % cold_page_size != 0)
+    {
+        printf("ERR: Compressible device %s size 0x%x is not aligned to cold pages\n",
+               std::string(name).c_str(), size);
+        return false;
+    }
+    HostMemory memory(size);
+    std::vector<ColdPage> cold(compressible ? size / cold_page_size : 0);
+    return map(std::make_unique<Region>(
+        Region{std::string(name), start, size, std::move(memory), true, nullptr, nullptr, std::move(cold),
+               false}));
+}
+
+bool DynamicBus::map_rom(std::string_view name, const uint32_t start, std::span<const uint8_t> image)
+{
+    // ROM occupies whole pages, the tail is filled like erased flash
+    const uint32_t size = static_cast<uint32_t>((image.size() + page_size - 1) & ~(page_size - 1));
+    HostMemory memory(size);
+    std::fill_n(memory.data(), memory.size(), 0xff);
+    std::copy(image.begin(), image.end(), memory.data());
+    return map(std::make_unique<Region>(
+        Region{std::string(name), start, size, std::move(memory), false, nullptr, nullptr, {}, false}));
+}
+
+bool DynamicBus::map_mmio(std::string_view name, const uint32_t start, const uint32_t size, Read read,
+                          Write write)
+{
+    return map(std::make_unique<Region>(
+        Region{std::string(name), start, size, {}, true, std::move(read), std::move(write), {}, false}));
+}
+
+bool DynamicBus::map(std::unique_ptr<Region> region)
+{
+    const uint64_t end = static_cast<uint64_t>(region->start) + region->size;
+    if (region->size == 0 || region->start % page_size != 0 || region->size % page_size != 0 ||
+        end > address_space)
+    {
+        printf("ERR: Device %s at 0x%05x, size 0x%x is not page aligned or out of range\n",
+               region->name.c_str(), region->start, region->size);
+        return false;
+    }
+
+    std::lock_guard lock(writer_);
+    for (const auto& mapped : regions_)
+    {
+        if (mapped->name == region->name)
+        {
+            printf("ERR: Device %s is already mapped\n", region->name.c_str());
+            return false;
+        }
+        if (region->start < mapped->start + mapped->size && mapped->start < end)
+        {
+            printf("ERR: Device %s overlaps %s\n", region->name.c_str(), mapped->name.c_str());
+            return false;
+        }
+    }
+
+    auto table = std::make_unique<Table>(*table_.load(std::memory_order_relaxed));
+    std::fill_n(&table->pages[region->start >> page_bits], region->size >> page_bits, region.get());
+    regions_.push_back(std::move(region));
+    publish(std::move(table), nullptr);
+    return true;
+}
+
+bool DynamicBus::unmap(std::string_view name)
+{
+    std::lock_guard lock(writer_);
+    const auto it = std::find_if(regions_.begin(), regions_.end(),
+                                 [name](const auto& region) { return region->name == name; });
+    if (it == regions_.end())
+    {
+        printf("ERR: Device %s is not mapped\n", std::string(name).c_str());
+        return false;
+    }
+
+    auto table = std::make_unique<Table>(*table_.load(std::memory_order_relaxed));
+    std::fill_n(&table->pages[(*it)->start >> page_bits], (*it)->size >> page_bits, nullptr);
+    std::unique_ptr<Region> region = std::move(*it);
+    regions_.erase(it);
+    publish(std::move(table), std::move(region));
+    return true;
+}
+
+void DynamicBus::publish(std::unique_ptr<Table> table, std::unique_ptr<Region> unmapped)
+{
+    table->generation = table_.load(std::memory_order_relaxed)->generation + 1;
+    const uint64_t generation = table->generation;
+
+    // reader may still use the old table and the unmapped device until it reports the new generation
+    std::unique_ptr<Table> old(table_.exchange(table.release(), std::memory_order_acq_rel));
+    retired_.push_back(Retired{generation, std::move(old), std::move(unmapped)});
+    collect_locked();
+}
+
+std::size_t DynamicBus::collect()
+{
+    std::lock_guard lock(writer_);
+    return collect_locked();
+}
+
+std::size_t DynamicBus::collect_locked()
+{
+    const uint64_t seen = reader_generation_.load(std::memory_order_acquire);
+    std::erase_if(retired_, [seen](const Retired& retired) { return retired.generation <= seen; });
+    return retired_.size();
+}
+
+std::size_t DynamicBus::age(const uint8_t cold_after)
+{
+    std::lock_guard lock(writer_);
+    std::size_t compressed = 0;
+    for (const auto& region : regions_)
+    {
+        if (region->pinned)
+        {
+            continue;
+        }
+        for (uint32_t page = 0; page < region->cold.size(); ++page)
+        {
+            ColdPage& cold = region->cold[page];
+            if (cold.compressed)
+            {
+                continue;
+            }
+            if (cold.accessed)
+            {
+                cold.accessed = false;
+                cold.age      = 0;
+                continue;
+            }
+            cold.age = static_cast<uint8_t>(std::min(cold.age + 1, 0xff));
+            if (cold.age < cold_after)
+            {
+                continue;
+            }
+            if (compress(*region, page))
+            {
+                ++compressed;
+            }
+            else
+            {
+                // incompressible, try again after another cold period
+                cold.age = 0;
+            }
+        }
+    }
+
+    // host ranges cached by the CPU point to released pages and hide accesses
+    publish(std::make_unique<Table>(*table_.load(std::memory_order_relaxed)), nullptr);
+    // the caller is the reader between slices, it drops cached ranges before the next access,
+    // so retired objects can go now instead of staying with a paused guest
+    reader_generation_.store(table_.load(std::memory_order_relaxed)->generation, std::memory_order_release);
+    collect_locked();
+    return compressed;
+}
+
+bool DynamicBus::compress(Region& region, const uint32_t page)
+{
+    ColdPage& cold                  = region.cold[page];
+    const std::span<uint8_t> memory = region.span().subspan(page * cold_page_size, cold_page_size);
+
+    // zero filled pages need no data, released memory reads back as zeros
+    if (std::any_of(memory.begin(), memory.end(), [](const uint8_t byte) { return byte != 0; }))
+    {
+        std::array<uint8_t, lz::max_compressed_size(cold_page_size)> buffer;
+        const std::size_t size = lz::compress(memory, buffer);
+        if (size == 0 || size >= cold_page_size)
+        {
+            return false;
+        }
+        cold.data.assign(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(size));
+    }
+
+    region.memory.release(page * cold_page_size, cold_page_size);
+    cold.compressed = true;
+    ++cold_stats_.compressed_pages;
+    cold_stats_.pool_bytes += cold.data.size();
+    return true;
+}
+
+void DynamicBus::decompress(Region& region, const uint32_t page)
+{
+    const auto begin                = std::chrono::steady_clock::now();
+    ColdPage& cold                  = region.cold[page];
+    const std::span<uint8_t> memory = region.span().subspan(page * cold_page_size, cold_page_size);
+
+    if (!cold.data.empty() && !lz::decompress(cold.data, memory))
+    {
+        printf("ERR: Compressed page %u of %s is corrupted\n", page, region.name.c_str());
+    }
+    --cold_stats_.compressed_pages;
+    cold_stats_.pool_bytes -= cold.data.size();
+    cold.data       = {};
+    cold.compressed = false;
+    cold.age        = 0;
+
+    const auto elapsed =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin);
+    ++cold_stats_.decompressions;
+    cold_stats_.touch_total += elapsed;
+    cold_stats_.touch_max = std::max(cold_stats_.touch_max, elapsed);
+}
+
+void DynamicBus::print() const
+{
+    std::lock_guard lock(writer_);
+    for (const auto& region : regions_)
+    {
+        printf("%s start: 0x%08x, end: 0x%08x%s%s\n", region->name.c_str(), region->start,
+               region->start + region->size, region->memory.empty() ? " (mmio)" : "",
+               region->cold.empty() ? "" : " (compressible)");
+    }
+}
+
+void DynamicBus::clear()
+{
+    std::lock_guard lock(writer_);
+    for (const auto& region : regions_)
+    {
+        if (!region->writable)
+        {
+            continue;
+        }
+        for (ColdPage& cold : region->cold)
+        {
+            cold_stats_.compressed_pages -= cold.compressed ? 1 : 0;
+            cold_stats_.pool_bytes -= cold.data.size();
+            cold = ColdPage{};
+        }
+        region->memory.clear();
+    }
+}
+
+MemoryView DynamicBus::get(const char* name)
+{
+    std::lock_guard lock(writer_);
+    for (const auto& region : regions_)
+    {
+        if (region->name == name)
+        {
+            // view bypasses access tracking, so the whole device has to stay resident
+            for (uint32_t page = 0; page < region->cold.size(); ++page)
+            {
+                touch(*region, page);
+            }
+            region->pinned = true;
+            return MemoryView(region->span(), region->start);
+        }
+    }
+    return MemoryView(std::span<uint8_t>(), 0);
+}
+
+} // namespace msemu
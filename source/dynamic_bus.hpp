@@ -0,0 +1,330 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "memory.hpp"
+
+namespace msemu
+{
+
+// Bus which devices are mapped and unmapped while the guest runs, i.e. to
+// inject a test ROM or to move a RAM window from the control plane.
+//
+// Address space is split into pages, the page table points to the device
+// of every page. The CPU thread reads the current table with a single load
+// and no lock. Writers are serialized, copy the table, modify the copy and
+// publish it with one atomic store. Replaced tables and unmapped devices
+// are retired and released once the CPU thread reported a quiescent state
+// with the new generation (Cpu does that at the start of every run()), at
+// which point it also drops translations cached in its TLB.
+//
+// Only one thread may read through the bus, any number may map and unmap.
+//
+// RAM mapped as compressible is tracked in cold pages for idle guests. A page
+// is marked as accessed when the CPU translates it (host_range() hands out one
+// cold page at a time) or touches it byte by byte. age() compresses pages not
+// accessed for a number of calls into a pool and returns their host memory to
+// the kernel, the next access decompresses the page on the slow path. age()
+// publishes a new generation, so translations cached by the CPU are dropped
+// and accessed bits are sampled again, like a TLB shootdown on a real MMU.
+// Views from get() bypass tracking, so a device handed out by get() is
+// pinned and never compressed again.
+class DynamicBus
+{
+public:
+    // Covers segment:offset addresses above 1 MiB up to ffff:ffff.
+    constexpr static uint32_t address_space = 0x110000;
+    constexpr static uint32_t page_bits     = 8;
+    constexpr static uint32_t page_size     = 1u << page_bits;
+    constexpr static uint32_t page_count    = address_space / page_size;
+
+    constexpr static uint32_t cold_page_size = 4096;
+
+    // Devices are known only at runtime, Cpu always translates through its TLB.
+    constexpr static std::size_t device_count = page_count;
+
+    // MMIO handlers get offset from the start of the device.
+    using Read  = std::function<uint8_t(uint32_t offset)>;
+    using Write = std::function<void(uint32_t offset, uint8_t value)>;
+
+    struct ColdPage
+    {
+        bool accessed;
+        bool compressed;
+        // age() calls since the last access
+        uint8_t age;
+        // compressed content, empty for zero filled page
+        std::vector<uint8_t> data;
+    };
+
+    struct Region
+    {
+        std::string name;
+        uint32_t start;
+        uint32_t size;
+        // empty for MMIO devices
+        HostMemory memory;
+        bool writable;
+        Read read;
+        Write write;
+        // empty unless RAM is compressible
+        std::vector<ColdPage> cold;
+        // get() handed out a view, age() leaves the device resident
+        bool pinned;
+
+        std::span<uint8_t> span()
+        {
+            return memory.span();
+        }
+
+        std::span<const uint8_t> span() const
+        {
+            return memory.span();
+        }
+    };
+
+    struct ColdStats
+    {
+        std::size_t compressed_pages;
+        // size of compressed data of all pages
+        std::size_t pool_bytes;
+        uint64_t decompressions;
+        // time spent by the first access to compressed page
+        std::chrono::nanoseconds touch_total;
+        std::chrono::nanoseconds touch_max;
+    };
+
+    DynamicBus();
+    ~DynamicBus();
+
+    DynamicBus(const DynamicBus&) = delete;
+    DynamicBus& operator=(const DynamicBus&) = delete;
+
+    // Start and size of devices must be aligned to page_size, size of
+    // compressible RAM to cold_page_size.
+    bool map_ram(std::string_view name, uint32_t start, uint32_t size, bool compressible = false);
+    bool map_rom(std::string_view name, uint32_t start, std::span<const uint8_t> image);
+    bool map_mmio(std::string_view name, uint32_t start, uint32_t size, Read read, Write write);
+    bool unmap(std::string_view name);
+
+    // CPU thread side, see Remappable.
+    bool quiescent(uint64_t& seen)
+    {
+        const uint64_t current = table_.load(std::memory_order_acquire)->generation;
+        reader_generation_.store(current, std::memory_order_release);
+        const bool changed = seen != current;
+        seen               = current;
+        return changed;
+    }
+
+    uint64_t generation() const
+    {
+        return table_.load(std::memory_order_acquire)->generation;
+    }
+
+    // Releases retired tables and devices which the reader can't see anymore,
+    // map and unmap do it as well. Returns number of still retired objects.
+    std::size_t collect();
+
+    // CPU thread side, called between run() slices. Compresses pages of
+    // compressible RAM which were not accessed for cold_after calls, returns
+    // number of pages compressed by this call.
+    std::size_t age(uint8_t cold_after);
+
+    ColdStats cold_stats() const
+    {
+        return cold_stats_;
+    }
+
+    void print() const;
+    void clear();
+
+    // View stays valid until the device is unmapped, the device is pinned
+    // resident for the rest of its lifetime.
+    MemoryView get(const char* name);
+
+    template <typename DataType>
+    DataType read(const uint32_t address)
+    {
+        if constexpr (sizeof(DataType) == 1)
+        {
+            return static_cast<DataType>(read_byte(address));
+        }
+        else
+        {
+            return static_cast<DataType>(read_byte(address) | read_byte(address + 1) << 8);
+        }
+    }
+
+    void read(const uint32_t address, std::span<uint8_t> data)
+    {
+        for (std::size_t i = 0; i < data.size(); ++i)
+        {
+            data[i] = read_byte(static_cast<uint32_t>(address + i));
+        }
+    }
+
+    void write(const uint32_t address, const std::span<const uint8_t> data)
+    {
+        for (std::size_t i = 0; i < data.size(); ++i)
+        {
+            write_byte(static_cast<uint32_t>(address + i), data[i]);
+        }
+    }
+
+    void write(const uint32_t address, const auto data)
+    {
+        if constexpr (std::is_integral_v<decltype(data)>)
+        {
+            for (std::size_t i = 0; i < sizeof(data); ++i)
+            {
+                write_byte(static_cast<uint32_t>(address + i), static_cast<uint8_t>(data >> (8 * i)));
+            }
+        }
+        else
+        {
+            write(address, std::span<const uint8_t>(data));
+        }
+    }
+
+    // Host memory of device which contains address, empty for MMIO or unmapped.
+    HostRange host_range(const uint32_t address)
+    {
+        Region* region = find(address);
+        if (region == nullptr || region->memory.empty())
+        {
+            return HostRange{};
+        }
+        if (!region->cold.empty())
+        {
+            const uint32_t page = (address - region->start) / cold_page_size;
+            touch(*region, page);
+            return HostRange{region->start + page * cold_page_size, cold_page_size,
+                             region->memory.data() + page * cold_page_size, region->writable};
+        }
+        return HostRange{region->start, region->size, region->memory.data(), region->writable};
+    }
+
+private:
+    struct Table
+    {
+        uint64_t generation;
+        std::array<Region*, page_count> pages;
+    };
+
+    struct Retired
+    {
+        uint64_t generation;
+        std::unique_ptr<Table> table;
+        std::unique_ptr<Region> region;
+    };
+
+    Region* find(const uint32_t address) const
+    {
+        const uint32_t page = address >> page_bits;
+        // acquire pairs with the release store of the writer, both are plain moves on x86
+        const Table* table = table_.load(std::memory_order_acquire);
+        return page < page_count ? table->pages[page] : nullptr;
+    }
+
+    inline void touch(Region& region, const uint32_t page)
+    {
+        ColdPage& cold = region.cold[page];
+        cold.accessed  = true;
+        if (cold.compressed) [[unlikely]]
+        {
+            decompress(region, page);
+        }
+    }
+
+    uint8_t read_byte(const uint32_t address)
+    {
+        Region* region = find(address);
+        if (region == nullptr)
+        {
+            return 0;
+        }
+        const uint32_t offset = address - region->start;
+        if (region->memory.empty())
+        {
+            return region->read ? region->read(offset) : 0;
+        }
+        if (!region->cold.empty())
+        {
+            touch(*region, offset / cold_page_size);
+        }
+        return region->memory[offset];
+    }
+
+    void write_byte(const uint32_t address, const uint8_t value)
+    {
+        Region* region = find(address);
+        if (region == nullptr)
+        {
+            return;
+        }
+        const uint32_t offset = address - region->start;
+        if (region->memory.empty())
+        {
+            if (region->write)
+            {
+                region->write(offset, value);
+            }
+        }
+        else if (region->writable)
+        {
+            if (!region->cold.empty())
+            {
+                touch(*region, offset / cold_page_size);
+            }
+            region->memory[offset] = value;
+        }
+    }
+
+    bool compress(Region& region, uint32_t page);
+    [[gnu::cold, gnu::noinline]] void decompress(Region& region, uint32_t page);
+
+    bool map(std::unique_ptr<Region> region);
+    void publish(std::unique_ptr<Table> table, std::unique_ptr<Region> unmapped);
+    std::size_t collect_locked();
+
+    std::atomic<Table*> table_;
+    std::atomic<uint64_t> reader_generation_;
+    mutable std::mutex writer_;
+    // owned by writers, the table only points to them
+    std::vector<std::unique_ptr<Region>> regions_;
+    std::vector<Retired> retired_;
+    // updated by the CPU thread only
+    ColdStats cold_stats_;
+};
+
+} // namespace msemu
@@ -0,0 +1,360 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "fleet.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <poll.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace msemu
+{
+
+namespace
+{
+
+// Sums "<name>: <value> kB" lines of /proc file, which names start with prefix.
+std::size_t read_kb(const char* path, const char* prefix)
+{
+    FILE* file = fopen(path, "r");
+    if (file == nullptr)
+    {
+        return 0;
+    }
+
+    std::size_t total = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        if (std::strncmp(line, prefix, std::strlen(prefix)) != 0)
+        {
+            continue;
+        }
+        const char* value = std::strchr(line, ':');
+        unsigned long kb  = 0;
+        if (value != nullptr && sscanf(value + 1, "%lu", &kb) == 1)
+        {
+            total += kb;
+        }
+    }
+    fclose(file);
+    return total * 1024;
+}
+
+std::size_t read_process_kb(const int pid, const char* prefix)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", pid);
+    return read_kb(path, prefix);
+}
+
+// Parses cpulist format used by sysfs, i.e. "0-3,8-11".
+std::vector<int> parse_cpu_list(const char* path)
+{
+    std::vector<int> cpus;
+    FILE* file = fopen(path, "r");
+    if (file == nullptr)
+    {
+        return cpus;
+    }
+
+    int first = 0;
+    while (fscanf(file, "%d", &first) == 1)
+    {
+        int last = first;
+        int next = fgetc(file);
+        if (next == '-')
+        {
+            if (fscanf(file, "%d", &last) != 1)
+            {
+                break;
+            }
+            next = fgetc(file);
+        }
+        for (int cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(cpu);
+        }
+        if (next != ',')
+        {
+            break;
+        }
+    }
+    fclose(file);
+    return cpus;
+}
+
+// Returns true when instance exited, options are passed to waitpid.
+bool reap(Fleet::Instance& instance, const int options)
+{
+    int status = 0;
+    pid_t result;
+    while ((result = waitpid(instance.pid, &status, options)) < 0 && errno == EINTR)
+    {
+    }
+    if (result != instance.pid)
+    {
+        return false;
+    }
+    instance.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    return true;
+}
+
+std::vector<std::vector<int>> read_topology()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+
+    std::vector<std::vector<int>> nodes;
+    for (const int node : parse_cpu_list("/sys/devices/system/node/online"))
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        std::vector<int> cpus;
+        for (const int cpu : parse_cpu_list(path))
+        {
+            if (CPU_ISSET(static_cast<std::size_t>(cpu), &allowed))
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        if (!cpus.empty())
+        {
+            nodes.push_back(std::move(cpus));
+        }
+    }
+
+    if (nodes.empty())
+    {
+        nodes.emplace_back();
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(static_cast<std::size_t>(cpu), &allowed))
+            {
+                nodes.back().push_back(cpu);
+            }
+        }
+    }
+    return nodes;
+}
+
+} // namespace
+
+Fleet::Fleet(const std::size_t instances, const Placement placement)
+    : instances_(instances)
+    , placement_(placement)
+    , nodes_(read_topology())
+    , report_{}
+{
+}
+
+void Fleet::place(Instance& instance, const std::size_t index) const
+{
+    instance.node = -1;
+    instance.cpu  = -1;
+    if (placement_ == Placement::none || nodes_.empty() || nodes_[0].empty())
+    {
+        return;
+    }
+
+    // spread instances over nodes first, then over CPUs of the node
+    const std::size_t node_index = index % nodes_.size();
+    const auto& cpus             = nodes_[node_index];
+    instance.node                = static_cast<int>(node_index);
+    instance.cpu                 = cpus[(index / nodes_.size()) % cpus.size()];
+}
+
+void Fleet::pin(const Instance& instance) const
+{
+    if (instance.cpu < 0)
+    {
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (placement_ == Placement::cpu)
+    {
+        CPU_SET(static_cast<std::size_t>(instance.cpu), &set);
+    }
+    else
+    {
+        for (const int cpu : nodes_[static_cast<std::size_t>(instance.node)])
+        {
+            CPU_SET(static_cast<std::size_t>(cpu), &set);
+        }
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+void Fleet::share(std::span<uint8_t> memory)
+{
+    const auto page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const auto begin     = (reinterpret_cast<uintptr_t>(memory.data()) + page_size - 1) & ~(page_size - 1);
+    const auto end       = (reinterpret_cast<uintptr_t>(memory.data() + memory.size())) & ~(page_size - 1);
+    if (end > begin)
+    {
+        // fails when kernel is built without KSM, fork sharing still works
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_MERGEABLE);
+    }
+}
+
+bool Fleet::run(const Run& run)
+{
+    int done[2];
+    int release[2];
+    if (pipe(done) != 0)
+    {
+        printf("ERR: Can't create fleet pipes\n");
+        return false;
+    }
+    if (pipe(release) != 0)
+    {
+        close(done[0]);
+        close(done[1]);
+        printf("ERR: Can't create fleet pipes\n");
+        return false;
+    }
+
+    fflush(stdout);
+    report_ = {};
+    for (std::size_t i = 0; i < instances_; ++i)
+    {
+        Instance instance{0, -1, -1, -1, 0, 0};
+        place(instance, i);
+        const pid_t pid = fork();
+        if (pid == 0)
+        {
+            // pinned before guest touches memory, so private copies are node local
+            pin(instance);
+            close(done[0]);
+            close(release[1]);
+            const int exit_code = run(i);
+            const char finished = 1;
+            static_cast<void>(write(done[1], &finished, sizeof(finished)));
+            // stay alive until the parent measured memory of all instances
+            char byte;
+            static_cast<void>(read(release[0], &byte, sizeof(byte)));
+            fflush(stdout);
+            _exit(exit_code);
+        }
+        if (pid < 0)
+        {
+            printf("ERR: Fleet fork failed for instance %zu\n", i);
+            break;
+        }
+        instance.pid = pid;
+        report_.instances.push_back(instance);
+    }
+
+    close(done[1]);
+    close(release[0]);
+
+    // pipe EOF never comes while other instances keep the write end open, so an
+    // instance which crashed before reporting is noticed when it is reaped
+    std::vector<bool> reaped(report_.instances.size(), false);
+    std::size_t finished = 0;
+    std::size_t exited   = 0;
+    while (finished + exited < report_.instances.size())
+    {
+        pollfd fd{done[0], POLLIN, 0};
+        const int ready = poll(&fd, 1, 10);
+        if (ready < 0 && errno != EINTR)
+        {
+            break;
+        }
+        if (ready > 0)
+        {
+            char byte;
+            const ssize_t size = read(done[0], &byte, sizeof(byte));
+            if (size == 0 || (size < 0 && errno != EINTR))
+            {
+                break;
+            }
+            finished += size > 0 ? 1 : 0;
+        }
+        for (std::size_t i = 0; i < report_.instances.size(); ++i)
+        {
+            if (!reaped[i] && reap(report_.instances[i], WNOHANG))
+            {
+                reaped[i] = true;
+                ++exited;
+            }
+        }
+    }
+    close(done[0]);
+
+    measure();
+    close(release[1]);
+
+    bool ok = report_.instances.size() == instances_;
+    for (std::size_t i = 0; i < report_.instances.size(); ++i)
+    {
+        if (!reaped[i])
+        {
+            reap(report_.instances[i], 0);
+        }
+        ok = ok && report_.instances[i].exit_code == 0;
+    }
+    return ok;
+}
+
+void Fleet::measure()
+{
+    std::size_t private_bytes = 0;
+    for (auto& instance : report_.instances)
+    {
+        instance.private_bytes = read_process_kb(instance.pid, "Private_");
+        instance.shared_bytes  = read_process_kb(instance.pid, "Shared_");
+        private_bytes += instance.private_bytes;
+        report_.shared_bytes = std::max(report_.shared_bytes, instance.shared_bytes);
+    }
+
+    if (report_.instances.empty())
+    {
+        return;
+    }
+    report_.private_bytes_per_instance = private_bytes / report_.instances.size();
+
+    const std::size_t available = read_kb("/proc/meminfo", "MemAvailable");
+    if (report_.private_bytes_per_instance != 0 && available > report_.shared_bytes)
+    {
+        report_.instances_per_host = (available - report_.shared_bytes) / report_.private_bytes_per_instance;
+    }
+}
+
+void Fleet::print_report() const
+{
+    for (const auto& instance : report_.instances)
+    {
+        printf("instance %d: exit: %d, node: %d, cpu: %d, private: %zu KiB, shared: %zu KiB\n", instance.pid,
+               instance.exit_code, instance.node, instance.cpu, instance.private_bytes / 1024,
+               instance.shared_bytes / 1024);
+    }
+    printf("memory per instance: %zu KiB, shared: %zu KiB, instances per host: %zu\n",
+           report_.private_bytes_per_instance / 1024, report_.shared_bytes / 1024, report_.instances_per_host);
+}
+
+} // namespace msemu
@@ -0,0 +1,104 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+namespace msemu
+{
+
+// Runs many instances of the same machine.
+//
+// CPU registers are process wide, so every instance is a process forked from
+// the template machine prepared by the caller. Pages of the template (loaded
+// ROM, BIOS, zeroed RAM) stay shared between all instances until an instance
+// writes to them, then the kernel gives that instance a private copy. Memory
+// passed to share() is additionally marked for kernel same-page merging, so
+// pages which become identical later are merged back by content.
+//
+// Instances can be pinned to a NUMA node or to a single CPU for their whole
+// lifetime. Private pages are allocated on first write by the instance itself,
+// so with pinning they land on the local node of the instance.
+class Fleet
+{
+public:
+    enum class Placement
+    {
+        none, // scheduler decides
+        node, // instance may move only between CPUs of its node
+        cpu   // instance stays on one CPU
+    };
+
+    struct Instance
+    {
+        int pid;
+        int exit_code;
+        int node;
+        int cpu;
+        std::size_t private_bytes;
+        std::size_t shared_bytes;
+    };
+
+    struct Report
+    {
+        std::vector<Instance> instances;
+        std::size_t private_bytes_per_instance;
+        std::size_t shared_bytes;
+        std::size_t instances_per_host;
+    };
+
+    // Returns exit code of instance.
+    using Run = std::function<int(std::size_t index)>;
+
+    explicit Fleet(std::size_t instances, Placement placement = Placement::none);
+
+    void share(std::span<uint8_t> memory);
+
+    template <typename BusType>
+    void share(BusType& bus)
+    {
+        bus.for_each_device([this](auto& device) { share(device.span()); });
+    }
+
+    // Starts all instances and waits until every one of them finished.
+    // Memory is measured while finished instances are still alive.
+    bool run(const Run& run);
+
+    const Report& report() const
+    {
+        return report_;
+    }
+
+    void print_report() const;
+
+private:
+    void measure();
+    void place(Instance& instance, std::size_t index) const;
+    void pin(const Instance& instance) const;
+
+    std::size_t instances_;
+    Placement placement_;
+    // online CPUs of every NUMA node
+    std::vector<std::vector<int>> nodes_;
+    Report report_;
+};
+
+} // namespace msemu
@@ -0,0 +1,171 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "host_memory.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace msemu
+{
+
+HostMemory::HostMemory()
+    : data_(nullptr)
+    , size_(0)
+{
+}
+
+HostMemory::HostMemory(const std::size_t size)
+    : data_(nullptr)
+    , size_(0)
+{
+    if (size == 0)
+    {
+        return;
+    }
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED)
+    {
+        // guest can't run without its memory, fail like operator new does
+        printf("ERR: Can't map %zu bytes of host memory\n", size);
+        throw std::bad_alloc();
+    }
+    data_ = static_cast<uint8_t*>(data);
+    size_ = size;
+}
+
+HostMemory::~HostMemory()
+{
+    if (data_ != nullptr)
+    {
+        munmap(data_, size_);
+    }
+}
+
+HostMemory::HostMemory(const HostMemory& other)
+    : HostMemory(other.size_)
+{
+    copy_pages(other.span(), true);
+}
+
+HostMemory& HostMemory::operator=(const HostMemory& other)
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+    const bool fresh = size_ != other.size_;
+    if (fresh)
+    {
+        *this = HostMemory(other.size_);
+    }
+    copy_pages(other.span(), fresh);
+    return *this;
+}
+
+HostMemory::HostMemory(HostMemory&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0))
+{
+}
+
+HostMemory& HostMemory::operator=(HostMemory&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (data_ != nullptr)
+        {
+            munmap(data_, size_);
+        }
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+std::size_t HostMemory::page_size()
+{
+    static const auto size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+void HostMemory::release(const std::size_t offset, const std::size_t size)
+{
+    // the mapping starts page aligned, so only offsets have to be rounded
+    const std::size_t mask  = page_size() - 1;
+    const std::size_t begin = (offset + mask) & ~mask;
+    const std::size_t end   = std::min(offset + size, size_) & ~mask;
+    if (data_ != nullptr && end > begin)
+    {
+        madvise(data_ + begin, end - begin, MADV_DONTNEED);
+    }
+}
+
+void HostMemory::clear()
+{
+    release(0, size_);
+    // partial page at the end can't be released
+    const std::size_t tail = size_ & ~(page_size() - 1);
+    if (data_ != nullptr)
+    {
+        std::memset(data_ + tail, 0, size_ - tail);
+    }
+}
+
+void HostMemory::assign(std::span<const uint8_t> source)
+{
+    copy_pages(source, false);
+}
+
+void HostMemory::copy_pages(std::span<const uint8_t> source_memory, const bool fresh)
+{
+    const auto is_zero = [](const uint8_t* data, const std::size_t size)
+    { return std::all_of(data, data + size, [](const uint8_t byte) { return byte == 0; }); };
+
+    const std::size_t size = std::min(size_, source_memory.size());
+    for (std::size_t offset = 0; offset < size; offset += page_size())
+    {
+        const std::size_t chunk = std::min(page_size(), size - offset);
+        uint8_t* target         = data_ + offset;
+        const uint8_t* source   = source_memory.data() + offset;
+        // reading pages which were never written does not commit them
+        if (!is_zero(source, chunk))
+        {
+            std::memcpy(target, source, chunk);
+        }
+        else if (fresh)
+        {
+            continue;
+        }
+        else if (chunk < page_size())
+        {
+            std::memset(target, 0, chunk);
+        }
+        else if (!is_zero(target, chunk))
+        {
+            release(offset, chunk);
+        }
+    }
+}
+
+} // namespace msemu
@@ -0,0 +1,106 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace msemu
+{
+
+// Zero filled anonymous mapping. Until the first write every page is backed
+// by the shared zero page of the kernel, so only written pages cost memory.
+// release() gives pages back, after which they read as zeros again. Copies
+// stay sparse, zero pages of the source are not committed in the copy.
+class HostMemory
+{
+public:
+    HostMemory();
+    // Throws std::bad_alloc when the mapping can't be created.
+    explicit HostMemory(std::size_t size);
+    ~HostMemory();
+
+    HostMemory(const HostMemory& other);
+    HostMemory& operator=(const HostMemory& other);
+    HostMemory(HostMemory&& other) noexcept;
+    HostMemory& operator=(HostMemory&& other) noexcept;
+
+    // Host page size, release() works on whole pages.
+    static std::size_t page_size();
+
+    // Drops pages fully inside [offset, offset + size).
+    void release(std::size_t offset, std::size_t size);
+
+    // Zeroes whole memory by releasing its pages.
+    void clear();
+
+    // Copies source to the start of memory, zero pages of source are released
+    // instead of written, so the memory stays as sparse as a copy would.
+    void assign(std::span<const uint8_t> source);
+
+    uint8_t* data()
+    {
+        return data_;
+    }
+
+    const uint8_t* data() const
+    {
+        return data_;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    uint8_t& operator[](const std::size_t index)
+    {
+        return data_[index];
+    }
+
+    uint8_t operator[](const std::size_t index) const
+    {
+        return data_[index];
+    }
+
+    std::span<uint8_t> span()
+    {
+        return {data_, size_};
+    }
+
+    std::span<const uint8_t> span() const
+    {
+        return {data_, size_};
+    }
+
+private:
+    // Fresh target is known to be zero and is not read, reads would map the
+    // zero page into it.
+    void copy_pages(std::span<const uint8_t> source, bool fresh);
+
+    uint8_t* data_;
+    std::size_t size_;
+};
+
+} // namespace msemu
@@ -0,0 +1,221 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "8086_cpu.hpp"
+#include "8086_reference_cpu.hpp"
+#include "8086_state.hpp"
+#include "core_dump.hpp"
+#include "tracing_bus.hpp"
+
+namespace msemu::cpu8086
+{
+
+// Runs the fast Cpu and the ReferenceCpu side by side, one instruction at a
+// time. The fast core works on the given bus, the reference on a private copy
+// of it, and after every instruction registers, defined flags and the bytes
+// written to memory are compared.
+template <typename BusType>
+class Lockstep
+{
+public:
+    enum class Result
+    {
+        running,
+        diverged,
+        fast_stopped,
+        reference_stopped
+    };
+
+    using FastCore      = Cpu<TracingBus<BusType>>;
+    using ReferenceCore = ReferenceCpu<TracingBus<BusType>>;
+
+    Lockstep(BusType& bus)
+        : fast_bus_(bus)
+        , reference_memory_(std::make_unique<BusType>(bus))
+        , reference_bus_(*reference_memory_)
+        , fast_(fast_bus_)
+        , reference_(reference_bus_)
+        , result_{Result::running}
+        , steps_{0}
+        , report_{}
+    {
+        reference_.reset(capture_state());
+    }
+
+    // Starts both cores from the given state and the current content of the bus.
+    void reset(const CpuState& state)
+    {
+        restore_state(state);
+        reference_.reset(state);
+        *reference_memory_ = fast_bus_.bus();
+        result_            = Result::running;
+        steps_             = 0;
+        report_.clear();
+    }
+
+    Result step()
+    {
+        if (result_ != Result::running)
+        {
+            return result_;
+        }
+
+        const CpuState before = capture_state();
+        fast_bus_.clear_writes();
+        reference_bus_.clear_writes();
+
+        fast_.step();
+        if (fast_.error()[0] != '\0')
+        {
+            restore_state(before);
+            report_ = describe("fast core stopped", before) + "    " + fast_.error();
+            return result_ = Result::fast_stopped;
+        }
+
+        if (reference_.step() != ReferenceCore::Status::ok)
+        {
+            report_ = describe("reference core stopped", before);
+            return result_ = Result::reference_stopped;
+        }
+
+        const uint16_t defined = static_cast<uint16_t>(~reference_.undefined_flags());
+        CpuState fast          = capture_state();
+        CpuState reference     = reference_.state();
+        fast.flags &= defined;
+        reference.flags &= defined;
+
+        if (fast != reference || !same_writes())
+        {
+            report_ = describe("divergence", before) + dump_state("fast", fast) +
+                      dump_state("reference", reference) + dump_writes("fast", fast_bus_) +
+                      dump_writes("reference", reference_bus_);
+            return result_ = Result::diverged;
+        }
+
+        ++steps_;
+        return result_;
+    }
+
+    Result run(const std::size_t max_steps)
+    {
+        for (std::size_t i = 0; i < max_steps && step() == Result::running; ++i)
+        {
+        }
+        return result_;
+    }
+
+    Result result() const
+    {
+        return result_;
+    }
+
+    std::size_t steps() const
+    {
+        return steps_;
+    }
+
+    const std::string& report() const
+    {
+        return report_;
+    }
+
+    FastCore& fast()
+    {
+        return fast_;
+    }
+
+    ReferenceCore& reference()
+    {
+        return reference_;
+    }
+
+private:
+    bool same_writes() const
+    {
+        return final_writes(fast_bus_) == final_writes(reference_bus_);
+    }
+
+    static std::map<uint32_t, uint8_t> final_writes(const TracingBus<BusType>& bus)
+    {
+        std::map<uint32_t, uint8_t> writes;
+        for (const auto& write : bus.writes())
+        {
+            writes[write.address] = write.data;
+        }
+        return writes;
+    }
+
+    std::string describe(const char* what, const CpuState& at)
+    {
+        const uint32_t address = physical_address(at.sregs[Register::cs_id], at.ip);
+
+        char instruction[80];
+        disassemble(instruction, sizeof(instruction), address, reference_bus_);
+
+        char line[256];
+        snprintf(line, sizeof(line),
+                 "%s after %zu instructions at %04x:%04x\n"
+                 "    %s\n",
+                 what, steps_, at.sregs[Register::cs_id], at.ip, instruction);
+        return line;
+    }
+
+    static std::string dump_state(const char* name, const CpuState& state)
+    {
+        char line[256];
+        snprintf(line, sizeof(line),
+                 "    %-9s ax: %04x cx: %04x dx: %04x bx: %04x sp: %04x bp: %04x si: %04x di: %04x "
+                 "es: %04x cs: %04x ss: %04x ds: %04x ip: %04x flags: %04x\n",
+                 name, state.regs[0], state.regs[1], state.regs[2], state.regs[3], state.regs[4],
+                 state.regs[5], state.regs[6], state.regs[7], state.sregs[0], state.sregs[1], state.sregs[2],
+                 state.sregs[3], state.ip, state.flags);
+        return line;
+    }
+
+    static std::string dump_writes(const char* name, const TracingBus<BusType>& bus)
+    {
+        std::string writes = "    ";
+        writes += name;
+        writes += " writes:";
+        for (const auto& [address, data] : final_writes(bus))
+        {
+            char entry[24];
+            snprintf(entry, sizeof(entry), " [%05x]=%02x", address, data);
+            writes += entry;
+        }
+        return writes + "\n";
+    }
+
+    TracingBus<BusType> fast_bus_;
+    std::unique_ptr<BusType> reference_memory_;
+    TracingBus<BusType> reference_bus_;
+    FastCore fast_;
+    ReferenceCore reference_;
+    Result result_;
+    std::size_t steps_;
+    std::string report_;
+};
+
+} // namespace msemu::cpu8086
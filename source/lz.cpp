@@ -0,0 +1,241 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "lz.hpp"
+
+#include <array>
+#include <cstring>
+#include <optional>
+
+namespace msemu::lz
+{
+
+namespace
+{
+constexpr std::size_t min_match     = 4;
+constexpr std::size_t hash_bits     = 12;
+constexpr std::size_t max_offset    = 0xffff;
+constexpr std::size_t last_literals = 5;
+
+uint32_t read32(const uint8_t* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t hash(const uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - hash_bits);
+}
+
+class Output
+{
+public:
+    Output(std::span<uint8_t> out)
+        : out_(out)
+        , position_(0)
+    {
+    }
+
+    bool put(const uint8_t byte)
+    {
+        if (position_ >= out_.size())
+        {
+            return false;
+        }
+        out_[position_++] = byte;
+        return true;
+    }
+
+    bool put(const uint8_t* data, const std::size_t size)
+    {
+        if (position_ + size > out_.size())
+        {
+            return false;
+        }
+        std::memcpy(&out_[position_], data, size);
+        position_ += size;
+        return true;
+    }
+
+    bool put_length(std::size_t length)
+    {
+        while (length >= 255)
+        {
+            if (!put(255))
+            {
+                return false;
+            }
+            length -= 255;
+        }
+        return put(static_cast<uint8_t>(length));
+    }
+
+    std::size_t size() const
+    {
+        return position_;
+    }
+
+private:
+    std::span<uint8_t> out_;
+    std::size_t position_;
+};
+
+bool emit(Output& out, const uint8_t* literals, const std::size_t literal_length, const std::size_t offset,
+          const std::size_t match_length)
+{
+    const std::size_t match_code = match_length ? match_length - min_match : 0;
+    const uint8_t token          = static_cast<uint8_t>((literal_length < 15 ? literal_length : 15) << 4 |
+                                               (match_code < 15 ? match_code : 15));
+    if (!out.put(token))
+    {
+        return false;
+    }
+    if (literal_length >= 15 && !out.put_length(literal_length - 15))
+    {
+        return false;
+    }
+    if (!out.put(literals, literal_length))
+    {
+        return false;
+    }
+    if (match_length == 0)
+    {
+        return true;
+    }
+    if (!out.put(static_cast<uint8_t>(offset & 0xff)) || !out.put(static_cast<uint8_t>(offset >> 8)))
+    {
+        return false;
+    }
+    return match_code < 15 || out.put_length(match_code - 15);
+}
+
+} // namespace
+
+std::size_t compress(std::span<const uint8_t> input, std::span<uint8_t> output)
+{
+    std::array<uint32_t, 1 << hash_bits> table{};
+    Output out(output);
+
+    const uint8_t* base     = input.data();
+    const std::size_t size  = input.size();
+    std::size_t anchor      = 0;
+    std::size_t position    = 0;
+    const std::size_t limit = size > min_match + last_literals ? size - min_match - last_literals : 0;
+
+    while (position < limit)
+    {
+        const uint32_t sequence = read32(base + position);
+        const uint32_t h        = hash(sequence);
+        const std::size_t entry = table[h];
+        table[h]                = static_cast<uint32_t>(position + 1);
+
+        // table keeps position + 1, so 0 marks an empty slot
+        const std::size_t candidate = entry - 1;
+        if (entry == 0 || position - candidate > max_offset || read32(base + candidate) != sequence)
+        {
+            ++position;
+            continue;
+        }
+
+        std::size_t length = min_match;
+        while (position + length < size - last_literals &&
+               base[candidate + length] == base[position + length])
+        {
+            ++length;
+        }
+
+        if (!emit(out, base + anchor, position - anchor, position - candidate, length))
+        {
+            return 0;
+        }
+        position += length;
+        anchor = position;
+    }
+
+    if (!emit(out, base + anchor, size - anchor, 0, 0))
+    {
+        return 0;
+    }
+    return out.size();
+}
+
+bool decompress(std::span<const uint8_t> input, std::span<uint8_t> output)
+{
+    std::size_t in  = 0;
+    std::size_t out = 0;
+
+    const auto read_length = [&](std::size_t length) -> std::optional<std::size_t> {
+        if (length != 15)
+        {
+            return length;
+        }
+        uint8_t byte = 255;
+        while (byte == 255)
+        {
+            if (in >= input.size())
+            {
+                return std::nullopt;
+            }
+            byte = input[in++];
+            length += byte;
+        }
+        return length;
+    };
+
+    while (in < input.size())
+    {
+        const uint8_t token = input[in++];
+
+        const auto literals = read_length(token >> 4);
+        if (!literals || in + *literals > input.size() || out + *literals > output.size())
+        {
+            return false;
+        }
+        std::memcpy(output.data() + out, input.data() + in, *literals);
+        in += *literals;
+        out += *literals;
+
+        if (in == input.size())
+        {
+            break;
+        }
+
+        if (in + 2 > input.size())
+        {
+            return false;
+        }
+        const std::size_t offset = static_cast<std::size_t>(input[in] | input[in + 1] << 8);
+        in += 2;
+
+        const auto match = read_length(token & 0x0f);
+        if (!match || offset == 0 || offset > out || out + *match + min_match > output.size())
+        {
+            return false;
+        }
+
+        // byte by byte, matches may overlap the bytes they produce
+        for (std::size_t i = 0; i < *match + min_match; ++i, ++out)
+        {
+            output[out] = output[out - offset];
+        }
+    }
+    return out == output.size();
+}
+
+} // namespace msemu::lz
@@ -0,0 +1,43 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace msemu::lz
+{
+
+// Small LZ77 byte codec in the spirit of LZ4 block format:
+// token (literal length << 4 | match length - 4), length extension bytes,
+// literals, 16 bit little endian match offset. Built for 4 KiB memory pages.
+
+// Worst case size of compressed data for given input size.
+constexpr std::size_t max_compressed_size(const std::size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+// Returns compressed size or 0 when output is too small.
+std::size_t compress(std::span<const uint8_t> input, std::span<uint8_t> output);
+
+// Returns false when input is malformed or does not decode to exactly output.size() bytes.
+bool decompress(std::span<const uint8_t> input, std::span<uint8_t> output);
+
+} // namespace msemu::lz
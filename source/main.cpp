@@ -15,8 +15,13 @@
  *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
+#include <string_view>
 
 #include <locale.h>
 #include <termios.h>
@@ -26,6 +31,11 @@
 #include "device.hpp"
 
 #include "8086_cpu.hpp"
+#include "bisect.hpp"
+#include "checkpoint.hpp"
+#include "fleet.hpp"
+#include "lockstep.hpp"
+#include "save_state.hpp"
 
 static struct termios term_orig;
 void disable_buffered_io()
@@ -66,19 +76,128 @@ int main(int argc, const char* argv[])
     msemu::Bus bus(FlashType("flash"), BiosType("bios/rom"));
     bus.print();
 
-    if (argc < 2)
+    const std::string_view mode = argc > 2 ? argv[1] : "";
+    const bool lockstep         = mode == "--lockstep" && argc == 3;
+    const bool fleet            = mode == "--fleet" && argc == 4;
+    const bool bench            = mode == "--bench" && argc == 4;
+    const bool bisect           = mode == "--bisect" && argc == 3;
+    const bool hashes           = mode == "--hashes" && argc == 4;
+    const bool checkpoint       = mode == "--checkpoint" && argc == 4;
+    if (argc < 2 || (argc > 2 && !lockstep && !fleet && !bench && !bisect && !hashes && !checkpoint))
     {
         printf("Please provide binary file\n");
+        printf("Usage: %s [--lockstep | --bisect | --fleet <instances> | --bench <instructions> |\n"
+               "       --hashes <interval> | --checkpoint <interval>] <binary>\n",
+               argv[0]);
         return 0;
     }
 
     msemu::MemoryView bios_memory = bus.get("bios/rom");
     printf("BIOS size: %x\n", bios_memory.size());
-    bios_memory.load_from_file(argv[1]);
+    bios_memory.load_from_file(argv[argc - 1]);
+
+    if (lockstep)
+    {
+        msemu::cpu8086::Lockstep checker(bus);
+        checker.fast().jump_to_bios();
+        checker.reset(msemu::cpu8086::capture_state());
+        checker.run(100000000);
+        printf("Lockstep finished after %zu instructions\n%s", checker.steps(), checker.report().c_str());
+        return checker.result() == decltype(checker)::Result::diverged ? 1 : 0;
+    }
 
     msemu::cpu8086::Cpu cpu(bus);
     cpu.jump_to_bios();
 
+    if (bisect)
+    {
+        using BusType = decltype(bus);
+        const msemu::cpu8086::CpuState entry = msemu::cpu8086::capture_state();
+        msemu::cpu8086::Bisector<msemu::cpu8086::FastSide<BusType>, msemu::cpu8086::ReferenceSide<BusType>>
+            bisector(bus, bus);
+        bisector.reset(entry);
+        const auto result = bisector.run(100000000, 1000000);
+        printf("Bisection finished after %" PRIu64 " instructions\n%s", bisector.position(),
+               bisector.report().c_str());
+        return result == decltype(bisector)::Result::diverged ? 1 : 0;
+    }
+
+    if (hashes)
+    {
+        // one line per interval, diff of traces from two builds shows the first interval where they disagree
+        const uint64_t interval = std::max<uint64_t>(std::strtoull(argv[2], nullptr, 10), 1);
+        const auto boot         = std::make_unique<decltype(bus)>(bus);
+        uint64_t position       = 0;
+        uint64_t executed       = interval;
+        while (executed == interval && position < 100000000)
+        {
+            executed = cpu.run(interval);
+            position += executed;
+            printf("%" PRIu64 " %016" PRIx64 "\n", position,
+                   msemu::cpu8086::hash_machine(msemu::cpu8086::capture_state(),
+                                                msemu::cpu8086::Flags::defined_mask, bus, *boot));
+        }
+        return 0;
+    }
+
+    if (checkpoint)
+    {
+        // guest keeps running while msemu.checkpoint is written in the background
+        const uint64_t interval = std::max<uint64_t>(std::strtoull(argv[2], nullptr, 10), 1);
+        msemu::Checkpointer checkpointer("msemu.checkpoint", interval);
+        uint64_t position = 0;
+        uint64_t executed = interval;
+        while (executed == interval && position < 100000000)
+        {
+            executed = cpu.run(interval);
+            position += executed;
+            checkpointer.checkpoint(bus);
+        }
+        const bool ok     = checkpointer.wait();
+        const auto stats  = checkpointer.stats();
+        printf("Checkpoints after %" PRIu64 " instructions: %zu completed, %zu failed, %zu skipped, "
+               "max pause: %.1f us\n",
+               position, stats.completed, stats.failed, stats.skipped,
+               static_cast<double>(stats.max_pause.count()) / 1e3);
+        return ok ? 0 : 1;
+    }
+
+    if (fleet)
+    {
+        constexpr uint64_t fleet_instructions = 10000000;
+        msemu::Fleet runner(std::strtoul(argv[2], nullptr, 10));
+        runner.share(bus);
+        const bool ok = runner.run(
+            [&cpu](std::size_t)
+            {
+                if (cpu.run(fleet_instructions) != fleet_instructions)
+                {
+                    printf("ERR: Instance stopped: %s\n", cpu.error());
+                    return 1;
+                }
+                return 0;
+            });
+        runner.print_report();
+        return ok ? 0 : 1;
+    }
+
+    if (bench)
+    {
+        const uint64_t instructions = std::strtoull(argv[2], nullptr, 10);
+        const auto begin            = std::chrono::steady_clock::now();
+        const uint64_t executed     = cpu.run(instructions);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+        if (executed != instructions)
+        {
+            printf("ERR: %s stopped after %" PRIu64 " instructions: %s", argv[3], executed, cpu.error());
+            return 1;
+        }
+        printf("%s: %" PRIu64 " instructions, %.1f MIPS, %.2f ns/instruction\n", argv[3], executed,
+               static_cast<double>(executed) / elapsed.count() / 1e6,
+               elapsed.count() * 1e9 / static_cast<double>(executed));
+        return 0;
+    }
+
     disable_buffered_io();
     setlocale(LC_CTYPE, "");
     //
@@ -90,7 +209,16 @@ int main(int argc, const char* argv[])
         {
             if (c == 's')
             {
-                cpu.step();
+                // run honours trap flag, step alone would not take INT 1
+                cpu.run(1);
+            }
+            else if (c == 'w')
+            {
+                msemu::save_state("msemu.state", bus);
+            }
+            else if (c == 'r')
+            {
+                msemu::load_state("msemu.state", bus);
             }
         }
     }
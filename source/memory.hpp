@@ -17,45 +17,73 @@
 
 #pragma once
 
-#include <array>
+#include <concepts>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <span>
 
+#include "host_memory.hpp"
 
 namespace msemu
 {
 
+// Host memory backing a range of physical addresses.
+struct HostRange
+{
+    uint32_t start;
+    uint32_t size;
+    uint8_t* data;
+    bool writable;
+};
+
+// Buses which map and unmap devices at runtime. Host memory handed out by
+// host_range() stays valid until the bus user reports a quiescent state, it
+// returns true when the map changed since the generation seen last time and
+// cached host ranges have to be dropped.
+template <typename BusType>
+concept Remappable = requires(BusType& bus, uint64_t& seen) {
+    { bus.quiescent(seen) } -> std::same_as<bool>;
+};
+
 template <uint32_t Size>
 class Memory
 {
 public:
     static constexpr uint32_t size = Size;
 
+    // Sparse, pages not written yet share the zero page of the kernel and
+    // private storage is committed on the first write.
     Memory()
-        : memory_{}
+        : memory_(Size)
     {
     }
 
     std::span<uint8_t> span()
     {
-        return memory_;
+        return memory_.span();
     }
 
     std::span<const uint8_t> span() const
     {
-        return memory_;
+        return memory_.span();
     }
 
+    // Frees written pages instead of zeroing them.
     void clear()
     {
-        memory_ = {};
+        memory_.clear();
+    }
+
+    // Copies image to the start of memory, keeps its zero pages uncommitted.
+    void assign(std::span<const uint8_t> image)
+    {
+        memory_.assign(image);
     }
 
 private:
-    std::array<uint8_t, Size> memory_;
+    HostMemory memory_;
 };
 
 class MemoryView
@@ -0,0 +1,118 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* C API of the emulator for embedding through FFI.
+ *
+ * Every call is meant to carry a lot of work: registers are read and written
+ * all at once, memory in spans or in batches of spans, and instances run for
+ * many instructions per call. Instances are not thread safe and all of them
+ * must be used from one thread, because CPU registers are process wide and
+ * are switched on the first call to another instance.
+ */
+
+#ifndef MSEMU_H
+#define MSEMU_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MSEMU_API __attribute__((visibility("default")))
+
+/* Incremented on every incompatible change of this header. */
+#define MSEMU_API_VERSION 1
+
+/* 1 MiB of RAM at physical address 0. */
+#define MSEMU_MEMORY_SIZE 0x100000u
+
+typedef struct msemu_instance msemu_instance;
+
+/* Registers in order of ModRM encoding, then segments. */
+typedef struct msemu_registers
+{
+    uint16_t ax, cx, dx, bx, sp, bp, si, di;
+    uint16_t es, cs, ss, ds;
+    uint16_t ip;
+    uint16_t flags;
+} msemu_registers;
+
+typedef struct msemu_memory_op
+{
+    uint32_t address;
+    uint32_t size;
+    void* data;
+    int write; /* 0 reads from guest memory into data */
+} msemu_memory_op;
+
+typedef struct msemu_stats
+{
+    uint64_t instructions;
+    uint64_t tlb_hits;
+    uint64_t tlb_misses;
+    uint64_t smc_events;
+    uint64_t smc_invalidated_blocks;
+    uint64_t return_hits;
+    uint64_t return_misses;
+} msemu_stats;
+
+MSEMU_API int msemu_api_version(void);
+
+/* Returns NULL when out of memory. All registers and memory start zeroed. */
+MSEMU_API msemu_instance* msemu_create(void);
+MSEMU_API void msemu_destroy(msemu_instance* instance);
+
+/* Functions returning int return 0 on success and -1 on failure. */
+
+/* Copies whole file to guest memory at address. */
+MSEMU_API int msemu_load_image(msemu_instance* instance, uint32_t address, const char* path);
+
+MSEMU_API int msemu_read_memory(msemu_instance* instance, uint32_t address, void* data, size_t size);
+MSEMU_API int msemu_write_memory(msemu_instance* instance, uint32_t address, const void* data, size_t size);
+
+/* Executes operations in order, returns number of successful ones. */
+MSEMU_API size_t msemu_memory_batch(msemu_instance* instance, const msemu_memory_op* ops, size_t count);
+
+MSEMU_API void msemu_get_registers(msemu_instance* instance, msemu_registers* registers);
+MSEMU_API void msemu_set_registers(msemu_instance* instance, const msemu_registers* registers);
+
+/* Runs up to count instructions, returns number of executed ones. Fewer are
+ * executed when the CPU stopped on an error, see msemu_error(). */
+MSEMU_API uint64_t msemu_run(msemu_instance* instance, uint64_t count);
+
+/* Runs every instance in turn, executed receives count of every instance and
+ * may be NULL. */
+MSEMU_API void msemu_run_many(msemu_instance* const* instances, size_t size, uint64_t count,
+                              uint64_t* executed);
+
+/* Error which stopped the last run, empty string when it did not stop. */
+MSEMU_API const char* msemu_error(msemu_instance* instance);
+
+/* Snapshot holds registers and whole memory. */
+MSEMU_API size_t msemu_snapshot_size(void);
+MSEMU_API int msemu_snapshot(msemu_instance* instance, void* buffer, size_t size);
+MSEMU_API int msemu_restore(msemu_instance* instance, const void* buffer, size_t size);
+
+MSEMU_API void msemu_get_stats(msemu_instance* instance, msemu_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MSEMU_H */
@@ -0,0 +1,322 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "msemu.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <span>
+#include <vector>
+
+#include "8086_cpu.hpp"
+#include "8086_state.hpp"
+#include "bus.hpp"
+#include "device.hpp"
+#include "memory.hpp"
+
+namespace
+{
+
+using RamType = msemu::Device<msemu::Memory<MSEMU_MEMORY_SIZE>, 0x00000000>;
+using BusType = msemu::Bus<RamType>;
+
+constexpr uint32_t snapshot_magic = 0x50534d4d; // "MMSP"
+
+struct SnapshotHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    msemu::cpu8086::CpuState cpu;
+};
+
+static_assert(sizeof(msemu_registers) == sizeof(msemu::cpu8086::CpuState));
+static_assert(offsetof(msemu_registers, es) == offsetof(msemu::cpu8086::CpuState, sregs));
+static_assert(offsetof(msemu_registers, ip) == offsetof(msemu::cpu8086::CpuState, ip));
+static_assert(offsetof(msemu_registers, flags) == offsetof(msemu::cpu8086::CpuState, flags));
+
+} // namespace
+
+struct msemu_instance
+{
+    msemu_instance()
+        : bus(RamType("ram"))
+        , cpu(bus)
+        , state{}
+        , instructions(0)
+    {
+    }
+
+    BusType bus;
+    msemu::cpu8086::Cpu<BusType> cpu;
+    // registers while another instance owns the process wide ones
+    msemu::cpu8086::CpuState state;
+    uint64_t instructions;
+};
+
+namespace
+{
+
+// Instance which registers are currently loaded in the CPU.
+msemu_instance* active = nullptr;
+
+void deactivate()
+{
+    if (active != nullptr)
+    {
+        active->state = msemu::cpu8086::capture_state();
+        active        = nullptr;
+    }
+}
+
+void activate(msemu_instance* instance)
+{
+    if (active != instance)
+    {
+        deactivate();
+        msemu::cpu8086::restore_state(instance->state);
+        active = instance;
+    }
+}
+
+bool in_memory(const uint32_t address, const std::size_t size)
+{
+    return address <= MSEMU_MEMORY_SIZE && size <= MSEMU_MEMORY_SIZE - address;
+}
+
+int read_memory(msemu_instance* instance, const uint32_t address, void* data, const std::size_t size)
+{
+    if (!in_memory(address, size))
+    {
+        return -1;
+    }
+    if (size != 0)
+    {
+        instance->bus.read(address, std::span<uint8_t>(static_cast<uint8_t*>(data), size));
+    }
+    return 0;
+}
+
+int write_memory(msemu_instance* instance, const uint32_t address, const void* data, const std::size_t size)
+{
+    if (!in_memory(address, size))
+    {
+        return -1;
+    }
+    if (size != 0)
+    {
+        instance->bus.write(address, std::span<const uint8_t>(static_cast<const uint8_t*>(data), size));
+    }
+    return 0;
+}
+
+} // namespace
+
+extern "C"
+{
+
+int msemu_api_version(void)
+{
+    return MSEMU_API_VERSION;
+}
+
+msemu_instance* msemu_create(void)
+{
+    // constructor of cpu resets registers of the active instance
+    deactivate();
+    msemu_instance* instance = nullptr;
+    try
+    {
+        instance = new msemu_instance();
+    }
+    catch (const std::bad_alloc&)
+    {
+        // guest memory could not be mapped, the C caller gets null
+        return nullptr;
+    }
+    active = instance;
+    return instance;
+}
+
+void msemu_destroy(msemu_instance* instance)
+{
+    if (active == instance)
+    {
+        active = nullptr;
+    }
+    delete instance;
+}
+
+int msemu_load_image(msemu_instance* instance, const uint32_t address, const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr)
+    {
+        printf("ERR: Can't open image: %s\n", path);
+        return -1;
+    }
+
+    std::vector<uint8_t> image;
+    uint8_t chunk[4096];
+    std::size_t size = 0;
+    while ((size = fread(chunk, 1, sizeof(chunk), file)) != 0)
+    {
+        image.insert(image.end(), chunk, chunk + size);
+    }
+    fclose(file);
+
+    if (!in_memory(address, image.size()))
+    {
+        printf("ERR: Image %s doesn't fit at 0x%05x\n", path, address);
+        return -1;
+    }
+    return write_memory(instance, address, image.data(), image.size());
+}
+
+int msemu_read_memory(msemu_instance* instance, const uint32_t address, void* data, const size_t size)
+{
+    return read_memory(instance, address, data, size);
+}
+
+int msemu_write_memory(msemu_instance* instance, const uint32_t address, const void* data, const size_t size)
+{
+    return write_memory(instance, address, data, size);
+}
+
+size_t msemu_memory_batch(msemu_instance* instance, const msemu_memory_op* ops, const size_t count)
+{
+    std::size_t done = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto& op   = ops[i];
+        const int result = op.write != 0 ? write_memory(instance, op.address, op.data, op.size)
+                                         : read_memory(instance, op.address, op.data, op.size);
+        done += result == 0 ? 1 : 0;
+    }
+    return done;
+}
+
+void msemu_get_registers(msemu_instance* instance, msemu_registers* registers)
+{
+    if (active == instance)
+    {
+        instance->state = msemu::cpu8086::capture_state();
+    }
+    std::memcpy(registers, &instance->state, sizeof(*registers));
+}
+
+void msemu_set_registers(msemu_instance* instance, const msemu_registers* registers)
+{
+    std::memcpy(&instance->state, registers, sizeof(*registers));
+    if (active == instance)
+    {
+        msemu::cpu8086::restore_state(instance->state);
+    }
+}
+
+uint64_t msemu_run(msemu_instance* instance, const uint64_t count)
+{
+    activate(instance);
+    const uint64_t executed = instance->cpu.run(count);
+    instance->instructions += executed;
+    return executed;
+}
+
+void msemu_run_many(msemu_instance* const* instances, const size_t size, const uint64_t count,
+                    uint64_t* executed)
+{
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        const uint64_t done = msemu_run(instances[i], count);
+        if (executed != nullptr)
+        {
+            executed[i] = done;
+        }
+    }
+}
+
+const char* msemu_error(msemu_instance* instance)
+{
+    return instance->cpu.error();
+}
+
+size_t msemu_snapshot_size(void)
+{
+    return sizeof(SnapshotHeader) + MSEMU_MEMORY_SIZE;
+}
+
+int msemu_snapshot(msemu_instance* instance, void* buffer, const size_t size)
+{
+    if (size < msemu_snapshot_size())
+    {
+        return -1;
+    }
+
+    if (active == instance)
+    {
+        instance->state = msemu::cpu8086::capture_state();
+    }
+    const SnapshotHeader header{
+        .magic = snapshot_magic, .version = MSEMU_API_VERSION, .cpu = instance->state};
+    auto* data = static_cast<uint8_t*>(buffer);
+    std::memcpy(data, &header, sizeof(header));
+    return read_memory(instance, 0, data + sizeof(header), MSEMU_MEMORY_SIZE);
+}
+
+int msemu_restore(msemu_instance* instance, const void* buffer, const size_t size)
+{
+    SnapshotHeader header;
+    if (size < msemu_snapshot_size())
+    {
+        return -1;
+    }
+    const auto* data = static_cast<const uint8_t*>(buffer);
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != snapshot_magic || header.version != MSEMU_API_VERSION)
+    {
+        printf("ERR: Snapshot is not compatible\n");
+        return -1;
+    }
+
+    // memory map doesn't change, so translations are still valid
+    msemu_registers registers;
+    std::memcpy(&registers, &header.cpu, sizeof(registers));
+    msemu_set_registers(instance, &registers);
+    // zero pages are released instead of written, restored instance stays sparse like after load_state
+    const std::span<const uint8_t> memory(data + sizeof(header), MSEMU_MEMORY_SIZE);
+    instance->bus.for_each_device([memory](auto& device) { device.memory().assign(memory); });
+    return 0;
+}
+
+void msemu_get_stats(msemu_instance* instance, msemu_stats* stats)
+{
+    const auto cpu = instance->cpu.stats();
+    *stats         = msemu_stats{};
+    for (std::size_t i = 0; i < cpu.tlb.hits.size(); ++i)
+    {
+        stats->tlb_hits += cpu.tlb.hits[i];
+        stats->tlb_misses += cpu.tlb.misses[i];
+    }
+    stats->instructions           = instance->instructions;
+    stats->smc_events             = cpu.smc.events;
+    stats->smc_invalidated_blocks = cpu.smc.invalidated_blocks;
+    stats->return_hits            = cpu.returns.hits;
+    stats->return_misses          = cpu.returns.misses;
+}
+
+} // extern "C"
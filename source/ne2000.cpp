@@ -0,0 +1,356 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ne2000.hpp"
+
+#include <algorithm>
+
+namespace msemu
+{
+
+namespace
+{
+
+// command register
+constexpr uint8_t cr_stop     = 0x01;
+constexpr uint8_t cr_start    = 0x02;
+constexpr uint8_t cr_transmit = 0x04;
+constexpr uint8_t cr_dma_mask = 0x38;
+constexpr uint8_t cr_abort    = 0x20;
+
+// interrupt status register
+constexpr uint8_t isr_transmitted = 0x02;
+constexpr uint8_t isr_dma_done    = 0x40;
+constexpr uint8_t isr_reset       = 0x80;
+
+constexpr uint8_t tsr_transmitted = 0x01;
+constexpr uint16_t prom_size      = 32;
+
+} // namespace
+
+Ne2000::Ne2000(const std::array<uint8_t, 6>& mac)
+    : local_{}
+    , nic_(&local_)
+    , switch_(nullptr)
+    , prom_{}
+    , cr_(0)
+    , tpsr_(0)
+    , tsr_(0)
+    , tcr_(0)
+    , dcr_(0)
+    , imr_(0)
+    , tbcr_(0)
+    , rsar_(0)
+    , rbcr_(0)
+{
+    // every byte doubled, as seen by drivers reading it in word mode
+    for (std::size_t i = 0; i < mac.size(); ++i)
+    {
+        prom_[2 * i]     = mac[i];
+        prom_[2 * i + 1] = mac[i];
+    }
+    std::fill(prom_.end() - 4, prom_.end(), uint8_t{0x57});
+    reset();
+}
+
+Ne2000::~Ne2000()
+{
+    if (switch_ != nullptr)
+    {
+        switch_->detach(*nic_);
+    }
+}
+
+bool Ne2000::connect(NetworkSwitch& network)
+{
+    NicBuffer* port = network.attach();
+    if (port == nullptr)
+    {
+        return false;
+    }
+    if (switch_ != nullptr)
+    {
+        switch_->detach(*nic_);
+    }
+
+    {
+        NicLock lock(*port);
+        NicLock local(*nic_);
+        port->started  = nic_->started;
+        port->rcr      = nic_->rcr;
+        port->pstart   = nic_->pstart;
+        port->pstop    = nic_->pstop;
+        port->curr     = nic_->curr;
+        port->bnry     = nic_->bnry;
+        port->par      = nic_->par;
+        port->mar      = nic_->mar;
+        port->received = 0;
+        port->dropped  = 0;
+        port->memory   = nic_->memory;
+        port->isr.store(nic_->isr.load(std::memory_order_relaxed), std::memory_order_release);
+    }
+    nic_    = port;
+    switch_ = &network;
+    return true;
+}
+
+void Ne2000::reset()
+{
+    NicLock lock(*nic_);
+    cr_           = cr_stop | cr_abort;
+    nic_->started = false;
+    nic_->isr.store(isr_reset, std::memory_order_release);
+    imr_ = 0;
+}
+
+uint8_t Ne2000::read_port(const uint16_t offset)
+{
+    if (offset == data_port)
+    {
+        const uint8_t value = read_memory(rsar_);
+        advance_remote_dma();
+        return value;
+    }
+    if (offset == reset_port)
+    {
+        reset();
+        return 0;
+    }
+
+    const uint8_t reg = offset & 0x0f;
+    if (reg == 0x00)
+    {
+        return cr_;
+    }
+
+    NicLock lock(*nic_);
+    switch (page() << 4 | reg)
+    {
+        case 0x03:
+            return nic_->bnry;
+        case 0x04:
+            return tsr_;
+        case 0x07:
+            return nic_->isr.load(std::memory_order_acquire);
+        case 0x08:
+            return static_cast<uint8_t>(rsar_);
+        case 0x09:
+            return static_cast<uint8_t>(rsar_ >> 8);
+        case 0x0c:
+            return 0x01;
+        case 0x11:
+        case 0x12:
+        case 0x13:
+        case 0x14:
+        case 0x15:
+        case 0x16:
+            return nic_->par[reg - 1u];
+        case 0x17:
+            return nic_->curr;
+        case 0x21:
+            return nic_->pstart;
+        case 0x22:
+            return nic_->pstop;
+        case 0x24:
+            return tpsr_;
+        case 0x2c:
+            return nic_->rcr;
+        case 0x2d:
+            return tcr_;
+        case 0x2e:
+            return dcr_;
+        case 0x2f:
+            return imr_;
+        default:
+            if (page() == 1 && reg >= 0x08)
+            {
+                return nic_->mar[reg - 8u];
+            }
+            return 0xff;
+    }
+}
+
+void Ne2000::write_port(const uint16_t offset, const uint8_t value)
+{
+    if (offset == data_port)
+    {
+        write_memory(rsar_, value);
+        advance_remote_dma();
+        return;
+    }
+    if (offset == reset_port)
+    {
+        reset();
+        return;
+    }
+
+    const uint8_t reg = offset & 0x0f;
+    if (reg == 0x00)
+    {
+        return command(value);
+    }
+
+    NicLock lock(*nic_);
+    switch (page() << 4 | reg)
+    {
+        case 0x01:
+            nic_->pstart = value;
+            return;
+        case 0x02:
+            nic_->pstop = value;
+            return;
+        case 0x03:
+            nic_->bnry = value;
+            return;
+        case 0x04:
+            tpsr_ = value;
+            return;
+        case 0x05:
+            tbcr_ = static_cast<uint16_t>((tbcr_ & 0xff00) | value);
+            return;
+        case 0x06:
+            tbcr_ = static_cast<uint16_t>((tbcr_ & 0x00ff) | value << 8);
+            return;
+        case 0x07:
+            // written ones acknowledge interrupts
+            nic_->isr.fetch_and(static_cast<uint8_t>(~value), std::memory_order_acq_rel);
+            return;
+        case 0x08:
+            rsar_ = static_cast<uint16_t>((rsar_ & 0xff00) | value);
+            return;
+        case 0x09:
+            rsar_ = static_cast<uint16_t>((rsar_ & 0x00ff) | value << 8);
+            return;
+        case 0x0a:
+            rbcr_ = static_cast<uint16_t>((rbcr_ & 0xff00) | value);
+            return;
+        case 0x0b:
+            rbcr_ = static_cast<uint16_t>((rbcr_ & 0x00ff) | value << 8);
+            return;
+        case 0x0c:
+            nic_->rcr = value;
+            return;
+        case 0x0d:
+            tcr_ = value;
+            return;
+        case 0x0e:
+            dcr_ = value;
+            return;
+        case 0x0f:
+            imr_ = value;
+            return;
+        case 0x11:
+        case 0x12:
+        case 0x13:
+        case 0x14:
+        case 0x15:
+        case 0x16:
+            nic_->par[reg - 1u] = value;
+            return;
+        case 0x17:
+            nic_->curr = value;
+            return;
+        default:
+            if (page() == 1 && reg >= 0x08)
+            {
+                nic_->mar[reg - 8u] = value;
+            }
+            return;
+    }
+}
+
+void Ne2000::command(const uint8_t value)
+{
+    cr_ = static_cast<uint8_t>(value & ~cr_transmit);
+    {
+        NicLock lock(*nic_);
+        if (value & cr_stop)
+        {
+            nic_->started = false;
+        }
+        else if (value & cr_start)
+        {
+            nic_->started = true;
+        }
+    }
+    if ((value & cr_transmit) && !(value & cr_stop))
+    {
+        transmit();
+    }
+    if ((value & cr_dma_mask) != cr_abort && rbcr_ == 0)
+    {
+        nic_->isr.fetch_or(isr_dma_done, std::memory_order_acq_rel);
+    }
+}
+
+void Ne2000::transmit()
+{
+    const uint32_t start = uint32_t{tpsr_} * 256;
+    if (start >= NicBuffer::start && start < NicBuffer::start + NicBuffer::size && switch_ != nullptr)
+    {
+        // frame goes from card memory straight into rings of the receivers
+        const uint32_t size = std::min<uint32_t>(tbcr_, NicBuffer::start + NicBuffer::size - start);
+        switch_->send(*nic_, std::span<const uint8_t>(nic_->memory).subspan(start - NicBuffer::start, size));
+    }
+    tsr_ = tsr_transmitted;
+    nic_->isr.fetch_or(isr_transmitted, std::memory_order_acq_rel);
+}
+
+uint8_t Ne2000::read_memory(const uint16_t address) const
+{
+    if (address < prom_size)
+    {
+        return prom_[address];
+    }
+    if (address >= NicBuffer::start && address < NicBuffer::start + NicBuffer::size)
+    {
+        // other instances write frames into the receive ring concurrently
+        NicLock lock(*nic_);
+        return nic_->memory[address - NicBuffer::start];
+    }
+    return 0xff;
+}
+
+void Ne2000::write_memory(const uint16_t address, const uint8_t value)
+{
+    if (address >= NicBuffer::start && address < NicBuffer::start + NicBuffer::size)
+    {
+        NicLock lock(*nic_);
+        nic_->memory[address - NicBuffer::start] = value;
+    }
+}
+
+void Ne2000::advance_remote_dma()
+{
+    if (rbcr_ == 0)
+    {
+        return;
+    }
+    ++rsar_;
+    // receive ring wraps for remote reads as well
+    NicLock lock(*nic_);
+    if (rsar_ == uint16_t{nic_->pstop} << 8 && nic_->pstop > nic_->pstart)
+    {
+        rsar_ = static_cast<uint16_t>(nic_->pstart << 8);
+    }
+    if (--rbcr_ == 0)
+    {
+        nic_->isr.fetch_or(isr_dma_done, std::memory_order_acq_rel);
+    }
+}
+
+} // namespace msemu
@@ -0,0 +1,90 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "network_switch.hpp"
+
+namespace msemu
+{
+
+// NE2000 network card, DP8390 registers at offsets 0x00 - 0x0f of base port,
+// remote DMA data port at 0x10 and reset at 0x1f.
+//
+// Without switch the card has private receive buffer and transmitted frames
+// are lost. After connect() card memory is a port of the shared switch.
+class Ne2000
+{
+public:
+    static constexpr uint16_t data_port  = 0x10;
+    static constexpr uint16_t reset_port = 0x1f;
+
+    explicit Ne2000(const std::array<uint8_t, 6>& mac);
+    ~Ne2000();
+
+    Ne2000(const Ne2000&) = delete;
+    Ne2000& operator=(const Ne2000&) = delete;
+
+    // False when all ports of switch are in use.
+    bool connect(NetworkSwitch& network);
+
+    uint8_t read_port(uint16_t offset);
+    void write_port(uint16_t offset, uint8_t value);
+
+    // State of interrupt line.
+    bool interrupt() const
+    {
+        return (nic_->isr.load(std::memory_order_acquire) & imr_) != 0;
+    }
+
+    const NicBuffer& buffer() const
+    {
+        return *nic_;
+    }
+
+private:
+    uint8_t page() const
+    {
+        return cr_ >> 6;
+    }
+
+    void reset();
+    void command(uint8_t value);
+    void transmit();
+    uint8_t read_memory(uint16_t address) const;
+    void write_memory(uint16_t address, uint8_t value);
+    void advance_remote_dma();
+
+    NicBuffer local_;
+    NicBuffer* nic_;
+    NetworkSwitch* switch_;
+    std::array<uint8_t, 32> prom_;
+    uint8_t cr_;
+    uint8_t tpsr_;
+    uint8_t tsr_;
+    uint8_t tcr_;
+    uint8_t dcr_;
+    uint8_t imr_;
+    uint16_t tbcr_;
+    uint16_t rsar_;
+    uint16_t rbcr_;
+};
+
+} // namespace msemu
@@ -0,0 +1,288 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "network_switch.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace msemu
+{
+
+namespace
+{
+
+constexpr uint32_t switch_magic = 0x4d534e57; // MSNW
+constexpr uint32_t page_size    = 256;
+constexpr uint32_t min_frame    = 60;
+
+// receive status and interrupt bits of DP8390
+constexpr uint8_t rsr_received    = 0x01;
+constexpr uint8_t isr_received    = 0x01;
+constexpr uint8_t isr_overwrite   = 0x10;
+constexpr uint8_t rcr_broadcast   = 0x04;
+constexpr uint8_t rcr_multicast   = 0x08;
+constexpr uint8_t rcr_promiscuous = 0x10;
+
+// CRC used by DP8390 multicast filter, most significant 6 bits select MAR bit
+uint32_t ethernet_crc(const std::span<const uint8_t> address)
+{
+    uint32_t crc = 0xffffffff;
+    for (uint8_t byte : address)
+    {
+        for (int bit = 0; bit < 8; ++bit, byte = static_cast<uint8_t>(byte >> 1))
+        {
+            crc = (crc << 1) ^ ((((crc >> 31) ^ byte) & 1) != 0 ? 0x04c11db7 : 0);
+        }
+    }
+    return crc;
+}
+
+bool accepts(const NicBuffer& port, const std::span<const uint8_t> frame)
+{
+    const auto destination = frame.first(6);
+    if (port.rcr & rcr_promiscuous)
+    {
+        return true;
+    }
+    if ((destination[0] & 1) == 0)
+    {
+        return std::equal(destination.begin(), destination.end(), port.par.begin());
+    }
+    if (std::all_of(destination.begin(), destination.end(), [](const uint8_t byte) { return byte == 0xff; }))
+    {
+        return port.rcr & rcr_broadcast;
+    }
+    const uint32_t index = ethernet_crc(destination) >> 26;
+    return (port.rcr & rcr_multicast) && (port.mar[index >> 3] >> (index & 7)) & 1;
+}
+
+} // namespace
+
+struct NetworkSwitch::Header
+{
+    std::atomic<uint32_t> magic;
+    uint32_t ports;
+};
+
+NetworkSwitch::NetworkSwitch(const char* name, const uint32_t ports)
+    : header_(nullptr)
+    , ports_(nullptr)
+    , count_(ports)
+    , size_(sizeof(Header) + alignof(NicBuffer) + ports * sizeof(NicBuffer))
+    , pcap_(nullptr)
+{
+    bool created = true;
+    int fd       = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+    {
+        created = false;
+        fd      = shm_open(name, O_RDWR, 0600);
+    }
+    if (fd < 0)
+    {
+        printf("ERR: Can't open network switch: %s\n", name);
+        return;
+    }
+
+    if (created && ftruncate(fd, static_cast<off_t>(size_)) != 0)
+    {
+        printf("ERR: Can't allocate network switch: %s\n", name);
+        close(fd);
+        return;
+    }
+    // creator may still be resizing the object
+    struct stat status{};
+    while (!created && fstat(fd, &status) == 0 && static_cast<std::size_t>(status.st_size) < size_)
+    {
+        usleep(1000);
+    }
+
+    void* memory = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        printf("ERR: Can't map network switch: %s\n", name);
+        return;
+    }
+
+    header_    = static_cast<Header*>(memory);
+    auto begin = reinterpret_cast<uintptr_t>(header_ + 1);
+    begin      = (begin + alignof(NicBuffer) - 1) & ~(uintptr_t{alignof(NicBuffer)} - 1);
+    ports_     = reinterpret_cast<NicBuffer*>(begin);
+
+    if (created)
+    {
+        // shared memory object starts zeroed, constructors only start lifetime of objects
+        new (header_) Header{};
+        header_->ports = count_;
+        for (uint32_t port = 0; port < count_; ++port)
+        {
+            new (&ports_[port]) NicBuffer{};
+        }
+        header_->magic.store(switch_magic, std::memory_order_release);
+        return;
+    }
+
+    while (header_->magic.load(std::memory_order_acquire) != switch_magic)
+    {
+        usleep(1000);
+    }
+    if (header_->ports != count_)
+    {
+        printf("ERR: Network switch %s has %u ports, expected %u\n", name, header_->ports, count_);
+        munmap(header_, size_);
+        header_ = nullptr;
+        ports_  = nullptr;
+    }
+}
+
+NetworkSwitch::~NetworkSwitch()
+{
+    if (header_ != nullptr)
+    {
+        munmap(header_, size_);
+    }
+}
+
+void NetworkSwitch::remove(const char* name)
+{
+    shm_unlink(name);
+}
+
+NicBuffer* NetworkSwitch::attach()
+{
+    for (uint32_t port = 0; ports_ != nullptr && port < count_; ++port)
+    {
+        bool attached = false;
+        if (ports_[port].attached.compare_exchange_strong(attached, true, std::memory_order_acq_rel))
+        {
+            return &ports_[port];
+        }
+    }
+    return nullptr;
+}
+
+void NetworkSwitch::detach(NicBuffer& port)
+{
+    {
+        NicLock lock(port);
+        port.started = false;
+    }
+    port.attached.store(false, std::memory_order_release);
+}
+
+std::size_t NetworkSwitch::send(const NicBuffer& from, const std::span<const uint8_t> frame)
+{
+    if (pcap_ != nullptr)
+    {
+        pcap_->write(frame);
+    }
+
+    std::size_t receivers = 0;
+    for (uint32_t port = 0; ports_ != nullptr && port < count_; ++port)
+    {
+        NicBuffer& to = ports_[port];
+        if (&to != &from && to.attached.load(std::memory_order_acquire) && deliver(to, frame))
+        {
+            ++receivers;
+        }
+    }
+    return receivers;
+}
+
+bool NetworkSwitch::deliver(NicBuffer& to, const std::span<const uint8_t> frame)
+{
+    if (frame.size() < 6 || frame.size() > 1518)
+    {
+        return false;
+    }
+
+    NicLock lock(to);
+    const uint32_t first_page = NicBuffer::start / page_size;
+    const uint32_t last_page  = (NicBuffer::start + NicBuffer::size) / page_size;
+    if (!to.started || to.pstart < first_page || to.pstop > last_page || to.pstart >= to.pstop ||
+        to.curr < to.pstart || to.curr >= to.pstop || !accepts(to, frame))
+    {
+        return false;
+    }
+
+    // short frames are padded on the wire
+    const auto length  = static_cast<uint32_t>(std::max<std::size_t>(frame.size(), min_frame));
+    const uint32_t ring = to.pstop - to.pstart;
+    const uint32_t pages = (length + 4 + page_size - 1) / page_size;
+    const uint32_t free  = to.bnry > to.curr ? to.bnry - to.curr : ring - (to.curr - to.bnry);
+    if (pages >= free)
+    {
+        ++to.dropped;
+        to.isr.fetch_or(isr_overwrite, std::memory_order_release);
+        return false;
+    }
+
+    uint32_t next = to.curr + pages;
+    if (next >= to.pstop)
+    {
+        next -= ring;
+    }
+
+    const uint32_t ring_start = to.pstart * page_size - NicBuffer::start;
+    const uint32_t ring_end   = to.pstop * page_size - NicBuffer::start;
+    uint32_t offset           = to.curr * page_size - NicBuffer::start;
+    // receive byte count includes the ring header
+    const uint32_t count      = length + 4;
+    const uint8_t header[]    = {rsr_received, static_cast<uint8_t>(next), static_cast<uint8_t>(count),
+                                 static_cast<uint8_t>(count >> 8)};
+    std::memcpy(&to.memory[offset], header, sizeof(header));
+    offset += sizeof(header);
+
+    // at most two copies, the second one after wrap of the ring
+    std::size_t copied = 0;
+    while (copied < length)
+    {
+        if (offset == ring_end)
+        {
+            offset = ring_start;
+        }
+        const std::size_t chunk = std::min<std::size_t>(length - copied, ring_end - offset);
+        if (copied < frame.size())
+        {
+            const std::size_t data = std::min(chunk, frame.size() - copied);
+            std::memcpy(&to.memory[offset], frame.data() + copied, data);
+            std::memset(&to.memory[offset + data], 0, chunk - data);
+        }
+        else
+        {
+            std::memset(&to.memory[offset], 0, chunk);
+        }
+        copied += chunk;
+        offset += static_cast<uint32_t>(chunk);
+    }
+
+    to.curr = static_cast<uint8_t>(next);
+    ++to.received;
+    to.isr.fetch_or(isr_received, std::memory_order_release);
+    return true;
+}
+
+} // namespace msemu
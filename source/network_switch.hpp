@@ -0,0 +1,132 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <thread>
+
+#include "pcap.hpp"
+
+namespace msemu
+{
+
+// Receive side of NE2000, the 16 KiB card memory with receive ring and
+// registers which decide if frame is accepted. It lives in memory shared by
+// all instances, so sender copies frame from its own card memory straight
+// into ring of the receiver, without intermediate buffers.
+//
+// Everything except isr and attached is accessed with lock held.
+struct NicBuffer
+{
+    static constexpr uint32_t start = 0x4000;
+    static constexpr uint32_t size  = 0x4000;
+
+    std::atomic_flag lock;
+    std::atomic<bool> attached;
+    std::atomic<uint8_t> isr;
+    bool started;
+    uint8_t rcr;
+    uint8_t pstart;
+    uint8_t pstop;
+    uint8_t curr;
+    uint8_t bnry;
+    std::array<uint8_t, 6> par;
+    std::array<uint8_t, 8> mar;
+    std::size_t received;
+    std::size_t dropped;
+    std::array<uint8_t, size> memory;
+};
+
+class NicLock
+{
+public:
+    explicit NicLock(NicBuffer& buffer)
+        : buffer_(buffer)
+    {
+        // futex based wait of atomics is process private, holders only copy one frame
+        while (buffer_.lock.test_and_set(std::memory_order_acquire))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    ~NicLock()
+    {
+        buffer_.lock.clear(std::memory_order_release);
+    }
+
+private:
+    NicBuffer& buffer_;
+};
+
+// Ethernet switch between emulator instances on one host.
+//
+// Ports live in POSIX shared memory object, every instance opening switch
+// of the same name (or forked after opening it) is connected. Frames are
+// delivered by the sending instance to every attached port which accepts
+// them, so there is no switch process. Port takes about 16.5 KiB, which
+// keeps hundreds of instances in a few megabytes of shared memory.
+class NetworkSwitch
+{
+public:
+    static constexpr uint32_t default_ports = 256;
+
+    explicit NetworkSwitch(const char* name, uint32_t ports = default_ports);
+    ~NetworkSwitch();
+
+    NetworkSwitch(const NetworkSwitch&) = delete;
+    NetworkSwitch& operator=(const NetworkSwitch&) = delete;
+
+    // Removes shared memory object, instances which opened it stay connected.
+    static void remove(const char* name);
+
+    bool ok() const
+    {
+        return ports_ != nullptr;
+    }
+
+    // Claims free port, nullptr when all are in use.
+    NicBuffer* attach();
+    void detach(NicBuffer& port);
+
+    // Returns number of ports which received the frame.
+    std::size_t send(const NicBuffer& from, std::span<const uint8_t> frame);
+
+    // Frames sent by this instance are written to pcap.
+    void capture(PcapWriter* pcap)
+    {
+        pcap_ = pcap;
+    }
+
+    // Writes frame to receive ring of port, false when not accepted.
+    static bool deliver(NicBuffer& to, std::span<const uint8_t> frame);
+
+private:
+    struct Header;
+
+    Header* header_;
+    NicBuffer* ports_;
+    uint32_t count_;
+    std::size_t size_;
+    PcapWriter* pcap_;
+};
+
+} // namespace msemu
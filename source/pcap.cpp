@@ -0,0 +1,93 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "pcap.hpp"
+
+#include <chrono>
+
+namespace msemu
+{
+
+namespace
+{
+
+struct FileHeader
+{
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t timezone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t network;
+};
+
+struct RecordHeader
+{
+    uint32_t seconds;
+    uint32_t microseconds;
+    uint32_t captured;
+    uint32_t length;
+};
+
+constexpr uint32_t snaplen       = 65535;
+constexpr uint32_t link_ethernet = 1;
+
+} // namespace
+
+PcapWriter::PcapWriter(const char* path)
+    : file_(fopen(path, "wb"))
+    , frames_(0)
+    , mutex_{}
+{
+    if (file_ == nullptr)
+    {
+        printf("ERR: Can't open pcap file: %s\n", path);
+        return;
+    }
+    const FileHeader header{0xa1b2c3d4, 2, 4, 0, 0, snaplen, link_ethernet};
+    fwrite(&header, sizeof(header), 1, file_);
+}
+
+PcapWriter::~PcapWriter()
+{
+    if (file_ != nullptr)
+    {
+        fclose(file_);
+    }
+}
+
+void PcapWriter::write(const std::span<const uint8_t> frame)
+{
+    if (file_ == nullptr)
+    {
+        return;
+    }
+    const auto now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch());
+    const auto size = static_cast<uint32_t>(frame.size());
+    const RecordHeader record{static_cast<uint32_t>(now.count() / 1000000),
+                              static_cast<uint32_t>(now.count() % 1000000), size, size};
+
+    std::lock_guard lock(mutex_);
+    fwrite(&record, sizeof(record), 1, file_);
+    fwrite(frame.data(), 1, frame.size(), file_);
+    fflush(file_);
+    ++frames_;
+}
+
+} // namespace msemu
@@ -0,0 +1,57 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <span>
+
+namespace msemu
+{
+
+// Writes ethernet frames to libpcap file readable by wireshark and tcpdump.
+class PcapWriter
+{
+public:
+    explicit PcapWriter(const char* path);
+    ~PcapWriter();
+
+    PcapWriter(const PcapWriter&) = delete;
+    PcapWriter& operator=(const PcapWriter&) = delete;
+
+    bool ok() const
+    {
+        return file_ != nullptr;
+    }
+
+    // Frames are stamped with host time of the call.
+    void write(std::span<const uint8_t> frame);
+
+    std::size_t frames() const
+    {
+        return frames_;
+    }
+
+private:
+    FILE* file_;
+    std::size_t frames_;
+    std::mutex mutex_;
+};
+
+} // namespace msemu
@@ -0,0 +1,552 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "save_state.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lz.hpp"
+
+namespace msemu
+{
+
+namespace
+{
+
+constexpr char magic[8]           = {'M', 'S', 'E', 'M', 'U', 'S', 'S', '\0'};
+constexpr std::size_t header_size = sizeof(magic) + 4;
+
+constexpr uint32_t make_tag(const char (&name)[5])
+{
+    return static_cast<uint32_t>(name[0]) | static_cast<uint32_t>(name[1]) << 8 |
+           static_cast<uint32_t>(name[2]) << 16 | static_cast<uint32_t>(name[3]) << 24;
+}
+
+constexpr uint32_t cpu_tag          = make_tag("CPU ");
+constexpr uint32_t device_tag       = make_tag("DEV ");
+constexpr uint32_t page_tag         = make_tag("PAGE");
+constexpr uint32_t device_state_tag = make_tag("DSTA");
+constexpr uint32_t end_tag          = make_tag("END ");
+
+enum PageEncoding : uint8_t
+{
+    raw        = 0,
+    compressed = 1,
+    duplicate  = 2
+};
+
+constexpr std::size_t cpu_payload_size  = 2 * (8 + 4 + 2);
+constexpr std::size_t page_header_size  = 9;
+constexpr std::size_t device_header_min = 13;
+constexpr std::size_t output_size       = 64 * 1024;
+
+void put16(uint8_t* out, const uint16_t value)
+{
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+void put32(uint8_t* out, const uint32_t value)
+{
+    put16(out, static_cast<uint16_t>(value));
+    put16(out + 2, static_cast<uint16_t>(value >> 16));
+}
+
+uint16_t get16(const uint8_t* in)
+{
+    return static_cast<uint16_t>(in[0] | in[1] << 8);
+}
+
+uint32_t get32(const uint8_t* in)
+{
+    return static_cast<uint32_t>(get16(in)) | static_cast<uint32_t>(get16(in + 2)) << 16;
+}
+
+uint64_t fnv1a(std::span<const uint8_t> data)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const uint8_t byte : data)
+    {
+        hash = (hash ^ byte) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool is_zero(std::span<const uint8_t> data)
+{
+    return std::all_of(data.begin(), data.end(), [](const uint8_t byte) { return byte == 0; });
+}
+
+} // namespace
+
+SaveStateWriter::SaveStateWriter()
+    : fd_(-1)
+    , failed_(false)
+    , stats_{}
+    , buffer_(lz::max_compressed_size(save_state_page_size))
+    , output_(output_size)
+    , output_size_(0)
+    , slots_{}
+    , stored_{}
+{
+}
+
+SaveStateWriter::~SaveStateWriter()
+{
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+bool SaveStateWriter::open(const char* path)
+{
+    fd_ = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+        printf("ERR: Can't create save state: %s\n", path);
+        return false;
+    }
+
+    failed_      = false;
+    output_size_ = 0;
+    stats_       = {};
+    slots_.clear();
+    stored_.clear();
+
+    uint8_t header[header_size] = {};
+    std::memcpy(header, magic, sizeof(magic));
+    put16(header + sizeof(magic), save_state_version);
+    append(header);
+    stats_.bytes = sizeof(header);
+    return true;
+}
+
+void SaveStateWriter::reserve(const std::size_t pages)
+{
+    stored_.reserve(pages);
+    // at most half full, so probing stays short and insert never grows
+    const std::size_t entries = std::max(pages, stored_.size()) + 1;
+    const std::size_t size    = std::bit_ceil(std::max<std::size_t>(2 * entries, 64));
+    if (slots_.size() < size)
+    {
+        std::vector<Slot> slots(size);
+        std::swap(slots, slots_);
+        for (const Slot& slot : slots)
+        {
+            if (slot.id != 0)
+            {
+                insert(slot.hash, slot.id - 1);
+            }
+        }
+    }
+}
+
+void SaveStateWriter::insert(const uint64_t hash, const uint32_t id)
+{
+    if (2 * (stored_.size() + 1) > slots_.size())
+    {
+        reserve(2 * stored_.size());
+    }
+    const std::size_t mask = slots_.size() - 1;
+    std::size_t index      = static_cast<std::size_t>(hash) & mask;
+    while (slots_[index].id != 0)
+    {
+        index = (index + 1) & mask;
+    }
+    slots_[index] = Slot{hash, id + 1};
+}
+
+void SaveStateWriter::write_cpu(const cpu8086::CpuState& state)
+{
+    uint8_t payload[cpu_payload_size];
+    uint8_t* out = payload;
+    for (const uint16_t reg : state.regs)
+    {
+        put16(out, reg);
+        out += 2;
+    }
+    for (const uint16_t sreg : state.sregs)
+    {
+        put16(out, sreg);
+        out += 2;
+    }
+    put16(out, state.ip);
+    put16(out + 2, state.flags);
+    write_chunk(cpu_tag, payload);
+}
+
+void SaveStateWriter::write_device(std::string_view name, const uint32_t start_address,
+                                   std::span<const uint8_t> memory)
+{
+    uint8_t header[device_header_min];
+    put32(header, start_address);
+    put32(header + 4, static_cast<uint32_t>(memory.size()));
+    put32(header + 8, save_state_page_size);
+    const std::size_t name_size = std::min<std::size_t>(name.size(), 255);
+    header[12]                  = static_cast<uint8_t>(name_size);
+    write_chunk(device_tag, header, {reinterpret_cast<const uint8_t*>(name.data()), name_size});
+
+    uint32_t index = 0;
+    for (std::size_t offset = 0; offset < memory.size(); offset += save_state_page_size, ++index)
+    {
+        const std::size_t size = std::min<std::size_t>(save_state_page_size, memory.size() - offset);
+        write_page(index, memory.subspan(offset, size));
+    }
+}
+
+void SaveStateWriter::write_device_state(std::span<const uint8_t> state)
+{
+    write_chunk(device_state_tag, {}, state);
+}
+
+bool SaveStateWriter::close()
+{
+    const bool ok = finish();
+    if (!ok)
+    {
+        printf("ERR: Save state write failed\n");
+    }
+    return ok;
+}
+
+bool SaveStateWriter::finish()
+{
+    if (fd_ < 0)
+    {
+        return false;
+    }
+    write_chunk(end_tag, {});
+    flush();
+    failed_ = ::close(fd_) != 0 || failed_;
+    fd_     = -1;
+    // memory is not released, so a reserved writer can be reused after fork as well
+    stored_.clear();
+    std::fill(slots_.begin(), slots_.end(), Slot{});
+    return !failed_;
+}
+
+void SaveStateWriter::write_chunk(const uint32_t tag, std::span<const uint8_t> header,
+                                  std::span<const uint8_t> data)
+{
+    uint8_t chunk[8];
+    put32(chunk, tag);
+    put32(chunk + 4, static_cast<uint32_t>(header.size() + data.size()));
+    append(chunk);
+    append(header);
+    append(data);
+    stats_.bytes += sizeof(chunk) + header.size() + data.size();
+}
+
+void SaveStateWriter::append(std::span<const uint8_t> data)
+{
+    while (!data.empty() && !failed_)
+    {
+        if (output_size_ == output_.size())
+        {
+            flush();
+        }
+        const std::size_t size = std::min(data.size(), output_.size() - output_size_);
+        std::memcpy(output_.data() + output_size_, data.data(), size);
+        output_size_ += size;
+        data = data.subspan(size);
+    }
+}
+
+void SaveStateWriter::flush()
+{
+    std::size_t position = 0;
+    while (position < output_size_ && !failed_ && fd_ >= 0)
+    {
+        const ssize_t size = ::write(fd_, output_.data() + position, output_size_ - position);
+        if (size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        failed_ = size <= 0;
+        position += size > 0 ? static_cast<std::size_t>(size) : 0;
+    }
+    output_size_ = 0;
+}
+
+void SaveStateWriter::write_page(const uint32_t index, std::span<const uint8_t> page)
+{
+    ++stats_.pages;
+    if (is_zero(page))
+    {
+        ++stats_.zero_pages;
+        return;
+    }
+
+    uint8_t header[page_header_size];
+    put32(header, index);
+
+    const uint64_t hash = fnv1a(page);
+    if (!slots_.empty())
+    {
+        const std::size_t mask = slots_.size() - 1;
+        for (std::size_t index = static_cast<std::size_t>(hash) & mask; slots_[index].id != 0;
+             index             = (index + 1) & mask)
+        {
+            const Slot& slot   = slots_[index];
+            const auto& stored = stored_[slot.id - 1];
+            if (slot.hash == hash && stored.size() == page.size() &&
+                std::memcmp(stored.data(), page.data(), page.size()) == 0)
+            {
+                ++stats_.duplicate_pages;
+                header[4] = duplicate;
+                put32(header + 5, slot.id - 1);
+                write_chunk(page_tag, header);
+                return;
+            }
+        }
+    }
+
+    const uint32_t id = static_cast<uint32_t>(stored_.size());
+    insert(hash, id);
+    stored_.push_back(page);
+
+    const std::size_t size = lz::compress(page, buffer_);
+    put32(header + 5, id);
+    if (size != 0 && size < page.size())
+    {
+        header[4] = compressed;
+        write_chunk(page_tag, header, std::span<const uint8_t>(buffer_).first(size));
+    }
+    else
+    {
+        header[4] = raw;
+        write_chunk(page_tag, header, page);
+    }
+}
+
+SaveStateReader::SaveStateReader()
+    : map_(nullptr)
+    , map_size_(0)
+    , cpu_{}
+    , devices_{}
+    , stored_{}
+{
+}
+
+SaveStateReader::~SaveStateReader()
+{
+    if (map_ != nullptr)
+    {
+        munmap(map_, map_size_);
+    }
+}
+
+bool SaveStateReader::open(const char* path)
+{
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        printf("ERR: Can't open save state: %s\n", path);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < header_size)
+    {
+        printf("ERR: Save state too short: %s\n", path);
+        ::close(fd);
+        return false;
+    }
+
+    map_size_ = static_cast<std::size_t>(info.st_size);
+    void* map = mmap(nullptr, map_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+        printf("ERR: Can't map save state: %s\n", path);
+        map_size_ = 0;
+        return false;
+    }
+    map_ = static_cast<uint8_t*>(map);
+    return parse();
+}
+
+bool SaveStateReader::parse()
+{
+    if (std::memcmp(map_, magic, sizeof(magic)) != 0)
+    {
+        printf("ERR: Not a save state\n");
+        return false;
+    }
+    const uint16_t version = get16(map_ + sizeof(magic));
+    if (version != save_state_version)
+    {
+        printf("ERR: Unsupported save state version: %d\n", version);
+        return false;
+    }
+
+    bool has_cpu         = false;
+    DeviceImage* device  = nullptr;
+    std::size_t position = header_size;
+    while (position + 8 <= map_size_)
+    {
+        const uint32_t tag  = get32(map_ + position);
+        const uint32_t size = get32(map_ + position + 4);
+        position += 8;
+        if (size > map_size_ - position)
+        {
+            break;
+        }
+        const uint8_t* payload = map_ + position;
+        position += size;
+
+        if (tag == end_tag)
+        {
+            return has_cpu;
+        }
+        else if (tag == cpu_tag && size >= cpu_payload_size)
+        {
+            for (auto& reg : cpu_.regs)
+            {
+                reg = get16(payload);
+                payload += 2;
+            }
+            for (auto& sreg : cpu_.sregs)
+            {
+                sreg = get16(payload);
+                payload += 2;
+            }
+            cpu_.ip    = get16(payload);
+            cpu_.flags = get16(payload + 2);
+            has_cpu    = true;
+        }
+        else if (tag == device_tag && size >= device_header_min && size >= device_header_min + payload[12])
+        {
+            DeviceImage image{};
+            image.start_address = get32(payload);
+            image.size          = get32(payload + 4);
+            image.page_size     = get32(payload + 8);
+            image.name.assign(reinterpret_cast<const char*>(payload + device_header_min), payload[12]);
+            // bounds the page index before it is allocated
+            if (image.page_size != save_state_page_size || image.size > save_state_max_device_size ||
+                image.start_address > save_state_max_device_size - image.size)
+            {
+                break;
+            }
+            image.pages.assign((image.size + image.page_size - 1) / image.page_size, -1);
+            devices_.push_back(std::move(image));
+            device = &devices_.back();
+        }
+        else if (tag == page_tag && size >= page_header_size && device != nullptr)
+        {
+            const uint32_t index     = get32(payload);
+            const uint8_t encoding   = payload[4];
+            const uint32_t reference = get32(payload + 5);
+            if (index >= device->pages.size())
+            {
+                break;
+            }
+            if (encoding == duplicate)
+            {
+                if (reference >= stored_.size())
+                {
+                    break;
+                }
+            }
+            else
+            {
+                if (reference != stored_.size())
+                {
+                    break;
+                }
+                stored_.push_back({encoding, {payload + page_header_size, size - page_header_size}});
+            }
+            device->pages[index] = static_cast<int32_t>(reference);
+        }
+        else if (tag == device_state_tag && device != nullptr)
+        {
+            device->state = {payload, size};
+        }
+    }
+
+    printf("ERR: Save state is corrupted\n");
+    return false;
+}
+
+const SaveStateReader::DeviceImage* SaveStateReader::device(std::string_view name) const
+{
+    for (const auto& image : devices_)
+    {
+        if (image.name == name)
+        {
+            return &image;
+        }
+    }
+    return nullptr;
+}
+
+bool SaveStateReader::read_page(const DeviceImage& device, const uint32_t index,
+                                std::span<uint8_t> page) const
+{
+    if (index >= device.pages.size() || device.pages[index] < 0)
+    {
+        // reading a page of sparse memory which was never written doesn't commit it
+        if (!is_zero(page))
+        {
+            std::fill(page.begin(), page.end(), 0);
+        }
+        return index < device.pages.size();
+    }
+
+    const StoredPage& stored = stored_[static_cast<std::size_t>(device.pages[index])];
+    if (stored.encoding == compressed)
+    {
+        return lz::decompress(stored.data, page);
+    }
+    if (stored.encoding == raw && stored.data.size() == page.size())
+    {
+        std::memcpy(page.data(), stored.data.data(), page.size());
+        return true;
+    }
+    return false;
+}
+
+bool SaveStateReader::restore_memory(const DeviceImage& device, std::span<uint8_t> memory) const
+{
+    if (memory.size() != device.size)
+    {
+        return false;
+    }
+
+    for (uint32_t index = 0; index < device.pages.size(); ++index)
+    {
+        const std::size_t offset = static_cast<std::size_t>(index) * device.page_size;
+        const std::size_t size   = std::min<std::size_t>(device.page_size, memory.size() - offset);
+        if (!read_page(device, index, memory.subspan(offset, size)))
+        {
+            printf("ERR: Can't restore page %d of %s\n", index, device.name.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace msemu
@@ -0,0 +1,245 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "8086_state.hpp"
+
+namespace msemu
+{
+
+// Save state file layout (all values little endian):
+//
+//   header: "MSEMUSS\0", u16 version, u16 reserved
+//   chunk:  u32 tag, u32 payload size, payload
+//
+//   "CPU " registers, ip and flags, the core keeps no other state between
+//          instructions
+//   "DEV " u32 start address, u32 size, u32 page size, u8 name length, name
+//   "PAGE" u32 page index, u8 encoding, u32 reference, data
+//          one per non zero page of the preceding "DEV ", duplicates of an
+//          already stored page only carry its reference
+//   "DSTA" device model state of the preceding "DEV "
+//   "END "
+//
+// Chunks are written one at a time, so saving never needs more than a page
+// worth of buffer. Readers skip chunks they do not know.
+//
+// Writer goes straight to the file descriptor through its own buffer. After
+// reserve() for all pages it neither allocates nor uses stdio, so it can run
+// in a child forked from a multithreaded process, see Checkpointer.
+
+constexpr uint16_t save_state_version   = 1;
+constexpr uint32_t save_state_page_size = 4096;
+// Covers segment:offset addresses up to ffff:ffff.
+constexpr uint32_t save_state_max_device_size = 0x110000;
+
+class SaveStateWriter
+{
+public:
+    struct Stats
+    {
+        std::size_t pages;
+        std::size_t zero_pages;
+        std::size_t duplicate_pages;
+        std::size_t bytes;
+    };
+
+    SaveStateWriter();
+    ~SaveStateWriter();
+
+    SaveStateWriter(const SaveStateWriter&) = delete;
+    SaveStateWriter& operator=(const SaveStateWriter&) = delete;
+
+    bool open(const char* path);
+    // Sizes deduplication index for given number of pages.
+    void reserve(std::size_t pages);
+    void write_cpu(const cpu8086::CpuState& state);
+    void write_device(std::string_view name, uint32_t start_address, std::span<const uint8_t> memory);
+    void write_device_state(std::span<const uint8_t> state);
+    // Buffered data is lost when the writer is destroyed without close().
+    bool close();
+    // close() which does not report failure, safe in a forked child.
+    bool finish();
+
+    const Stats& stats() const
+    {
+        return stats_;
+    }
+
+private:
+    struct Slot
+    {
+        uint64_t hash;
+        // stored page + 1, 0 for empty slot
+        uint32_t id;
+    };
+
+    void write_chunk(uint32_t tag, std::span<const uint8_t> header, std::span<const uint8_t> data = {});
+    void write_page(uint32_t index, std::span<const uint8_t> page);
+    void append(std::span<const uint8_t> data);
+    void flush();
+    void insert(uint64_t hash, uint32_t id);
+
+    int fd_;
+    bool failed_;
+    Stats stats_;
+    std::vector<uint8_t> buffer_;
+    std::vector<uint8_t> output_;
+    std::size_t output_size_;
+    // open addressing index of stored pages by content hash
+    std::vector<Slot> slots_;
+    // the spans point to memory which is being saved
+    std::vector<std::span<const uint8_t>> stored_;
+};
+
+class SaveStateReader
+{
+public:
+    struct DeviceImage
+    {
+        std::string name;
+        uint32_t start_address;
+        uint32_t size;
+        uint32_t page_size;
+        // index of stored page for each device page, -1 for zero filled page
+        std::vector<int32_t> pages;
+        std::span<const uint8_t> state;
+    };
+
+    SaveStateReader();
+    ~SaveStateReader();
+
+    SaveStateReader(const SaveStateReader&) = delete;
+    SaveStateReader& operator=(const SaveStateReader&) = delete;
+
+    // Maps the file and indexes chunks, page data is not touched.
+    bool open(const char* path);
+
+    const cpu8086::CpuState& cpu() const
+    {
+        return cpu_;
+    }
+
+    const DeviceImage* device(std::string_view name) const;
+
+    // Decompresses single page on demand.
+    bool read_page(const DeviceImage& device, uint32_t index, std::span<uint8_t> page) const;
+    // Pages which were not stored are zeroed only when they hold data, so in
+    // sparse memory they stay uncommitted. Stored pages are decompressed
+    // eagerly: the CPU reads guest memory directly through host pointers and
+    // has no fault to decompress on, unlike cold pages of DynamicBus. Restore
+    // commits no more memory than the saved machine had written.
+    bool restore_memory(const DeviceImage& device, std::span<uint8_t> memory) const;
+
+private:
+    struct StoredPage
+    {
+        uint8_t encoding;
+        std::span<const uint8_t> data;
+    };
+
+    bool parse();
+
+    uint8_t* map_;
+    std::size_t map_size_;
+    cpu8086::CpuState cpu_;
+    std::vector<DeviceImage> devices_;
+    std::vector<StoredPage> stored_;
+};
+
+// Number of pages written for all devices of bus.
+template <typename BusType>
+std::size_t state_pages(const BusType& bus)
+{
+    std::size_t pages = 0;
+    bus.for_each_device(
+        [&pages](const auto& device)
+        { pages += (device.span().size() + save_state_page_size - 1) / save_state_page_size; });
+    return pages;
+}
+
+template <typename BusType>
+void write_state(SaveStateWriter& writer, const BusType& bus)
+{
+    writer.write_cpu(cpu8086::capture_state());
+    bus.for_each_device(
+        [&writer](const auto& device)
+        {
+            writer.write_device(device.name(), device.start_address, device.span());
+            if constexpr (requires { device.save_state(writer); })
+            {
+                device.save_state(writer);
+            }
+        });
+}
+
+template <typename BusType>
+bool save_state(const char* path, const BusType& bus)
+{
+    SaveStateWriter writer;
+    if (!writer.open(path))
+    {
+        return false;
+    }
+    writer.reserve(state_pages(bus));
+    write_state(writer, bus);
+    return writer.close();
+}
+
+template <typename BusType>
+bool load_state(const char* path, BusType& bus)
+{
+    SaveStateReader reader;
+    if (!reader.open(path))
+    {
+        return false;
+    }
+
+    bool ok = true;
+    bus.for_each_device(
+        [&reader, &ok](auto& device)
+        {
+            const auto* image = reader.device(device.name());
+            if (image == nullptr || image->size != device.span().size())
+            {
+                printf("ERR: save state does not match device: %s\n", device.name().data());
+                ok = false;
+                return;
+            }
+            ok = reader.restore_memory(*image, device.span()) && ok;
+            if constexpr (requires { device.load_state(image->state); })
+            {
+                device.load_state(image->state);
+            }
+        });
+
+    if (ok)
+    {
+        cpu8086::restore_state(reader.cpu());
+    }
+    return ok;
+}
+
+} // namespace msemu
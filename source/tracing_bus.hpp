@@ -0,0 +1,129 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "memory.hpp"
+
+namespace msemu
+{
+
+struct BusWrite
+{
+    uint32_t address;
+    uint8_t data;
+
+    bool operator==(const BusWrite&) const = default;
+};
+
+// Forwards every access to the wrapped bus and records each written byte,
+// so two cores can be compared on their memory side effects.
+template <typename BusType>
+class TracingBus
+{
+public:
+    constexpr static std::size_t device_count = BusType::device_count;
+
+    TracingBus(BusType& bus)
+        : bus_(bus)
+        , writes_{}
+    {
+    }
+
+    void print() const
+    {
+        bus_.print();
+    }
+
+    auto get(const char* name) const
+    {
+        return static_cast<const BusType&>(bus_).get(name);
+    }
+
+    auto get(const char* name)
+    {
+        return bus_.get(name);
+    }
+
+    void clear()
+    {
+        bus_.clear();
+    }
+
+    template <typename DataType>
+    DataType read(const uint32_t address)
+    {
+        return bus_.template read<DataType>(address);
+    }
+
+    void read(const uint32_t address, std::span<uint8_t> data)
+    {
+        bus_.read(address, data);
+    }
+
+    // Writes through host pointers would not be recorded.
+    HostRange host_range(const uint32_t address)
+    {
+        HostRange range = bus_.host_range(address);
+        range.writable  = false;
+        return range;
+    }
+
+    void write(const uint32_t address, const std::span<const uint8_t> data)
+    {
+        for (std::size_t i = 0; i < data.size(); ++i)
+        {
+            writes_.push_back(BusWrite{static_cast<uint32_t>(address + i), data[i]});
+        }
+        bus_.write(address, data);
+    }
+
+    void write(const uint32_t address, const auto data)
+    {
+        for (std::size_t i = 0; i < sizeof(data); ++i)
+        {
+            writes_.push_back(BusWrite{static_cast<uint32_t>(address + i),
+                                       static_cast<uint8_t>((data >> (8 * i)) & 0xff)});
+        }
+        bus_.write(address, data);
+    }
+
+    const std::vector<BusWrite>& writes() const
+    {
+        return writes_;
+    }
+
+    void clear_writes()
+    {
+        writes_.clear();
+    }
+
+    BusType& bus()
+    {
+        return bus_;
+    }
+
+private:
+    BusType& bus_;
+    std::vector<BusWrite> writes_;
+};
+
+} // namespace msemu
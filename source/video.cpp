@@ -0,0 +1,329 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "video.hpp"
+
+#include <bit>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MSEMU_VIDEO_X86
+#include <immintrin.h>
+#endif
+
+namespace msemu
+{
+
+namespace
+{
+
+constexpr uint32_t rgba(const uint32_t red, const uint32_t green, const uint32_t blue)
+{
+    return red | green << 8 | blue << 16 | 0xff000000;
+}
+
+constexpr std::array<uint32_t, 16> ega_palette = {
+    rgba(0x00, 0x00, 0x00), rgba(0x00, 0x00, 0xaa), rgba(0x00, 0xaa, 0x00), rgba(0x00, 0xaa, 0xaa),
+    rgba(0xaa, 0x00, 0x00), rgba(0xaa, 0x00, 0xaa), rgba(0xaa, 0x55, 0x00), rgba(0xaa, 0xaa, 0xaa),
+    rgba(0x55, 0x55, 0x55), rgba(0x55, 0x55, 0xff), rgba(0x55, 0xff, 0x55), rgba(0x55, 0xff, 0xff),
+    rgba(0xff, 0x55, 0x55), rgba(0xff, 0x55, 0xff), rgba(0xff, 0xff, 0x55), rgba(0xff, 0xff, 0xff)};
+
+// byte of plane to 8 pixels, one byte each, leftmost pixel in the lowest byte
+constexpr std::array<uint64_t, 256> plane_spread = []
+{
+    std::array<uint64_t, 256> table{};
+    for (uint32_t byte = 0; byte < 256; ++byte)
+    {
+        for (uint32_t pixel = 0; pixel < 8; ++pixel)
+        {
+            table[byte] |= static_cast<uint64_t>((byte >> (7 - pixel)) & 1) << (8 * pixel);
+        }
+    }
+    return table;
+}();
+
+using PackedTable = std::array<std::array<uint32_t, 8>, 256>;
+
+void convert_packed_scalar(const uint8_t* source, uint32_t* target, const uint32_t bytes,
+                           const uint32_t bits_per_pixel, const uint32_t* colors)
+{
+    const uint32_t pixels = 8 / bits_per_pixel;
+    const uint32_t mask   = (1u << bits_per_pixel) - 1;
+    for (uint32_t x = 0; x < bytes; ++x)
+    {
+        for (uint32_t pixel = 0; pixel < pixels; ++pixel)
+        {
+            *target++ = colors[(source[x] >> (8 - bits_per_pixel * (pixel + 1))) & mask];
+        }
+    }
+}
+
+void convert_planar_scalar(const uint8_t* source, const uint32_t plane_stride, uint32_t* target,
+                           const uint32_t bytes, const uint32_t* colors)
+{
+    for (uint32_t x = 0; x < bytes; ++x)
+    {
+        for (uint32_t bit = 8; bit-- > 0;)
+        {
+            uint32_t index = 0;
+            for (uint32_t plane = 0; plane < 4; ++plane)
+            {
+                index |= ((source[plane * plane_stride + x] >> bit) & 1u) << plane;
+            }
+            *target++ = colors[index];
+        }
+    }
+}
+
+#ifdef MSEMU_VIDEO_X86
+
+__attribute__((target("sse2"))) void convert_packed_sse2(const uint8_t* source, uint32_t* target,
+                                                         const uint32_t bytes, const uint32_t bits_per_pixel,
+                                                         const PackedTable& table)
+{
+    for (uint32_t x = 0; x < bytes; ++x)
+    {
+        const auto* pixels = reinterpret_cast<const __m128i*>(table[source[x]].data());
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(target), _mm_load_si128(pixels));
+        target += 4;
+        if (bits_per_pixel == 1)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target), _mm_load_si128(pixels + 1));
+            target += 4;
+        }
+    }
+}
+
+__attribute__((target("sse2"))) void convert_planar_sse2(const uint8_t* source, const uint32_t plane_stride,
+                                                         uint32_t* target, const uint32_t bytes,
+                                                         const uint32_t* colors)
+{
+    for (uint32_t x = 0; x < bytes; ++x)
+    {
+        // 4 bit index of 8 pixels at once
+        const uint64_t index = plane_spread[source[x]] | plane_spread[source[plane_stride + x]] << 1 |
+                               plane_spread[source[2 * plane_stride + x]] << 2 |
+                               plane_spread[source[3 * plane_stride + x]] << 3;
+        const auto color = [colors, index](const uint32_t pixel)
+        { return static_cast<int>(colors[(index >> (8 * pixel)) & 0xf]); };
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(target),
+                         _mm_setr_epi32(color(0), color(1), color(2), color(3)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(target + 4),
+                         _mm_setr_epi32(color(4), color(5), color(6), color(7)));
+        target += 8;
+    }
+}
+
+// packed pixels are copied from table, shifting them out like in planar
+// kernel below turned out slower than table lookups
+__attribute__((target("avx2"))) void convert_packed_avx2(const uint8_t* source, uint32_t* target,
+                                                         const uint32_t bytes, const uint32_t bits_per_pixel,
+                                                         const PackedTable& table)
+{
+    uint32_t x = 0;
+    if (bits_per_pixel == 2)
+    {
+        for (; x + 2 <= bytes; x += 2, target += 8)
+        {
+            const __m256i pixels =
+                _mm256_loadu2_m128i(reinterpret_cast<const __m128i*>(table[source[x + 1]].data()),
+                                    reinterpret_cast<const __m128i*>(table[source[x]].data()));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target), pixels);
+        }
+    }
+    else
+    {
+        for (; x < bytes; ++x, target += 8)
+        {
+            const auto* pixels = reinterpret_cast<const __m256i*>(table[source[x]].data());
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target), _mm256_loadu_si256(pixels));
+        }
+    }
+    convert_packed_sse2(source + x, target, bytes - x, bits_per_pixel, table);
+}
+
+// 8 pixels per iteration, pixel index is shifted out of broadcasted plane
+// bytes and looked up with permutes in palette kept in registers
+__attribute__((target("avx2"))) void convert_planar_avx2(const uint8_t* source, const uint32_t plane_stride,
+                                                         uint32_t* target, const uint32_t bytes,
+                                                         const uint32_t* colors)
+{
+    const __m256i low     = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(colors));
+    const __m256i high    = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(colors + 8));
+    const __m256i shifts  = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m256i bits    = _mm256_set1_epi32(0x01010101);
+    const __m256i weights = _mm256_set1_epi32(0x01020408);
+    for (uint32_t x = 0; x < bytes; ++x, target += 8)
+    {
+        const uint32_t planes = static_cast<uint32_t>(source[x]) | source[plane_stride + x] << 8 |
+                                source[2 * plane_stride + x] << 16 |
+                                static_cast<uint32_t>(source[3 * plane_stride + x]) << 24;
+        // one bit of every plane in each byte of lane, multiply gathers them in the top byte
+        const __m256i lanes =
+            _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32(static_cast<int>(planes)), shifts), bits);
+        const __m256i index  = _mm256_srli_epi32(_mm256_mullo_epi32(lanes, weights), 24);
+        const __m256i select = _mm256_srai_epi32(_mm256_slli_epi32(index, 28), 31);
+        const __m256i pixels = _mm256_blendv_epi8(_mm256_permutevar8x32_epi32(low, index),
+                                                  _mm256_permutevar8x32_epi32(high, index), select);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(target), pixels);
+    }
+}
+
+#endif
+
+} // namespace
+
+VideoOutput::VideoOutput(const Kernel kernel)
+    : kernel_(kernel)
+    , mode_{}
+    , layout_{}
+    , redraw_(true)
+    , colors_{}
+    , packed_{}
+    , frame_(video_max_width * video_max_height)
+    , stats_{}
+{
+    set_mode(VideoMode::cga_320x200x4);
+}
+
+VideoOutput::Kernel VideoOutput::best_kernel()
+{
+#ifdef MSEMU_VIDEO_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return Kernel::avx2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return Kernel::sse2;
+    }
+#endif
+    return Kernel::scalar;
+}
+
+void VideoOutput::set_mode(const VideoMode mode)
+{
+    mode_   = mode;
+    layout_ = video_layout(mode);
+    redraw_ = true;
+    switch (mode)
+    {
+        case VideoMode::cga_320x200x4:
+            // palette 1, high intensity
+            colors_ = {ega_palette[0], ega_palette[11], ega_palette[13], ega_palette[15]};
+            break;
+        case VideoMode::cga_640x200x2:
+            colors_ = {ega_palette[0], ega_palette[15]};
+            break;
+        case VideoMode::ega_320x200x16:
+        case VideoMode::ega_640x350x16:
+            colors_ = ega_palette;
+            break;
+    }
+    prepare_tables();
+}
+
+void VideoOutput::palette(const uint8_t index, const uint32_t rgba)
+{
+    colors_[index & 0xf] = rgba;
+    redraw_              = true;
+    prepare_tables();
+}
+
+void VideoOutput::prepare_tables()
+{
+    if (layout_.planes != 1)
+    {
+        return;
+    }
+    for (uint32_t byte = 0; byte < packed_.size(); ++byte)
+    {
+        const auto source = static_cast<uint8_t>(byte);
+        convert_packed_scalar(&source, packed_[byte].data(), 1, layout_.bits_per_pixel, colors_.data());
+    }
+}
+
+std::size_t VideoOutput::update(VideoMemory& memory)
+{
+    if (memory.mode() != mode_)
+    {
+        set_mode(memory.mode());
+    }
+    if (redraw_)
+    {
+        memory.invalidate();
+        redraw_ = false;
+    }
+
+    const auto dirty  = memory.take_dirty();
+    std::size_t lines = 0;
+    for (uint32_t word = 0; word < dirty.size(); ++word)
+    {
+        for (uint64_t bits = dirty[word]; bits != 0; bits &= bits - 1)
+        {
+            const uint32_t line = word * 64 + static_cast<uint32_t>(std::countr_zero(bits));
+            if (line >= layout_.height)
+            {
+                break;
+            }
+            convert_line(memory.span().data(), line);
+            ++lines;
+        }
+    }
+    ++stats_.frames;
+    stats_.lines += lines;
+    return lines;
+}
+
+void VideoOutput::convert_line(const uint8_t* memory, const uint32_t line)
+{
+    const uint8_t* source = memory + layout_.offset + (line % layout_.banks) * layout_.bank_stride +
+                            (line / layout_.banks) * layout_.bytes_per_line;
+    uint32_t* target      = frame_.data() + line * layout_.width;
+    const bool planar     = layout_.planes != 1;
+    switch (kernel_)
+    {
+#ifdef MSEMU_VIDEO_X86
+        case Kernel::avx2:
+            if (planar)
+            {
+                return convert_planar_avx2(source, layout_.plane_stride, target, layout_.bytes_per_line,
+                                           colors_.data());
+            }
+            return convert_packed_avx2(source, target, layout_.bytes_per_line, layout_.bits_per_pixel,
+                                       packed_);
+        case Kernel::sse2:
+            if (planar)
+            {
+                return convert_planar_sse2(source, layout_.plane_stride, target, layout_.bytes_per_line,
+                                           colors_.data());
+            }
+            return convert_packed_sse2(source, target, layout_.bytes_per_line, layout_.bits_per_pixel,
+                                       packed_);
+#endif
+        default:
+            if (planar)
+            {
+                return convert_planar_scalar(source, layout_.plane_stride, target, layout_.bytes_per_line,
+                                             colors_.data());
+            }
+            return convert_packed_scalar(source, target, layout_.bytes_per_line, layout_.bits_per_pixel,
+                                         colors_.data());
+    }
+}
+
+} // namespace msemu
@@ -0,0 +1,253 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace msemu
+{
+
+enum class VideoMode : uint8_t
+{
+    cga_320x200x4,  // 2 bits per pixel, even and odd scanlines in separate banks
+    cga_640x200x2,  // 1 bit per pixel, interleaved like above
+    ega_320x200x16, // 4 planes, 1 bit of pixel in each
+    ega_640x350x16
+};
+
+// Where pixels of a mode live in video memory. Scanline y starts at
+// offset + (y % banks) * bank_stride + (y / banks) * bytes_per_line,
+// further planes follow the first one every plane_stride bytes.
+//
+// Sequencer and graphics controller of EGA are not emulated, planes are
+// visible to the guest one after another at 0xa0000.
+struct VideoLayout
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t bits_per_pixel;
+    uint32_t planes;
+    uint32_t banks;
+    uint32_t offset;
+    uint32_t bytes_per_line;
+    uint32_t bank_stride;
+    uint32_t plane_stride;
+};
+
+constexpr VideoLayout video_layout(const VideoMode mode)
+{
+    switch (mode)
+    {
+        case VideoMode::cga_320x200x4:
+            return {320, 200, 2, 1, 2, 0x18000, 80, 0x2000, 0x4000};
+        case VideoMode::cga_640x200x2:
+            return {640, 200, 1, 1, 2, 0x18000, 80, 0x2000, 0x4000};
+        case VideoMode::ega_320x200x16:
+            return {320, 200, 1, 4, 1, 0x00000, 40, 0x8000, 0x8000};
+        case VideoMode::ega_640x350x16:
+            return {640, 350, 1, 4, 1, 0x00000, 80, 0x8000, 0x8000};
+    }
+    return {};
+}
+
+constexpr uint32_t video_max_width  = 640;
+constexpr uint32_t video_max_height = 350;
+
+// Video memory mapped at 0xa0000 - 0xbffff.
+//
+// Every write through the bus marks touched scanlines of current mode, so
+// VideoOutput converts only lines changed since previous frame.
+class VideoMemory
+{
+public:
+    static constexpr uint32_t size = 0x20000;
+
+    VideoMemory()
+        : memory_{}
+        , mode_(VideoMode::cga_320x200x4)
+        , dirty_{}
+    {
+        invalidate();
+    }
+
+    std::span<uint8_t> span()
+    {
+        return memory_;
+    }
+
+    std::span<const uint8_t> span() const
+    {
+        return memory_;
+    }
+
+    void clear()
+    {
+        memory_ = {};
+        invalidate();
+    }
+
+    VideoMode mode() const
+    {
+        return mode_;
+    }
+
+    void mode(const VideoMode mode)
+    {
+        mode_ = mode;
+        invalidate();
+    }
+
+    // Called by the bus after write of size bytes at offset from start of device.
+    void written(uint32_t offset, const uint32_t size)
+    {
+        const VideoLayout layout = video_layout(mode_);
+        const uint32_t end       = offset + size;
+        if (end <= layout.offset)
+        {
+            return;
+        }
+        const uint32_t bank_lines = (layout.height + layout.banks - 1) / layout.banks;
+        offset                    = offset < layout.offset ? 0 : offset - layout.offset;
+        while (offset < end - layout.offset)
+        {
+            const uint32_t plane = offset / layout.plane_stride;
+            const uint32_t bank  = (offset % layout.plane_stride) / layout.bank_stride;
+            const uint32_t local = offset % layout.bank_stride;
+            const uint32_t row   = local / layout.bytes_per_line;
+            const uint32_t line  = row * layout.banks + bank;
+            if (plane >= layout.planes)
+            {
+                return;
+            }
+            if (row >= bank_lines)
+            {
+                // gap after the last line of the bank, lines continue at the next bank
+                offset += layout.bank_stride - local;
+                continue;
+            }
+            if (line < layout.height)
+            {
+                dirty_[line / 64] |= uint64_t{1} << (line % 64);
+            }
+            offset += layout.bytes_per_line - local % layout.bytes_per_line;
+        }
+    }
+
+    bool dirty(const uint32_t line) const
+    {
+        return (dirty_[line / 64] >> (line % 64)) & 1;
+    }
+
+    void invalidate()
+    {
+        dirty_.fill(~uint64_t{0});
+    }
+
+    // Returns dirty scanlines and marks all of them clean.
+    std::array<uint64_t, (video_max_height + 63) / 64> take_dirty()
+    {
+        const auto dirty = dirty_;
+        dirty_           = {};
+        return dirty;
+    }
+
+private:
+    std::array<uint8_t, size> memory_;
+    VideoMode mode_;
+    std::array<uint64_t, (video_max_height + 63) / 64> dirty_;
+};
+
+// Converts video memory to host RGBA framebuffer, one uint32_t per pixel
+// with red in the lowest byte.
+//
+// Kernels for x86 hosts are selected at runtime. Packed pixels are copied
+// from per byte tables in 16 or 32 byte groups, AVX2 expands planar pixels
+// with variable shifts and palette permutes. Scalar kernel is the reference
+// for both of them.
+class VideoOutput
+{
+public:
+    enum class Kernel : uint8_t
+    {
+        scalar,
+        sse2,
+        avx2
+    };
+
+    struct Stats
+    {
+        std::size_t frames;
+        std::size_t lines;
+    };
+
+    explicit VideoOutput(Kernel kernel = best_kernel());
+
+    static Kernel best_kernel();
+
+    Kernel kernel() const
+    {
+        return kernel_;
+    }
+
+    // Sets color of pixel value, mode change restores default palette.
+    void palette(uint8_t index, uint32_t rgba);
+
+    // Converts scanlines written since previous update, returns their number.
+    std::size_t update(VideoMemory& memory);
+
+    uint32_t width() const
+    {
+        return layout_.width;
+    }
+
+    uint32_t height() const
+    {
+        return layout_.height;
+    }
+
+    // Pixels of current mode, row after row.
+    std::span<const uint32_t> frame() const
+    {
+        return std::span<const uint32_t>(frame_).first(layout_.width * layout_.height);
+    }
+
+    const Stats& stats() const
+    {
+        return stats_;
+    }
+
+private:
+    void set_mode(VideoMode mode);
+    void prepare_tables();
+    void convert_line(const uint8_t* memory, uint32_t line);
+
+    Kernel kernel_;
+    VideoMode mode_;
+    VideoLayout layout_;
+    bool redraw_;
+    alignas(32) std::array<uint32_t, 16> colors_;
+    // pixels of every possible byte for packed modes, 4 or 8 per byte
+    alignas(16) std::array<std::array<uint32_t, 8>, 256> packed_;
+    std::vector<uint32_t> frame_;
+    Stats stats_;
+};
+
+} // namespace msemu
@@ -0,0 +1,219 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "video_capture.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace msemu
+{
+
+VideoCapture::VideoCapture(const char* path, const Format format, const uint32_t frame_rate,
+                           const uint64_t clock)
+    : file_(fopen(path, "wb"))
+    , format_(format)
+    , frame_rate_(frame_rate)
+    , period_(clock / frame_rate)
+    , cycles_(0)
+    , first_(true)
+    , changed_(false)
+    , repeats_(0)
+    , trailing_repeats_(0)
+    , width_(0)
+    , height_(0)
+    , ring_{}
+    , head_(0)
+    , tail_(0)
+    , wake_(0)
+    , stop_(false)
+    , stats_{}
+    , written_(0)
+    , encoded_{}
+    , writer_{}
+{
+    if (file_ == nullptr)
+    {
+        printf("ERR: Can't open capture file: %s\n", path);
+        return;
+    }
+    // pixels are never allocated on the CPU thread
+    for (auto& frame : ring_)
+    {
+        frame.pixels.resize(video_max_width * video_max_height);
+    }
+    writer_ = std::thread(&VideoCapture::write_frames, this);
+}
+
+VideoCapture::~VideoCapture()
+{
+    close();
+}
+
+void VideoCapture::capture(VideoOutput& output, VideoMemory& memory)
+{
+    if (file_ == nullptr)
+    {
+        return;
+    }
+
+    ++stats_.captured;
+    changed_ = output.update(memory) != 0 || changed_;
+
+    const bool resized = output.width() != width_ || output.height() != height_;
+    if (!first_ && resized && format_ == Format::y4m)
+    {
+        ++stats_.dropped;
+        ++repeats_;
+        return;
+    }
+    if (!first_ && !changed_ && !resized)
+    {
+        ++stats_.repeats;
+        ++repeats_;
+        return;
+    }
+
+    const uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == ring_size)
+    {
+        // changed_ stays set, so the next frame carries the change
+        ++stats_.dropped;
+        ++repeats_;
+        return;
+    }
+
+    Frame& frame      = ring_[head % ring_size];
+    frame.width       = output.width();
+    frame.height      = output.height();
+    frame.repeats     = std::exchange(repeats_, 0);
+    const auto pixels = output.frame();
+    std::copy(pixels.begin(), pixels.end(), frame.pixels.begin());
+    first_   = false;
+    changed_ = false;
+    width_   = frame.width;
+    height_  = frame.height;
+
+    head_.store(head + 1, std::memory_order_release);
+    wake_.fetch_add(1, std::memory_order_release);
+    wake_.notify_one();
+}
+
+void VideoCapture::close()
+{
+    if (writer_.joinable())
+    {
+        trailing_repeats_ = std::exchange(repeats_, 0);
+        stop_.store(true, std::memory_order_release);
+        wake_.fetch_add(1, std::memory_order_release);
+        wake_.notify_one();
+        writer_.join();
+    }
+    if (file_ != nullptr)
+    {
+        fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+VideoCapture::Stats VideoCapture::stats() const
+{
+    Stats stats   = stats_;
+    stats.written = written_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void VideoCapture::write_frames()
+{
+    bool header = format_ == Format::y4m;
+    while (true)
+    {
+        const uint32_t wake = wake_.load(std::memory_order_acquire);
+        const uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire))
+        {
+            if (stop_.load(std::memory_order_acquire))
+            {
+                write_encoded(trailing_repeats_);
+                break;
+            }
+            wake_.wait(wake, std::memory_order_acquire);
+            continue;
+        }
+
+        const Frame& frame = ring_[tail % ring_size];
+        if (header)
+        {
+            fprintf(file_, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", frame.width, frame.height, frame_rate_);
+            header = false;
+        }
+        write_encoded(frame.repeats);
+        encode(frame);
+        tail_.store(tail + 1, std::memory_order_release);
+        write_encoded(1);
+    }
+    fflush(file_);
+}
+
+void VideoCapture::write_encoded(const uint64_t count)
+{
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        if (fwrite(encoded_.data(), 1, encoded_.size(), file_) == encoded_.size())
+        {
+            written_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void VideoCapture::encode(const Frame& frame)
+{
+    const std::size_t pixels = std::size_t{frame.width} * frame.height;
+    if (format_ == Format::raw)
+    {
+        encoded_.resize(pixels * sizeof(uint32_t));
+        for (std::size_t i = 0; i < pixels; ++i)
+        {
+            const uint32_t pixel = frame.pixels[i];
+            for (std::size_t byte = 0; byte < sizeof(uint32_t); ++byte)
+            {
+                encoded_[i * sizeof(uint32_t) + byte] = static_cast<uint8_t>(pixel >> (8 * byte));
+            }
+        }
+        return;
+    }
+
+    static constexpr char tag[] = "FRAME\n";
+    const std::size_t offset    = sizeof(tag) - 1;
+    encoded_.resize(offset + 3 * pixels);
+    std::copy(tag, tag + offset, encoded_.begin());
+    uint8_t* y = encoded_.data() + offset;
+    uint8_t* u = y + pixels;
+    uint8_t* v = u + pixels;
+    for (std::size_t i = 0; i < pixels; ++i)
+    {
+        // BT.601, studio range
+        const int red   = static_cast<int>(frame.pixels[i] & 0xff);
+        const int green = static_cast<int>((frame.pixels[i] >> 8) & 0xff);
+        const int blue  = static_cast<int>((frame.pixels[i] >> 16) & 0xff);
+        y[i]            = static_cast<uint8_t>(((66 * red + 129 * green + 25 * blue + 128) >> 8) + 16);
+        u[i]            = static_cast<uint8_t>(((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128);
+        v[i]            = static_cast<uint8_t>(((112 * red - 94 * green - 18 * blue + 128) >> 8) + 128);
+    }
+}
+
+} // namespace msemu
@@ -0,0 +1,137 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "video.hpp"
+
+namespace msemu
+{
+
+// Records guest screen at fixed rate of emulated time.
+//
+// CPU thread converts dirty scanlines with VideoOutput and hands frames to
+// the writer thread through single producer, single consumer ring. Frames
+// without dirty scanlines take no ring slot, they are counted as repeats
+// which the writer emits as the previously encoded frame again before the
+// next queued one (or on close). When the writer falls behind, changed frame
+// is dropped instead of stopping the guest and a repeat takes its place, so
+// the stream keeps one frame per period and the change goes out with the
+// next frame.
+//
+// Y4M streams use 4:4:4 chroma and size of the first frame, frames of other
+// size (after mode change) are replaced by repeats. Raw streams are RGBA
+// frames one after another.
+class VideoCapture
+{
+public:
+    enum class Format
+    {
+        y4m,
+        raw
+    };
+
+    struct Stats
+    {
+        std::size_t captured;
+        std::size_t repeats;
+        std::size_t dropped;
+        std::size_t written;
+    };
+
+    // 8086 of IBM PC runs at 4.77 MHz
+    VideoCapture(const char* path, Format format, uint32_t frame_rate = 60, uint64_t clock = 4772727);
+    ~VideoCapture();
+
+    VideoCapture(const VideoCapture&) = delete;
+    VideoCapture& operator=(const VideoCapture&) = delete;
+
+    bool ok() const
+    {
+        return file_ != nullptr;
+    }
+
+    // Advances emulated time, frame is captured at every frame period.
+    void advance(const uint64_t cycles, VideoOutput& output, VideoMemory& memory)
+    {
+        cycles_ += cycles;
+        while (cycles_ >= period_)
+        {
+            cycles_ -= period_;
+            capture(output, memory);
+        }
+    }
+
+    void capture(VideoOutput& output, VideoMemory& memory);
+
+    // Writes pending frames and closes the file.
+    void close();
+
+    Stats stats() const;
+
+private:
+    struct Frame
+    {
+        std::vector<uint32_t> pixels;
+        uint32_t width;
+        uint32_t height;
+        // repeats of the previous frame which go before this one
+        uint64_t repeats;
+    };
+
+    static constexpr uint32_t ring_size = 4;
+
+    void write_frames();
+    void encode(const Frame& frame);
+    void write_encoded(uint64_t count);
+
+    FILE* file_;
+    const Format format_;
+    const uint32_t frame_rate_;
+    const uint64_t period_;
+    uint64_t cycles_;
+    bool first_;
+    // changed frame was dropped, next one can't be a repeat
+    bool changed_;
+    // repeats of the last queued frame, handed over with the next frame
+    uint64_t repeats_;
+    // repeats left after the last frame, set by close() before stop_
+    uint64_t trailing_repeats_;
+    uint32_t width_;
+    uint32_t height_;
+    std::array<Frame, ring_size> ring_;
+    std::atomic<uint32_t> head_;
+    std::atomic<uint32_t> tail_;
+    // incremented for every published frame and on close, writer sleeps on it
+    std::atomic<uint32_t> wake_;
+    std::atomic<bool> stop_;
+    Stats stats_;
+    std::atomic<std::size_t> written_;
+    // owned by writer thread
+    std::vector<uint8_t> encoded_;
+    std::thread writer_;
+};
+
+} // namespace msemu
@@ -0,0 +1,197 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "8086_alu.hpp"
+#include "test_base.hpp"
+
+namespace msemu::cpu8086
+{
+
+TEST(AluKernelTests, ComputesParityOfLowByte)
+{
+    EXPECT_EQ(parity_table[0x00], alu_flags::parity);
+    EXPECT_EQ(parity_table[0x01], 0);
+    EXPECT_EQ(parity_table[0x03], alu_flags::parity);
+    EXPECT_EQ(parity_table[0x80], 0);
+    EXPECT_EQ(parity_table[0xff], alu_flags::parity);
+}
+
+TEST(AluKernelTests, SetsCarryAndOverflowOfAddition)
+{
+    const auto carry = alu<AluOp::add_op, uint8_t>(0xff, 0x01, false);
+    EXPECT_EQ(carry.value, 0x00);
+    EXPECT_EQ(carry.flags, alu_flags::carry | alu_flags::adjust | alu_flags::zero | alu_flags::parity);
+
+    const auto overflow = alu<AluOp::add_op, uint16_t>(0x7fff, 0x0001, false);
+    EXPECT_EQ(overflow.value, 0x8000);
+    EXPECT_EQ(overflow.flags, alu_flags::overflow | alu_flags::sign | alu_flags::adjust | alu_flags::parity);
+
+    const auto adc = alu<AluOp::adc_op, uint16_t>(0xfffe, 0x0001, true);
+    EXPECT_EQ(adc.value, 0x0000);
+    EXPECT_TRUE(adc.flags & alu_flags::carry);
+}
+
+TEST(AluKernelTests, SetsBorrowAndOverflowOfSubtraction)
+{
+    const auto borrow = alu<AluOp::sub_op, uint8_t>(0x00, 0x01, false);
+    EXPECT_EQ(borrow.value, 0xff);
+    EXPECT_EQ(borrow.flags, alu_flags::carry | alu_flags::adjust | alu_flags::sign | alu_flags::parity);
+
+    const auto overflow = alu<AluOp::sub_op, uint8_t>(0x80, 0x01, false);
+    EXPECT_EQ(overflow.value, 0x7f);
+    EXPECT_EQ(overflow.flags, alu_flags::overflow | alu_flags::adjust);
+
+    const auto sbb = alu<AluOp::sbb_op, uint16_t>(0x0001, 0x0001, true);
+    EXPECT_EQ(sbb.value, 0xffff);
+    EXPECT_TRUE(sbb.flags & alu_flags::carry);
+}
+
+TEST(AluKernelTests, LogicOperationsClearCarryAndOverflow)
+{
+    const auto or_result = alu<AluOp::or_op, uint8_t>(0x80, 0x01, true);
+    EXPECT_EQ(or_result.flags, alu_flags::sign | alu_flags::parity);
+
+    const auto and_result = alu<AluOp::and_op, uint16_t>(0xff00, 0x00ff, true);
+    EXPECT_EQ(and_result.flags, alu_flags::zero | alu_flags::parity);
+
+    const auto xor_result = alu<AluOp::xor_op, uint16_t>(0x1234, 0x1234, false);
+    EXPECT_EQ(xor_result.value, 0x0000);
+}
+
+class AluTests : public TestBase
+{
+};
+
+TEST_F(AluTests, XorWritesWordToModrm)
+{
+    // xor bx, ax
+    bus_.write(0x00000, std::vector<uint8_t>{0x31, 0xc3});
+    sut_.set_registers({.ax = 0x1234, .bx = 0xff00});
+
+    sut_.step();
+
+    EXPECT_EQ(sut_.get_registers().bx, 0xed34);
+    EXPECT_EQ(sut_.get_registers().ax, 0x1234);
+    EXPECT_EQ(sut_.last_instruction_cost(), 3);
+}
+
+TEST_F(AluTests, AddsRegisterToMemory)
+{
+    // add [bx], ax
+    bus_.write(0x00000, std::vector<uint8_t>{0x01, 0x07});
+    bus_.write(0x01000, std::vector<uint8_t>{0xff, 0x7f});
+    sut_.set_registers({.ax = 0x0001, .bx = 0x1000});
+
+    sut_.step();
+
+    EXPECT_EQ(bus_.read<uint16_t>(0x1000), 0x8000);
+    EXPECT_TRUE(sut_.get_registers().flags.o);
+    EXPECT_TRUE(sut_.get_registers().flags.s);
+    EXPECT_FALSE(sut_.get_registers().flags.c);
+    EXPECT_EQ(sut_.last_instruction_cost(), 16 + 5);
+}
+
+TEST_F(AluTests, SubtractsMemoryFromRegister)
+{
+    // sub al, [bx]
+    bus_.write(0x00000, std::vector<uint8_t>{0x2a, 0x07});
+    bus_.write(0x01000, std::vector<uint8_t>{0x05});
+    sut_.set_registers({.ax = 0x0003, .bx = 0x1000});
+
+    sut_.step();
+
+    EXPECT_EQ(sut_.get_registers().al, 0xfe);
+    EXPECT_TRUE(sut_.get_registers().flags.c);
+    EXPECT_TRUE(sut_.get_registers().flags.s);
+}
+
+TEST_F(AluTests, CompareDoesNotWriteResult)
+{
+    // cmp al, 0x42; cmp word [bx], 0x1234
+    bus_.write(0x00000, std::vector<uint8_t>{0x3c, 0x42, 0x81, 0x3f, 0x34, 0x12});
+    bus_.write(0x01000, std::vector<uint8_t>{0x00, 0x10});
+    sut_.set_registers({.ax = 0x0042, .bx = 0x1000});
+
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().al, 0x42);
+    EXPECT_TRUE(sut_.get_registers().flags.z);
+
+    sut_.step();
+    EXPECT_EQ(bus_.read<uint16_t>(0x1000), 0x1000);
+    EXPECT_TRUE(sut_.get_registers().flags.c);
+    EXPECT_FALSE(sut_.get_registers().flags.z);
+    EXPECT_EQ(sut_.last_instruction_cost(), 10 + 5);
+}
+
+TEST_F(AluTests, SignExtendsByteImmediate)
+{
+    // add ax, -1; sub word [bx], -2
+    bus_.write(0x00000, std::vector<uint8_t>{0x83, 0xc0, 0xff, 0x83, 0x2f, 0xfe});
+    bus_.write(0x01000, std::vector<uint8_t>{0x00, 0x01});
+    sut_.set_registers({.ax = 0x0005, .bx = 0x1000});
+
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().ax, 0x0004);
+    EXPECT_TRUE(sut_.get_registers().flags.c);
+
+    sut_.step();
+    EXPECT_EQ(bus_.read<uint16_t>(0x1000), 0x0102);
+    EXPECT_TRUE(sut_.get_registers().flags.c);
+}
+
+TEST_F(AluTests, TestOnlyUpdatesFlags)
+{
+    // test ax, bx; test byte [bx], 0x80; test al, 0x01
+    bus_.write(0x00000, std::vector<uint8_t>{0x85, 0xd8, 0xf6, 0x07, 0x80, 0xa8, 0x01});
+    bus_.write(0x01000, std::vector<uint8_t>{0x81});
+    sut_.set_registers({.ax = 0x0f0f, .bx = 0x1000});
+
+    sut_.step();
+    EXPECT_TRUE(sut_.get_registers().flags.z);
+    EXPECT_EQ(sut_.get_registers().ax, 0x0f0f);
+
+    sut_.step();
+    EXPECT_TRUE(sut_.get_registers().flags.s);
+    EXPECT_EQ(bus_.read<uint8_t>(0x1000), 0x81);
+    EXPECT_EQ(sut_.last_instruction_cost(), 11 + 5);
+
+    sut_.step();
+    EXPECT_FALSE(sut_.get_registers().flags.z);
+    EXPECT_EQ(sut_.get_registers().ip, 0x0007);
+}
+
+TEST_F(AluTests, SubtractsWithBorrowFromAccumulator)
+{
+    // stc is not implemented, borrow comes from previous sub
+    // sub al, 0x01; sbb ax, 0x0001
+    bus_.write(0x00000, std::vector<uint8_t>{0x2c, 0x01, 0x1d, 0x01, 0x00});
+    sut_.set_registers({.ax = 0x0000});
+
+    sut_.step();
+    EXPECT_TRUE(sut_.get_registers().flags.c);
+
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().ax, 0x00fd);
+    EXPECT_FALSE(sut_.get_registers().flags.c);
+}
+
+} // namespace msemu::cpu8086
@@ -0,0 +1,149 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "bisect.hpp"
+#include "flat_machine.hpp"
+
+namespace msemu::cpu8086
+{
+namespace
+{
+
+using TwoRuns = Bisector<FastSide<FlatBusType>, FastSide<FlatBusType>>;
+
+// mov cx, 1000; loop $; <instruction>; jmp $
+std::vector<uint8_t> after_loop(const std::vector<uint8_t>& instruction)
+{
+    std::vector<uint8_t> code = {0xb9, 0xe8, 0x03, 0xe2, 0xfe};
+    for (const uint8_t byte : instruction)
+    {
+        code.push_back(byte);
+    }
+    code.push_back(0xeb);
+    code.push_back(0xfe);
+    return code;
+}
+
+} // namespace
+
+class BisectTests : public ::testing::Test
+{
+public:
+    BisectTests()
+        : a_(std::make_unique<FlatBusType>(FlatMemoryType("ram")))
+        , b_(std::make_unique<FlatBusType>(FlatMemoryType("ram")))
+    {
+    }
+
+protected:
+    std::unique_ptr<FlatBusType> a_;
+    std::unique_ptr<FlatBusType> b_;
+};
+
+TEST_F(BisectTests, FastAndReferenceCoresMatch)
+{
+    const std::vector<uint8_t> binary = load_binary("push.bin");
+    ASSERT_FALSE(binary.empty());
+    a_->write(bios_address, binary);
+
+    Bisector<FastSide<FlatBusType>, ReferenceSide<FlatBusType>> bisector(*a_, *a_);
+    bisector.reset(bios_entry());
+
+    EXPECT_EQ(bisector.run(10000, 64), decltype(bisector)::Result::matched) << bisector.report();
+    EXPECT_GT(bisector.position(), 0u);
+    EXPECT_EQ(bisector.restores(), 0u);
+}
+
+TEST_F(BisectTests, FindsFirstDifferentInstruction)
+{
+    // mov al, [0x2000]
+    a_->write(bios_address, after_loop({0xa0, 0x00, 0x20}));
+    b_->write(bios_address, after_loop({0xa0, 0x00, 0x20}));
+    a_->write(0x2000, std::vector<uint8_t>{0x11});
+    b_->write(0x2000, std::vector<uint8_t>{0x22});
+
+    TwoRuns bisector(*a_, *b_);
+    bisector.reset(bios_entry());
+
+    EXPECT_EQ(bisector.run(100000, 4096), TwoRuns::Result::diverged);
+    EXPECT_EQ(bisector.position(), 1001u);
+    EXPECT_LE(bisector.restores(), 13u);
+    EXPECT_THAT(bisector.report(), ::testing::HasSubstr("divergence after 1001 instructions"));
+    EXPECT_THAT(bisector.report(), ::testing::HasSubstr("f000:0105 a0 00 20"));
+    EXPECT_THAT(bisector.report(), ::testing::HasSubstr("ax: 0011"));
+    EXPECT_THAT(bisector.report(), ::testing::HasSubstr("ax: 0022"));
+}
+
+TEST_F(BisectTests, FindsDifferenceInDirtyMemory)
+{
+    // add byte [0x2000], 1
+    a_->write(bios_address, after_loop({0x80, 0x06, 0x00, 0x20, 0x01}));
+    b_->write(bios_address, after_loop({0x80, 0x06, 0x00, 0x20, 0x01}));
+    a_->write(0x2000, std::vector<uint8_t>{0x10});
+    b_->write(0x2000, std::vector<uint8_t>{0x20});
+
+    TwoRuns bisector(*a_, *b_);
+    bisector.reset(bios_entry());
+
+    EXPECT_EQ(bisector.run(100000, 4096), TwoRuns::Result::diverged);
+    EXPECT_EQ(bisector.position(), 1001u);
+    EXPECT_THAT(bisector.report(), ::testing::HasSubstr("[02000]=11"));
+    EXPECT_THAT(bisector.report(), ::testing::HasSubstr("[02000]=21"));
+}
+
+TEST_F(BisectTests, ReportsSideWhichStopped)
+{
+    // hlt is not implemented and stops the first run, mov al, 1 in the second
+    a_->write(bios_address, after_loop({0xf4}));
+    b_->write(bios_address, after_loop({0xb0, 0x01}));
+
+    TwoRuns bisector(*a_, *b_);
+    bisector.reset(bios_entry());
+
+    EXPECT_EQ(bisector.run(100000, 4096), TwoRuns::Result::diverged);
+    EXPECT_EQ(bisector.position(), 1001u);
+    EXPECT_THAT(bisector.report(), ::testing::HasSubstr("f000:0105 f4"));
+    EXPECT_THAT(bisector.report(), ::testing::HasSubstr("\nstopped "));
+}
+
+TEST_F(BisectTests, SideTracksWrittenPages)
+{
+    // add byte [0x2000], 1
+    a_->write(bios_address, after_loop({0x80, 0x06, 0x00, 0x20, 0x01}));
+    a_->write(0x2000, std::vector<uint8_t>{0x10});
+    const FlatBusType checkpoint = *a_;
+
+    FastSide<FlatBusType> side(*a_);
+    side.restore(bios_entry());
+    EXPECT_EQ(side.run(1002), 1002u);
+    EXPECT_EQ(side.dirty().count(), 1u);
+    EXPECT_TRUE(side.dirty().any(0x2000, 1));
+    EXPECT_EQ(side.bus().read<uint8_t>(0x2000), 0x11);
+
+    side.restore(bios_entry(), checkpoint);
+    EXPECT_EQ(side.dirty().count(), 0u);
+    EXPECT_EQ(side.bus().read<uint8_t>(0x2000), 0x10);
+}
+
+} // namespace msemu::cpu8086
@@ -0,0 +1,186 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "test_base.hpp"
+
+namespace msemu::cpu8086
+{
+
+class CallTests : public TestBase
+{
+};
+
+TEST_F(CallTests, NearCallReturnsThroughPredictedTarget)
+{
+    // call +0x10; ...; ret
+    bus_.write(0x00100, std::vector<uint8_t>{0xe8, 0x10, 0x00});
+    bus_.write(0x00113, std::vector<uint8_t>{0xc3});
+    sut_.set_registers({.sp = 0x1000, .ip = 0x0100});
+
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().ip, 0x0113);
+    EXPECT_EQ(sut_.get_registers().sp, 0x0ffe);
+    EXPECT_EQ(bus_.read<uint16_t>(0x0ffe), 0x0103);
+    EXPECT_EQ(sut_.last_instruction_cost(), 19);
+
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().ip, 0x0103);
+    EXPECT_EQ(sut_.get_registers().sp, 0x1000);
+    EXPECT_EQ(sut_.last_instruction_cost(), 8);
+    EXPECT_EQ(sut_.stats().returns.hits, 1u);
+    EXPECT_EQ(sut_.stats().returns.misses, 0u);
+}
+
+TEST_F(CallTests, ModifiedReturnAddressIsMispredicted)
+{
+    // call +0x00; pop ax; push bx; ret
+    bus_.write(0x00100, std::vector<uint8_t>{0xe8, 0x00, 0x00, 0x58, 0x53, 0xc3});
+    sut_.set_registers({.bx = 0x0200, .sp = 0x1000, .ip = 0x0100});
+
+    for (int i = 0; i < 4; ++i)
+    {
+        sut_.step();
+    }
+
+    EXPECT_EQ(sut_.get_registers().ip, 0x0200);
+    EXPECT_EQ(sut_.stats().returns.hits, 0u);
+    EXPECT_EQ(sut_.stats().returns.misses, 1u);
+}
+
+TEST_F(CallTests, ReturnUsedAsJumpKeepsCallerPrediction)
+{
+    // call +0x00; push bx; ret; ...; ret
+    bus_.write(0x00100, std::vector<uint8_t>{0xe8, 0x00, 0x00, 0x53, 0xc3});
+    bus_.write(0x00108, std::vector<uint8_t>{0xc3});
+    sut_.set_registers({.bx = 0x0108, .sp = 0x1000, .ip = 0x0100});
+
+    for (int i = 0; i < 4; ++i)
+    {
+        sut_.step();
+    }
+
+    EXPECT_EQ(sut_.get_registers().ip, 0x0103);
+    EXPECT_EQ(sut_.get_registers().sp, 0x1000);
+    EXPECT_EQ(sut_.stats().returns.hits, 1u);
+    EXPECT_EQ(sut_.stats().returns.misses, 1u);
+}
+
+TEST_F(CallTests, ReturnReleasesArguments)
+{
+    // ret 4
+    bus_.write(0x00100, std::vector<uint8_t>{0xc2, 0x04, 0x00});
+    bus_.write(0x00ffa, std::vector<uint8_t>{0x34, 0x12});
+    sut_.set_registers({.sp = 0x0ffa, .ip = 0x0100});
+
+    sut_.step();
+
+    EXPECT_EQ(sut_.get_registers().ip, 0x1234);
+    EXPECT_EQ(sut_.get_registers().sp, 0x1000);
+    EXPECT_EQ(sut_.last_instruction_cost(), 12);
+}
+
+TEST_F(CallTests, FarCallAndReturn)
+{
+    // call 0x0020:0x0010; retf 2 at 0x0210
+    bus_.write(0x00100, std::vector<uint8_t>{0x9a, 0x10, 0x00, 0x20, 0x00});
+    bus_.write(0x00210, std::vector<uint8_t>{0xca, 0x02, 0x00});
+    sut_.set_registers({.sp = 0x1000, .ip = 0x0100});
+
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().cs, 0x0020);
+    EXPECT_EQ(sut_.get_registers().ip, 0x0010);
+    EXPECT_EQ(bus_.read<uint16_t>(0x0ffc), 0x0105);
+    EXPECT_EQ(bus_.read<uint16_t>(0x0ffe), 0x0000);
+
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().cs, 0x0000);
+    EXPECT_EQ(sut_.get_registers().ip, 0x0105);
+    EXPECT_EQ(sut_.get_registers().sp, 0x1002);
+    EXPECT_EQ(sut_.last_instruction_cost(), 17);
+    EXPECT_EQ(sut_.stats().returns.hits, 1u);
+}
+
+TEST_F(CallTests, CallsThroughModrm)
+{
+    // call bx
+    bus_.write(0x00100, std::vector<uint8_t>{0xff, 0xd3});
+    sut_.set_registers({.bx = 0x0300, .sp = 0x1000, .ip = 0x0100});
+
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().ip, 0x0300);
+    EXPECT_EQ(bus_.read<uint16_t>(0x0ffe), 0x0102);
+    EXPECT_EQ(sut_.last_instruction_cost(), 16);
+
+    // call far [bx]
+    bus_.write(0x00100, std::vector<uint8_t>{0xff, 0x1f});
+    bus_.write(0x00300, std::vector<uint8_t>{0x40, 0x00, 0x10, 0x00});
+    sut_.set_registers({.bx = 0x0300, .sp = 0x1000, .ip = 0x0100});
+
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().cs, 0x0010);
+    EXPECT_EQ(sut_.get_registers().ip, 0x0040);
+    EXPECT_EQ(bus_.read<uint16_t>(0x0ffc), 0x0102);
+    EXPECT_EQ(sut_.last_instruction_cost(), 37 + 5);
+}
+
+TEST_F(CallTests, InterruptAndReturn)
+{
+    // int 0x21 with handler at 0x0040:0x0000 which is iret
+    bus_.write(0x00084, std::vector<uint8_t>{0x00, 0x00, 0x40, 0x00});
+    bus_.write(0x00100, std::vector<uint8_t>{0xcd, 0x21});
+    bus_.write(0x00400, std::vector<uint8_t>{0xcf});
+    sut_.set_registers({.sp = 0x1000, .ip = 0x0100, .flags = {.i = true, .z = true}});
+
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().cs, 0x0040);
+    EXPECT_EQ(sut_.get_registers().ip, 0x0000);
+    EXPECT_FALSE(sut_.get_registers().flags.i);
+    EXPECT_EQ(bus_.read<uint16_t>(0x0ffa), 0x0102);
+    EXPECT_EQ(bus_.read<uint16_t>(0x0ffc), 0x0000);
+    EXPECT_EQ(sut_.last_instruction_cost(), 51);
+
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().cs, 0x0000);
+    EXPECT_EQ(sut_.get_registers().ip, 0x0102);
+    EXPECT_EQ(sut_.get_registers().sp, 0x1000);
+    EXPECT_TRUE(sut_.get_registers().flags.i);
+    EXPECT_TRUE(sut_.get_registers().flags.z);
+    EXPECT_EQ(sut_.stats().returns.hits, 1u);
+}
+
+TEST_F(CallTests, IntoInterruptsOnlyOnOverflow)
+{
+    bus_.write(0x00010, std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00});
+    bus_.write(0x00100, std::vector<uint8_t>{0xce, 0xce});
+    sut_.set_registers({.sp = 0x1000, .ip = 0x0100});
+
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().ip, 0x0101);
+    EXPECT_EQ(sut_.last_instruction_cost(), 4);
+
+    sut_.set_registers({.sp = 0x1000, .ip = 0x0101, .flags = {.o = true}});
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().ip, 0x0200);
+    EXPECT_EQ(sut_.last_instruction_cost(), 53);
+}
+
+} // namespace msemu::cpu8086
@@ -0,0 +1,161 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "msemu.h"
+
+namespace msemu
+{
+namespace
+{
+
+// mov ax, value; jmp short back to mov
+std::vector<uint8_t> loop_program(const uint16_t value)
+{
+    return {0xb8, static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8), 0xeb, 0xfb};
+}
+
+msemu_instance* create_looping(const uint16_t value)
+{
+    msemu_instance* instance = msemu_create();
+    const auto program       = loop_program(value);
+    EXPECT_EQ(msemu_write_memory(instance, 0x100, program.data(), program.size()), 0);
+    msemu_registers registers{};
+    registers.ip = 0x100;
+    msemu_set_registers(instance, &registers);
+    return instance;
+}
+
+} // namespace
+
+TEST(CApiTests, InstancesKeepTheirOwnRegisters)
+{
+    msemu_instance* first  = create_looping(0x1111);
+    msemu_instance* second = create_looping(0x2222);
+    msemu_instance* both[] = {first, second};
+
+    uint64_t executed[2] = {};
+    msemu_run_many(both, 2, 11, executed);
+    EXPECT_EQ(executed[0], 11u);
+    EXPECT_EQ(executed[1], 11u);
+
+    msemu_registers registers{};
+    msemu_get_registers(first, &registers);
+    EXPECT_EQ(registers.ax, 0x1111);
+    EXPECT_EQ(registers.ip, 0x103);
+    msemu_get_registers(second, &registers);
+    EXPECT_EQ(registers.ax, 0x2222);
+
+    msemu_stats stats{};
+    msemu_get_stats(first, &stats);
+    EXPECT_EQ(stats.instructions, 11u);
+
+    msemu_destroy(first);
+    msemu_destroy(second);
+}
+
+TEST(CApiTests, RunStopsOnError)
+{
+    msemu_instance* instance = msemu_create();
+    // mov bx, 1; hlt
+    const uint8_t program[] = {0xbb, 0x01, 0x00, 0xf4};
+    ASSERT_EQ(msemu_write_memory(instance, 0, program, sizeof(program)), 0);
+
+    EXPECT_EQ(msemu_run(instance, 100), 1u);
+    EXPECT_NE(std::string(msemu_error(instance)), "");
+    msemu_destroy(instance);
+}
+
+TEST(CApiTests, ErrorIsClearedByNextRun)
+{
+    msemu_instance* instance = msemu_create();
+    // hlt
+    const uint8_t program[] = {0xf4};
+    ASSERT_EQ(msemu_write_memory(instance, 0, program, sizeof(program)), 0);
+    std::vector<uint8_t> snapshot(msemu_snapshot_size());
+    ASSERT_EQ(msemu_snapshot(instance, snapshot.data(), snapshot.size()), 0);
+
+    EXPECT_EQ(msemu_run(instance, 10), 0u);
+    EXPECT_NE(std::string(msemu_error(instance)), "");
+
+    ASSERT_EQ(msemu_restore(instance, snapshot.data(), snapshot.size()), 0);
+    // mov ax, 1
+    const uint8_t mov[] = {0xb8, 0x01, 0x00};
+    ASSERT_EQ(msemu_write_memory(instance, 0, mov, sizeof(mov)), 0);
+    EXPECT_EQ(msemu_run(instance, 1), 1u);
+    EXPECT_EQ(std::string(msemu_error(instance)), "");
+    msemu_destroy(instance);
+}
+
+TEST(CApiTests, MemoryBatchChecksBounds)
+{
+    msemu_instance* instance = msemu_create();
+    uint8_t data[4]          = {1, 2, 3, 4};
+    uint8_t read[4]          = {};
+    const msemu_memory_op ops[] = {
+        {.address = 0x12345, .size = 4, .data = data, .write = 1},
+        {.address = 0x12345, .size = 4, .data = read, .write = 0},
+        {.address = MSEMU_MEMORY_SIZE - 2, .size = 4, .data = data, .write = 1},
+    };
+
+    EXPECT_EQ(msemu_memory_batch(instance, ops, 3), 2u);
+    EXPECT_EQ(std::vector<uint8_t>(read, read + 4), std::vector<uint8_t>(data, data + 4));
+    msemu_destroy(instance);
+}
+
+TEST(CApiTests, RestoreReturnsToSnapshot)
+{
+    const auto path = (std::filesystem::temp_directory_path() / "msemu_capi_tests.bin").string();
+    const auto program = loop_program(0x4321);
+    FILE* file         = fopen(path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    fwrite(program.data(), 1, program.size(), file);
+    fclose(file);
+
+    msemu_instance* instance = msemu_create();
+    ASSERT_EQ(msemu_load_image(instance, 0, path.c_str()), 0);
+    std::remove(path.c_str());
+
+    std::vector<uint8_t> snapshot(msemu_snapshot_size());
+    ASSERT_EQ(msemu_snapshot(instance, snapshot.data(), snapshot.size()), 0);
+
+    msemu_run(instance, 1);
+    const uint8_t zero = 0;
+    ASSERT_EQ(msemu_write_memory(instance, 1, &zero, 1), 0);
+
+    ASSERT_EQ(msemu_restore(instance, snapshot.data(), snapshot.size()), 0);
+    msemu_registers registers{};
+    msemu_get_registers(instance, &registers);
+    EXPECT_EQ(registers.ax, 0);
+    EXPECT_EQ(registers.ip, 0);
+
+    msemu_run(instance, 1);
+    msemu_get_registers(instance, &registers);
+    EXPECT_EQ(registers.ax, 0x4321);
+
+    snapshot[0] ^= 0xff;
+    EXPECT_EQ(msemu_restore(instance, snapshot.data(), snapshot.size()), -1);
+    msemu_destroy(instance);
+}
+
+} // namespace msemu
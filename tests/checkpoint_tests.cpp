@@ -0,0 +1,103 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "bus.hpp"
+#include "checkpoint.hpp"
+#include "device.hpp"
+#include "memory.hpp"
+
+namespace msemu
+{
+namespace
+{
+
+using RamType = Device<Memory<256 * 1024>, 0x00000000>;
+using TestBus = Bus<RamType>;
+
+} // namespace
+
+class CheckpointTests : public ::testing::Test
+{
+public:
+    CheckpointTests()
+        : bus_(std::make_unique<TestBus>(RamType("ram")))
+        , path_((std::filesystem::temp_directory_path() / "msemu_checkpoint_tests.state").string())
+    {
+    }
+
+    ~CheckpointTests()
+    {
+        std::remove(path_.c_str());
+    }
+
+protected:
+    std::unique_ptr<TestBus> bus_;
+    std::string path_;
+};
+
+TEST_F(CheckpointTests, SnapshotIsTakenAtCheckpointTime)
+{
+    bus_->write(0x1234, std::vector<uint8_t>{0x11});
+    cpu8086::CpuState state{};
+    state.regs[cpu8086::Register::ax_id] = 0xabcd;
+    cpu8086::restore_state(state);
+
+    Checkpointer checkpointer(path_, 1000);
+    ASSERT_TRUE(checkpointer.checkpoint(*bus_));
+
+    // guest keeps running and modifying memory while checkpoint is written
+    bus_->write(0x1234, std::vector<uint8_t>{0x22});
+    cpu8086::restore_state(cpu8086::CpuState{});
+
+    ASSERT_TRUE(checkpointer.wait());
+    EXPECT_EQ(checkpointer.stats().started, 1u);
+    EXPECT_EQ(checkpointer.stats().completed, 1u);
+    EXPECT_GT(checkpointer.stats().max_pause.count(), 0);
+
+    SaveStateReader reader;
+    ASSERT_TRUE(reader.open(path_.c_str()));
+    EXPECT_EQ(reader.cpu().regs[cpu8086::Register::ax_id], 0xabcd);
+
+    const auto* ram = reader.device("ram");
+    ASSERT_NE(ram, nullptr);
+    std::vector<uint8_t> page(save_state_page_size);
+    ASSERT_TRUE(reader.read_page(*ram, 1, page));
+    EXPECT_EQ(page[0x234], 0x11);
+}
+
+TEST_F(CheckpointTests, StartsCheckpointEveryInterval)
+{
+    Checkpointer checkpointer(path_, 3);
+    checkpointer.tick(*bus_);
+    checkpointer.tick(*bus_);
+    EXPECT_EQ(checkpointer.stats().started, 0u);
+
+    checkpointer.tick(*bus_);
+    EXPECT_EQ(checkpointer.stats().started, 1u);
+    EXPECT_TRUE(checkpointer.wait());
+    EXPECT_TRUE(std::filesystem::exists(path_));
+}
+
+} // namespace msemu
@@ -0,0 +1,184 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "device_scheduler.hpp"
+
+namespace msemu
+{
+namespace
+{
+
+constexpr uint16_t tick_event = 1;
+constexpr uint16_t echo_event = 2;
+
+// Ticks every period instructions and answers every CPU event with value + 1.
+DeviceScheduler::Model timer(const uint64_t period)
+{
+    return [period, next = period](DeviceScheduler::Context& context) mutable
+    {
+        DeviceEvent event{};
+        while (context.next(event))
+        {
+            context.emit(DeviceEvent{event.stamp, 0, echo_event, false, event.value + 1});
+        }
+        for (; next < context.until(); next += period)
+        {
+            context.emit(DeviceEvent{next, 0, tick_event, false, 0});
+        }
+    };
+}
+
+// CPU which posts one event to every device at the start of each quantum.
+std::vector<DeviceEvent> run_guest(const DeviceScheduler::Mode mode, const uint64_t instructions)
+{
+    DeviceScheduler scheduler(1000, 100, mode);
+    const uint32_t first  = scheduler.add_device("timer", timer(700));
+    const uint32_t second = scheduler.add_device("serial", timer(300));
+
+    std::vector<DeviceEvent> delivered;
+    const auto deliver = [&delivered](const DeviceEvent& event) { delivered.push_back(event); };
+    uint32_t value     = 0;
+    const auto cpu     = [&](const uint64_t count)
+    {
+        scheduler.post(first, DeviceEvent{scheduler.now() + 10, 0, echo_event, false, value++});
+        scheduler.post(second, DeviceEvent{scheduler.now() + 20, 0, echo_event, false, value++});
+        return count;
+    };
+    EXPECT_EQ(scheduler.run(instructions, cpu, deliver), instructions);
+    scheduler.sync(deliver);
+    return delivered;
+}
+
+// CPU which posts more events per quantum than fit in the inbox next to
+// those of the previous quantum, to a device which starts late.
+std::pair<std::vector<DeviceEvent>, uint64_t> run_flood(const DeviceScheduler::Mode mode)
+{
+    constexpr uint64_t posts = DeviceScheduler::mailbox_size * 3 / 4;
+    DeviceScheduler scheduler(1000, 100, mode);
+    const auto echo = [](DeviceScheduler::Context& context)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        DeviceEvent event{};
+        while (context.next(event))
+        {
+            context.emit(DeviceEvent{event.stamp, 0, echo_event, false, event.value});
+        }
+    };
+    const uint32_t device = scheduler.add_device("echo", echo);
+
+    std::vector<DeviceEvent> delivered;
+    const auto deliver = [&delivered](const DeviceEvent& event) { delivered.push_back(event); };
+    uint32_t value     = 0;
+    const auto cpu     = [&](const uint64_t count)
+    {
+        for (uint64_t i = 0; i < posts; ++i)
+        {
+            scheduler.post(device, DeviceEvent{scheduler.now() + i % count, 0, echo_event, false, value++});
+        }
+        return count;
+    };
+    scheduler.run(5000, cpu, deliver);
+    scheduler.sync(deliver);
+    return {delivered, scheduler.stats().dropped};
+}
+
+} // namespace
+
+TEST(DeviceSchedulerTests, ParallelRunMatchesSequentialRun)
+{
+    const auto parallel   = run_guest(DeviceScheduler::Mode::parallel, 50000);
+    const auto sequential = run_guest(DeviceScheduler::Mode::sequential, 50000);
+
+    // ticks of both devices and echo of every posted event
+    EXPECT_EQ(parallel.size(), 50000u / 700 + 50000u / 300 + 2 * 50);
+    EXPECT_EQ(parallel, sequential);
+}
+
+TEST(DeviceSchedulerTests, FullInboxDoesNotDependOnThreadTiming)
+{
+    const auto [parallel, parallel_dropped]     = run_flood(DeviceScheduler::Mode::parallel);
+    const auto [sequential, sequential_dropped] = run_flood(DeviceScheduler::Mode::sequential);
+
+    EXPECT_EQ(parallel_dropped, 0u);
+    EXPECT_EQ(sequential_dropped, 0u);
+    EXPECT_EQ(parallel.size(), 5 * DeviceScheduler::mailbox_size * 3 / 4);
+    EXPECT_EQ(parallel, sequential);
+}
+
+TEST(DeviceSchedulerTests, DeliversEventsOrderedByStamp)
+{
+    const auto delivered = run_guest(DeviceScheduler::Mode::parallel, 20000);
+    ASSERT_FALSE(delivered.empty());
+    for (std::size_t i = 1; i < delivered.size(); ++i)
+    {
+        EXPECT_LE(delivered[i - 1].stamp, delivered[i].stamp);
+    }
+    for (const auto& event : delivered)
+    {
+        if (event.kind == echo_event)
+        {
+            // echo keeps stamp of the posted event
+            EXPECT_EQ(event.stamp % 1000, event.device == 0 ? 10u : 20u);
+        }
+    }
+}
+
+TEST(DeviceSchedulerTests, UrgentEventsShortenQuantum)
+{
+    DeviceScheduler scheduler(8000, 500);
+    // interrupt request at 20000, devices run one quantum behind the CPU
+    scheduler.add_device("pic",
+                         [](DeviceScheduler::Context& context)
+                         {
+                             if (context.from() <= 20000 && 20000 < context.until())
+                             {
+                                 context.emit(DeviceEvent{20000, 0, tick_event, true, 0});
+                             }
+                         });
+
+    const auto cpu     = [](const uint64_t count) { return count; };
+    const auto deliver = [](const DeviceEvent&) {};
+    scheduler.run(32000, cpu, deliver);
+    EXPECT_EQ(scheduler.quantum(), 4000u);
+    EXPECT_EQ(scheduler.stats().to_cpu, 1u);
+
+    // quiet quanta bring the quantum back
+    scheduler.run(28000, cpu, deliver);
+    EXPECT_EQ(scheduler.quantum(), 4000u);
+    scheduler.run(4000, cpu, deliver);
+    EXPECT_EQ(scheduler.quantum(), 8000u);
+}
+
+TEST(DeviceSchedulerTests, StopsWhenCpuStops)
+{
+    DeviceScheduler scheduler(1000, 100);
+    scheduler.add_device("timer", timer(100));
+
+    const auto cpu     = [](const uint64_t count) { return count / 2; };
+    const auto deliver = [](const DeviceEvent&) {};
+    EXPECT_EQ(scheduler.run(10000, cpu, deliver), 500u);
+    EXPECT_EQ(scheduler.now(), 500u);
+}
+
+} // namespace msemu
@@ -0,0 +1,135 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "8237_dma.hpp"
+#include "bus.hpp"
+#include "device.hpp"
+#include "memory.hpp"
+
+namespace msemu
+{
+namespace
+{
+
+using RamType = Device<Memory<256 * 1024>, 0x00000000>;
+using DmaBus  = Bus<RamType>;
+
+} // namespace
+
+class DmaTests : public ::testing::Test
+{
+public:
+    DmaTests()
+        : bus_(std::make_unique<DmaBus>(RamType("ram")))
+        , buffer_(32)
+    {
+        std::iota(buffer_.begin(), buffer_.end(), uint8_t{0});
+    }
+
+protected:
+    void program(const uint8_t channel, const uint8_t mode, const uint32_t address, const uint16_t count)
+    {
+        const auto port = static_cast<uint16_t>(channel * 2);
+        sut_.write_port(0x0c, 0);
+        sut_.write_port(port, static_cast<uint8_t>(address));
+        sut_.write_port(port, static_cast<uint8_t>(address >> 8));
+        sut_.write_port(static_cast<uint16_t>(port + 1), static_cast<uint8_t>(count));
+        sut_.write_port(static_cast<uint16_t>(port + 1), static_cast<uint8_t>(count >> 8));
+        constexpr uint16_t page_ports[] = {0x87, 0x83, 0x81, 0x82};
+        sut_.write_port(page_ports[channel], static_cast<uint8_t>(address >> 16));
+        sut_.write_port(0x0b, static_cast<uint8_t>(mode | channel));
+        sut_.write_port(0x0a, channel);
+    }
+
+    std::unique_ptr<DmaBus> bus_;
+    Dma8237 sut_;
+    std::vector<uint8_t> buffer_;
+};
+
+TEST_F(DmaTests, AddressWrapsWithinPage)
+{
+    // single mode, write to memory
+    program(2, 0x44, 0x1fff0, 31);
+    EXPECT_EQ(sut_.transfer(*bus_, 2, buffer_, 0), 32u);
+
+    EXPECT_EQ(bus_->read<uint8_t>(0x1fff0), 0);
+    EXPECT_EQ(bus_->read<uint8_t>(0x1ffff), 15);
+    // page register is not incremented
+    EXPECT_EQ(bus_->read<uint8_t>(0x10000), 16);
+    EXPECT_EQ(bus_->read<uint8_t>(0x1000f), 31);
+    EXPECT_EQ(bus_->read<uint8_t>(0x20000), 0);
+    EXPECT_EQ(sut_.stats().chunks, 2u);
+    EXPECT_TRUE(sut_.channel(2).masked);
+}
+
+TEST_F(DmaTests, TerminalCountIsRaisedWhenTransferFinishes)
+{
+    std::vector<uint8_t> completed;
+    sut_.on_complete([&completed](uint8_t channel) { completed.push_back(channel); });
+    program(2, 0x44, 0x1000, 31);
+    sut_.transfer(*bus_, 2, buffer_, 100);
+
+    const uint64_t done = 100 + 32 * Dma8237::cycles_per_byte;
+    EXPECT_EQ(sut_.next_event(), done);
+    sut_.poll(done - 1);
+    EXPECT_TRUE(completed.empty());
+    EXPECT_EQ(sut_.read_port(0x08) & 0x0f, 0);
+
+    sut_.poll(done);
+    EXPECT_EQ(completed, std::vector<uint8_t>{2});
+    EXPECT_EQ(sut_.next_event(), 0u);
+    EXPECT_EQ(sut_.read_port(0x08) & 0x0f, 0x04);
+    EXPECT_EQ(sut_.read_port(0x08) & 0x0f, 0);
+}
+
+TEST_F(DmaTests, AutoinitializeReloadsChannel)
+{
+    bus_->write(0x3000, std::vector<uint8_t>{1, 2, 3, 4});
+    // single mode, autoinitialize, read from memory
+    program(1, 0x58, 0x3000, 3);
+    std::vector<uint8_t> buffer(8);
+    EXPECT_EQ(sut_.transfer(*bus_, 1, buffer, 0), 4u);
+
+    EXPECT_EQ(buffer, (std::vector<uint8_t>{1, 2, 3, 4, 0, 0, 0, 0}));
+    EXPECT_FALSE(sut_.channel(1).masked);
+    EXPECT_EQ(sut_.channel(1).address, 0x3000);
+    EXPECT_EQ(sut_.channel(1).count, 3);
+}
+
+TEST_F(DmaTests, DemandTransferStopsWhenDeviceRunsOut)
+{
+    // demand mode, address decrement, write to memory
+    program(3, 0x24, 0x5010, 63);
+    EXPECT_EQ(sut_.transfer(*bus_, 3, buffer_, 0), 32u);
+
+    EXPECT_EQ(bus_->read<uint8_t>(0x5010), 0);
+    EXPECT_EQ(bus_->read<uint8_t>(0x4ff1), 31);
+    EXPECT_EQ(sut_.channel(3).address, 0x4ff0);
+    EXPECT_EQ(sut_.channel(3).count, 31);
+    EXPECT_EQ(sut_.next_event(), 0u);
+    // buffer of device is left untouched
+    EXPECT_EQ(buffer_[1], 1);
+}
+
+} // namespace msemu
@@ -0,0 +1,246 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "8086_cpu.hpp"
+#include "8086_state.hpp"
+#include "dynamic_bus.hpp"
+
+namespace msemu
+{
+namespace
+{
+
+// code placed at f000:0100 followed by jmp $
+std::vector<uint8_t> rom_with(const std::vector<uint8_t>& code)
+{
+    std::vector<uint8_t> rom(0x100 + code.size() + 2);
+    std::copy(code.begin(), code.end(), rom.begin() + 0x100);
+    rom[0x100 + code.size()]     = 0xeb;
+    rom[0x100 + code.size() + 1] = 0xfe;
+    return rom;
+}
+
+cpu8086::CpuState rom_entry()
+{
+    cpu8086::CpuState state{};
+    state.sregs[cpu8086::Register::cs_id] = 0xf000;
+    state.ip                              = 0x0100;
+    return state;
+}
+
+} // namespace
+
+TEST(DynamicBusTests, RoutesAccessesToMappedDevices)
+{
+    DynamicBus bus;
+    std::vector<uint32_t> mmio_writes;
+    const auto read  = [](const uint32_t offset) { return static_cast<uint8_t>(offset + 1); };
+    const auto write = [&mmio_writes](const uint32_t offset, const uint8_t value)
+    { mmio_writes.push_back(offset << 8 | value); };
+    ASSERT_TRUE(bus.map_ram("ram", 0x00000, 0x10000));
+    ASSERT_TRUE(bus.map_rom("rom", 0xf0000, std::vector<uint8_t>{0x12, 0x34}));
+    ASSERT_TRUE(bus.map_mmio("mmio", 0xa0000, 0x100, read, write));
+
+    bus.write(0x1234, static_cast<uint16_t>(0xbeef));
+    EXPECT_EQ(bus.read<uint16_t>(0x1234), 0xbeef);
+    EXPECT_EQ(bus.read<uint16_t>(0xf0000), 0x3412);
+
+    // ROM ignores writes and has no writable host memory
+    bus.write(0xf0000, static_cast<uint8_t>(0));
+    EXPECT_EQ(bus.read<uint8_t>(0xf0000), 0x12);
+    EXPECT_FALSE(bus.host_range(0xf0000).writable);
+
+    EXPECT_EQ(bus.read<uint8_t>(0xa0010), 0x11);
+    bus.write(0xa0020, static_cast<uint8_t>(0x55));
+    EXPECT_EQ(mmio_writes, std::vector<uint32_t>{0x2055});
+    EXPECT_EQ(bus.host_range(0xa0000).size, 0u);
+
+    EXPECT_EQ(bus.read<uint8_t>(0x50000), 0);
+    EXPECT_EQ(bus.host_range(0x50000).size, 0u);
+}
+
+TEST(DynamicBusTests, RejectsOverlappingAndUnalignedDevices)
+{
+    DynamicBus bus;
+    ASSERT_TRUE(bus.map_ram("ram", 0x00000, 0x10000));
+    EXPECT_FALSE(bus.map_ram("ram", 0x20000, 0x100));
+    EXPECT_FALSE(bus.map_ram("window", 0x0ff00, 0x200));
+    EXPECT_FALSE(bus.map_ram("window", 0x20010, 0x100));
+    EXPECT_FALSE(bus.map_ram("window", 0x20000, 0));
+    EXPECT_FALSE(bus.unmap("window"));
+
+    EXPECT_TRUE(bus.unmap("ram"));
+    EXPECT_TRUE(bus.map_ram("window", 0x0ff00, 0x200));
+}
+
+TEST(DynamicBusTests, CpuExecutesReplacedRomAfterNextRun)
+{
+    DynamicBus bus;
+    ASSERT_TRUE(bus.map_ram("ram", 0x00000, 0x10000));
+    // mov ax, 1
+    ASSERT_TRUE(bus.map_rom("rom", 0xf0000, rom_with({0xb8, 0x01, 0x00})));
+
+    cpu8086::Cpu cpu(bus);
+    cpu8086::restore_state(rom_entry());
+    cpu.run(10);
+    EXPECT_EQ(cpu8086::capture_state().regs[cpu8086::Register::ax_id], 1);
+
+    // mov ax, 2
+    ASSERT_TRUE(bus.unmap("rom"));
+    ASSERT_TRUE(bus.map_rom("rom", 0xf0000, rom_with({0xb8, 0x02, 0x00})));
+    // cpu may still hold pointers to the old ROM
+    EXPECT_GT(bus.collect(), 0u);
+
+    cpu8086::restore_state(rom_entry());
+    cpu.run(10);
+    EXPECT_EQ(cpu8086::capture_state().regs[cpu8086::Register::ax_id], 2);
+    EXPECT_EQ(bus.collect(), 0u);
+}
+
+TEST(DynamicBusTests, RemapsWhileGuestRuns)
+{
+    DynamicBus bus;
+    ASSERT_TRUE(bus.map_ram("ram", 0x00000, 0x10000));
+    // loop: mov al, [0]; jmp loop
+    ASSERT_TRUE(bus.map_rom("rom", 0xf0000, rom_with({0xa0, 0x00, 0x00, 0xeb, 0xfb})));
+
+    cpu8086::Cpu cpu(bus);
+    cpu8086::CpuState state               = rom_entry();
+    state.sregs[cpu8086::Register::ds_id] = 0xd000;
+    cpu8086::restore_state(state);
+
+    std::atomic<bool> done{false};
+    std::thread control(
+        [&bus, &done]
+        {
+            const std::vector<uint8_t> images[] = {{0x11}, {0x22}};
+            for (int i = 0; !done.load(); ++i)
+            {
+                bus.map_rom("window", 0xd0000, images[i % 2]);
+                bus.unmap("window");
+            }
+        });
+
+    for (int slice = 0; slice < 2000; ++slice)
+    {
+        ASSERT_EQ(cpu.run(1000), 1000u) << cpu.error();
+        const uint16_t al = cpu8086::capture_state().regs[cpu8086::Register::ax_id];
+        ASSERT_TRUE(al == 0 || al == 0x11 || al == 0x22) << al;
+    }
+    done = true;
+    control.join();
+
+    // everything retired is released once cpu passed quiescent state after the last remap
+    cpu.run(1);
+    EXPECT_EQ(bus.collect(), 0u);
+}
+
+TEST(DynamicBusTests, CompressesColdPagesAndRestoresThemOnAccess)
+{
+    DynamicBus bus;
+    ASSERT_TRUE(bus.map_ram("ram", 0x00000, 0x10000, true));
+    EXPECT_FALSE(bus.map_ram("odd", 0x20000, 0x100, true));
+
+    std::vector<uint8_t> text(DynamicBus::cold_page_size);
+    std::vector<uint8_t> noise(DynamicBus::cold_page_size);
+    uint32_t seed = 1;
+    for (std::size_t i = 0; i < text.size(); ++i)
+    {
+        text[i]  = static_cast<uint8_t>("cold page "[i % 10]);
+        seed     = seed * 1103515245 + 12345;
+        noise[i] = static_cast<uint8_t>(seed >> 16);
+    }
+    bus.write(0x1000, text);
+    bus.write(0x3000, noise);
+
+    // written pages were accessed during the first period
+    EXPECT_EQ(bus.age(2), 0u);
+    EXPECT_EQ(bus.age(2), 14u);
+    EXPECT_EQ(bus.cold_stats().pool_bytes, 0u);
+    // noise does not compress and stays resident
+    EXPECT_EQ(bus.age(2), 1u);
+    EXPECT_EQ(bus.cold_stats().compressed_pages, 15u);
+    EXPECT_GT(bus.cold_stats().pool_bytes, 0u);
+    EXPECT_LT(bus.cold_stats().pool_bytes, DynamicBus::cold_page_size / 4);
+
+    const HostRange range = bus.host_range(0x1234);
+    EXPECT_EQ(range.start, 0x1000u);
+    EXPECT_EQ(range.size, DynamicBus::cold_page_size);
+    EXPECT_TRUE(std::equal(text.begin(), text.end(), range.data));
+
+    std::vector<uint8_t> data(DynamicBus::cold_page_size);
+    bus.read(0x3000, data);
+    EXPECT_EQ(data, noise);
+    EXPECT_EQ(bus.read<uint8_t>(0x5000), 0);
+    EXPECT_EQ(bus.cold_stats().decompressions, 2u);
+    EXPECT_EQ(bus.cold_stats().compressed_pages, 13u);
+    EXPECT_EQ(bus.cold_stats().pool_bytes, 0u);
+}
+
+TEST(DynamicBusTests, DeviceWithViewIsNotCompressed)
+{
+    DynamicBus bus;
+    ASSERT_TRUE(bus.map_ram("ram", 0x00000, 0x10000, true));
+    ASSERT_TRUE(bus.map_ram("idle", 0x10000, 0x10000, true));
+    bus.write(0x1000, static_cast<uint8_t>(0x55));
+
+    MemoryView view = bus.get("ram");
+    for (int period = 0; period < 3; ++period)
+    {
+        bus.age(1);
+    }
+    EXPECT_EQ(bus.cold_stats().compressed_pages, 16u);
+
+    // writes through the view are not tracked and must not be lost
+    view.write(0x2000, static_cast<uint8_t>(0xaa));
+    bus.age(1);
+    EXPECT_EQ(bus.read<uint8_t>(0x1000), 0x55);
+    EXPECT_EQ(bus.read<uint8_t>(0x2000), 0xaa);
+    EXPECT_EQ(bus.cold_stats().decompressions, 0u);
+}
+
+TEST(DynamicBusTests, CpuKeepsRunningWhileIdlePagesAreCompressed)
+{
+    DynamicBus bus;
+    ASSERT_TRUE(bus.map_ram("ram", 0x00000, 0x10000, true));
+    // loop: add word [0x8000], 1; jmp loop
+    ASSERT_TRUE(bus.map_rom("rom", 0xf0000, rom_with({0x83, 0x06, 0x00, 0x80, 0x01, 0xeb, 0xf9})));
+    bus.write(0x2000, static_cast<uint16_t>(0x1234));
+
+    cpu8086::Cpu cpu(bus);
+    cpu8086::restore_state(rom_entry());
+    for (int slice = 0; slice < 10; ++slice)
+    {
+        ASSERT_EQ(cpu.run(1000), 1000u) << cpu.error();
+        bus.age(1);
+    }
+
+    // only the counter page is in use
+    EXPECT_EQ(bus.cold_stats().compressed_pages, 15u);
+    EXPECT_EQ(bus.read<uint16_t>(0x8000), 5000);
+    EXPECT_EQ(bus.read<uint16_t>(0x2000), 0x1234);
+    EXPECT_EQ(bus.cold_stats().compressed_pages, 14u);
+}
+
+} // namespace msemu
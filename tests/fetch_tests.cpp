@@ -0,0 +1,82 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "test_base.hpp"
+
+namespace msemu::cpu8086
+{
+
+class FetchTests : public TestBase
+{
+};
+
+TEST_F(FetchTests, DecodesInstructionFromHostMemory)
+{
+    // mov word [bx+0x1234], 0xbeef
+    bus_.write(0x00100, std::vector<uint8_t>{0xc7, 0x87, 0x34, 0x12, 0xef, 0xbe});
+    sut_.set_registers({.bx = 0x0010, .ip = 0x0100});
+
+    sut_.step();
+
+    EXPECT_FALSE(sut_.has_error()) << sut_.get_error();
+    EXPECT_EQ(sut_.get_registers().ip, 0x0106);
+    EXPECT_EQ(bus_.read<uint16_t>(0x1244), 0xbeef);
+}
+
+TEST_F(FetchTests, WrapsIpInsideCodeSegment)
+{
+    // mov ax, 0x1234 starting at cs:fffe, immediate high byte at cs:0000
+    bus_.write(0x1fffe, std::vector<uint8_t>{0xb8, 0x34});
+    bus_.write(0x10000, std::vector<uint8_t>{0x12});
+    sut_.set_registers({.ip = 0xfffe, .cs = 0x1000});
+
+    sut_.step();
+
+    EXPECT_EQ(sut_.get_registers().ax, 0x1234);
+    EXPECT_EQ(sut_.get_registers().ip, 0x0001);
+}
+
+TEST_F(FetchTests, ReadsWindowStraddlingDevices)
+{
+    // mov ax, 0x5678 at the last bytes of flash, window reaches past the device
+    bus_.write(0x1fffd, std::vector<uint8_t>{0xb8, 0x78, 0x56});
+    sut_.set_registers({.ip = 0x00fd, .cs = 0x1ff0});
+
+    sut_.step();
+
+    EXPECT_EQ(sut_.get_registers().ax, 0x5678);
+    EXPECT_EQ(sut_.get_registers().ip, 0x0100);
+}
+
+TEST_F(FetchTests, RefetchesAfterSegmentPrefix)
+{
+    // es: mov word [bx+0x1234], 0xbeef is seven bytes long
+    bus_.write(0x00100, std::vector<uint8_t>{0x26, 0xc7, 0x87, 0x34, 0x12, 0xef, 0xbe});
+    sut_.set_registers({.bx = 0x0010, .ip = 0x0100, .es = 0x0100});
+
+    sut_.step();
+
+    EXPECT_EQ(sut_.get_registers().ip, 0x0107);
+    EXPECT_EQ(bus_.read<uint16_t>(0x2244), 0xbeef);
+}
+
+} // namespace msemu::cpu8086
@@ -0,0 +1,42 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "flat_machine.hpp"
+
+#include <fstream>
+#include <iterator>
+
+namespace msemu::cpu8086
+{
+
+std::vector<uint8_t> load_binary(const std::string& name)
+{
+    std::ifstream file(std::string(MSEMU_TEST_BINARIES_DIR) + "/" + name, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+CpuState bios_entry()
+{
+    CpuState state{};
+    state.sregs[Register::cs_id] = 0xf000;
+    state.sregs[Register::ss_id] = 0x7000;
+    state.regs[Register::sp_id]  = 0xfffe;
+    state.ip                     = 0x0100;
+    return state;
+}
+
+} // namespace msemu::cpu8086
@@ -0,0 +1,44 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "8086_state.hpp"
+#include "bus.hpp"
+#include "device.hpp"
+#include "memory.hpp"
+
+namespace msemu::cpu8086
+{
+
+// Machine with RAM over the whole first megabyte, test binaries are loaded
+// at bios_address and started from bios_entry().
+using FlatMemoryType = Device<Memory<1024 * 1024>, 0x00000000>;
+using FlatBusType    = Bus<FlatMemoryType>;
+
+constexpr uint32_t bios_address = 0xf0100;
+
+// Binary from test_binaries, empty when it does not exist.
+std::vector<uint8_t> load_binary(const std::string& name);
+
+CpuState bios_entry();
+
+} // namespace msemu::cpu8086
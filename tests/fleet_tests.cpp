@@ -0,0 +1,114 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <csignal>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <sched.h>
+#include <unistd.h>
+
+#include "bus.hpp"
+#include "device.hpp"
+#include "fleet.hpp"
+#include "memory.hpp"
+
+namespace msemu
+{
+namespace
+{
+
+using RamType = Device<Memory<1024 * 1024>, 0x00000000>;
+using TestBus = Bus<RamType>;
+
+} // namespace
+
+TEST(FleetTests, InstancesShareTemplateAndKeepWritesPrivate)
+{
+    auto bus = std::make_unique<TestBus>(RamType("ram"));
+    bus->write(0x100, std::vector<uint8_t>{0xaa});
+
+    Fleet fleet(4);
+    fleet.share(*bus);
+    const bool ok = fleet.run(
+        [&bus](const std::size_t index)
+        {
+            if (bus->read<uint8_t>(0x100) != 0xaa)
+            {
+                return 1;
+            }
+            // dirty 16 KiB of private pages in every instance
+            bus->write(static_cast<uint32_t>(0x10000 + index * 0x4000), std::vector<uint8_t>(0x4000, 0x55));
+            return 0;
+        });
+
+    EXPECT_TRUE(ok);
+    ASSERT_EQ(fleet.report().instances.size(), 4u);
+    for (const auto& instance : fleet.report().instances)
+    {
+        EXPECT_EQ(instance.exit_code, 0);
+    }
+    EXPECT_LT(fleet.report().private_bytes_per_instance, bus->get("ram").size());
+    EXPECT_EQ(bus->read<uint8_t>(0x10000), 0x00);
+}
+
+TEST(FleetTests, ReportsFailingInstance)
+{
+    Fleet fleet(2);
+    EXPECT_FALSE(fleet.run([](const std::size_t index) { return static_cast<int>(index); }));
+    EXPECT_EQ(fleet.report().instances[0].exit_code, 0);
+    EXPECT_EQ(fleet.report().instances[1].exit_code, 1);
+}
+
+TEST(FleetTests, DoesNotWaitForCrashedInstance)
+{
+    Fleet fleet(3);
+    EXPECT_FALSE(fleet.run(
+        [](const std::size_t index)
+        {
+            if (index == 1)
+            {
+                kill(getpid(), SIGKILL);
+            }
+            return 0;
+        }));
+    EXPECT_EQ(fleet.report().instances[0].exit_code, 0);
+    EXPECT_EQ(fleet.report().instances[1].exit_code, -1);
+    EXPECT_EQ(fleet.report().instances[2].exit_code, 0);
+}
+
+TEST(FleetTests, PinsInstancesToCpus)
+{
+    Fleet fleet(2, Fleet::Placement::cpu);
+    EXPECT_TRUE(fleet.run(
+        [](std::size_t)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            sched_getaffinity(0, sizeof(set), &set);
+            return CPU_COUNT(&set) == 1 ? 0 : 1;
+        }));
+    for (const auto& instance : fleet.report().instances)
+    {
+        EXPECT_GE(instance.node, 0);
+        EXPECT_GE(instance.cpu, 0);
+    }
+}
+
+} // namespace msemu
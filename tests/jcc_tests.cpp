@@ -0,0 +1,187 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "test_base.hpp"
+
+namespace msemu::cpu8086
+{
+namespace
+{
+
+Registers::Flags make_flags(const uint32_t index)
+{
+    Registers::Flags flags{};
+    flags.c = index & 0x01;
+    flags.p = (index >> 1) & 0x01;
+    flags.z = (index >> 2) & 0x01;
+    flags.s = (index >> 3) & 0x01;
+    flags.o = (index >> 4) & 0x01;
+    return flags;
+}
+
+bool expected_condition(const uint8_t condition, const Registers::Flags& f)
+{
+    switch (condition)
+    {
+        case 0x0:
+            return f.o;
+        case 0x1:
+            return !f.o;
+        case 0x2:
+            return f.c;
+        case 0x3:
+            return !f.c;
+        case 0x4:
+            return f.z;
+        case 0x5:
+            return !f.z;
+        case 0x6:
+            return f.c || f.z;
+        case 0x7:
+            return !f.c && !f.z;
+        case 0x8:
+            return f.s;
+        case 0x9:
+            return !f.s;
+        case 0xa:
+            return f.p;
+        case 0xb:
+            return !f.p;
+        case 0xc:
+            return f.s != f.o;
+        case 0xd:
+            return f.s == f.o;
+        case 0xe:
+            return f.z || f.s != f.o;
+        case 0xf:
+            return !f.z && f.s == f.o;
+    }
+    return false;
+}
+
+} // namespace
+
+class JccTests : public TestBase
+{
+};
+
+TEST_F(JccTests, EvaluatesEveryConditionForEveryFlagCombination)
+{
+    for (uint8_t condition = 0; condition < 16; ++condition)
+    {
+        for (uint32_t index = 0; index < 32; ++index)
+        {
+            const Registers::Flags flags = make_flags(index);
+            bus_.write(0x00100, std::vector<uint8_t>{static_cast<uint8_t>(0x70 | condition), 0x10});
+            sut_.set_registers({.ip = 0x0100, .flags = flags});
+
+            sut_.step();
+
+            const bool taken = expected_condition(condition, flags);
+            EXPECT_EQ(sut_.get_registers().ip, taken ? 0x0112 : 0x0102)
+                << "condition: " << static_cast<int>(condition) << ", flags: " << index;
+            EXPECT_EQ(sut_.last_instruction_cost(), taken ? 16 : 4);
+        }
+    }
+}
+
+TEST_F(JccTests, JumpsBackwardAndThroughAlias)
+{
+    // jnz -0x10 encoded as undocumented 0x65
+    bus_.write(0x00100, std::vector<uint8_t>{0x65, 0xf0});
+    sut_.set_registers({.ip = 0x0100});
+
+    sut_.step();
+
+    EXPECT_EQ(sut_.get_registers().ip, 0x00f2);
+}
+
+TEST_F(JccTests, LoopDecrementsCx)
+{
+    // loop -2
+    bus_.write(0x00100, std::vector<uint8_t>{0xe2, 0xfe});
+    sut_.set_registers({.cx = 0x0002, .ip = 0x0100});
+
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().cx, 0x0001);
+    EXPECT_EQ(sut_.get_registers().ip, 0x0100);
+    EXPECT_EQ(sut_.last_instruction_cost(), 17);
+
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().cx, 0x0000);
+    EXPECT_EQ(sut_.get_registers().ip, 0x0102);
+    EXPECT_EQ(sut_.last_instruction_cost(), 5);
+}
+
+TEST_F(JccTests, LoopWithZeroCxWrapsAround)
+{
+    bus_.write(0x00100, std::vector<uint8_t>{0xe2, 0x10});
+    sut_.set_registers({.cx = 0x0000, .ip = 0x0100});
+
+    sut_.step();
+
+    EXPECT_EQ(sut_.get_registers().cx, 0xffff);
+    EXPECT_EQ(sut_.get_registers().ip, 0x0112);
+}
+
+TEST_F(JccTests, LoopzAndLoopnzCheckZeroFlag)
+{
+    // loopz +0x10; loopnz +0x10
+    bus_.write(0x00100, std::vector<uint8_t>{0xe1, 0x10, 0xe0, 0x10});
+
+    sut_.set_registers({.cx = 0x0005, .ip = 0x0100, .flags = {.z = true}});
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().ip, 0x0112);
+    EXPECT_EQ(sut_.last_instruction_cost(), 18);
+
+    sut_.set_registers({.cx = 0x0005, .ip = 0x0100, .flags = {.z = false}});
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().ip, 0x0102);
+    EXPECT_EQ(sut_.get_registers().cx, 0x0004);
+
+    sut_.set_registers({.cx = 0x0005, .ip = 0x0102, .flags = {.z = false}});
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().ip, 0x0114);
+    EXPECT_EQ(sut_.last_instruction_cost(), 19);
+
+    sut_.set_registers({.cx = 0x0005, .ip = 0x0102, .flags = {.z = true}});
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().ip, 0x0104);
+}
+
+TEST_F(JccTests, JcxzDoesNotModifyCx)
+{
+    bus_.write(0x00100, std::vector<uint8_t>{0xe3, 0x10});
+
+    sut_.set_registers({.cx = 0x0000, .ip = 0x0100});
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().ip, 0x0112);
+    EXPECT_EQ(sut_.last_instruction_cost(), 18);
+
+    sut_.set_registers({.cx = 0x0001, .ip = 0x0100});
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().ip, 0x0102);
+    EXPECT_EQ(sut_.get_registers().cx, 0x0001);
+    EXPECT_EQ(sut_.last_instruction_cost(), 6);
+}
+
+} // namespace msemu::cpu8086
@@ -0,0 +1,160 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "flat_machine.hpp"
+#include "lockstep.hpp"
+
+namespace msemu::cpu8086
+{
+
+class LockstepTests : public ::testing::Test
+{
+public:
+    LockstepTests()
+        : bus_(std::make_unique<FlatBusType>(FlatMemoryType("ram")))
+    {
+    }
+
+protected:
+    std::unique_ptr<FlatBusType> bus_;
+};
+
+class LockstepBinariesTests : public LockstepTests, public ::testing::WithParamInterface<std::string>
+{
+};
+
+TEST_P(LockstepBinariesTests, RunsWithoutDivergence)
+{
+    const std::vector<uint8_t> binary = load_binary(GetParam());
+    ASSERT_FALSE(binary.empty());
+    bus_->write(bios_address, binary);
+
+    Lockstep<FlatBusType> lockstep(*bus_);
+    lockstep.reset(bios_entry());
+    const auto result = lockstep.run(10000);
+
+    EXPECT_NE(result, Lockstep<FlatBusType>::Result::diverged) << lockstep.report();
+    EXPECT_GT(lockstep.steps(), 0u) << lockstep.report();
+}
+
+INSTANTIATE_TEST_SUITE_P(LockstepBinariesTests, LockstepBinariesTests,
+                         ::testing::Values("aaa.bin", "jmp.bin", "mov.bin", "op.bin", "push.bin", "simple.bin",
+                                           "simple"));
+
+struct LockstepProgram
+{
+    std::string name;
+    std::vector<uint8_t> code;
+    uint64_t instructions;
+};
+
+void PrintTo(const LockstepProgram& program, std::ostream* os)
+{
+    *os << program.name;
+}
+
+class LockstepProgramTests : public LockstepTests, public ::testing::WithParamInterface<LockstepProgram>
+{
+};
+
+// Program ends with hlt, which the fast core does not implement.
+TEST_P(LockstepProgramTests, RunsWithoutDivergence)
+{
+    std::vector<uint8_t> code = GetParam().code;
+    code.push_back(0xf4);
+    bus_->write(bios_address, code);
+    bus_->write(0x01234, std::vector<uint8_t>{0x11, 0x22});
+    bus_->write(0x21234, std::vector<uint8_t>{0x77, 0x88});
+
+    Lockstep<FlatBusType> lockstep(*bus_);
+    CpuState state               = bios_entry();
+    state.sregs[Register::es_id] = 0x2000;
+    state.regs[Register::ax_id]  = 0x5566;
+    lockstep.reset(state);
+
+    EXPECT_EQ(lockstep.run(100), Lockstep<FlatBusType>::Result::fast_stopped) << lockstep.report();
+    EXPECT_EQ(lockstep.steps(), GetParam().instructions) << lockstep.report();
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    LockstepProgramTests, LockstepProgramTests,
+    ::testing::Values(LockstepProgram{"es_mov_al_moffs", {0x26, 0xa0, 0x34, 0x12}, 1},
+                      LockstepProgram{"es_mov_ax_moffs", {0x26, 0xa1, 0x34, 0x12}, 1},
+                      LockstepProgram{"es_mov_moffs_al", {0x26, 0xa2, 0x34, 0x12}, 1},
+                      LockstepProgram{"es_mov_moffs_ax", {0x26, 0xa3, 0x34, 0x12}, 1},
+                      LockstepProgram{"cs_mov_ax_moffs", {0x2e, 0xa1, 0x34, 0x12}, 1},
+                      LockstepProgram{"ss_mov_moffs_ax", {0x36, 0xa3, 0x34, 0x12}, 1},
+                      LockstepProgram{"aaa_without_adjust", {0xb0, 0x25, 0x37}, 2},
+                      LockstepProgram{"aas_without_adjust", {0xb0, 0x25, 0x3f}, 2}),
+    [](const ::testing::TestParamInfo<LockstepProgram>& info) { return info.param.name; });
+
+TEST_F(LockstepTests, ReportsFirstDivergence)
+{
+    // mov al, 0x12; mov bl, 0x34
+    bus_->write(bios_address, std::vector<uint8_t>{0xb0, 0x12, 0xb3, 0x34});
+
+    Lockstep<FlatBusType> lockstep(*bus_);
+    lockstep.reset(bios_entry());
+    EXPECT_EQ(lockstep.step(), Lockstep<FlatBusType>::Result::running);
+
+    lockstep.reference().state().regs[Register::dx_id] = 0xbeef;
+    EXPECT_EQ(lockstep.step(), Lockstep<FlatBusType>::Result::diverged);
+    EXPECT_EQ(lockstep.steps(), 1u);
+    EXPECT_THAT(lockstep.report(), ::testing::HasSubstr("divergence after 1 instructions at f000:0102"));
+    EXPECT_THAT(lockstep.report(), ::testing::HasSubstr("mov bl,0x34"));
+    EXPECT_THAT(lockstep.report(), ::testing::HasSubstr("dx: beef"));
+}
+
+TEST_F(LockstepTests, ComparesMemoryWrites)
+{
+    // mov [0x0010], al
+    bus_->write(bios_address, std::vector<uint8_t>{0xa2, 0x10, 0x00});
+
+    Lockstep<FlatBusType> lockstep(*bus_);
+    CpuState state               = bios_entry();
+    state.sregs[Register::ds_id] = 0x0100;
+    state.regs[Register::ax_id]  = 0x00aa;
+    lockstep.reset(state);
+    lockstep.reference().state().sregs[Register::ds_id] = 0x0200;
+    lockstep.reference().state().regs[Register::ax_id]  = 0x00aa;
+
+    EXPECT_EQ(lockstep.step(), Lockstep<FlatBusType>::Result::diverged);
+    EXPECT_THAT(lockstep.report(), ::testing::HasSubstr("fast writes: [01010]=aa"));
+    EXPECT_THAT(lockstep.report(), ::testing::HasSubstr("reference writes: [02010]=aa"));
+}
+
+TEST_F(LockstepTests, StopsOnInstructionMissingInFastCore)
+{
+    // hlt
+    bus_->write(bios_address, std::vector<uint8_t>{0xf4});
+
+    Lockstep<FlatBusType> lockstep(*bus_);
+    lockstep.reset(bios_entry());
+
+    EXPECT_EQ(lockstep.run(10), Lockstep<FlatBusType>::Result::fast_stopped);
+    EXPECT_THAT(lockstep.report(), ::testing::HasSubstr("unimplemented"));
+}
+
+} // namespace msemu::cpu8086
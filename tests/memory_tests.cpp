@@ -0,0 +1,106 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+
+#include "memory.hpp"
+
+namespace msemu
+{
+namespace
+{
+
+constexpr uint32_t memory_size = 16 * 1024 * 1024;
+
+using SparseMemory = Memory<memory_size>;
+
+// Host pages of memory which are mapped. mincore() counts the shared zero
+// page mapped by a read as well, so tests count before they read.
+std::size_t resident_pages(std::span<const uint8_t> memory)
+{
+    std::vector<unsigned char> pages((memory.size() + HostMemory::page_size() - 1) / HostMemory::page_size());
+    EXPECT_EQ(mincore(const_cast<uint8_t*>(memory.data()), memory.size(), pages.data()), 0);
+    return static_cast<std::size_t>(
+        std::count_if(pages.begin(), pages.end(), [](const unsigned char page) { return page & 1; }));
+}
+
+void touch_every_page(std::span<uint8_t> memory)
+{
+    for (std::size_t offset = 0; offset < memory.size(); offset += HostMemory::page_size())
+    {
+        memory[offset] = 1;
+    }
+}
+
+} // namespace
+
+TEST(MemoryTests, CommitsOnlyWrittenPages)
+{
+    auto memory             = std::make_unique<SparseMemory>();
+    const auto span         = memory->span();
+    const std::size_t pages = memory_size / HostMemory::page_size();
+    EXPECT_EQ(resident_pages(span), 0u);
+
+    span[3 * HostMemory::page_size() + 5] = 0x55;
+    EXPECT_EQ(resident_pages(span), 1u);
+
+    touch_every_page(span);
+    EXPECT_EQ(resident_pages(span), pages);
+
+    memory->clear();
+    EXPECT_EQ(resident_pages(span), 0u);
+    EXPECT_EQ(std::accumulate(span.begin(), span.end(), 0u), 0u);
+}
+
+TEST(MemoryTests, CopyStaysSparse)
+{
+    auto memory = std::make_unique<SparseMemory>();
+    memory->span()[0x1234]          = 0x55;
+    memory->span()[memory_size - 1] = 0xaa;
+
+    auto copy = std::make_unique<SparseMemory>(*memory);
+    EXPECT_EQ(resident_pages(copy->span()), 2u);
+    EXPECT_EQ(copy->span()[0x1234], 0x55);
+    EXPECT_EQ(copy->span()[memory_size - 1], 0xaa);
+
+    // pages which are zero in the source are released in the target
+    touch_every_page(copy->span());
+    *copy = *memory;
+    EXPECT_EQ(resident_pages(copy->span()), 2u);
+    EXPECT_TRUE(std::equal(copy->span().begin(), copy->span().end(), memory->span().begin()));
+}
+
+TEST(MemoryTests, AssignReleasesZeroPages)
+{
+    std::vector<uint8_t> image(memory_size);
+    image[0x1234]          = 0x55;
+    image[memory_size - 1] = 0xaa;
+
+    auto memory = std::make_unique<SparseMemory>();
+    touch_every_page(memory->span());
+    memory->assign(image);
+    EXPECT_EQ(resident_pages(memory->span()), 2u);
+    EXPECT_TRUE(std::equal(image.begin(), image.end(), memory->span().begin()));
+}
+
+} // namespace msemu
@@ -130,14 +130,16 @@ TEST_P(MovTests, ProcessCmd)
             if (test_data.mod)
             {
                 auto m = test_data.mod->rm;
-                if (m == 0 || m == 1 || m == 4 || m == 5 || m == 7)
+                if (m == 0 || m == 1 || m == 4 || m == 5 || m == 7 || (m == 6 && test_data.mod->mod == 0))
                 {
-                    const uint32_t address = (sut_.get_registers().ds << 4) + test_data.memop.address;
+                    const uint32_t address =
+                        physical_address(sut_.get_registers().ds, test_data.memop.address);
                     bus_.write(address, test_data.memop.data);
                 }
                 else if (m == 2 || m == 3 || m == 6)
                 {
-                    const uint32_t address = (sut_.get_registers().ss << 4) + test_data.memop.address;
+                    const uint32_t address =
+                        physical_address(sut_.get_registers().ss, test_data.memop.address);
 
                     bus_.write(address, test_data.memop.data);
                 }
@@ -150,8 +152,7 @@ TEST_P(MovTests, ProcessCmd)
 
         auto& opcode = test_data.cmd;
 
-        const uint32_t address =
-            (static_cast<uint32_t>(sut_.get_registers().cs) << 4) + sut_.get_registers().ip;
+        const uint32_t address = physical_address(sut_.get_registers().cs, sut_.get_registers().ip);
         bus_.write(address, opcode);
 
         sut_.step();
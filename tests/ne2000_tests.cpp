@@ -0,0 +1,250 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ne2000.hpp"
+#include "network_switch.hpp"
+#include "pcap.hpp"
+
+namespace msemu
+{
+namespace
+{
+
+constexpr std::array<uint8_t, 6> mac_a = {0x52, 0x54, 0x00, 0x00, 0x00, 0x0a};
+constexpr std::array<uint8_t, 6> mac_b = {0x52, 0x54, 0x00, 0x00, 0x00, 0x0b};
+constexpr std::array<uint8_t, 6> mac_c = {0x52, 0x54, 0x00, 0x00, 0x00, 0x0c};
+
+// receive ring 0x46 - 0x7f, transmit buffer at page 0x40
+constexpr uint8_t rx_start = 0x46;
+constexpr uint8_t rx_stop  = 0x80;
+
+// same sequence as DOS packet drivers use
+void initialize(Ne2000& nic)
+{
+    nic.write_port(0x00, 0x21);
+    nic.write_port(0x0e, 0x49);
+    nic.write_port(0x0c, 0x04);
+    nic.write_port(0x01, rx_start);
+    nic.write_port(0x02, rx_stop);
+    nic.write_port(0x03, rx_stop - 1);
+    nic.write_port(0x07, 0xff);
+    nic.write_port(0x0f, 0x03);
+
+    // station address from PROM
+    nic.write_port(0x08, 0x00);
+    nic.write_port(0x09, 0x00);
+    nic.write_port(0x0a, 12);
+    nic.write_port(0x0b, 0);
+    nic.write_port(0x00, 0x0a);
+    std::array<uint8_t, 6> mac{};
+    for (auto& byte : mac)
+    {
+        byte = nic.read_port(Ne2000::data_port);
+        nic.read_port(Ne2000::data_port);
+    }
+
+    nic.write_port(0x00, 0x61);
+    for (uint8_t i = 0; i < mac.size(); ++i)
+    {
+        nic.write_port(static_cast<uint16_t>(0x01 + i), mac[i]);
+    }
+    nic.write_port(0x07, rx_start);
+    nic.write_port(0x00, 0x22);
+    nic.write_port(0x07, 0xff);
+}
+
+void transmit(Ne2000& nic, const std::vector<uint8_t>& frame)
+{
+    const auto size = static_cast<uint16_t>(frame.size());
+    nic.write_port(0x0a, static_cast<uint8_t>(size));
+    nic.write_port(0x0b, static_cast<uint8_t>(size >> 8));
+    nic.write_port(0x08, 0x00);
+    nic.write_port(0x09, 0x40);
+    nic.write_port(0x00, 0x12);
+    for (const uint8_t byte : frame)
+    {
+        nic.write_port(Ne2000::data_port, byte);
+    }
+    nic.write_port(0x04, 0x40);
+    nic.write_port(0x05, static_cast<uint8_t>(size));
+    nic.write_port(0x06, static_cast<uint8_t>(size >> 8));
+    nic.write_port(0x00, 0x26);
+}
+
+std::vector<uint8_t> read_card(Ne2000& nic, const uint16_t address, const uint16_t size)
+{
+    nic.write_port(0x0a, static_cast<uint8_t>(size));
+    nic.write_port(0x0b, static_cast<uint8_t>(size >> 8));
+    nic.write_port(0x08, static_cast<uint8_t>(address));
+    nic.write_port(0x09, static_cast<uint8_t>(address >> 8));
+    nic.write_port(0x00, 0x0a);
+    std::vector<uint8_t> data(size);
+    for (auto& byte : data)
+    {
+        byte = nic.read_port(Ne2000::data_port);
+    }
+    return data;
+}
+
+std::vector<uint8_t> make_frame(const std::array<uint8_t, 6>& destination,
+                                const std::array<uint8_t, 6>& source)
+{
+    std::vector<uint8_t> frame(destination.begin(), destination.end());
+    frame.insert(frame.end(), source.begin(), source.end());
+    // ARP ethertype and a few bytes of payload
+    frame.insert(frame.end(), {0x08, 0x06, 0xde, 0xad, 0xbe, 0xef});
+    return frame;
+}
+
+} // namespace
+
+class Ne2000Tests : public ::testing::Test
+{
+public:
+    Ne2000Tests()
+        : name_("/msemu_ne2000_tests_" + std::to_string(getpid()))
+        , switch_(name_.c_str(), 8)
+        , a_(mac_a)
+        , b_(mac_b)
+        , c_(mac_c)
+    {
+    }
+
+    ~Ne2000Tests()
+    {
+        NetworkSwitch::remove(name_.c_str());
+    }
+
+protected:
+    void connect_all()
+    {
+        ASSERT_TRUE(switch_.ok());
+        for (Ne2000* nic : {&a_, &b_, &c_})
+        {
+            ASSERT_TRUE(nic->connect(switch_));
+            initialize(*nic);
+        }
+    }
+
+    std::string name_;
+    NetworkSwitch switch_;
+    Ne2000 a_;
+    Ne2000 b_;
+    Ne2000 c_;
+};
+
+TEST_F(Ne2000Tests, StationAddressComesFromProm)
+{
+    initialize(a_);
+    a_.write_port(0x00, 0x62);
+    for (uint8_t i = 0; i < mac_a.size(); ++i)
+    {
+        EXPECT_EQ(a_.read_port(static_cast<uint16_t>(0x01 + i)), mac_a[i]);
+    }
+    EXPECT_EQ(a_.read_port(0x07), rx_start);
+}
+
+TEST_F(Ne2000Tests, UnicastFrameReachesOnlyDestination)
+{
+    connect_all();
+    const auto frame = make_frame(mac_b, mac_a);
+    transmit(a_, frame);
+
+    EXPECT_EQ(a_.read_port(0x07) & 0x02, 0x02);
+    EXPECT_TRUE(b_.interrupt());
+    EXPECT_FALSE(c_.interrupt());
+    EXPECT_EQ(b_.buffer().received, 1u);
+    EXPECT_EQ(c_.buffer().received, 0u);
+
+    // status, next page, length of frame padded to 60 bytes and of the header
+    const auto header = read_card(b_, rx_start << 8, 4);
+    EXPECT_EQ(header, (std::vector<uint8_t>{0x01, rx_start + 1, 64, 0}));
+    const auto data = read_card(b_, (rx_start << 8) + 4, 60);
+    EXPECT_TRUE(std::equal(frame.begin(), frame.end(), data.begin()));
+    EXPECT_EQ(data[59], 0);
+
+    b_.write_port(0x00, 0x62);
+    EXPECT_EQ(b_.read_port(0x07), rx_start + 1);
+}
+
+TEST_F(Ne2000Tests, BroadcastIsCapturedAndReachesEveryone)
+{
+    const auto path = (std::filesystem::temp_directory_path() / "msemu_ne2000_tests.pcap").string();
+    {
+        PcapWriter pcap(path.c_str());
+        switch_.capture(&pcap);
+        connect_all();
+        const auto frame = make_frame({0xff, 0xff, 0xff, 0xff, 0xff, 0xff}, mac_c);
+        EXPECT_EQ(switch_.send(c_.buffer(), frame), 2u);
+        EXPECT_EQ(pcap.frames(), 1u);
+        switch_.capture(nullptr);
+    }
+    EXPECT_TRUE(a_.interrupt());
+    EXPECT_TRUE(b_.interrupt());
+    // file header, record header and the frame
+    EXPECT_EQ(std::filesystem::file_size(path), 24u + 16u + 18u);
+    std::remove(path.c_str());
+}
+
+TEST_F(Ne2000Tests, FullRingDropsFrames)
+{
+    connect_all();
+    // 58 pages of ring, every frame takes one page and page at the boundary stays free
+    const auto frame = make_frame(mac_b, mac_a);
+    for (int i = 0; i < 60; ++i)
+    {
+        transmit(a_, frame);
+    }
+    EXPECT_EQ(b_.buffer().received, 56u);
+    EXPECT_EQ(b_.buffer().dropped, 4u);
+    EXPECT_EQ(b_.read_port(0x07) & 0x10, 0x10);
+}
+
+TEST_F(Ne2000Tests, InstancesInOtherProcessesAreConnected)
+{
+    connect_all();
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        NetworkSwitch network(name_.c_str(), 8);
+        Ne2000 nic({0x52, 0x54, 0x00, 0x00, 0x00, 0x0d});
+        const bool ok = nic.connect(network);
+        initialize(nic);
+        transmit(nic, make_frame(mac_a, {0x52, 0x54, 0x00, 0x00, 0x00, 0x0d}));
+        _exit(ok ? 0 : 1);
+    }
+    int status = 0;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    EXPECT_EQ(a_.buffer().received, 1u);
+    // last bytes of source address, after ring header
+    EXPECT_EQ(read_card(a_, (rx_start << 8) + 4 + 10, 2), (std::vector<uint8_t>{0x00, 0x0d}));
+}
+
+} // namespace msemu
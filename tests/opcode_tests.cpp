@@ -0,0 +1,167 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "8086_opcodes.hpp"
+#include "test_base.hpp"
+
+namespace msemu::cpu8086
+{
+
+TEST(OpcodeTableTests, DecodesInstructionLength)
+{
+    struct Case
+    {
+        std::vector<uint8_t> bytes;
+        std::size_t length;
+    };
+    const std::vector<Case> cases = {
+        {{0x90}, 1},                                     // nop
+        {{0xb8, 0x34, 0x12}, 3},                         // mov ax, 0x1234
+        {{0x01, 0xd8}, 2},                               // add ax, bx
+        {{0x8b, 0x06, 0x00, 0x10}, 4},                   // mov ax, [0x1000]
+        {{0x80, 0x40, 0x10, 0x01}, 4},                   // add byte [bx+si+0x10], 1
+        {{0xc7, 0x80, 0x00, 0x10, 0x34, 0x12}, 6},       // mov word [bx+si+0x1000], 0x1234
+        {{0xf6, 0xc0, 0x01}, 3},                         // test al, 1
+        {{0xf7, 0xd0}, 2},                               // not ax
+        {{0x9a, 0x00, 0x01, 0x00, 0xf0}, 5},             // call far f000:0100
+        {{0x2e, 0xf3, 0xa4}, 3},                         // rep movsb with cs override
+        {{0x26, 0x8b, 0x47, 0x02}, 4},                   // mov ax, es:[bx+2]
+        {{0x81, 0x06, 0x00, 0x10}, 0},                   // truncated immediate
+        {{0x2e}, 0},                                     // prefix only
+    };
+
+    for (const auto& test : cases)
+    {
+        EXPECT_EQ(instruction_length(test.bytes), test.length)
+            << "opcode: " << std::hex << int{test.bytes[0]};
+    }
+}
+
+TEST(OpcodeTableTests, NoInstructionIsLongerThanMaximum)
+{
+    for (uint32_t opcode = 0; opcode < 256; ++opcode)
+    {
+        if (opcode_table[opcode].prefix != Prefix::none)
+        {
+            continue;
+        }
+        // direct address and test immediate give the longest encoding
+        const std::vector<uint8_t> bytes = {static_cast<uint8_t>(opcode), 0x06, 0, 0, 0, 0, 0, 0};
+        EXPECT_LE(instruction_length(bytes), max_instruction_length) << "opcode: " << std::hex << opcode;
+    }
+}
+
+TEST(OpcodeTableTests, ShiftByClWritesNoFlags)
+{
+    // count of 0 in cl leaves flags unchanged, so liveness must keep them
+    EXPECT_EQ(opcode_table[0xd2].flags_written, 0);
+    EXPECT_EQ(opcode_table[0xd3].flags_written, 0);
+}
+
+class OpcodeCostTests : public TestBase
+{
+};
+
+TEST_F(OpcodeCostTests, InterpreterDecodesLengthAsTable)
+{
+    for (uint32_t opcode = 0; opcode < 256; ++opcode)
+    {
+        const OpcodeInfo& info = opcode_table[opcode];
+        const std::string_view mnemonic(info.mnemonic);
+        // control transfers don't end after the instruction
+        if (info.prefix != Prefix::none || mnemonic.starts_with("j") || mnemonic.starts_with("loop") ||
+            mnemonic.starts_with("call") || mnemonic.starts_with("ret") || mnemonic.starts_with("int") ||
+            mnemonic == "iret")
+        {
+            continue;
+        }
+
+        // register form of ModRM with byte immediate of 1
+        const std::vector<uint8_t> bytes = {static_cast<uint8_t>(opcode), 0xc0, 0x01, 0x00, 0x00, 0x00};
+        bus_.write(0x00100, bytes);
+        sut_.set_registers({.sp = 0x0ffa, .ip = 0x0100});
+
+        sut_.step();
+
+        char unimplemented[40];
+        snprintf(unimplemented, sizeof(unimplemented), "Opcode: 0x%x is unimplemented!", opcode);
+        if (sut_.get_error().starts_with(unimplemented))
+        {
+            continue;
+        }
+        EXPECT_EQ(sut_.get_registers().ip - 0x0100u, instruction_length(bytes))
+            << "opcode: " << std::hex << opcode;
+    }
+}
+
+TEST_F(OpcodeCostTests, RegisterFormsCostAsInTable)
+{
+    struct Case
+    {
+        const char* name;
+        std::vector<uint8_t> bytes;
+    };
+    const std::vector<Case> cases = {
+        {"add ax, bx", {0x01, 0xd8}},
+        {"sub ax, 1", {0x2d, 0x01, 0x00}},
+        {"mov ax, bx", {0x89, 0xd8}},
+        {"mov ax, 0x1234", {0xb8, 0x34, 0x12}},
+        {"mov ds, ax", {0x8e, 0xd8}},
+        {"push ax", {0x50}},
+        {"pop ax", {0x58}},
+        {"push es", {0x06}},
+        {"pop es", {0x07}},
+        {"pushf", {0x9c}},
+        {"popf", {0x9d}},
+        {"aaa", {0x37}},
+        {"aam", {0xd4, 0x0a}},
+        {"aad", {0xd5, 0x0a}},
+        {"jo", {0x70, 0x00}},
+        {"loop", {0xe2, 0x00}},
+        {"jcxz", {0xe3, 0x00}},
+        {"jmp short", {0xeb, 0x00}},
+        {"jmp near", {0xe9, 0x00, 0x00}},
+        {"jmp far", {0xea, 0x00, 0x02, 0x00, 0x00}},
+        {"call near", {0xe8, 0x00, 0x00}},
+        {"call far", {0x9a, 0x00, 0x02, 0x00, 0x00}},
+        {"ret", {0xc3}},
+        {"int", {0xcd, 0x10}},
+        {"iret", {0xcf}},
+    };
+
+    for (const auto& test : cases)
+    {
+        // not taken branches, stack holds ip 0x0200, cs 0 and flags 0
+        bus_.write(0x00100, test.bytes);
+        bus_.write(0x00ffa, std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x00});
+        sut_.set_registers({.cx = 1, .sp = 0x0ffa, .ip = 0x0100});
+
+        sut_.step();
+
+        EXPECT_EQ(sut_.last_instruction_cost(), opcode_table[test.bytes[0]].cost) << test.name;
+        EXPECT_STREQ(sut_.get_error().c_str(), "") << test.name;
+    }
+}
+
+} // namespace msemu::cpu8086
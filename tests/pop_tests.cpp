@@ -385,7 +385,7 @@ TEST_P(PopTests, ProcessCmd)
     bus_.clear();
     for (const auto& test : param.cases)
     {
-        const uint32_t address = static_cast<uint32_t>((test.regs_init.cs << 4) + test.regs_init.ip);
+        const uint32_t address = physical_address(test.regs_init.cs, test.regs_init.ip);
 
         std::vector<uint8_t> cmd;
         std::copy(param.cmd.begin(), param.cmd.end(), std::back_inserter(cmd));
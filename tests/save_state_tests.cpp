@@ -0,0 +1,231 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "bus.hpp"
+#include "device.hpp"
+#include "lz.hpp"
+#include "memory.hpp"
+#include "save_state.hpp"
+
+namespace msemu
+{
+namespace
+{
+
+using RamType = Device<Memory<64 * 1024>, 0x00000000>;
+using RomType = Device<Memory<16 * 1024>, 0x000f0000>;
+using TestBus = Bus<RamType, RomType>;
+
+std::string temporary_path(const char* name)
+{
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+} // namespace
+
+TEST(LzTests, RoundTripsCompressibleAndRandomData)
+{
+    std::vector<uint8_t> text;
+    for (int i = 0; i < 4096; ++i)
+    {
+        text.push_back(static_cast<uint8_t>("mov ax, bx; "[i % 12]));
+    }
+    std::vector<uint8_t> noise(4096);
+    uint32_t seed = 12345;
+    for (auto& byte : noise)
+    {
+        seed = seed * 1103515245u + 12345u;
+        byte = static_cast<uint8_t>(seed >> 16);
+    }
+
+    for (const auto& input : {text, noise, std::vector<uint8_t>{1, 2, 3}})
+    {
+        std::vector<uint8_t> compressed(lz::max_compressed_size(input.size()));
+        const std::size_t size = lz::compress(input, compressed);
+        ASSERT_NE(size, 0u);
+        compressed.resize(size);
+
+        std::vector<uint8_t> output(input.size());
+        EXPECT_TRUE(lz::decompress(compressed, output));
+        EXPECT_EQ(output, input);
+    }
+
+    std::vector<uint8_t> compressed(lz::max_compressed_size(text.size()));
+    EXPECT_LT(lz::compress(text, compressed), text.size() / 10);
+}
+
+TEST(LzTests, RejectsMalformedInput)
+{
+    std::vector<uint8_t> output(16);
+    // match offset pointing before beginning of output
+    EXPECT_FALSE(lz::decompress(std::vector<uint8_t>{0x10, 0xaa, 0x05, 0x00}, output));
+    // literal run longer than input
+    EXPECT_FALSE(lz::decompress(std::vector<uint8_t>{0x50, 0xaa}, output));
+}
+
+class SaveStateTests : public ::testing::Test
+{
+public:
+    SaveStateTests()
+        : bus_(std::make_unique<TestBus>(RamType("ram"), RomType("rom")))
+        , path_(temporary_path("msemu_save_state_tests.state"))
+    {
+    }
+
+    ~SaveStateTests()
+    {
+        std::remove(path_.c_str());
+    }
+
+protected:
+    std::unique_ptr<TestBus> bus_;
+    std::string path_;
+};
+
+TEST_F(SaveStateTests, RestoresMemoryAndRegisters)
+{
+    std::vector<uint8_t> page(4096);
+    for (std::size_t i = 0; i < page.size(); ++i)
+    {
+        page[i] = static_cast<uint8_t>(i * 7);
+    }
+    bus_->write(0x1000, page);
+    bus_->write(0x5000, page);
+    bus_->write(0xf0010, std::vector<uint8_t>{0xea, 0x00, 0x01, 0x00, 0xf0});
+
+    cpu8086::CpuState state{};
+    for (uint16_t i = 0; i < state.regs.size(); ++i)
+    {
+        state.regs[i] = static_cast<uint16_t>(0x1111 * (i + 1));
+    }
+    state.sregs = {0x0100, 0xf000, 0x2000, 0x0300};
+    state.ip    = 0x0010;
+    state.flags = 0x08c5;
+    cpu8086::restore_state(state);
+
+    ASSERT_TRUE(save_state(path_.c_str(), *bus_));
+
+    auto restored = std::make_unique<TestBus>(RamType("ram"), RomType("rom"));
+    cpu8086::restore_state(cpu8086::CpuState{});
+    ASSERT_TRUE(load_state(path_.c_str(), *restored));
+
+    EXPECT_EQ(cpu8086::capture_state(), state);
+    bus_->for_each_device(
+        [&restored](const auto& device)
+        {
+            restored->for_each_device(
+                [&device](const auto& other)
+                {
+                    if (other.name() == device.name())
+                    {
+                        EXPECT_TRUE(std::equal(device.span().begin(), device.span().end(),
+                                               other.span().begin(), other.span().end()))
+                            << device.name();
+                    }
+                });
+        });
+}
+
+TEST_F(SaveStateTests, SkipsZeroAndDuplicatePages)
+{
+    std::vector<uint8_t> page(4096, 0x90);
+    page[0] = 0xcc;
+    bus_->write(0x0000, page);
+    bus_->write(0x3000, page);
+    bus_->write(0xf2000, page);
+
+    SaveStateWriter writer;
+    ASSERT_TRUE(writer.open(path_.c_str()));
+    writer.write_cpu(cpu8086::capture_state());
+    bus_->for_each_device([&writer](const auto& device)
+                          { writer.write_device(device.name(), device.start_address, device.span()); });
+    ASSERT_TRUE(writer.close());
+
+    EXPECT_EQ(writer.stats().pages, 20u);
+    EXPECT_EQ(writer.stats().zero_pages, 17u);
+    EXPECT_EQ(writer.stats().duplicate_pages, 2u);
+    EXPECT_LT(writer.stats().bytes, 4096u);
+    EXPECT_EQ(std::filesystem::file_size(path_), writer.stats().bytes);
+}
+
+TEST_F(SaveStateTests, ReadsSinglePageOnDemand)
+{
+    std::vector<uint8_t> page(4096, 0x55);
+    bus_->write(0xf1000, page);
+    ASSERT_TRUE(save_state(path_.c_str(), *bus_));
+
+    SaveStateReader reader;
+    ASSERT_TRUE(reader.open(path_.c_str()));
+    const auto* rom = reader.device("rom");
+    ASSERT_NE(rom, nullptr);
+    EXPECT_EQ(rom->start_address, 0xf0000u);
+    EXPECT_EQ(rom->size, 16u * 1024u);
+
+    std::vector<uint8_t> out(4096, 0xff);
+    EXPECT_TRUE(reader.read_page(*rom, 1, out));
+    EXPECT_EQ(out, page);
+    EXPECT_TRUE(reader.read_page(*rom, 2, out));
+    EXPECT_EQ(out, std::vector<uint8_t>(4096, 0));
+    EXPECT_FALSE(reader.read_page(*rom, 4, out));
+}
+
+TEST_F(SaveStateTests, RejectsUnknownVersion)
+{
+    ASSERT_TRUE(save_state(path_.c_str(), *bus_));
+
+    FILE* file = fopen(path_.c_str(), "r+b");
+    ASSERT_NE(file, nullptr);
+    fseek(file, 8, SEEK_SET);
+    const uint8_t version[] = {0xff, 0x7f};
+    fwrite(version, 1, sizeof(version), file);
+    fclose(file);
+
+    SaveStateReader reader;
+    EXPECT_FALSE(reader.open(path_.c_str()));
+}
+
+TEST_F(SaveStateTests, RejectsDeviceLargerThanAddressSpace)
+{
+    ASSERT_TRUE(save_state(path_.c_str(), *bus_));
+
+    std::vector<uint8_t> data(std::filesystem::file_size(path_));
+    FILE* file = fopen(path_.c_str(), "r+b");
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(fread(data.data(), 1, data.size(), file), data.size());
+    // size field of the first device, far beyond the 8086 address space
+    const std::vector<uint8_t> tag = {'D', 'E', 'V', ' '};
+    const auto device = std::search(data.begin(), data.end(), tag.begin(), tag.end());
+    ASSERT_NE(device, data.end());
+    fseek(file, static_cast<long>(device - data.begin()) + 12, SEEK_SET);
+    const uint8_t size[] = {0xff, 0xff, 0xff, 0xff};
+    fwrite(size, 1, sizeof(size), file);
+    fclose(file);
+
+    SaveStateReader reader;
+    EXPECT_FALSE(reader.open(path_.c_str()));
+}
+
+} // namespace msemu
@@ -0,0 +1,83 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "test_base.hpp"
+
+namespace msemu::cpu8086
+{
+
+class SmcTests : public TestBase
+{
+};
+
+TEST_F(SmcTests, IgnoresWritesOutsideOfCodeBlocks)
+{
+    // push ax; push ax with stack in the same page as code, but another block
+    bus_.write(0x00100, std::vector<uint8_t>{0x50, 0x50});
+    sut_.set_registers({.sp = 0x0200, .ip = 0x0100});
+
+    sut_.step();
+    sut_.step();
+
+    EXPECT_EQ(sut_.stats().smc.events, 0u);
+}
+
+TEST_F(SmcTests, CountsWritesIntoCodeBlocks)
+{
+    // mov [0x0110], ax; mov [0x0110], ax, the second write follows re-marking by fetch
+    bus_.write(0x00100, std::vector<uint8_t>{0xa3, 0x10, 0x01, 0xa3, 0x10, 0x01});
+    sut_.set_registers({.ip = 0x0100});
+
+    sut_.step();
+    EXPECT_EQ(sut_.stats().smc.events, 1u);
+    EXPECT_EQ(sut_.stats().smc.invalidated_blocks, 1u);
+
+    sut_.step();
+    EXPECT_EQ(sut_.stats().smc.events, 2u);
+}
+
+TEST_F(SmcTests, ExecutesModifiedInstruction)
+{
+    // mov byte [0x0107], 0x77; mov ax, 0x1234 with immediate patched to 0x7734
+    bus_.write(0x00100, std::vector<uint8_t>{0xc6, 0x06, 0x07, 0x01, 0x77, 0xb8, 0x34, 0x12});
+    sut_.set_registers({.ip = 0x0100});
+
+    sut_.step();
+    sut_.step();
+
+    EXPECT_EQ(sut_.get_registers().ax, 0x7734);
+    EXPECT_EQ(sut_.stats().smc.events, 1u);
+}
+
+TEST_F(SmcTests, InvalidatesOnlyTouchedBlocks)
+{
+    // mov [0x013f], ax writes across two blocks, only the code block is unmarked
+    bus_.write(0x00100, std::vector<uint8_t>{0xa3, 0x3f, 0x01});
+    sut_.set_registers({.ip = 0x0100});
+
+    sut_.step();
+
+    EXPECT_EQ(sut_.stats().smc.events, 1u);
+    EXPECT_EQ(sut_.stats().smc.invalidated_blocks, 1u);
+}
+
+} // namespace msemu::cpu8086
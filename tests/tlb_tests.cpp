@@ -0,0 +1,121 @@
+/*
+ *   Copyright (c) 2021 Mateusz Stadnik
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "bus.hpp"
+#include "cpu8086_for_test.hpp"
+#include "device.hpp"
+#include "memory.hpp"
+
+namespace msemu::cpu8086
+{
+namespace
+{
+
+// three devices, so the cpu resolves accesses through the software TLB
+using LowMemoryType  = Device<Memory<1024 * 64>, 0x00000000>;
+using HighMemoryType = Device<Memory<1024 * 64>, 0x00010000>;
+using RomType        = Device<Memory<1024 * 64>, 0x000f0000>;
+using TlbBusType     = Bus<LowMemoryType, HighMemoryType, RomType>;
+
+} // namespace
+
+class TlbTests : public ::testing::Test
+{
+public:
+    TlbTests()
+        : bus_(LowMemoryType("low"), HighMemoryType("high"), RomType("rom"))
+        , sut_(bus_)
+    {
+    }
+
+protected:
+    TlbBusType bus_;
+    CpuForTest<TlbBusType> sut_;
+};
+
+TEST_F(TlbTests, HitsAfterFirstMiss)
+{
+    // push ax; pop bx; push ax; pop bx
+    bus_.write(0x00100, std::vector<uint8_t>{0x50, 0x5b, 0x50, 0x5b});
+    sut_.set_registers({.ax = 0x1234, .sp = 0x0100, .ip = 0x0100, .ss = 0x0100});
+
+    for (int i = 0; i < 4; ++i)
+    {
+        sut_.step();
+    }
+
+    EXPECT_EQ(sut_.get_registers().bx, 0x1234);
+    const auto stats = sut_.stats().tlb;
+    // later fetches from the same code block skip the TLB
+    EXPECT_EQ(stats.misses[SoftwareTlb::code], 1u);
+    EXPECT_EQ(stats.misses[SoftwareTlb::stack], 1u);
+    EXPECT_EQ(stats.hits[SoftwareTlb::stack], 3u);
+}
+
+TEST_F(TlbTests, MissesAfterInvalidate)
+{
+    // mov ax, [0x0010]; mov ax, [0x0010]
+    bus_.write(0x00100, std::vector<uint8_t>{0xa1, 0x10, 0x00, 0xa1, 0x10, 0x00});
+    sut_.set_registers({.ip = 0x0100});
+
+    sut_.step();
+    sut_.invalidate_tlb();
+    sut_.step();
+
+    const auto stats = sut_.stats().tlb;
+    EXPECT_EQ(stats.misses[SoftwareTlb::code], 2u);
+    EXPECT_EQ(stats.misses[SoftwareTlb::data], 2u);
+    EXPECT_EQ(stats.hits[SoftwareTlb::data], 0u);
+}
+
+TEST_F(TlbTests, AccessesStraddlingDevicesGoThroughBus)
+{
+    // mov ax, [0xffff]; mov [0xffff], bx
+    bus_.write(0x00100, std::vector<uint8_t>{0xa1, 0xff, 0xff, 0x89, 0x1e, 0xff, 0xff});
+    bus_.write(0x0ffff, std::vector<uint8_t>{0x34});
+    bus_.write(0x10000, std::vector<uint8_t>{0x12});
+    sut_.set_registers({.bx = 0xbeef, .ip = 0x0100});
+
+    sut_.step();
+    sut_.step();
+
+    EXPECT_EQ(sut_.get_registers().ax, 0x1234);
+    EXPECT_EQ(bus_.read<uint8_t>(0x0ffff), 0xef);
+    EXPECT_EQ(bus_.read<uint8_t>(0x10000), 0xbe);
+}
+
+TEST_F(TlbTests, FollowsSegmentChangeWithoutFlush)
+{
+    // mov ax, [0x0000] with ds in low memory, then with ds in high memory
+    bus_.write(0x00100, std::vector<uint8_t>{0xa1, 0x00, 0x00, 0x8e, 0xdb, 0xa1, 0x00, 0x00});
+    bus_.write(0x00000, std::vector<uint8_t>{0x11, 0x11});
+    bus_.write(0x10000, std::vector<uint8_t>{0x22, 0x22});
+    sut_.set_registers({.bx = 0x1000, .ip = 0x0100});
+
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().ax, 0x1111);
+    sut_.step();
+    sut_.step();
+    EXPECT_EQ(sut_.get_registers().ax, 0x2222);
+}
+
+} // namespace msemu::cpu8086
@@ -0,0 +1,106 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "test_base.hpp"
+
+namespace msemu::cpu8086
+{
+
+class TrapTests : public TestBase
+{
+public:
+    TrapTests()
+    {
+        // int 1 handler at 0000:0200 counts traps in word at 0x0300
+        bus_.write(0x00004, std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00});
+        // add word [0x0300], 1; iret
+        bus_.write(0x00200, std::vector<uint8_t>{0x83, 0x06, 0x00, 0x03, 0x01, 0xcf});
+    }
+};
+
+TEST_F(TrapTests, TrapFollowsEveryInstructionWhileFlagIsSet)
+{
+    // pushf; pop ax; or ax, 0x0100; push ax; popf
+    // mov bx, 1; mov bx, 2; mov bx, 3
+    // pushf; pop ax; and ax, 0xfeff; push ax; popf
+    // mov cx, 1; hlt
+    bus_.write(0x00100, std::vector<uint8_t>{0x9c, 0x58, 0x0d, 0x00, 0x01, 0x50, 0x9d, 0xbb, 0x01, 0x00,
+                                             0xbb, 0x02, 0x00, 0xbb, 0x03, 0x00, 0x9c, 0x58, 0x25, 0xff,
+                                             0xfe, 0x50, 0x9d, 0xb9, 0x01, 0x00, 0xf4});
+    sut_.set_registers({.sp = 0x1000, .ip = 0x0100});
+
+    sut_.run(1000);
+
+    // popf which clears the flag started with it set, so it is trapped too
+    EXPECT_EQ(bus_.read<uint16_t>(0x0300), 8);
+    EXPECT_EQ(sut_.get_registers().bx, 3);
+    EXPECT_EQ(sut_.get_registers().cx, 1);
+    EXPECT_FALSE(sut_.get_registers().flags.t);
+    EXPECT_EQ(sut_.get_registers().ip, 0x011a);
+    EXPECT_NE(std::string(sut_.get_error()).find("0xf4"), std::string::npos);
+}
+
+TEST_F(TrapTests, HandlerSeesTrapFlagPushed)
+{
+    // mov bx, 1; mov bx, 2
+    bus_.write(0x00100, std::vector<uint8_t>{0xbb, 0x01, 0x00, 0xbb, 0x02, 0x00});
+    sut_.set_registers({.sp = 0x1000, .ip = 0x0100, .flags = {.t = true}});
+
+    sut_.run(1);
+
+    EXPECT_EQ(sut_.get_registers().cs, 0x0000);
+    EXPECT_EQ(sut_.get_registers().ip, 0x0200);
+    EXPECT_FALSE(sut_.get_registers().flags.t);
+    EXPECT_EQ(bus_.read<uint16_t>(0x0ffa), 0x0103);
+    EXPECT_EQ(bus_.read<uint16_t>(0x0ffe) & 0x0100, 0x0100);
+
+    // handler runs without traps, iret resumes tracing
+    sut_.run(5);
+    EXPECT_EQ(bus_.read<uint16_t>(0x0300), 2);
+    EXPECT_EQ(sut_.get_registers().bx, 2);
+}
+
+TEST_F(TrapTests, PrefixIsTracedWithItsInstruction)
+{
+    // mov ax, es:[0x0000]
+    bus_.write(0x00100, std::vector<uint8_t>{0x26, 0xa1, 0x00, 0x00});
+    sut_.set_registers({.sp = 0x1000, .ip = 0x0100, .flags = {.t = true}});
+
+    sut_.run(1);
+    EXPECT_EQ(sut_.get_registers().ip, 0x0200);
+    EXPECT_EQ(bus_.read<uint16_t>(0x0ffa), 0x0104);
+}
+
+TEST_F(TrapTests, UnimplementedOpcodeIsNotTrapped)
+{
+    // hlt
+    bus_.write(0x00100, std::vector<uint8_t>{0xf4});
+    sut_.set_registers({.sp = 0x1000, .ip = 0x0100, .flags = {.t = true}});
+
+    sut_.run(1);
+    EXPECT_EQ(sut_.get_registers().cs, 0x0000);
+    EXPECT_EQ(sut_.get_registers().ip, 0x0100);
+    EXPECT_EQ(sut_.get_registers().sp, 0x1000);
+    EXPECT_NE(std::string(sut_.get_error()).find("0xf4"), std::string::npos);
+}
+
+} // namespace msemu::cpu8086
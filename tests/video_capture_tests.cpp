@@ -0,0 +1,147 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "video_capture.hpp"
+
+namespace msemu
+{
+
+class VideoCaptureTests : public ::testing::Test
+{
+public:
+    VideoCaptureTests()
+        : memory_(std::make_unique<VideoMemory>())
+        , path_((std::filesystem::temp_directory_path() / "msemu_video_capture_tests.y4m").string())
+    {
+    }
+
+    ~VideoCaptureTests()
+    {
+        std::remove(path_.c_str());
+    }
+
+protected:
+    std::vector<uint8_t> read_file() const
+    {
+        std::ifstream file(path_, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    std::unique_ptr<VideoMemory> memory_;
+    std::string path_;
+};
+
+TEST_F(VideoCaptureTests, UnchangedFramesAreRepeated)
+{
+    VideoOutput output;
+    VideoCapture capture(path_.c_str(), VideoCapture::Format::y4m, 60, 600);
+    ASSERT_TRUE(capture.ok());
+
+    // frame every 10 cycles
+    capture.advance(10, output, *memory_);
+    memory_->span()[0x18000] = 0xc0;
+    memory_->written(0x18000, 1);
+    capture.advance(15, output, *memory_);
+    capture.advance(5, output, *memory_);
+    capture.advance(9, output, *memory_);
+    capture.close();
+
+    const auto stats = capture.stats();
+    EXPECT_EQ(stats.captured, 3u);
+    EXPECT_EQ(stats.repeats, 1u);
+    EXPECT_EQ(stats.dropped, 0u);
+    EXPECT_EQ(stats.written, 3u);
+
+    const std::string header = "YUV4MPEG2 W320 H200 F60:1 Ip A1:1 C444\n";
+    const std::size_t frame  = 6 + 3 * 320 * 200;
+    const auto file          = read_file();
+    ASSERT_EQ(file.size(), header.size() + 3 * frame);
+    EXPECT_EQ(std::string(file.begin(), file.begin() + static_cast<long>(header.size())), header);
+
+    const auto first = file.begin() + static_cast<long>(header.size() + 6);
+    // black and white luma of studio range
+    EXPECT_EQ(first[0], 16);
+    EXPECT_EQ(first[static_cast<long>(frame)], 235);
+    const auto second = file.begin() + static_cast<long>(header.size() + frame);
+    EXPECT_TRUE(std::equal(second, second + static_cast<long>(frame), second + static_cast<long>(frame)));
+}
+
+TEST_F(VideoCaptureTests, LongAdvanceCapturesEveryPeriod)
+{
+    VideoOutput output;
+    VideoCapture capture(path_.c_str(), VideoCapture::Format::y4m, 60, 600);
+    capture.advance(35, output, *memory_);
+    capture.close();
+
+    const auto stats = capture.stats();
+    EXPECT_EQ(stats.captured, 3u);
+    EXPECT_EQ(stats.repeats, 2u);
+    EXPECT_EQ(stats.written, 3u);
+}
+
+TEST_F(VideoCaptureTests, RepeatsAndDroppedFramesKeepTimeline)
+{
+    VideoOutput output;
+    VideoCapture capture(path_.c_str(), VideoCapture::Format::y4m, 60, 600);
+
+    // repeats take no ring slots, so they are never dropped
+    capture.advance(1000, output, *memory_);
+    EXPECT_EQ(capture.stats().dropped, 0u);
+
+    // changed frames may outrun the writer, dropped ones are written as repeats
+    for (uint32_t i = 0; i < 50; ++i)
+    {
+        memory_->span()[0x18000] = static_cast<uint8_t>(i);
+        memory_->written(0x18000, 1);
+        capture.advance(10, output, *memory_);
+    }
+    capture.close();
+
+    const auto stats = capture.stats();
+    EXPECT_EQ(stats.captured, 150u);
+    EXPECT_EQ(stats.written, 150u);
+    const std::size_t header = std::string("YUV4MPEG2 W320 H200 F60:1 Ip A1:1 C444\n").size();
+    EXPECT_EQ(read_file().size(), header + 150 * (6 + 3 * 320 * 200));
+}
+
+TEST_F(VideoCaptureTests, RawFramesAreRgba)
+{
+    memory_->mode(VideoMode::ega_320x200x16);
+    memory_->span()[0] = 0x80;
+    VideoOutput output;
+    VideoCapture capture(path_.c_str(), VideoCapture::Format::raw);
+    capture.capture(output, *memory_);
+    capture.close();
+
+    const auto file = read_file();
+    ASSERT_EQ(file.size(), 320u * 200u * 4u);
+    EXPECT_EQ(std::vector<uint8_t>(file.begin(), file.begin() + 8),
+              (std::vector<uint8_t>{0x00, 0x00, 0xaa, 0xff, 0x00, 0x00, 0x00, 0xff}));
+}
+
+} // namespace msemu
@@ -0,0 +1,189 @@
+/*
+ Copyright (c) 2021 Mateusz Stadnik
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "bus.hpp"
+#include "cpu8086_for_test.hpp"
+#include "device.hpp"
+#include "memory.hpp"
+#include "video.hpp"
+
+namespace msemu
+{
+namespace
+{
+
+// three devices, so the cpu writes through the software TLB
+using RamType     = Device<Memory<1024 * 64>, 0x00000000>;
+using VideoType   = Device<VideoMemory, 0x000a0000>;
+using RomType     = Device<Memory<1024 * 64>, 0x000f0000>;
+using VideoBus    = Bus<RamType, VideoType, RomType>;
+using VideoKernel = VideoOutput::Kernel;
+
+constexpr uint32_t cga_memory = 0xb8000;
+
+} // namespace
+
+class VideoTests : public ::testing::Test
+{
+public:
+    VideoTests()
+        : bus_(std::make_unique<VideoBus>(RamType("ram"), VideoType("video"), RomType("rom")))
+    {
+    }
+
+protected:
+    VideoMemory& video()
+    {
+        VideoMemory* memory = nullptr;
+        bus_->for_each_device(
+            [&memory](auto& device)
+            {
+                if constexpr (std::is_same_v<std::decay_t<decltype(device)>, VideoType>)
+                {
+                    memory = &device.memory();
+                }
+            });
+        return *memory;
+    }
+
+    std::unique_ptr<VideoBus> bus_;
+};
+
+TEST_F(VideoTests, ConvertsInterleavedCgaScanlines)
+{
+    VideoOutput output(VideoKernel::scalar);
+    // pixels 0, 1, 2, 3 on line 0 and 3, 2, 1, 0 on line 1 from the odd bank
+    bus_->write(cga_memory, uint8_t{0x1b});
+    bus_->write(cga_memory + 0x2000, uint8_t{0xe4});
+    output.update(video());
+
+    ASSERT_EQ(output.width(), 320u);
+    ASSERT_EQ(output.height(), 200u);
+    const auto frame = output.frame();
+    EXPECT_EQ(frame[0], 0xff000000u);
+    EXPECT_EQ(frame[1], 0xffffff55u);
+    EXPECT_EQ(frame[2], 0xffff55ffu);
+    EXPECT_EQ(frame[3], 0xffffffffu);
+    EXPECT_EQ(frame[320], 0xffffffffu);
+    EXPECT_EQ(frame[323], 0xff000000u);
+}
+
+TEST_F(VideoTests, ConvertsEgaPlanes)
+{
+    video().mode(VideoMode::ega_640x350x16);
+    VideoOutput output(VideoKernel::scalar);
+    // leftmost pixel of line 1 has planes 0 and 2 set
+    bus_->write(0xa0000 + 80, uint8_t{0x80});
+    bus_->write(0xa0000 + 2 * 0x8000 + 80, uint8_t{0x80});
+    output.update(video());
+
+    ASSERT_EQ(output.width(), 640u);
+    EXPECT_EQ(output.frame()[640], 0xffaa00aau);
+    EXPECT_EQ(output.frame()[641], 0xff000000u);
+}
+
+TEST_F(VideoTests, ConvertsOnlyDirtyScanlines)
+{
+    VideoOutput output;
+    EXPECT_EQ(output.update(video()), 200u);
+    EXPECT_EQ(output.update(video()), 0u);
+
+    // word write straddling lines 0 and 2, both in the even bank
+    bus_->write(cga_memory + 79, uint16_t{0xffff});
+    bus_->write(cga_memory + 0x2000 + 80 * 99, uint8_t{0xff});
+    EXPECT_EQ(output.update(video()), 3u);
+
+    output.palette(1, 0xff0000ff);
+    EXPECT_EQ(output.update(video()), 200u);
+    EXPECT_EQ(output.stats().lines, 403u);
+}
+
+TEST_F(VideoTests, WriteAcrossBankGapMarksNextBank)
+{
+    VideoOutput output;
+    output.update(video());
+
+    // starts in the gap after line 198 of the even bank, ends in line 1 of the odd bank
+    const std::vector<uint8_t> data(60, 0xff);
+    bus_->write(cga_memory + 0x1fd6, data);
+
+    EXPECT_FALSE(video().dirty(198));
+    EXPECT_TRUE(video().dirty(1));
+    EXPECT_FALSE(video().dirty(3));
+    EXPECT_EQ(output.update(video()), 1u);
+}
+
+TEST_F(VideoTests, CpuWritesMarkScanlinesDirty)
+{
+    cpu8086::CpuForTest<VideoBus> cpu(*bus_);
+    VideoOutput output;
+    output.update(video());
+
+    // mov ax, 0xb800; mov ds, ax; mov al, 0xff; mov [0x2050], al
+    bus_->write(0x00100, std::vector<uint8_t>{0xb8, 0x00, 0xb8, 0x8e, 0xd8, 0xb0, 0xff, 0xa2, 0x50, 0x20});
+    cpu.set_registers({.ip = 0x0100});
+    for (int i = 0; i < 4; ++i)
+    {
+        cpu.step();
+    }
+
+    EXPECT_FALSE(video().dirty(1));
+    EXPECT_TRUE(video().dirty(3));
+    EXPECT_EQ(output.update(video()), 1u);
+    EXPECT_EQ(output.frame()[3 * 320], 0xffffffffu);
+}
+
+TEST_F(VideoTests, KernelsMatchScalar)
+{
+    std::mt19937 random(87);
+    for (auto& byte : video().span())
+    {
+        byte = static_cast<uint8_t>(random());
+    }
+
+    for (const auto mode : {VideoMode::cga_320x200x4, VideoMode::cga_640x200x2, VideoMode::ega_320x200x16,
+                            VideoMode::ega_640x350x16})
+    {
+        video().mode(mode);
+        VideoOutput reference(VideoKernel::scalar);
+        reference.update(video());
+        const std::vector<uint32_t> expected(reference.frame().begin(), reference.frame().end());
+
+        for (const auto kernel : {VideoKernel::sse2, VideoKernel::avx2})
+        {
+            if (kernel > VideoOutput::best_kernel())
+            {
+                continue;
+            }
+            video().invalidate();
+            VideoOutput output(kernel);
+            output.update(video());
+            EXPECT_EQ(std::vector<uint32_t>(output.frame().begin(), output.frame().end()), expected)
+                << "mode: " << static_cast<int>(mode) << ", kernel: " << static_cast<int>(kernel);
+        }
+        video().invalidate();
+    }
+}
+
+} // namespace msemu